@@ -0,0 +1,91 @@
+// Copyright (C) 2012 Duncan Steele
+// http://slidetocode.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//
+//  arithmetic.cpp
+//  TinyClojure
+//
+//  Microbenchmark for the arithmetic and comparison builtins, reporting the cost per call and per operation
+//  for each of the argument shapes that have a specialised kernel, and for the mixed mode fallback.
+//
+
+#include "TinyClojure.h"
+
+#include <chrono>
+#include <cstdio>
+
+namespace {
+    /**
+     * time repeated calls of a builtin directly through ExtensionFunction::execute
+     *
+     * this skips the evaluator so that the cost is that of the kernel, plus boxing the result
+     */
+    void benchmarkBuiltin(tinyclojure::TinyClojure& interpreter, std::string functionName, std::string argumentText, std::string label) {
+        const int iterations = 1000000, collectionInterval = 10000;
+        
+        tinyclojure::Object *function = interpreter.eval(interpreter.parse(functionName));
+        tinyclojure::ExtensionFunction *extensionFunction = function->functionValueExtensionFunction();
+        
+        tinyclojure::ObjectList arguments;
+        interpreter.parseAll(argumentText, arguments);
+        
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        
+        for (int iteration = 0; iteration < iterations; ++iteration) {
+            extensionFunction->execute(arguments, NULL);
+            
+            if (iteration % collectionInterval == collectionInterval - 1) {
+                // keep the results from piling up, but leave the arguments alive
+                interpreter.CollectGarbage();
+                arguments.clear();
+                interpreter.parseAll(argumentText, arguments);
+            }
+        }
+        
+        double elapsedNanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        double perCall = elapsedNanoseconds / iterations;
+        size_t operations = arguments.size() > 1 ? arguments.size() - 1 : 1;
+        
+        printf("%-28s %-4s %8.1f ns/call %8.2f ns/op\n", label.c_str(), functionName.c_str(), perCall, perCall / operations);
+        
+        interpreter.CollectGarbage();
+    }
+}
+
+int main(int argc, const char * argv[]) {
+    tinyclojure::TinyClojure interpreter;
+    
+    benchmarkBuiltin(interpreter, "+", "1 2", "two fixnums");
+    benchmarkBuiltin(interpreter, "+", "1.5 2.5", "two doubles");
+    benchmarkBuiltin(interpreter, "+", "1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16", "sixteen fixnums");
+    benchmarkBuiltin(interpreter, "+", "1.5 2.5 3.5 4.5 5.5 6.5 7.5 8.5 9.5 10.5 11.5 12.5 13.5 14.5 15.5 16.5", "sixteen doubles");
+    benchmarkBuiltin(interpreter, "+", "1 2.5 3 4.5 5 6.5 7 8.5 9 10.5 11 12.5 13 14.5 15 16.5", "sixteen mixed");
+    benchmarkBuiltin(interpreter, "*", "3 5 7 11 13 17 19 23", "eight fixnums");
+    benchmarkBuiltin(interpreter, "*", "9223372036854775807 2", "overflowing fixnums");
+    benchmarkBuiltin(interpreter, "/", "1000 2 5 10", "fixnum division");
+    benchmarkBuiltin(interpreter, "<", "1 2", "two fixnums");
+    benchmarkBuiltin(interpreter, "<", "1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16", "sixteen fixnums");
+    benchmarkBuiltin(interpreter, "<", "1.5 2.5 3.5 4.5 5.5 6.5 7.5 8.5 9.5 10.5 11.5 12.5 13.5 14.5 15.5 16.5", "sixteen doubles");
+    benchmarkBuiltin(interpreter, "<", "1 2.5 3 4.5 5 6.5 7 8.5 9 10.5 11 12.5 13 14.5 15 16.5", "sixteen mixed");
+    
+    return 0;
+}
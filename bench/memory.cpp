@@ -0,0 +1,150 @@
+// Copyright (C) 2012 Duncan Steele
+// http://slidetocode.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//
+//  memory.cpp
+//  TinyClojure
+//
+//  Memory benchmark, reporting the heap bytes and allocations per element of lists of numbers and strings.
+//  Every allocation goes through the counting operator new below, and is charged the size of the chunk the
+//  allocator gave it, so the figures are what the heap really gives up for each element.  Each is shown beside
+//  the figure for the layout before objects were compacted, when an Object was 48 bytes holding a Number* and a
+//  std::string and every one was a malloc of its own, as measured by this benchmark on x86-64 glibc.
+//
+
+#include "TinyClojure.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#else
+#include <malloc.h>
+#endif
+
+namespace {
+    size_t liveBytes = 0, liveAllocations = 0;
+    
+#if defined(__APPLE__)
+    /// the size class the request was rounded up to, the zone keeps its bookkeeping outside the chunk
+    size_t chunkSize(void *pointer) {
+        return malloc_size(pointer);
+    }
+#else
+    /// the usable size, plus the size_t of bookkeeping glibc keeps in front of each chunk
+    size_t chunkSize(void *pointer) {
+        return malloc_usable_size(pointer) + sizeof(size_t);
+    }
+#endif
+}
+
+void* operator new(size_t size) {
+    void *pointer = malloc(size ? size : 1);
+    if (!pointer) {
+        throw std::bad_alloc();
+    }
+    
+    liveBytes += chunkSize(pointer);
+    ++liveAllocations;
+    return pointer;
+}
+
+void operator delete(void *pointer) noexcept {
+    if (pointer) {
+        liveBytes -= chunkSize(pointer);
+        --liveAllocations;
+        free(pointer);
+    }
+}
+
+namespace {
+    const int kElements = 100000;
+    
+    typedef tinyclojure::Object* (*ElementMaker)(int index);
+    
+    tinyclojure::Object* makeInteger(int index) {
+        return new tinyclojure::Object(index);
+    }
+    
+    tinyclojure::Object* makeShortString(int index) {
+        char text[16];
+        snprintf(text, sizeof(text), "s%d", index);
+        return new tinyclojure::Object(std::string(text));
+    }
+    
+    tinyclojure::Object* makeLongString(int index) {
+        char text[40];
+        snprintf(text, sizeof(text), "a longer string number %d", index);
+        return new tinyclojure::Object(std::string(text));
+    }
+    
+    /**
+     * build a cons list of kElements elements and report the heap it holds per element
+     *
+     * the list is built directly rather than through the garbage collector so that only the objects are counted.
+     * Lists are kept alive until the end, so that each one is measured on fresh memory rather than reusing the
+     * cells freed by the one before.  The figures are printed beside those for the uncompacted layout.
+     */
+    tinyclojure::Object* measureList(ElementMaker makeElement, const char *label, double uncompactedBytes, double uncompactedAllocations) {
+        size_t startBytes = liveBytes, startAllocations = liveAllocations;
+        
+        tinyclojure::Object *list = new tinyclojure::Object();
+        for (int index = kElements - 1; index >= 0; --index) {
+            list = new tinyclojure::Object(makeElement(index), list);
+        }
+        
+        double  bytesPerElement = (double)(liveBytes - startBytes) / kElements,
+                allocationsPerElement = (double)(liveAllocations - startAllocations) / kElements;
+        
+        printf("%-28s %8.1f bytes/element %6.3f allocations/element   (uncompacted %5.1f bytes, %5.3f allocations)\n",
+               label, bytesPerElement, allocationsPerElement, uncompactedBytes, uncompactedAllocations);
+        
+        return list;
+    }
+    
+    void freeList(tinyclojure::Object *list) {
+        while (list->type() == tinyclojure::Object::kObjectTypeCons) {
+            tinyclojure::Object *rest = list->consValueRight();
+            delete list->consValueLeft();
+            delete list;
+            list = rest;
+        }
+        delete list;
+    }
+}
+
+int main(int argc, const char * argv[]) {
+    printf("sizeof(Object) %d bytes\n", (int)sizeof(tinyclojure::Object));
+    
+    tinyclojure::Object *lists[] = {
+        measureList(makeInteger, "list of integers", 128, 3),
+        measureList(makeShortString, "list of short strings", 144, 3),
+        measureList(makeLongString, "list of long strings", 192, 4),
+    };
+    
+    for (size_t listIndex = 0; listIndex < sizeof(lists) / sizeof(lists[0]); ++listIndex) {
+        freeList(lists[listIndex]);
+    }
+    
+    return 0;
+}
@@ -0,0 +1,375 @@
+// Copyright (C) 2012 Duncan Steele
+// http://slidetocode.com
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//
+//  suite.cpp
+//  TinyClojure
+//
+//  Benchmark suite, microbenchmarks of the evaluator, parser and collector through the embedding API, and the
+//  workloads in bench/workloads run as whole programs.  Results are written as JSON, one benchmark to a line, and
+//  compared with an earlier results file if one is given, exiting with status 1 if any benchmark got worse by
+//  more than the tolerance.  To make a baseline, keep a copy of a results file:
+//
+//      ./bench/suite --output bench/results.json && cp bench/results.json bench/baseline.json
+//      ./bench/suite --baseline bench/baseline.json
+//
+
+#include "TinyClojure.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <streambuf>
+
+namespace {
+    /// each benchmark is run this many times, and the fastest run kept, to keep out noise from the rest of the machine
+    const int kRuns = 5, kWorkloadRuns = 3;
+
+    /// the number of copies of the benchmarked form in each evaluated form
+    const int kFormsPerEval = 1000;
+
+    const char *kWorkloads[] = { "fib", "tak", "nbody", "binary-trees", "strings" };
+
+    struct Result {
+        std::string name, unit;
+
+        /// true if a bigger value is better, as for throughput
+        bool higherIsBetter;
+
+        double value;
+
+        /// what the workload evaluated to, so that a faster but wrong run stands out
+        std::string result;
+    };
+
+    double elapsedNanoseconds(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void evalText(tinyclojure::TinyClojure& interpreter, const std::string& text) {
+        tinyclojure::ObjectList forms;
+        interpreter.parseAll(text, forms);
+        for (size_t formIndex = 0; formIndex < forms.size(); ++formIndex) {
+            interpreter.eval(forms[formIndex]);
+        }
+        interpreter.CollectGarbage();
+    }
+
+    /**
+     * the time per evaluation of form, after evaluating setup
+     *
+     * the form is repeated inside a do, so the cost of calling eval is spread over many copies of it
+     */
+    Result benchmarkForm(const char *name, const std::string& setup, const std::string& form, int evals) {
+        tinyclojure::TinyClojure interpreter;
+        evalText(interpreter, setup);
+
+        std::string text = "(do";
+        for (int copy = 0; copy < kFormsPerEval; ++copy) {
+            text += " " + form;
+        }
+        text += ")";
+        tinyclojure::Object *code = interpreter.exportObject(interpreter.parse(text));
+
+        double fastest = 0;
+        for (int run = 0; run < kRuns; ++run) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (int evalIndex = 0; evalIndex < evals; ++evalIndex) {
+                interpreter.eval(code);
+            }
+            double perForm = elapsedNanoseconds(start) / ((double)evals * kFormsPerEval);
+
+            if (run == 0 || perForm < fastest) {
+                fastest = perForm;
+            }
+        }
+
+        interpreter.releaseObject(code);
+
+        Result result = { name, "ns/op", false, fastest, "" };
+        return result;
+    }
+
+    /// about a megabyte of code, in a mixture of the forms a program is made of
+    std::string parserInput() {
+        std::string text;
+        while (text.size() < 1000000) {
+            text += "(defn area [shape scale] (cond (= (first shape) \"circle\") (* 3.14159 scale scale)\n"
+                    "    (= (first shape) \"square\") (* scale scale) true [0 1.5 -2 \"none\"]))\n"
+                    "; a comment between forms\n"
+                    "(def totals (list 1 2 3 4 5 6 7 8 9 10 (area (list \"circle\") 2.5)))\n";
+        }
+        return text;
+    }
+
+    /// about a megabyte of data, the nested vectors, numbers and strings of a data file
+    std::string dataInput() {
+        std::string text;
+        for (int record = 0; text.size() < 1000000; ++record) {
+            std::stringstream line;
+            line << "[" << record << " \"station-" << record % 97 << "\" " << record * 0.25 << " -" << record % 13
+                 << " [" << record % 7 << ", " << record % 11 << ", 12345678901] \"an escaped \\\"quote\\\"\"]\n";
+            text += line.str();
+        }
+        return text;
+    }
+
+    /// about a megabyte of indented, commented data with long strings, where the reader mostly passes over characters
+    std::string documentInput() {
+        std::string text;
+        for (int record = 0; text.size() < 1000000; ++record) {
+            std::stringstream entry;
+            entry << ";; entry " << record << ", exported from the catalogue with its description and notes intact\n"
+                  << "{:id " << record << "\n"
+                  << "        :title \"The collected notes of station " << record % 97 << ", volume " << record % 13 << "\"\n"
+                  << "        :description \"A long run of prose in a string literal, as a data file holds for anything "
+                  << "written by people rather than programs, with the occasional \\\"quoted\\\" phrase.\"\n"
+                  << "        :tags [\"archive\"    \"survey\"    \"field notes\"]}\n\n";
+            text += entry.str();
+        }
+        return text;
+    }
+
+    /// parseAll throughput, or that of the recursive descent parser it replaced
+    Result benchmarkParse(const char *name, const std::string& text, bool recursive) {
+        tinyclojure::TinyClojure interpreter;
+
+        double fastest = 0;
+        for (int run = 0; run < kRuns; ++run) {
+            tinyclojure::ObjectList forms;
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            if (recursive) {
+                interpreter.recursiveParseAll(text, forms);
+            } else {
+                interpreter.parseAll(text, forms);
+            }
+            double elapsed = elapsedNanoseconds(start);
+
+            interpreter.CollectGarbage();
+
+            if (run == 0 || elapsed < fastest) {
+                fastest = elapsed;
+            }
+        }
+
+        Result result = { name, "MB/s", true, text.size() / (fastest / 1e9) / 1e6, "" };
+        return result;
+    }
+
+    /// the time CollectGarbage takes per object freed, the objects being a megabyte of parsed code
+    Result benchmarkCollectGarbage() {
+        tinyclojure::TinyClojure interpreter;
+        std::string text = parserInput();
+
+        double fastest = 0;
+        for (int run = 0; run < kRuns; ++run) {
+            tinyclojure::ObjectList forms;
+
+            uint64_t objectsBefore = interpreter.heapStatistics().allocatedObjects;
+            interpreter.parseAll(text, forms);
+            uint64_t objects = interpreter.heapStatistics().allocatedObjects - objectsBefore;
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            interpreter.CollectGarbage();
+            double perObject = elapsedNanoseconds(start) / objects;
+
+            if (run == 0 || perObject < fastest) {
+                fastest = perObject;
+            }
+        }
+
+        Result result = { "collect-garbage", "ns/object", false, fastest, "" };
+        return result;
+    }
+
+    /// run a workload file from start to finish in a new interpreter, as tclj would
+    Result benchmarkWorkload(const std::string& directory, const char *name) {
+        std::string path = directory + "/" + name + ".clj";
+        std::ifstream file(path.c_str());
+        if (!file) {
+            fprintf(stderr, "could not read %s\n", path.c_str());
+            exit(2);
+        }
+        std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        Result result = { name, "ms", false, 0, "" };
+
+        for (int run = 0; run < kWorkloadRuns; ++run) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            tinyclojure::TinyClojure interpreter;
+            tinyclojure::ObjectList forms;
+            interpreter.parseAll(text, forms);
+
+            tinyclojure::Object *value = NULL;
+            for (size_t formIndex = 0; formIndex < forms.size(); ++formIndex) {
+                value = interpreter.eval(forms[formIndex]);
+            }
+            std::string valueText = value ? value->stringRepresentation() : "nil";
+
+            double elapsed = elapsedNanoseconds(start) / 1e6;
+            if (run == 0 || elapsed < result.value) {
+                result.value = elapsed;
+            }
+            result.result = valueText;
+        }
+
+        return result;
+    }
+
+    /// the benchmark values in a results file written by this program, by name
+    std::map<std::string, double> readBaseline(const std::string& path) {
+        std::map<std::string, double> baseline;
+        std::ifstream file(path.c_str());
+        if (!file) {
+            fprintf(stderr, "could not read the baseline %s\n", path.c_str());
+            exit(2);
+        }
+
+        // each benchmark is on a line of its own
+        std::string line;
+        while (std::getline(file, line)) {
+            size_t nameStart = line.find("\"name\": \""), valueStart = line.find("\"value\": ");
+            if (nameStart == std::string::npos || valueStart == std::string::npos) {
+                continue;
+            }
+
+            nameStart += strlen("\"name\": \"");
+            std::string name = line.substr(nameStart, line.find('"', nameStart) - nameStart);
+            baseline[name] = atof(line.c_str() + valueStart + strlen("\"value\": "));
+        }
+
+        return baseline;
+    }
+
+    std::string jsonString(const std::string& text) {
+        std::string quoted = "\"";
+        for (size_t index = 0; index < text.size(); ++index) {
+            if (text[index] == '"' || text[index] == '\\') {
+                quoted += '\\';
+            }
+            quoted += text[index];
+        }
+        return quoted + "\"";
+    }
+}
+
+int main(int argc, const char * argv[]) {
+    std::string baselinePath, outputPath, workloadDirectory = "bench/workloads";
+    // the runs of a benchmark can differ by ten percent or more on a busy machine
+    double tolerance = 0.2;
+
+    for (int argumentIndex = 1; argumentIndex < argc; ++argumentIndex) {
+        std::string argument = argv[argumentIndex];
+
+        if (argument == "--baseline" && argumentIndex + 1 < argc) {
+            baselinePath = argv[++argumentIndex];
+        } else if (argument == "--output" && argumentIndex + 1 < argc) {
+            outputPath = argv[++argumentIndex];
+        } else if (argument == "--tolerance" && argumentIndex + 1 < argc) {
+            tolerance = atof(argv[++argumentIndex]);
+        } else if (argument == "--workloads" && argumentIndex + 1 < argc) {
+            workloadDirectory = argv[++argumentIndex];
+        } else {
+            fprintf(stderr, "usage: suite [--baseline results.json] [--output results.json] [--tolerance 0.2] [--workloads bench/workloads]\n");
+            return 2;
+        }
+    }
+
+    std::vector<Result> results;
+    results.push_back(benchmarkForm("symbol-lookup", "(def x 1)", "x", 200));
+    results.push_back(benchmarkForm("closure-call", "(defn identity-fn [a] a)", "(identity-fn 1)", 50));
+    results.push_back(benchmarkForm("arithmetic", "", "(+ 1 2)", 200));
+    results.push_back(benchmarkForm("cons-allocation", "", "(cons 1 nil)", 200));
+    results.push_back(benchmarkParse("parse", parserInput(), false));
+    results.push_back(benchmarkParse("parse-recursive", parserInput(), true));
+    results.push_back(benchmarkParse("parse-data", dataInput(), false));
+    results.push_back(benchmarkParse("parse-data-recursive", dataInput(), true));
+    results.push_back(benchmarkParse("parse-document", documentInput(), false));
+    results.push_back(benchmarkParse("parse-document-recursive", documentInput(), true));
+    results.push_back(benchmarkCollectGarbage());
+
+    for (size_t workloadIndex = 0; workloadIndex < sizeof(kWorkloads) / sizeof(kWorkloads[0]); ++workloadIndex) {
+        results.push_back(benchmarkWorkload(workloadDirectory, kWorkloads[workloadIndex]));
+    }
+
+    std::map<std::string, double> baseline;
+    if (baselinePath.size()) {
+        baseline = readBaseline(baselinePath);
+    }
+
+    FILE *output = outputPath.size() ? fopen(outputPath.c_str(), "w") : stdout;
+    if (!output) {
+        fprintf(stderr, "could not write %s\n", outputPath.c_str());
+        return 2;
+    }
+
+    std::vector<std::string> regressions;
+
+    fprintf(output, "{\n\"benchmarks\": [\n");
+    for (size_t resultIndex = 0; resultIndex < results.size(); ++resultIndex) {
+        const Result& result = results[resultIndex];
+
+        fprintf(output, "{\"name\": %s, \"unit\": %s, \"better\": \"%s\", \"value\": %.3f",
+                jsonString(result.name).c_str(), jsonString(result.unit).c_str(), result.higherIsBetter ? "higher" : "lower", result.value);
+        if (result.result.size()) {
+            fprintf(output, ", \"result\": %s", jsonString(result.result).c_str());
+        }
+
+        fprintf(stderr, "%-26s %12.3f %-10s", result.name.c_str(), result.value, result.unit.c_str());
+
+        std::map<std::string, double>::iterator baselineValue = baseline.find(result.name);
+        if (baselineValue != baseline.end() && baselineValue->second > 0) {
+            // the change is positive when the benchmark got worse
+            double change = result.value / baselineValue->second - 1;
+            if (result.higherIsBetter) {
+                change = baselineValue->second / result.value - 1;
+            }
+
+            fprintf(output, ", \"baseline\": %.3f, \"change\": %.4f", baselineValue->second, change);
+            fprintf(stderr, " baseline %12.3f %+7.1f%%", baselineValue->second, change * 100);
+
+            if (change > tolerance) {
+                regressions.push_back(result.name);
+                fprintf(stderr, " REGRESSION");
+            }
+        }
+
+        fprintf(output, "}%s\n", resultIndex + 1 < results.size() ? "," : "");
+        fprintf(stderr, "\n");
+    }
+    fprintf(output, "],\n\"regressions\": [");
+    for (size_t regressionIndex = 0; regressionIndex < regressions.size(); ++regressionIndex) {
+        fprintf(output, "%s%s", regressionIndex ? ", " : "", jsonString(regressions[regressionIndex]).c_str());
+    }
+    fprintf(output, "]\n}\n");
+
+    if (output != stdout) {
+        fclose(output);
+    }
+
+    return regressions.empty() ? 0 : 1;
+}
@@ -0,0 +1,13 @@
+; binary trees from the benchmarks game, allocating and walking complete trees of lists
+
+(defn make-tree [depth] (if (= depth 0) (list nil nil) (list (make-tree (- depth 1)) (make-tree (- depth 1)))))
+
+(defn check-tree [tree] (if (= (first tree) nil) 1 (+ 1 (check-tree (first tree)) (check-tree (first (rest tree))))))
+
+; many short lived trees of each depth, every other depth
+(defn check-trees [n depth] (if (= n 0) 0 (+ (check-tree (make-tree depth)) (check-trees (- n 1) depth))))
+
+(defn check-depths [depth max-depth]
+  (if (> depth max-depth) 0 (+ (check-trees (* 4 (- (+ max-depth 1) depth)) depth) (check-depths (+ depth 2) max-depth))))
+
+(+ (check-tree (make-tree 9)) (check-depths 4 8))
@@ -0,0 +1,5 @@
+; doubly recursive fibonacci, closure calls and fixnum arithmetic
+
+(defn fib [n] (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+
+(fib 22)
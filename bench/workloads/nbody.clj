@@ -0,0 +1,71 @@
+; the n-body simulation of the Jovian planets from the benchmarks game
+;
+; the state is one double array of seven values per body, x y z vx vy vz mass, passed to every function as closures
+; capture copies of the values they refer to.  There are no loops or sqrt builtin, so loops recurse and square roots
+; use Newton's method, and intermediate values are passed to helper functions rather than bound with let.
+
+(def solar-mass 39.47841760435743)
+(def days-per-year 365.24)
+(def body-count 5)
+
+(defn field [b i k] (aget b (+ (* i 7) k)))
+(defn set-field [b i k value] (aset b (+ (* i 7) k) value))
+
+(defn body [b i px py pz pvx pvy pvz m]
+  (do (set-field b i 0 px) (set-field b i 1 py) (set-field b i 2 pz)
+      (set-field b i 3 (* pvx days-per-year)) (set-field b i 4 (* pvy days-per-year)) (set-field b i 5 (* pvz days-per-year))
+      (set-field b i 6 (* m solar-mass))))
+
+(def bodies (double-array 35))
+(body bodies 0 0.0 0.0 0.0 0.0 0.0 0.0 1.0)
+(body bodies 1 4.84143144246472090 -1.16032004402742839 -0.103622044471123109
+      0.00166007664274403694 0.00769901118419740425 -0.0000690460016972063023 0.000954791938424326609)
+(body bodies 2 8.34336671824457987 4.12479856412430479 -0.403523417114321381
+      -0.00276742510726862411 0.00499852801234917238 0.0000230417297573763929 0.000285885980666130812)
+(body bodies 3 12.8943695621391310 -15.1111514016986312 -0.223307578892655734
+      0.00296460137564761618 0.00237847173959480950 -0.0000296589568540237556 0.0000436624404335156298)
+(body bodies 4 15.3796971148509165 -25.9193146099879641 0.179258772950371181
+      0.00268067772490389322 0.00162824170038242295 -0.0000951592254519715870 0.0000515138902046611451)
+
+(defn sqrt-iterate [n guess k] (if (= k 0) guess (sqrt-iterate n (* 0.5 (+ guess (/ n guess))) (- k 1))))
+(defn sqrt [n] (sqrt-iterate n (+ 1.0 (* 0.5 n)) 12))
+
+(defn push [b i j dx dy dz mi mj]
+  (do (set-field b i 3 (- (field b i 3) (* dx mj))) (set-field b i 4 (- (field b i 4) (* dy mj))) (set-field b i 5 (- (field b i 5) (* dz mj)))
+      (set-field b j 3 (+ (field b j 3) (* dx mi))) (set-field b j 4 (+ (field b j 4) (* dy mi))) (set-field b j 5 (+ (field b j 5) (* dz mi)))))
+
+(defn pull [b i j dx dy dz magnitude] (push b i j dx dy dz (* (field b i 6) magnitude) (* (field b j 6) magnitude)))
+
+(defn separate [b i j dx dy dz d2 dt] (pull b i j dx dy dz (/ dt (* d2 (sqrt d2)))))
+
+(defn interact [b i j dx dy dz dt] (separate b i j dx dy dz (+ (* dx dx) (* dy dy) (* dz dz)) dt))
+
+(defn interact-pairs [b i j dt]
+  (if (< i body-count)
+    (if (< j body-count)
+      (do (interact b i j (- (field b i 0) (field b j 0)) (- (field b i 1) (field b j 1)) (- (field b i 2) (field b j 2)) dt)
+          (interact-pairs b i (+ j 1) dt))
+      (interact-pairs b (+ i 1) (+ i 2) dt))
+    nil))
+
+(defn move [b i dt]
+  (if (< i body-count)
+    (do (set-field b i 0 (+ (field b i 0) (* dt (field b i 3))))
+        (set-field b i 1 (+ (field b i 1) (* dt (field b i 4))))
+        (set-field b i 2 (+ (field b i 2) (* dt (field b i 5))))
+        (move b (+ i 1) dt))
+    nil))
+
+(defn advance [b dt] (do (interact-pairs b 0 1 dt) (move b 0 dt)))
+
+; recurse by halves to keep the depth down
+(defn advance-steps [b n dt]
+  (if (< n 2)
+    (advance b dt)
+    (do (advance-steps b (quot n 2) dt) (advance-steps b (- n (quot n 2)) dt))))
+
+(defn speed2 [b i] (+ (* (field b i 3) (field b i 3)) (* (field b i 4) (field b i 4)) (* (field b i 5) (field b i 5))))
+(defn kinetic-energy [b i] (if (< i body-count) (+ (* 0.5 (field b i 6) (speed2 b i)) (kinetic-energy b (+ i 1))) 0.0))
+
+(advance-steps bodies 200 0.01)
+(kinetic-energy bodies 0)
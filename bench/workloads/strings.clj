@@ -0,0 +1,13 @@
+; string building, concatenating numbers and short strings into longer and longer strings with str
+
+(defn digits [n] (if (< n 10) (str n) (str (digits (quot n 10)) "," (rem n 10))))
+
+; build by halves to keep the depth down
+(defn build [from to]
+  (if (< (- to from) 2)
+    (str "<" (digits (* from 7919)) ">")
+    (str (build from (quot (+ from to) 2)) (build (quot (+ from to) 2) to))))
+
+(defn build-many [n] (if (= n 0) 0 (+ (count (build 0 1000)) (build-many (- n 1)))))
+
+(build-many 3)
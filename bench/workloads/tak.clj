@@ -0,0 +1,5 @@
+; the Takeuchi function, deep non tail recursion with three arguments
+
+(defn tak [x y z] (if (< y x) (tak (tak (- x 1) y z) (tak (- y 1) z x) (tak (- z 1) x y)) z))
+
+(tak 18 12 6)
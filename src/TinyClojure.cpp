@@ -32,9 +32,283 @@
 #include <cstdio>
 #include <cmath>
 #include <fstream>
+#include <cerrno>
+#include <cstdlib>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <new>
+#include <mutex>
+#include <iomanip>
+#include <csignal>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 namespace tinyclojure {
 
+#pragma mark -
+#pragma mark BigInteger
+    
+    BigInteger::BigInteger() : _negative(false) {
+    }
+    
+    BigInteger::BigInteger(int64_t val) : _negative(val < 0) {
+        // negate in unsigned arithmetic so that INT64_MIN survives
+        uint64_t magnitude = _negative ? (uint64_t)0 - (uint64_t)val : (uint64_t)val;
+        
+        while (magnitude) {
+            _magnitude.push_back((uint32_t)magnitude);
+            magnitude >>= 32;
+        }
+    }
+    
+    BigInteger BigInteger::fromString(const std::string& digits) {
+        BigInteger result;
+        size_t digitIndex = 0;
+        bool negative = false;
+        
+        if (digits.length() && (digits[0] == '-' || digits[0] == '+')) {
+            negative = digits[0] == '-';
+            digitIndex = 1;
+        }
+        
+        for (; digitIndex < digits.length(); ++digitIndex) {
+            // multiply the magnitude by ten and add the digit, carrying through the limbs
+            uint64_t carry = (uint64_t)(digits[digitIndex] - '0');
+            
+            for (size_t limbIndex = 0; limbIndex < result._magnitude.size(); ++limbIndex) {
+                uint64_t limb = (uint64_t)result._magnitude[limbIndex] * 10 + carry;
+                result._magnitude[limbIndex] = (uint32_t)limb;
+                carry = limb >> 32;
+            }
+            
+            if (carry) {
+                result._magnitude.push_back((uint32_t)carry);
+            }
+        }
+        
+        result._negative = negative;
+        result.normalise();
+        
+        return result;
+    }
+    
+    int BigInteger::compareMagnitudes(const Magnitude& lhs, const Magnitude& rhs) {
+        if (lhs.size() != rhs.size()) {
+            return lhs.size() < rhs.size() ? -1 : 1;
+        }
+        
+        for (size_t limbIndex = lhs.size(); limbIndex-- > 0;) {
+            if (lhs[limbIndex] != rhs[limbIndex]) {
+                return lhs[limbIndex] < rhs[limbIndex] ? -1 : 1;
+            }
+        }
+        
+        return 0;
+    }
+    
+    BigInteger::Magnitude BigInteger::addMagnitudes(const Magnitude& lhs, const Magnitude& rhs) {
+        const Magnitude &longer = lhs.size() >= rhs.size() ? lhs : rhs,
+                        &shorter = lhs.size() >= rhs.size() ? rhs : lhs;
+        
+        Magnitude result;
+        result.reserve(longer.size() + 1);
+        
+        uint64_t carry = 0;
+        for (size_t limbIndex = 0; limbIndex < longer.size(); ++limbIndex) {
+            uint64_t sum = (uint64_t)longer[limbIndex] + carry;
+            if (limbIndex < shorter.size()) {
+                sum += shorter[limbIndex];
+            }
+            
+            result.push_back((uint32_t)sum);
+            carry = sum >> 32;
+        }
+        
+        if (carry) {
+            result.push_back((uint32_t)carry);
+        }
+        
+        return result;
+    }
+    
+    BigInteger::Magnitude BigInteger::subtractMagnitudes(const Magnitude& lhs, const Magnitude& rhs) {
+        Magnitude result;
+        result.reserve(lhs.size());
+        
+        int64_t borrow = 0;
+        for (size_t limbIndex = 0; limbIndex < lhs.size(); ++limbIndex) {
+            int64_t difference = (int64_t)lhs[limbIndex] - borrow;
+            if (limbIndex < rhs.size()) {
+                difference -= rhs[limbIndex];
+            }
+            
+            borrow = difference < 0 ? 1 : 0;
+            result.push_back((uint32_t)(difference + (borrow << 32)));
+        }
+        
+        return result;
+    }
+    
+    void BigInteger::normalise() {
+        while (_magnitude.size() && _magnitude.back() == 0) {
+            _magnitude.pop_back();
+        }
+        
+        if (_magnitude.empty()) {
+            _negative = false;
+        }
+    }
+    
+    BigInteger BigInteger::operator+(const BigInteger& rhs) const {
+        BigInteger result;
+        
+        if (_negative == rhs._negative) {
+            result._magnitude = addMagnitudes(_magnitude, rhs._magnitude);
+            result._negative = _negative;
+        } else if (compareMagnitudes(_magnitude, rhs._magnitude) >= 0) {
+            result._magnitude = subtractMagnitudes(_magnitude, rhs._magnitude);
+            result._negative = _negative;
+        } else {
+            result._magnitude = subtractMagnitudes(rhs._magnitude, _magnitude);
+            result._negative = rhs._negative;
+        }
+        
+        result.normalise();
+        return result;
+    }
+    
+    BigInteger BigInteger::operator-() const {
+        BigInteger result(*this);
+        result._negative = !_negative;
+        result.normalise();
+        return result;
+    }
+    
+    BigInteger BigInteger::operator-(const BigInteger& rhs) const {
+        return *this + (-rhs);
+    }
+    
+    BigInteger BigInteger::operator*(const BigInteger& rhs) const {
+        BigInteger result;
+        result._magnitude.assign(_magnitude.size() + rhs._magnitude.size(), 0);
+        
+        // schoolbook multiplication, each partial product fits in 64 bits with the carry
+        for (size_t lhsIndex = 0; lhsIndex < _magnitude.size(); ++lhsIndex) {
+            uint64_t carry = 0;
+            
+            for (size_t rhsIndex = 0; rhsIndex < rhs._magnitude.size(); ++rhsIndex) {
+                uint64_t product = (uint64_t)_magnitude[lhsIndex] * rhs._magnitude[rhsIndex]
+                                    + result._magnitude[lhsIndex + rhsIndex]
+                                    + carry;
+                
+                result._magnitude[lhsIndex + rhsIndex] = (uint32_t)product;
+                carry = product >> 32;
+            }
+            
+            result._magnitude[lhsIndex + rhs._magnitude.size()] = (uint32_t)carry;
+        }
+        
+        result._negative = _negative != rhs._negative;
+        result.normalise();
+        return result;
+    }
+    
+    int BigInteger::compare(const BigInteger& rhs) const {
+        if (_negative != rhs._negative) {
+            return _negative ? -1 : 1;
+        }
+        
+        int magnitudeComparison = compareMagnitudes(_magnitude, rhs._magnitude);
+        return _negative ? -magnitudeComparison : magnitudeComparison;
+    }
+    
+    bool BigInteger::fitsInteger() const {
+        if (_magnitude.size() > 2) {
+            return false;
+        }
+        
+        uint64_t magnitude = 0;
+        for (size_t limbIndex = _magnitude.size(); limbIndex-- > 0;) {
+            magnitude = (magnitude << 32) | _magnitude[limbIndex];
+        }
+        
+        // the negative range reaches one further than the positive range
+        return magnitude <= (uint64_t)INT64_MAX + (_negative ? 1 : 0);
+    }
+    
+    int64_t BigInteger::integerValue() const {
+        uint64_t magnitude = 0;
+        for (size_t limbIndex = _magnitude.size() < 2 ? _magnitude.size() : 2; limbIndex-- > 0;) {
+            magnitude = (magnitude << 32) | _magnitude[limbIndex];
+        }
+        
+        return (int64_t)(_negative ? (uint64_t)0 - magnitude : magnitude);
+    }
+    
+    double BigInteger::floatingValue() const {
+        double result = 0;
+        
+        for (size_t limbIndex = _magnitude.size(); limbIndex-- > 0;) {
+            result = result * 4294967296.0 + _magnitude[limbIndex];
+        }
+        
+        return _negative ? -result : result;
+    }
+    
+    std::string BigInteger::stringRepresentation() const {
+        if (_magnitude.empty()) {
+            return "0";
+        }
+        
+        // repeatedly divide by 10^9, collecting the remainders as nine digit chunks
+        Magnitude quotient(_magnitude);
+        std::vector<uint32_t> chunks;
+        
+        while (quotient.size()) {
+            uint64_t remainder = 0;
+            
+            for (size_t limbIndex = quotient.size(); limbIndex-- > 0;) {
+                uint64_t current = (remainder << 32) | quotient[limbIndex];
+                quotient[limbIndex] = (uint32_t)(current / 1000000000);
+                remainder = current % 1000000000;
+            }
+            
+            chunks.push_back((uint32_t)remainder);
+            
+            while (quotient.size() && quotient.back() == 0) {
+                quotient.pop_back();
+            }
+        }
+        
+        std::stringstream stringBuilder;
+        
+        if (_negative) {
+            stringBuilder << '-';
+        }
+        
+        stringBuilder << chunks.back();
+        for (size_t chunkIndex = chunks.size() - 1; chunkIndex-- > 0;) {
+            char chunkBuffer[10];
+            snprintf(chunkBuffer, sizeof(chunkBuffer), "%09u", chunks[chunkIndex]);
+            stringBuilder << chunkBuffer;
+        }
+        
+        return stringBuilder.str();
+    }
+    
 #pragma mark -
 #pragma mark Number
     
@@ -46,13 +320,80 @@ namespace tinyclojure {
         setInteger(val);
     }
     
+    Number::Number(int64_t val) {
+        setInteger(val);
+    }
+    
+    Number::Number(const BigInteger& val) {
+        _mode = kNumberModeInteger;
+        setBigInteger(val);
+    }
+    
     Number::Number() {
         setInteger(0);
     }
 
     Number::Number(Number* oldNum) {
-        _mode = oldNum->_mode;
-        _value = oldNum->_value;
+        _mode = kNumberModeInteger;
+        *this = *oldNum;
+    }
+    
+    Number::Number(const Number& rhs) {
+        _mode = rhs._mode;
+        _value = rhs._value;
+        
+        if (_mode == kNumberModeBigInteger) {
+            _value.bigInteger = new BigInteger(*rhs._value.bigInteger);
+        }
+    }
+    
+    Number::~Number() {
+        clear();
+    }
+    
+    Number& Number::operator=(const Number& rhs) {
+        if (this != &rhs) {
+            if (rhs._mode == kNumberModeBigInteger) {
+                setBigInteger(*rhs._value.bigInteger);
+            } else {
+                clear();
+                _mode = rhs._mode;
+                _value = rhs._value;
+            }
+        }
+        
+        return *this;
+    }
+    
+    void Number::clear() {
+        if (_mode == kNumberModeBigInteger) {
+            delete _value.bigInteger;
+            _mode = kNumberModeInteger;
+        }
+    }
+    
+    Number Number::integerFromString(const std::string& digits) {
+        errno = 0;
+        long long val = strtoll(digits.c_str(), NULL, 10);
+        
+        if (errno == ERANGE) {
+            return Number(BigInteger::fromString(digits));
+        }
+        
+        return Number((int64_t)val);
+    }
+
+    uint64_t Number::hashValue() const {
+        // every equality between numbers either is exact or goes through floating point, so hashing the floating
+        // point value keeps equal numbers' hashes equal, large fixnums that differ beyond 2^53 just collide
+        double value = floatingValue();
+        if (value == 0.0) {
+            value = 0.0;
+        }
+        
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
     }
 
     double Number::floatingValue() const {
@@ -61,7 +402,12 @@ namespace tinyclojure {
                 return _value.floating;
                 break;
                 
+            case kNumberModeBigInteger:
+                return _value.bigInteger->floatingValue();
+                break;
+                
             case kNumberModeInteger:
+            default:
                 return (double)_value.integer;
                 break;
         }
@@ -71,50 +417,80 @@ namespace tinyclojure {
         return Number(floatingValue());
     }
     
-    int Number::integerValue() const {
+    int64_t Number::integerValue() const {
         switch (_mode) {
             case kNumberModeInteger:
                 return _value.integer;
                 break;
                 
+            case kNumberModeBigInteger:
+                // a BigInteger is always outside the fixnum range
+                return _value.bigInteger->isNegative() ? INT64_MIN : INT64_MAX;
+                break;
+                
             case kNumberModeFloating:
-                return (int)std::round(_value.floating);
+            default:
+                return (int64_t)std::round(_value.floating);
                 break;
         }
     }
     
     Number Number::integerVersion() const {
-        return Number(floatingValue());
+        return Number(integerValue());
     }
     
-    Number Number::operator+(const Number& rhs) const {
-        Number ilhs,irhs;
-        equivalentModes(*this, rhs, ilhs, irhs);
-        
-        switch (ilhs._mode) {
-            case kNumberModeFloating:
-                return Number(ilhs._value.floating + irhs._value.floating);
+    BigInteger Number::bigIntegerValue() const {
+        switch (_mode) {
+            case kNumberModeBigInteger:
+                return *_value.bigInteger;
                 break;
                 
+            case kNumberModeFloating: {
+                if (std::fabs(_value.floating) < 9.2e18) {
+                    return BigInteger((int64_t)_value.floating);
+                }
+                
+                // too large for a fixnum, go via the exact decimal representation
+                char digitBuffer[400];
+                snprintf(digitBuffer, sizeof(digitBuffer), "%.0f", std::trunc(_value.floating));
+                return BigInteger::fromString(digitBuffer);
+            } break;
+                
             case kNumberModeInteger:
-                return Number(ilhs._value.integer + irhs._value.integer);
+            default:
+                return BigInteger(_value.integer);
                 break;
         }
     }
     
+    Number Number::operator+(const Number& rhs) const {
+        int64_t result;
+        
+        if (_mode == kNumberModeInteger && rhs._mode == kNumberModeInteger
+            && !__builtin_add_overflow(_value.integer, rhs._value.integer, &result)) {
+            return Number(result);
+        }
+        
+        if (promotedMode(*this, rhs) == kNumberModeFloating) {
+            return Number(floatingValue() + rhs.floatingValue());
+        }
+        
+        return Number(bigIntegerValue() + rhs.bigIntegerValue());
+    }
+    
     Number Number::operator*(const Number& rhs) const {
-        Number ilhs,irhs;
-        equivalentModes(*this, rhs, ilhs, irhs);
+        int64_t result;
         
-        switch (ilhs._mode) {
-            case kNumberModeFloating:
-                return Number(ilhs._value.floating * irhs._value.floating);
-                break;
-                
-            case kNumberModeInteger:
-                return Number(ilhs._value.integer * irhs._value.integer);
-                break;
+        if (_mode == kNumberModeInteger && rhs._mode == kNumberModeInteger
+            && !__builtin_mul_overflow(_value.integer, rhs._value.integer, &result)) {
+            return Number(result);
         }
+        
+        if (promotedMode(*this, rhs) == kNumberModeFloating) {
+            return Number(floatingValue() * rhs.floatingValue());
+        }
+        
+        return Number(bigIntegerValue() * rhs.bigIntegerValue());
     }
     
     Number Number::operator/(const Number& rhs) const {
@@ -122,28 +498,18 @@ namespace tinyclojure {
     }
     
     Number Number::operator-(const Number& rhs) const {
-        Number ilhs,irhs;
-        equivalentModes(*this, rhs, ilhs, irhs);
+        int64_t result;
         
-        switch (ilhs._mode) {
-            case kNumberModeFloating:
-                return Number(ilhs._value.floating - irhs._value.floating);
-                break;
-                
-            case kNumberModeInteger:
-                return Number(ilhs._value.integer - irhs._value.integer);
-                break;
+        if (_mode == kNumberModeInteger && rhs._mode == kNumberModeInteger
+            && !__builtin_sub_overflow(_value.integer, rhs._value.integer, &result)) {
+            return Number(result);
         }
-    }
-
-    void Number::equivalentModes(const Number& originalLHS, const Number& originalRHS, Number& newLHS, Number& newRHS) {
-        if (originalLHS._mode==originalRHS._mode) {
-            newLHS=originalLHS;
-            newRHS=originalRHS;
-        } else {
-            newLHS = originalLHS.floatingVersion();
-            newRHS = originalRHS.floatingVersion();
+        
+        if (promotedMode(*this, rhs) == kNumberModeFloating) {
+            return Number(floatingValue() - rhs.floatingValue());
         }
+        
+        return Number(bigIntegerValue() - rhs.bigIntegerValue());
     }
     
     void Number::setFloating(double val) {
@@ -151,11 +517,27 @@ namespace tinyclojure {
         _mode = kNumberModeFloating;
     }
     
-    void Number::setInteger(int val) {
+    void Number::setInteger(int64_t val) {
         _value.integer = val;
         _mode = kNumberModeInteger;
     }
     
+    void Number::setBigInteger(const BigInteger& val) {
+        if (val.fitsInteger()) {
+            // demote, the BigInteger mode only holds values outside the fixnum range
+            if (_mode == kNumberModeBigInteger) {
+                delete _value.bigInteger;
+            }
+            
+            setInteger(val.integerValue());
+        } else if (_mode == kNumberModeBigInteger) {
+            *_value.bigInteger = val;
+        } else {
+            _value.bigInteger = new BigInteger(val);
+            _mode = kNumberModeBigInteger;
+        }
+    }
+    
     std::string Number::stringRepresentation() const {
         std::stringstream stringBuilder;
         
@@ -164,6 +546,10 @@ namespace tinyclojure {
                 stringBuilder << _value.floating;
                 break;
                 
+            case kNumberModeBigInteger:
+                stringBuilder << _value.bigInteger->stringRepresentation();
+                break;
+                
             case kNumberModeInteger:
                 stringBuilder << _value.integer;
                 break;
@@ -171,80 +557,58 @@ namespace tinyclojure {
         
         return stringBuilder.str();
     }
-
-    bool Number::operator==(const Number& rhs) const {
-        Number ilhs,irhs;
-        equivalentModes(*this, rhs, ilhs, irhs);
-        
-        switch (ilhs._mode) {
-            case kNumberModeFloating:
-                return ilhs._value.floating == irhs._value.floating;
+    
+    int Number::compare(const Number& lhs, const Number& rhs) {
+        switch (promotedMode(lhs, rhs)) {
+            case kNumberModeInteger:
+                return (lhs._value.integer > rhs._value.integer) - (lhs._value.integer < rhs._value.integer);
                 break;
                 
-            case kNumberModeInteger:
-                return ilhs._value.integer == irhs._value.integer;
+            case kNumberModeBigInteger:
+                return lhs.bigIntegerValue().compare(rhs.bigIntegerValue());
                 break;
+                
+            case kNumberModeFloating:
+            default: {
+                double  lhsValue = lhs.floatingValue(),
+                        rhsValue = rhs.floatingValue();
+                
+                return (lhsValue > rhsValue) - (lhsValue < rhsValue);
+            } break;
         }
     }
+
+    bool Number::operator==(const Number& rhs) const {
+        if (promotedMode(*this, rhs) == kNumberModeFloating) {
+            // compare directly so that NaN is unequal to everything
+            return floatingValue() == rhs.floatingValue();
+        }
+        
+        return compare(*this, rhs) == 0;
+    }
     
     bool Number::operator<(const Number& rhs) const {
-        Number ilhs,irhs;
-        equivalentModes(*this, rhs, ilhs, irhs);
-        
-        switch (ilhs._mode) {
-            case kNumberModeFloating:
-                return ilhs._value.floating < irhs._value.floating;
-                break;
-                
-            case kNumberModeInteger:
-                return ilhs._value.integer < irhs._value.integer;
-                break;
+        if (promotedMode(*this, rhs) == kNumberModeFloating) {
+            return floatingValue() < rhs.floatingValue();
         }
+        
+        return compare(*this, rhs) < 0;
     }
     
     bool Number::operator>(const Number& rhs) const {
-        Number ilhs,irhs;
-        equivalentModes(*this, rhs, ilhs, irhs);
-        
-        switch (ilhs._mode) {
-            case kNumberModeFloating:
-                return ilhs._value.floating > irhs._value.floating;
-                break;
-                
-            case kNumberModeInteger:
-                return ilhs._value.integer > irhs._value.integer;
-                break;
-        }
+        return rhs < *this;
     }
     
     bool Number::operator<=(const Number& rhs) const {
-        Number ilhs,irhs;
-        equivalentModes(*this, rhs, ilhs, irhs);
-        
-        switch (ilhs._mode) {
-            case kNumberModeFloating:
-                return ilhs._value.floating <= irhs._value.floating;
-                break;
-                
-            case kNumberModeInteger:
-                return ilhs._value.integer <= irhs._value.integer;
-                break;
+        if (promotedMode(*this, rhs) == kNumberModeFloating) {
+            return floatingValue() <= rhs.floatingValue();
         }
+        
+        return compare(*this, rhs) <= 0;
     }
     
     bool Number::operator>=(const Number& rhs) const {
-        Number ilhs,irhs;
-        equivalentModes(*this, rhs, ilhs, irhs);
-        
-        switch (ilhs._mode) {
-            case kNumberModeFloating:
-                return ilhs._value.floating >= irhs._value.floating;
-                break;
-                
-            case kNumberModeInteger:
-                return ilhs._value.integer >= irhs._value.integer;
-                break;
-        }
+        return rhs <= *this;
     }
     
     bool Number::operator!=(const Number& rhs) const {
@@ -257,39 +621,484 @@ namespace tinyclojure {
 
     void Number::roundUp() {
         if (_mode == kNumberModeFloating) {
-            setInteger(std::ceil(_value.floating));
+            setInteger((int64_t)std::ceil(_value.floating));
         }
     }
 
     void Number::roundDown() {
         if (_mode == kNumberModeFloating) {
-            setInteger(std::floor(_value.floating));
+            setInteger((int64_t)std::floor(_value.floating));
         }
     }
     
-#pragma mark - ExtensionFunction
-    
-    void ExtensionFunction::garbageCollector(GarbageCollector *gc_long, GarbageCollector *gc_short) {
-        _gc_long = gc_long;
-        _gc_short = gc_short;
-    }
-
-    void ExtensionFunction::evaluator(TinyClojure *evaluator) {
-        _evaluator = evaluator;
-    }
-    
-    void ExtensionFunction::setIOProxy(IOProxy *ioProxy) {
-        _ioProxy = ioProxy;
-    }
+#pragma mark -
+#pragma mark Array kernels
     
-    bool ExtensionFunction::validateArgumentTypes(std::vector<Object::ObjectType>& typeArray) {
-        if (_typeArray.size()==0)
-            return true;
-
-        if (_typeArray.size() != typeArray.size())
-            return false;
-        
-        for (int typeIndex = 0; typeIndex < _typeArray.size(); ++typeIndex) {
+    /**
+     * kernels over contiguous primitive arrays
+     *
+     * the vector versions use SSE2 where the compiler targets it and AVX/AVX2 when the CPU reports support at runtime,
+     * the table of kernels is chosen once, the first time it is needed.  Everything has a scalar fallback so the
+     * arrays work on any platform.  Long array arithmetic wraps on overflow, as primitive arrays do in Clojure.
+     */
+    namespace kernels {
+        typedef enum {
+            kArrayOperationAdd,
+            kArrayOperationSubtract,
+            kArrayOperationMultiply,
+            kArrayOperationDivide,
+            kArrayOperationCount,
+        } ArrayOperation;
+        
+        /**
+         * an element wise operation result[i] = lhs[i] op rhs[i * rhsStride]
+         *
+         * rhsStride is 1 for two arrays, or 0 to broadcast a single scalar on the right hand side
+         */
+        typedef void (*DoubleElementwiseKernel)(const double *lhs, const double *rhs, size_t rhsStride, double *result, size_t count);
+        typedef void (*LongElementwiseKernel)(const int64_t *lhs, const int64_t *rhs, size_t rhsStride, int64_t *result, size_t count);
+        
+        struct KernelTable {
+            double (*sumDoubles)(const double *values, size_t count);
+            double (*dotDoubles)(const double *lhs, const double *rhs, size_t count);
+            double (*minimumDouble)(const double *values, size_t count);
+            double (*maximumDouble)(const double *values, size_t count);
+            DoubleElementwiseKernel elementwiseDoubles[kArrayOperationCount];
+            
+            int64_t (*sumLongs)(const int64_t *values, size_t count);
+            LongElementwiseKernel elementwiseLongs[kArrayOperationCount];
+            
+            /// the name of the widest instruction set in use, for diagnostics
+            const char *instructionSet;
+        };
+        
+        struct AddOperation {
+            static double apply(double lhs, double rhs) { return lhs + rhs; }
+            static int64_t apply(int64_t lhs, int64_t rhs) { return (int64_t)((uint64_t)lhs + (uint64_t)rhs); }
+#if defined(__SSE2__)
+            static __m128d apply(__m128d lhs, __m128d rhs) { return _mm_add_pd(lhs, rhs); }
+            static __m128i applyLongs(__m128i lhs, __m128i rhs) { return _mm_add_epi64(lhs, rhs); }
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+            __attribute__((target("avx"))) static __m256d apply(__m256d lhs, __m256d rhs) { return _mm256_add_pd(lhs, rhs); }
+#endif
+        };
+        
+        struct SubtractOperation {
+            static double apply(double lhs, double rhs) { return lhs - rhs; }
+            static int64_t apply(int64_t lhs, int64_t rhs) { return (int64_t)((uint64_t)lhs - (uint64_t)rhs); }
+#if defined(__SSE2__)
+            static __m128d apply(__m128d lhs, __m128d rhs) { return _mm_sub_pd(lhs, rhs); }
+            static __m128i applyLongs(__m128i lhs, __m128i rhs) { return _mm_sub_epi64(lhs, rhs); }
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+            __attribute__((target("avx"))) static __m256d apply(__m256d lhs, __m256d rhs) { return _mm256_sub_pd(lhs, rhs); }
+#endif
+        };
+        
+        struct MultiplyOperation {
+            static double apply(double lhs, double rhs) { return lhs * rhs; }
+            static int64_t apply(int64_t lhs, int64_t rhs) { return (int64_t)((uint64_t)lhs * (uint64_t)rhs); }
+#if defined(__SSE2__)
+            static __m128d apply(__m128d lhs, __m128d rhs) { return _mm_mul_pd(lhs, rhs); }
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+            __attribute__((target("avx"))) static __m256d apply(__m256d lhs, __m256d rhs) { return _mm256_mul_pd(lhs, rhs); }
+#endif
+        };
+        
+        struct DivideOperation {
+            static double apply(double lhs, double rhs) { return lhs / rhs; }
+            static int64_t apply(int64_t lhs, int64_t rhs) { return rhs ? lhs / rhs : 0; }
+#if defined(__SSE2__)
+            static __m128d apply(__m128d lhs, __m128d rhs) { return _mm_div_pd(lhs, rhs); }
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+            __attribute__((target("avx"))) static __m256d apply(__m256d lhs, __m256d rhs) { return _mm256_div_pd(lhs, rhs); }
+#endif
+        };
+        
+#pragma mark scalar kernels
+        
+        double scalarSumDoubles(const double *values, size_t count) {
+            double sum = 0;
+            for (size_t index = 0; index < count; ++index) {
+                sum += values[index];
+            }
+            return sum;
+        }
+        
+        double scalarDotDoubles(const double *lhs, const double *rhs, size_t count) {
+            double sum = 0;
+            for (size_t index = 0; index < count; ++index) {
+                sum += lhs[index] * rhs[index];
+            }
+            return sum;
+        }
+        
+        double scalarMinimumDouble(const double *values, size_t count) {
+            double minimum = values[0];
+            for (size_t index = 1; index < count; ++index) {
+                minimum = values[index] < minimum ? values[index] : minimum;
+            }
+            return minimum;
+        }
+        
+        double scalarMaximumDouble(const double *values, size_t count) {
+            double maximum = values[0];
+            for (size_t index = 1; index < count; ++index) {
+                maximum = values[index] > maximum ? values[index] : maximum;
+            }
+            return maximum;
+        }
+        
+        template <class Operation, typename Element>
+        void scalarElementwise(const Element *lhs, const Element *rhs, size_t rhsStride, Element *result, size_t count) {
+            for (size_t index = 0; index < count; ++index) {
+                result[index] = Operation::apply(lhs[index], rhs[index * rhsStride]);
+            }
+        }
+        
+        int64_t scalarSumLongs(const int64_t *values, size_t count) {
+            uint64_t sum = 0;
+            for (size_t index = 0; index < count; ++index) {
+                sum += (uint64_t)values[index];
+            }
+            return (int64_t)sum;
+        }
+        
+#if defined(__SSE2__)
+#pragma mark SSE2 kernels
+        
+        double sse2SumDoubles(const double *values, size_t count) {
+            __m128d firstSum = _mm_setzero_pd(), secondSum = _mm_setzero_pd();
+            size_t index = 0;
+            
+            // two accumulators to hide the latency of the adds
+            for (; index + 4 <= count; index += 4) {
+                firstSum = _mm_add_pd(firstSum, _mm_loadu_pd(values + index));
+                secondSum = _mm_add_pd(secondSum, _mm_loadu_pd(values + index + 2));
+            }
+            
+            double lanes[2];
+            _mm_storeu_pd(lanes, _mm_add_pd(firstSum, secondSum));
+            
+            return lanes[0] + lanes[1] + scalarSumDoubles(values + index, count - index);
+        }
+        
+        double sse2DotDoubles(const double *lhs, const double *rhs, size_t count) {
+            __m128d firstSum = _mm_setzero_pd(), secondSum = _mm_setzero_pd();
+            size_t index = 0;
+            
+            for (; index + 4 <= count; index += 4) {
+                firstSum = _mm_add_pd(firstSum, _mm_mul_pd(_mm_loadu_pd(lhs + index), _mm_loadu_pd(rhs + index)));
+                secondSum = _mm_add_pd(secondSum, _mm_mul_pd(_mm_loadu_pd(lhs + index + 2), _mm_loadu_pd(rhs + index + 2)));
+            }
+            
+            double lanes[2];
+            _mm_storeu_pd(lanes, _mm_add_pd(firstSum, secondSum));
+            
+            return lanes[0] + lanes[1] + scalarDotDoubles(lhs + index, rhs + index, count - index);
+        }
+        
+        double sse2MinimumDouble(const double *values, size_t count) {
+            if (count < 2) {
+                return scalarMinimumDouble(values, count);
+            }
+            
+            __m128d minimum = _mm_loadu_pd(values);
+            size_t index = 2;
+            
+            for (; index + 2 <= count; index += 2) {
+                minimum = _mm_min_pd(minimum, _mm_loadu_pd(values + index));
+            }
+            
+            double lanes[2];
+            _mm_storeu_pd(lanes, minimum);
+            
+            double result = lanes[0] < lanes[1] ? lanes[0] : lanes[1];
+            for (; index < count; ++index) {
+                result = values[index] < result ? values[index] : result;
+            }
+            
+            return result;
+        }
+        
+        double sse2MaximumDouble(const double *values, size_t count) {
+            if (count < 2) {
+                return scalarMaximumDouble(values, count);
+            }
+            
+            __m128d maximum = _mm_loadu_pd(values);
+            size_t index = 2;
+            
+            for (; index + 2 <= count; index += 2) {
+                maximum = _mm_max_pd(maximum, _mm_loadu_pd(values + index));
+            }
+            
+            double lanes[2];
+            _mm_storeu_pd(lanes, maximum);
+            
+            double result = lanes[0] > lanes[1] ? lanes[0] : lanes[1];
+            for (; index < count; ++index) {
+                result = values[index] > result ? values[index] : result;
+            }
+            
+            return result;
+        }
+        
+        template <class Operation>
+        void sse2ElementwiseDoubles(const double *lhs, const double *rhs, size_t rhsStride, double *result, size_t count) {
+            size_t index = 0;
+            
+            if (rhsStride) {
+                for (; index + 2 <= count; index += 2) {
+                    _mm_storeu_pd(result + index, Operation::apply(_mm_loadu_pd(lhs + index), _mm_loadu_pd(rhs + index)));
+                }
+            } else {
+                __m128d broadcast = _mm_set1_pd(rhs[0]);
+                for (; index + 2 <= count; index += 2) {
+                    _mm_storeu_pd(result + index, Operation::apply(_mm_loadu_pd(lhs + index), broadcast));
+                }
+            }
+            
+            scalarElementwise<Operation, double>(lhs + index, rhs + index * rhsStride, rhsStride, result + index, count - index);
+        }
+        
+        int64_t sse2SumLongs(const int64_t *values, size_t count) {
+            __m128i sum = _mm_setzero_si128();
+            size_t index = 0;
+            
+            for (; index + 2 <= count; index += 2) {
+                sum = _mm_add_epi64(sum, _mm_loadu_si128((const __m128i *)(values + index)));
+            }
+            
+            int64_t lanes[2];
+            _mm_storeu_si128((__m128i *)lanes, sum);
+            
+            return (int64_t)((uint64_t)lanes[0] + (uint64_t)lanes[1] + (uint64_t)scalarSumLongs(values + index, count - index));
+        }
+        
+        template <class Operation>
+        void sse2ElementwiseLongs(const int64_t *lhs, const int64_t *rhs, size_t rhsStride, int64_t *result, size_t count) {
+            size_t index = 0;
+            
+            if (rhsStride) {
+                for (; index + 2 <= count; index += 2) {
+                    _mm_storeu_si128((__m128i *)(result + index),
+                                     Operation::applyLongs(_mm_loadu_si128((const __m128i *)(lhs + index)),
+                                                           _mm_loadu_si128((const __m128i *)(rhs + index))));
+                }
+            } else {
+                __m128i broadcast = _mm_set1_epi64x(rhs[0]);
+                for (; index + 2 <= count; index += 2) {
+                    _mm_storeu_si128((__m128i *)(result + index),
+                                     Operation::applyLongs(_mm_loadu_si128((const __m128i *)(lhs + index)), broadcast));
+                }
+            }
+            
+            scalarElementwise<Operation, int64_t>(lhs + index, rhs + index * rhsStride, rhsStride, result + index, count - index);
+        }
+#endif
+        
+#if defined(__x86_64__) || defined(__i386__)
+#pragma mark AVX kernels
+        
+        __attribute__((target("avx"))) double avxSumDoubles(const double *values, size_t count) {
+            __m256d firstSum = _mm256_setzero_pd(), secondSum = _mm256_setzero_pd();
+            size_t index = 0;
+            
+            for (; index + 8 <= count; index += 8) {
+                firstSum = _mm256_add_pd(firstSum, _mm256_loadu_pd(values + index));
+                secondSum = _mm256_add_pd(secondSum, _mm256_loadu_pd(values + index + 4));
+            }
+            
+            double lanes[4];
+            _mm256_storeu_pd(lanes, _mm256_add_pd(firstSum, secondSum));
+            
+            return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + scalarSumDoubles(values + index, count - index);
+        }
+        
+        __attribute__((target("avx"))) double avxDotDoubles(const double *lhs, const double *rhs, size_t count) {
+            __m256d firstSum = _mm256_setzero_pd(), secondSum = _mm256_setzero_pd();
+            size_t index = 0;
+            
+            for (; index + 8 <= count; index += 8) {
+                firstSum = _mm256_add_pd(firstSum, _mm256_mul_pd(_mm256_loadu_pd(lhs + index), _mm256_loadu_pd(rhs + index)));
+                secondSum = _mm256_add_pd(secondSum, _mm256_mul_pd(_mm256_loadu_pd(lhs + index + 4), _mm256_loadu_pd(rhs + index + 4)));
+            }
+            
+            double lanes[4];
+            _mm256_storeu_pd(lanes, _mm256_add_pd(firstSum, secondSum));
+            
+            return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + scalarDotDoubles(lhs + index, rhs + index, count - index);
+        }
+        
+        __attribute__((target("avx"))) double avxMinimumDouble(const double *values, size_t count) {
+            if (count < 4) {
+                return scalarMinimumDouble(values, count);
+            }
+            
+            __m256d minimum = _mm256_loadu_pd(values);
+            size_t index = 4;
+            
+            for (; index + 4 <= count; index += 4) {
+                minimum = _mm256_min_pd(minimum, _mm256_loadu_pd(values + index));
+            }
+            
+            double lanes[4];
+            _mm256_storeu_pd(lanes, minimum);
+            
+            double result = scalarMinimumDouble(lanes, 4);
+            for (; index < count; ++index) {
+                result = values[index] < result ? values[index] : result;
+            }
+            
+            return result;
+        }
+        
+        __attribute__((target("avx"))) double avxMaximumDouble(const double *values, size_t count) {
+            if (count < 4) {
+                return scalarMaximumDouble(values, count);
+            }
+            
+            __m256d maximum = _mm256_loadu_pd(values);
+            size_t index = 4;
+            
+            for (; index + 4 <= count; index += 4) {
+                maximum = _mm256_max_pd(maximum, _mm256_loadu_pd(values + index));
+            }
+            
+            double lanes[4];
+            _mm256_storeu_pd(lanes, maximum);
+            
+            double result = scalarMaximumDouble(lanes, 4);
+            for (; index < count; ++index) {
+                result = values[index] > result ? values[index] : result;
+            }
+            
+            return result;
+        }
+        
+        template <class Operation>
+        __attribute__((target("avx"))) void avxElementwiseDoubles(const double *lhs, const double *rhs, size_t rhsStride, double *result, size_t count) {
+            size_t index = 0;
+            
+            if (rhsStride) {
+                for (; index + 4 <= count; index += 4) {
+                    _mm256_storeu_pd(result + index, Operation::apply(_mm256_loadu_pd(lhs + index), _mm256_loadu_pd(rhs + index)));
+                }
+            } else {
+                __m256d broadcast = _mm256_set1_pd(rhs[0]);
+                for (; index + 4 <= count; index += 4) {
+                    _mm256_storeu_pd(result + index, Operation::apply(_mm256_loadu_pd(lhs + index), broadcast));
+                }
+            }
+            
+            scalarElementwise<Operation, double>(lhs + index, rhs + index * rhsStride, rhsStride, result + index, count - index);
+        }
+        
+        __attribute__((target("avx2"))) int64_t avx2SumLongs(const int64_t *values, size_t count) {
+            __m256i sum = _mm256_setzero_si256();
+            size_t index = 0;
+            
+            for (; index + 4 <= count; index += 4) {
+                sum = _mm256_add_epi64(sum, _mm256_loadu_si256((const __m256i *)(values + index)));
+            }
+            
+            int64_t lanes[4];
+            _mm256_storeu_si256((__m256i *)lanes, sum);
+            
+            uint64_t total = (uint64_t)lanes[0] + (uint64_t)lanes[1] + (uint64_t)lanes[2] + (uint64_t)lanes[3];
+            return (int64_t)(total + (uint64_t)scalarSumLongs(values + index, count - index));
+        }
+#endif
+        
+        KernelTable selectKernels() {
+            KernelTable table;
+            
+            table.instructionSet = "scalar";
+            table.sumDoubles = scalarSumDoubles;
+            table.dotDoubles = scalarDotDoubles;
+            table.minimumDouble = scalarMinimumDouble;
+            table.maximumDouble = scalarMaximumDouble;
+            table.elementwiseDoubles[kArrayOperationAdd] = scalarElementwise<AddOperation, double>;
+            table.elementwiseDoubles[kArrayOperationSubtract] = scalarElementwise<SubtractOperation, double>;
+            table.elementwiseDoubles[kArrayOperationMultiply] = scalarElementwise<MultiplyOperation, double>;
+            table.elementwiseDoubles[kArrayOperationDivide] = scalarElementwise<DivideOperation, double>;
+            table.sumLongs = scalarSumLongs;
+            table.elementwiseLongs[kArrayOperationAdd] = scalarElementwise<AddOperation, int64_t>;
+            table.elementwiseLongs[kArrayOperationSubtract] = scalarElementwise<SubtractOperation, int64_t>;
+            table.elementwiseLongs[kArrayOperationMultiply] = scalarElementwise<MultiplyOperation, int64_t>;
+            table.elementwiseLongs[kArrayOperationDivide] = scalarElementwise<DivideOperation, int64_t>;
+            
+#if defined(__SSE2__)
+            table.instructionSet = "sse2";
+            table.sumDoubles = sse2SumDoubles;
+            table.dotDoubles = sse2DotDoubles;
+            table.minimumDouble = sse2MinimumDouble;
+            table.maximumDouble = sse2MaximumDouble;
+            table.elementwiseDoubles[kArrayOperationAdd] = sse2ElementwiseDoubles<AddOperation>;
+            table.elementwiseDoubles[kArrayOperationSubtract] = sse2ElementwiseDoubles<SubtractOperation>;
+            table.elementwiseDoubles[kArrayOperationMultiply] = sse2ElementwiseDoubles<MultiplyOperation>;
+            table.elementwiseDoubles[kArrayOperationDivide] = sse2ElementwiseDoubles<DivideOperation>;
+            table.sumLongs = sse2SumLongs;
+            table.elementwiseLongs[kArrayOperationAdd] = sse2ElementwiseLongs<AddOperation>;
+            table.elementwiseLongs[kArrayOperationSubtract] = sse2ElementwiseLongs<SubtractOperation>;
+#endif
+            
+#if defined(__x86_64__) || defined(__i386__)
+            if (__builtin_cpu_supports("avx")) {
+                table.instructionSet = "avx";
+                table.sumDoubles = avxSumDoubles;
+                table.dotDoubles = avxDotDoubles;
+                table.minimumDouble = avxMinimumDouble;
+                table.maximumDouble = avxMaximumDouble;
+                table.elementwiseDoubles[kArrayOperationAdd] = avxElementwiseDoubles<AddOperation>;
+                table.elementwiseDoubles[kArrayOperationSubtract] = avxElementwiseDoubles<SubtractOperation>;
+                table.elementwiseDoubles[kArrayOperationMultiply] = avxElementwiseDoubles<MultiplyOperation>;
+                table.elementwiseDoubles[kArrayOperationDivide] = avxElementwiseDoubles<DivideOperation>;
+            }
+            
+            if (__builtin_cpu_supports("avx2")) {
+                table.instructionSet = "avx2";
+                table.sumLongs = avx2SumLongs;
+            }
+#endif
+            
+            return table;
+        }
+        
+        /// the kernels for this CPU, selected on first use
+        const KernelTable& kernelTable() {
+            static KernelTable table = selectKernels();
+            return table;
+        }
+    }
+    
+#pragma mark - ExtensionFunction
+    
+    void ExtensionFunction::garbageCollector(GarbageCollector *gc_long, GarbageCollector *gc_short) {
+        _gc_long = gc_long;
+        _gc_short = gc_short;
+    }
+
+    void ExtensionFunction::evaluator(TinyClojure *evaluator) {
+        _evaluator = evaluator;
+    }
+    
+    void ExtensionFunction::setIOProxy(IOProxy *ioProxy) {
+        _ioProxy = ioProxy;
+    }
+    
+    bool ExtensionFunction::validateArgumentTypes(std::vector<Object::ObjectType>& typeArray) {
+        if (_typeArray.size()==0)
+            return true;
+
+        if (_typeArray.size() != typeArray.size())
+            return false;
+        
+        for (int typeIndex = 0; typeIndex < _typeArray.size(); ++typeIndex) {
             if (typeArray[typeIndex] != _typeArray[typeIndex]) {
                 return false;
             }
@@ -315,75 +1124,176 @@ namespace tinyclojure {
 #pragma mark Standard Library
     
     namespace core {
-        /// function for adding a list of numbers
-        class Arithmetic : public ExtensionFunction {
-            virtual Number numberOperation(Number lhs, Number rhs) = 0;
+        /**
+         * the operations behind the arithmetic functions
+         *
+         * each has a fixnum version (returning false on overflow), a floating version and a numeric tower version.
+         * integerClosed is false when the fixnum result of the operation is not a fixnum
+         */
+        struct PlusOperation {
+            static const bool integerClosed = true;
+            
+            static bool integer(int64_t lhs, int64_t rhs, int64_t& result) {
+                return !__builtin_add_overflow(lhs, rhs, &result);
+            }
+            
+            static double floating(double lhs, double rhs) {
+                return lhs + rhs;
+            }
+            
+            static Number number(const Number& lhs, const Number& rhs) {
+                return lhs + rhs;
+            }
+        };
+        
+        struct MinusOperation {
+            static const bool integerClosed = true;
+            
+            static bool integer(int64_t lhs, int64_t rhs, int64_t& result) {
+                return !__builtin_sub_overflow(lhs, rhs, &result);
+            }
+            
+            static double floating(double lhs, double rhs) {
+                return lhs - rhs;
+            }
+            
+            static Number number(const Number& lhs, const Number& rhs) {
+                return lhs - rhs;
+            }
+        };
+        
+        struct MultiplyOperation {
+            static const bool integerClosed = true;
+            
+            static bool integer(int64_t lhs, int64_t rhs, int64_t& result) {
+                return !__builtin_mul_overflow(lhs, rhs, &result);
+            }
+            
+            static double floating(double lhs, double rhs) {
+                return lhs * rhs;
+            }
+            
+            static Number number(const Number& lhs, const Number& rhs) {
+                return lhs * rhs;
+            }
+        };
+        
+        struct DivideOperation {
+            static const bool integerClosed = false;
+            
+            static bool integer(int64_t lhs, int64_t rhs, int64_t& result) {
+                return false;
+            }
+            
+            static double floating(double lhs, double rhs) {
+                return lhs / rhs;
+            }
             
+            static Number number(const Number& lhs, const Number& rhs) {
+                return lhs / rhs;
+            }
+        };
+        
+        /**
+         * function for folding an arithmetic operation over a list of numbers
+         *
+         * the shape of the arguments is classified once per call.  All fixnum and all floating argument lists are then
+         * folded in a tight loop over the unboxed values, anything else (mixed modes, BigIntegers, or a fixnum
+         * overflow part way through) carries on through the numeric tower.
+         */
+        template <class Operation>
+        class Arithmetic : public ExtensionFunction {
             int minimumNumberOfArguments() {
                 return 1;
             }
             
             Object* execute(ObjectList arguments, InterpreterScope* interpreterState) {
-                bool first = true;
+                bool    allIntegers = true,
+                        allFloating = true;
                 
-                Number current;
-
-                for (int argumentIndex = 0; argumentIndex < arguments.size(); ++argumentIndex) {
-                    Object *evaluatedArgument = arguments[argumentIndex];
-                    if (evaluatedArgument->type() != Object::kObjectTypeNumber) {
+                for (size_t argumentIndex = 0; argumentIndex < arguments.size(); ++argumentIndex) {
+                    if (arguments[argumentIndex]->type() != Object::kObjectTypeNumber) {
                         throw Error("Arithmetic functions require all arguments to be numbers");
                     }
                     
-                    if (first) {
-                        current = evaluatedArgument->numberValue();
-                        first = false;
-                    } else {
-                        current = numberOperation(current, evaluatedArgument->numberValue());
+                    Number::NumberMode mode = arguments[argumentIndex]->numberReference().getMode();
+                    allIntegers &= mode == Number::kNumberModeInteger;
+                    allFloating &= mode == Number::kNumberModeFloating;
+                }
+                
+                if (allIntegers && Operation::integerClosed) {
+                    int64_t accumulator = arguments[0]->numberReference().rawInteger();
+                    
+                    size_t argumentIndex = 1;
+                    for (; argumentIndex < arguments.size(); ++argumentIndex) {
+                        int64_t result;
+                        
+                        if (!Operation::integer(accumulator, arguments[argumentIndex]->numberReference().rawInteger(), result)) {
+                            break;
+                        }
+                        
+                        accumulator = result;
+                    }
+                    
+                    if (argumentIndex == arguments.size()) {
+                        return _gc_short->create(accumulator);
+                    }
+                    
+                    // overflowed, the accumulator still holds the last good value so continue through the numeric tower
+                    return foldNumbers(Number(accumulator), arguments, argumentIndex);
+                } else if (allIntegers) {
+                    double accumulator = (double)arguments[0]->numberReference().rawInteger();
+                    
+                    for (size_t argumentIndex = 1; argumentIndex < arguments.size(); ++argumentIndex) {
+                        accumulator = Operation::floating(accumulator, (double)arguments[argumentIndex]->numberReference().rawInteger());
+                    }
+                    
+                    return _gc_short->create(accumulator);
+                } else if (allFloating) {
+                    double accumulator = arguments[0]->numberReference().rawFloating();
+                    
+                    for (size_t argumentIndex = 1; argumentIndex < arguments.size(); ++argumentIndex) {
+                        accumulator = Operation::floating(accumulator, arguments[argumentIndex]->numberReference().rawFloating());
                     }
+                    
+                    return _gc_short->create(accumulator);
+                }
+                
+                return foldNumbers(arguments[0]->numberReference(), arguments, 1);
+            }
+            
+            /// the general case, fold the remaining arguments into current through the numeric tower
+            Object* foldNumbers(Number current, ObjectList& arguments, size_t firstArgumentIndex) {
+                for (size_t argumentIndex = firstArgumentIndex; argumentIndex < arguments.size(); ++argumentIndex) {
+                    current = Operation::number(current, arguments[argumentIndex]->numberReference());
                 }
                 
-                return _gc_short->registerObject(new Object(current));
+                return _gc_short->create(current);
             }
         };
         
-        class Plus : public Arithmetic {
+        class Plus : public Arithmetic<PlusOperation> {
             std::string functionName() {
                 return std::string("+");
             }
-            
-            virtual Number numberOperation(Number lhs, Number rhs) {
-                return lhs + rhs;
-            }
         };
         
-        class Minus : public Arithmetic {
+        class Minus : public Arithmetic<MinusOperation> {
             std::string functionName() {
                 return "-";
             }
-            
-            virtual Number numberOperation(Number lhs, Number rhs) {
-                return lhs - rhs;
-            }
         };
         
-        class Multiply : public Arithmetic {
+        class Multiply : public Arithmetic<MultiplyOperation> {
             std::string functionName() {
                 return "*";
             }
-            
-            virtual Number numberOperation(Number lhs, Number rhs) {
-                return lhs * rhs;
-            }
         };
         
-        class Divide  : public Arithmetic {
+        class Divide  : public Arithmetic<DivideOperation> {
             std::string functionName() {
                 return "/";
             }
-            
-            virtual Number numberOperation(Number lhs, Number rhs) {
-                return lhs / rhs;
-            }
         };
         
         class If : public ExtensionFunction {
@@ -391,6 +1301,10 @@ namespace tinyclojure {
                 return "if";
             }
             
+            SpecialForm specialForm() {
+                return kSpecialFormIf;
+            }
+            
             int minimumNumberOfArguments() {
                 return 2;
             }
@@ -411,7 +1325,7 @@ namespace tinyclojure {
                 if (arguments.size()==3) {
                     falseBranch = arguments[2];
                 } else {
-                    falseBranch = _gc_short->registerObject(new Object());
+                    falseBranch = _gc_short->create();
                 }
                 
                 Object *evaluatedCondition = _evaluator->scopedEval(interpreterState, condition);
@@ -428,6 +1342,10 @@ namespace tinyclojure {
                 return "=";
             }
             
+            SpecialForm specialForm() {
+                return kSpecialFormEqual;
+            }
+            
             int minimumNumberOfArguments() {
                 return 1;
             }
@@ -443,11 +1361,11 @@ namespace tinyclojure {
                     Object *rhs = _evaluator->scopedEval(interpreterState, arguments[argumentIndex]);
                     
                     if (*lhs!=*rhs) {
-                        return _gc_short->registerObject(new Object(false));
+                        return _gc_short->create(false);
                     }
                 }
                 
-                return _gc_short->registerObject(new Object(true));
+                return _gc_short->create(true);
             }
         };
 
@@ -456,6 +1374,10 @@ namespace tinyclojure {
                 return "not=";
             }
             
+            SpecialForm specialForm() {
+                return kSpecialFormNotEqual;
+            }
+            
             int minimumNumberOfArguments() {
                 return 1;
             }
@@ -471,21 +1393,47 @@ namespace tinyclojure {
                     Object *rhs = _evaluator->scopedEval(interpreterState, arguments[argumentIndex]);
                     
                     if (*lhs==*rhs) {
-                        return _gc_short->registerObject(new Object(false));
+                        return _gc_short->create(false);
                     }
                 }
                 
-                return _gc_short->registerObject(new Object(true));
+                return _gc_short->create(true);
             }
         };
         
+        /// (identical? x y), true only if x and y are the same object
+        class Identical : public ExtensionFunction {
+            std::string functionName() {
+                return "identical?";
+            }
+            
+            int requiredNumberOfArguments() {
+                return 2;
+            }
+            
+            Object *execute(ObjectList arguments, InterpreterScope* interpreterState) {
+                return _gc_short->create(arguments[0] == arguments[1]);
+            }
+        };
+        
+        /**
+         * function for checking a numeric inequality holds between each consecutive pair of arguments
+         *
+         * like Arithmetic, the arguments are classified once and the all fixnum and all floating cases compare the
+         * unboxed values directly.  Comparison::holds is a template so the same operator serves every mode.
+         */
+        template <class Comparison>
         class NumericInequality : public ExtensionFunction {
+            int minimumNumberOfArguments() {
+                return 1;
+            }
+            
             Object *execute(ObjectList arguments, InterpreterScope* interpreterState) {
-                ObjectList evaluatedArguments;
-                for (int argumentIndex=0; argumentIndex<arguments.size(); ++argumentIndex) {
-                    evaluatedArguments.push_back(_evaluator->scopedEval(interpreterState, arguments[argumentIndex]));
-                    
-                    if (evaluatedArguments.back()->type() != Object::kObjectTypeNumber) {
+                bool    allIntegers = true,
+                        allFloating = true;
+                
+                for (size_t argumentIndex = 0; argumentIndex < arguments.size(); ++argumentIndex) {
+                    if (arguments[argumentIndex]->type() != Object::kObjectTypeNumber) {
                         std::stringstream stringBuilder;
                         
                         stringBuilder   << "Arguments to "
@@ -494,67 +1442,85 @@ namespace tinyclojure {
                         
                         throw Error(stringBuilder.str());
                     }
+                    
+                    Number::NumberMode mode = arguments[argumentIndex]->numberReference().getMode();
+                    allIntegers &= mode == Number::kNumberModeInteger;
+                    allFloating &= mode == Number::kNumberModeFloating;
                 }
-
-                Object *lhs = _evaluator->scopedEval(interpreterState, arguments[0]);
                 
-                for (int argumentIndex = 1; argumentIndex < arguments.size(); ++argumentIndex) {
-                    Object *rhs = _evaluator->scopedEval(interpreterState, arguments[argumentIndex]);
-                    
-                    if (!comparison(lhs->numberValue(), rhs->numberValue())) {
-                        return _gc_short->registerObject(new Object(false));
+                bool result = true;
+                
+                if (allIntegers) {
+                    for (size_t argumentIndex = 1; result && argumentIndex < arguments.size(); ++argumentIndex) {
+                        result = Comparison::holds(arguments[argumentIndex-1]->numberReference().rawInteger(),
+                                                   arguments[argumentIndex]->numberReference().rawInteger());
+                    }
+                } else if (allFloating) {
+                    for (size_t argumentIndex = 1; result && argumentIndex < arguments.size(); ++argumentIndex) {
+                        result = Comparison::holds(arguments[argumentIndex-1]->numberReference().rawFloating(),
+                                                   arguments[argumentIndex]->numberReference().rawFloating());
+                    }
+                } else {
+                    for (size_t argumentIndex = 1; result && argumentIndex < arguments.size(); ++argumentIndex) {
+                        result = Comparison::holds(arguments[argumentIndex-1]->numberReference(),
+                                                   arguments[argumentIndex]->numberReference());
                     }
                 }
                 
-                return _gc_short->registerObject(new Object(true));
+                return _gc_short->create(result);
             }
-            
-            bool preEvaluateArguments() {
-                return false;
+        };
+        
+        struct LessThanComparison {
+            template <typename Lhs, typename Rhs>
+            static bool holds(const Lhs& lhs, const Rhs& rhs) {
+                return lhs < rhs;
+            }
+        };
+        
+        struct GreaterThanComparison {
+            template <typename Lhs, typename Rhs>
+            static bool holds(const Lhs& lhs, const Rhs& rhs) {
+                return lhs > rhs;
+            }
+        };
+        
+        struct LessThanOrEqualComparison {
+            template <typename Lhs, typename Rhs>
+            static bool holds(const Lhs& lhs, const Rhs& rhs) {
+                return lhs <= rhs;
+            }
+        };
+        
+        struct GreaterThanOrEqualComparison {
+            template <typename Lhs, typename Rhs>
+            static bool holds(const Lhs& lhs, const Rhs& rhs) {
+                return lhs >= rhs;
             }
-            
-        protected:
-            virtual bool comparison(Number lhs, Number rhs) = 0;
         };
         
-        class LessThan : public NumericInequality {
+        class LessThan : public NumericInequality<LessThanComparison> {
             std::string functionName() {
                 return "<";
             }
-            
-            bool comparison(Number lhs, Number rhs) {
-                return lhs < rhs;
-            }
         };
 
-        class GreaterThan : public NumericInequality {
+        class GreaterThan : public NumericInequality<GreaterThanComparison> {
             std::string functionName() {
                 return ">";
             }
-            
-            bool comparison(Number lhs, Number rhs) {
-                return lhs > rhs;
-            }
         };
 
-        class LessThanOrEqual : public NumericInequality {
+        class LessThanOrEqual : public NumericInequality<LessThanOrEqualComparison> {
             std::string functionName() {
                 return "<=";
             }
-            
-            bool comparison(Number lhs, Number rhs) {
-                return lhs <= rhs;
-            }
         };
 
-        class GreaterThanOrEqual : public NumericInequality {
+        class GreaterThanOrEqual : public NumericInequality<GreaterThanOrEqualComparison> {
             std::string functionName() {
                 return ">=";
             }
-            
-            bool comparison(Number lhs, Number rhs) {
-                return lhs >= rhs;
-            }
         };
         
         class Vector : public ExtensionFunction {
@@ -563,7 +1529,7 @@ namespace tinyclojure {
             }
             
             Object* execute(ObjectList arguments, InterpreterScope *interpreterState) {
-                return _gc_short->registerObject(new Object(arguments));
+                return _gc_short->create(arguments);
             }
         };
         
@@ -573,23 +1539,7 @@ namespace tinyclojure {
             }
             
             Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
-                Object *null = _gc_short->registerObject(new Object());
-
-                if (arguments.size()==0) {
-                    return _gc_short->registerObject(new Object(null,null));
-                } else if (arguments.size()==1) {
-                    return _gc_short->registerObject(new Object(arguments[0],null));
-                } else {
-                    Object *rhs = null;
-                    
-                    for (long argumentIndex = arguments.size()-1; argumentIndex >= 0; --argumentIndex) {
-                        Object *lhs = arguments[argumentIndex];
-                        
-                        rhs = _gc_short->registerObject(new Object(lhs, rhs));
-                    }
-                    
-                    return rhs;
-                }
+                return _evaluator->listObject(arguments);
             }
         };
                 
@@ -603,7 +1553,7 @@ namespace tinyclojure {
             }
             
             Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
-                return _gc_short->registerObject(new Object(arguments[0], arguments[1]));
+                return _gc_short->create(arguments[0], arguments[1]);
             }
         };
         
@@ -624,7 +1574,7 @@ namespace tinyclojure {
                     }
                 }
                 
-                return _gc_short->registerObject(new Object());
+                return _gc_short->create();
             }
         };
 
@@ -648,7 +1598,7 @@ namespace tinyclojure {
 
                 _ioProxy->writeOut("\n");
 
-                return _gc_short->registerObject(new Object());
+                return _gc_short->create();
             }
 
         };
@@ -673,7 +1623,7 @@ namespace tinyclojure {
                     }
                 }
 
-                return _gc_short->registerObject(new Object(stringToPrint));
+                return _gc_short->create(stringToPrint);
             }
 
         };
@@ -700,7 +1650,7 @@ namespace tinyclojure {
 
                 stringToPrint.append("\n");
 
-                return _gc_short->registerObject(new Object(stringToPrint));
+                return _gc_short->create(stringToPrint);
             }
 
         };
@@ -727,7 +1677,7 @@ namespace tinyclojure {
                     }
                 }
 
-                return _gc_short->registerObject(new Object(result));
+                return _gc_short->create(result);
             }
 
         };
@@ -768,7 +1718,7 @@ namespace tinyclojure {
                         break;
                 }
 
-                return _gc_short->registerObject(new Object(result));
+                return _gc_short->create(result);
 
             }
         };
@@ -831,7 +1781,7 @@ namespace tinyclojure {
                     }
                 }
 
-                return _gc_short->registerObject(new Object(result));
+                return _gc_short->create(result);
             }
 
         };
@@ -877,7 +1827,7 @@ namespace tinyclojure {
                     result = arguments[0]->stringValue().substr(arguments[1]->numberValue().integerValue(), std::string::npos);
                 }
 
-                return _gc_short->registerObject(new Object(result));
+                return _gc_short->create(result);
             }
 
         };
@@ -903,7 +1853,7 @@ namespace tinyclojure {
                     result.roundUp();
                 }
 
-                return _gc_short->registerObject(new Object(result.integerValue()));
+                return _gc_short->create(result.integerValue());
             }
         };
 
@@ -930,7 +1880,7 @@ namespace tinyclojure {
 
                 Number remainder = arguments[0]->numberValue() - (result * arguments[1]->numberValue());
 
-                return _gc_short->registerObject(new Object(remainder));
+                return _gc_short->create(remainder);
             }
         };
 
@@ -947,7 +1897,7 @@ namespace tinyclojure {
 
                 Number result = arguments[0]->numberValue() + Number(1);
 
-                return _gc_short->registerObject(new Object(result));
+                return _gc_short->create(result);
 
             }
         };
@@ -965,7 +1915,7 @@ namespace tinyclojure {
 
                 Number result = arguments[0]->numberValue() - Number(1);
 
-                return _gc_short->registerObject(new Object(result));
+                return _gc_short->create(result);
 
             }
         };
@@ -990,7 +1940,7 @@ namespace tinyclojure {
                     }
                 }
 
-                return _gc_short->registerObject(new Object(maxVal));
+                return _gc_short->create(maxVal);
             }
         };
 
@@ -1014,7 +1964,7 @@ namespace tinyclojure {
                     }
                 }
 
-                return _gc_short->registerObject(new Object(minVal));
+                return _gc_short->create(minVal);
 
             }
         };
@@ -1029,39 +1979,80 @@ namespace tinyclojure {
             }
 
             Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
-
-                std::ifstream myFile(arguments[0]->stringValue());
-
-                // Error handling if unable to open the file
-                if (myFile.fail()) {
-                    std::cout << "Failed to open " << arguments[0]->stringValue() << std::endl;
-                }
-
-                std::string myLine;
-
-
-                while (std::getline(myFile, myLine)) {
-
+                TraceRecorder::Scope loadTrace(_evaluator->traceRecorder(), "load", "load-file " + arguments[0]->stringValue());
+                
+                std::string path = arguments[0]->stringValue();
+                
+                try {
+                    // the forms come from the file's image if it hasn't changed since it was compiled
+                    ScriptImage *image = ScriptImage::openCurrent(path);
+                    SourceFile *source = NULL;
+                    size_t position = image ? image->formsStart() : 0;
+                    
                     try {
-                        Object *code = _evaluator->parse(myLine);
-
-                        if (code) {
-                            if (code->type() != tinyclojure::Object::kObjectTypeNil) {
-                                Object *resultObject = _evaluator->scopedEval(interpreterState, code);
-                                std::cout << resultObject->stringRepresentation() << std::endl;
-                            }
+                        if (!image) {
+                            source = new SourceFile(path);
                         }
-
+                        
+                        while (loadForm(source, image, position, interpreterState)) {
+                        }
+                    } catch (...) {
+                        delete image;
+                        delete source;
+                        throw;
+                    }
+                    
+                    delete image;
+                    delete source;
+                } catch (tinyclojure::Error error) {
+                    // the file couldn't be opened, or a form couldn't be read, so nothing after it can be
+                    if (error.isEvaluationLimit()) {
+                        throw;
+                    }
+                    std::cout << error.position << ": " << error.message << std::endl << std::endl;
+                }
+                
+                return _gc_short->create();
+            }
+            
+        protected:
+            /**
+             * read the form at position in image, or source if there is no image, and evaluate it, returning false if
+             * there were no forms left
+             *
+             * the form is read and evaluated in a region of its own, which is freed before the next is read, so a
+             * file takes no more memory than its largest form.  Anything def'd has already been copied to _gc_long.
+             */
+            bool loadForm(const SourceFile *source, const ScriptImage *image, size_t& position, InterpreterScope *interpreterState) {
+                _gc_short->pushRegion();
+                
+                try {
+                    Object *code = image ? _evaluator->loadNext(*image, position) : _evaluator->parseNext(source->text(), source->length(), position);
+                    if (!code) {
+                        _gc_short->popRegion(NULL);
+                        return false;
+                    }
+                    
+                    try {
+                        Object *resultObject = _evaluator->scopedEval(interpreterState, code);
+                        std::cout << resultObject->stringRepresentation() << std::endl;
                     } catch (tinyclojure::Error error) {
+                        // an error in one form doesn't stop the rest of the file
+                        if (error.isEvaluationLimit()) {
+                            throw;
+                        }
                         std::cout << error.position << ": " << error.message << std::endl << std::endl;
                     }
-
+                } catch (...) {
+                    _gc_short->popRegion(NULL);
+                    throw;
                 }
-                return _gc_short->registerObject(new Object());
+                
+                _gc_short->popRegion(NULL);
+                return true;
             }
         };
-
-        // Hanldes only one set per string
+        
         class LoadString : public ExtensionFunction {
             std::string functionName() {
                 return "load-string";
@@ -1078,15 +2069,18 @@ namespace tinyclojure {
 
                     if (code) {
                         if (code->type() != tinyclojure::Object::kObjectTypeNil) {
-                            return _gc_short->registerObject(_evaluator->scopedEval(interpreterState, code));
+                            return _evaluator->scopedEval(interpreterState, code);
                         }
                     }
 
                 } catch (tinyclojure::Error error) {
+                    if (error.isEvaluationLimit()) {
+                        throw;
+                    }
                     std::cout << error.position << ": " << error.message << std::endl << std::endl;
                 }
 
-                return _gc_short->registerObject(new Object());
+                return _gc_short->create();
             }
         };
 
@@ -1104,7 +2098,7 @@ namespace tinyclojure {
                 std::ofstream myFile(arguments[0]->stringValue());
                 myFile << arguments[1]->stringValue();
 
-                return _gc_short->registerObject(new Object());
+                return _gc_short->create();
             }
         };
 
@@ -1127,7 +2121,7 @@ namespace tinyclojure {
                     result += myLine;
                 }
 
-                return _gc_short->registerObject(new Object(result));
+                return _gc_short->create(result);
             }
         };
 
@@ -1155,7 +2149,7 @@ namespace tinyclojure {
 
                 Number remainder = arguments[0]->numberValue() - (result * arguments[1]->numberValue());
 
-                return _gc_short->registerObject(new Object(remainder));
+                return _gc_short->create(remainder);
 
             }
         };
@@ -1178,14 +2172,296 @@ namespace tinyclojure {
 
             Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
 
-                // Erases the symbol from the symbol table
-                // Returns the corresponding object for that symbol (for deletion in the garbage collector)
-                Object *ret = interpreterState->removeSymbol(arguments[0]->stringValue());
+                // Erases the symbol from the symbol table, the value is freed by the collector once nothing refers to it
+                interpreterState->removeSymbol(arguments[0]->stringValue());
+
+                return _gc_short->create();
+            }
+        };
+        
+        /// a builtin that reports (name value) pairs
+        class StatisticsFunction : public ExtensionFunction {
+        protected:
+            /// a two element list
+            Object* pair(Object *name, Object *value) {
+                ObjectList elements;
+                elements.push_back(name);
+                elements.push_back(value);
+                return _evaluator->listObject(elements);
+            }
+            
+            Object* pair(const char *name, Object *value) {
+                return pair(_gc_short->create(std::string(name)), value);
+            }
+        };
+        
+        /**
+         * heap and collection statistics, see TinyClojure::heapStatistics
+         *
+         * with no arguments this returns a list of (name value) pairs, the live object and byte counts being lists of
+         * (type count) pairs in turn.  Pass a name to get just its value.
+         */
+        class GcStats : public StatisticsFunction {
+            std::string functionName() {
+                return "gc-stats";
+            }
+            
+            int minimumNumberOfArguments() {
+                return 0;
+            }
+            
+            int maximumNumberOfArguments() {
+                return 1;
+            }
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                HeapStatistics statistics = _evaluator->heapStatistics();
+                
+                ObjectList liveObjects, liveBytes;
+                for (size_t type = 0; type < HeapStatistics::kObjectTypeCount; ++type) {
+                    Object *typeName = _gc_short->create(std::string(Object::typeName((Object::ObjectType)type)));
+                    liveObjects.push_back(pair(typeName, _gc_short->create((int64_t)statistics.liveObjects[type])));
+                    liveBytes.push_back(pair(typeName, _gc_short->create((int64_t)statistics.liveBytes[type])));
+                }
+                
+                ObjectList entries;
+                entries.push_back(pair("live-objects", _evaluator->listObject(liveObjects)));
+                entries.push_back(pair("live-bytes", _evaluator->listObject(liveBytes)));
+                entries.push_back(pair("collections", _gc_short->create((int64_t)statistics.collections)));
+                entries.push_back(pair("total-pause-us", _gc_short->create(statistics.totalPauseMicros)));
+                entries.push_back(pair("max-pause-us", _gc_short->create(statistics.maxPauseMicros)));
+                entries.push_back(pair("promoted", _gc_short->create((int64_t)statistics.promotedObjects)));
+                entries.push_back(pair("allocated-objects", _gc_short->create((int64_t)statistics.allocatedObjects)));
+                entries.push_back(pair("allocated-bytes", _gc_short->create((int64_t)statistics.allocatedBytes)));
+                entries.push_back(pair("allocation-rate", _gc_short->create(statistics.allocationRate())));
+                
+                if (arguments.empty()) {
+                    return _evaluator->listObject(entries);
+                }
+                
+                if (arguments[0]->type() != Object::kObjectTypeString) {
+                    throw Error("the argument to gc-stats must be the name of a statistic");
+                }
+                
+                for (size_t entryIndex = 0; entryIndex < entries.size(); ++entryIndex) {
+                    if (*entries[entryIndex]->consValueLeft() == *arguments[0]) {
+                        return entries[entryIndex]->consValueRight()->consValueLeft();
+                    }
+                }
+                
+                throw Error("gc-stats has no statistic called " + arguments[0]->stringValue());
+            }
+
+        };
+
+        /**
+         * call statistics of the builtins, see TinyClojure::builtinStatistics
+         *
+         * with no arguments this returns a list of (name statistics) pairs for the builtins that have been called,
+         * those with the most time in them first.  The statistics are (name value) pairs, the latencies being a list
+         * of (upper-bound-ns calls) pairs for the buckets with calls in them.  Pass a builtin's name to get just its
+         * statistics.
+         */
+        class BuiltinStats : public StatisticsFunction {
+            std::string functionName() {
+                return "builtin-stats";
+            }
+            
+            int minimumNumberOfArguments() {
+                return 0;
+            }
+            
+            int maximumNumberOfArguments() {
+                return 1;
+            }
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                if (arguments.size() && arguments[0]->type() != Object::kObjectTypeString) {
+                    throw Error("the argument to builtin-stats must be the name of a builtin");
+                }
+                
+                std::vector<std::pair<std::string, BuiltinStatistics> > statistics = _evaluator->builtinStatistics();
+                
+                ObjectList entries;
+                for (size_t builtinIndex = 0; builtinIndex < statistics.size(); ++builtinIndex) {
+                    if (arguments.size() && statistics[builtinIndex].first != arguments[0]->stringValue()) {
+                        continue;
+                    }
+                    
+                    const BuiltinStatistics& builtin = statistics[builtinIndex].second;
+                    
+                    ObjectList latencies;
+                    for (int bucket = 0; bucket < BuiltinStatistics::kLatencyBucketCount; ++bucket) {
+                        if (builtin.latencyBuckets[bucket]) {
+                            latencies.push_back(pair(_gc_short->create((int64_t)1 << bucket),
+                                                     _gc_short->create((int64_t)builtin.latencyBuckets[bucket])));
+                        }
+                    }
+                    
+                    ObjectList values;
+                    values.push_back(pair("calls", _gc_short->create((int64_t)builtin.calls)));
+                    values.push_back(pair("total-ns", _gc_short->create((int64_t)builtin.totalNanos)));
+                    values.push_back(pair("max-ns", _gc_short->create((int64_t)builtin.maxNanos)));
+                    values.push_back(pair("latency-ns", _evaluator->listObject(latencies)));
+                    
+                    if (arguments.size()) {
+                        return _evaluator->listObject(values);
+                    }
+                    
+                    entries.push_back(pair(statistics[builtinIndex].first.c_str(), _evaluator->listObject(values)));
+                }
+                
+                if (arguments.size()) {
+                    throw Error("builtin-stats has no calls to " + arguments[0]->stringValue());
+                }
+                
+                return _evaluator->listObject(entries);
+            }
 
-                // Delete the returned object from the garbage collector
-                _gc_long->deleteObject(ret);
+        };
 
-                return _gc_short->registerObject(new Object());
+        /// nanoseconds on a monotonic clock, for measuring intervals, as the clock's zero is arbitrary
+        class NanoTime : public ExtensionFunction {
+            std::string functionName() {
+                return "nano-time";
+            }
+            
+            int requiredNumberOfArguments() {
+                return 0;
+            }
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                return _gc_short->create((int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+            }
+        };
+        
+        /// milliseconds since the Unix epoch on the wall clock
+        class CurrentTimeMillis : public ExtensionFunction {
+            std::string functionName() {
+                return "current-time-millis";
+            }
+            
+            int requiredNumberOfArguments() {
+                return 0;
+            }
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                return _gc_short->create((int64_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+            }
+        };
+        
+        /// (time expr) evaluates expr, prints how long it took and what it allocated, and returns its value
+        class Time : public ExtensionFunction {
+            std::string functionName() {
+                return "time";
+            }
+            
+            int requiredNumberOfArguments() {
+                return 1;
+            }
+            
+            bool preEvaluateArguments() {
+                return false;
+            }
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                HeapStatistics before = _evaluator->heapStatistics();
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                
+                Object *result = _evaluator->scopedEval(interpreterState, arguments[0]);
+                
+                double elapsedMillis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                HeapStatistics after = _evaluator->heapStatistics();
+                
+                std::stringstream stringBuilder;
+                stringBuilder   << "Elapsed time: " << elapsedMillis << " msecs, "
+                                << after.allocatedObjects - before.allocatedObjects << " objects, "
+                                << after.allocatedBytes - before.allocatedBytes << " bytes allocated" << std::endl;
+                _ioProxy->writeOut(stringBuilder.str());
+                
+                return result;
+            }
+        };
+        
+        /**
+         * (bench expr n) evaluates expr n times, after a tenth as many untimed runs to warm up, and prints and returns
+         * the distribution of the times in nanoseconds as (name value) pairs
+         *
+         * each run's allocations are freed as soon as it finishes, so the value of expr is thrown away
+         */
+        class Bench : public StatisticsFunction {
+            std::string functionName() {
+                return "bench";
+            }
+            
+            int requiredNumberOfArguments() {
+                return 2;
+            }
+            
+            bool preEvaluateArguments() {
+                return false;
+            }
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                Object *runsObject = _evaluator->scopedEval(interpreterState, arguments[1]);
+                if (runsObject->type() != Object::kObjectTypeNumber
+                    || runsObject->numberValue().getMode() != Number::kNumberModeInteger
+                    || runsObject->numberValue().integerValue() < 1) {
+                    throw Error("the number of runs for bench must be a positive integer");
+                }
+                int64_t runs = runsObject->numberValue().integerValue();
+                
+                for (int64_t warmup = 0; warmup < std::max((int64_t)1, runs / 10); ++warmup) {
+                    timeRun(arguments[0], interpreterState);
+                }
+                
+                std::vector<double> times;
+                for (int64_t run = 0; run < runs; ++run) {
+                    times.push_back(timeRun(arguments[0], interpreterState));
+                }
+                
+                double mean = std::accumulate(times.begin(), times.end(), 0.0) / runs;
+                std::sort(times.begin(), times.end());
+                
+                std::stringstream stringBuilder;
+                stringBuilder   << runs << " runs: mean " << mean << " ns, p50 " << percentile(times, 50)
+                                << " ns, p90 " << percentile(times, 90) << " ns, p99 " << percentile(times, 99)
+                                << " ns, min " << times.front() << " ns, max " << times.back() << " ns" << std::endl;
+                _ioProxy->writeOut(stringBuilder.str());
+                
+                ObjectList entries;
+                entries.push_back(pair("runs", _gc_short->create(runs)));
+                entries.push_back(pair("mean-ns", _gc_short->create(mean)));
+                entries.push_back(pair("p50-ns", _gc_short->create(percentile(times, 50))));
+                entries.push_back(pair("p90-ns", _gc_short->create(percentile(times, 90))));
+                entries.push_back(pair("p99-ns", _gc_short->create(percentile(times, 99))));
+                entries.push_back(pair("min-ns", _gc_short->create(times.front())));
+                entries.push_back(pair("max-ns", _gc_short->create(times.back())));
+                return _evaluator->listObject(entries);
+            }
+            
+        protected:
+            /// evaluate code in a region of its own, returning the nanoseconds it took
+            double timeRun(Object *code, InterpreterScope *interpreterState) {
+                _gc_short->pushRegion();
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                
+                try {
+                    _evaluator->scopedEval(interpreterState, code);
+                } catch (...) {
+                    _gc_short->popRegion(NULL);
+                    throw;
+                }
+                
+                double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+                _gc_short->popRegion(NULL);
+                return elapsed;
+            }
+            
+            /// the nearest rank percentile of sorted times
+            double percentile(const std::vector<double>& times, int percent) {
+                size_t rank = (times.size() * percent + 99) / 100;
+                return times[rank ? rank - 1 : 0];
             }
         };
 
@@ -1194,6 +2470,10 @@ namespace tinyclojure {
                 return "def";
             }
             
+            SpecialForm specialForm() {
+                return kSpecialFormDef;
+            }
+            
             int requiredNumberOfArguments() {
                 return 2;
             }
@@ -1203,8 +2483,8 @@ namespace tinyclojure {
             }
             
             Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
-                Object  *symbol = _gc_long->registerObject(new Object(arguments[0], _gc_long)),
-                        *value = _gc_long->registerObject(new Object(_evaluator->scopedEval(interpreterState, arguments[1]), _gc_long));
+                Object  *symbol = _gc_long->create(arguments[0], _gc_long),
+                        *value = _gc_long->create(_evaluator->scopedEval(interpreterState, arguments[1]), _gc_long);
                 
                 if (symbol->type()!=Object::kObjectTypeSymbol) {
                     throw Error("first argument to def must be a symbol");
@@ -1212,7 +2492,7 @@ namespace tinyclojure {
                 
                 interpreterState->setSymbolInScope(symbol->stringValue(), value);
                 
-                return _gc_short->registerObject(new Object());
+                return _gc_short->create();
             }
         };
         
@@ -1221,6 +2501,10 @@ namespace tinyclojure {
                 return "do";
             }
             
+            SpecialForm specialForm() {
+                return kSpecialFormDo;
+            }
+            
             bool preEvaluateArguments() {
                 return false;
             }
@@ -1228,7 +2512,7 @@ namespace tinyclojure {
             Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
                 InterpreterScope aScope(interpreterState);
                 
-                Object  *retValue = _gc_short->registerObject(new Object());
+                Object  *retValue = _gc_short->create();
                 
                 for (int argumentIndex = 0; argumentIndex < arguments.size(); ++argumentIndex) {
                     retValue = _evaluator->unscopedEval(&aScope, arguments[argumentIndex]);
@@ -1252,6 +2536,9 @@ namespace tinyclojure {
                     case Object::kObjectTypeString:
                     case Object::kObjectTypeBuiltinFunction:
                     case Object::kObjectTypeClosure:
+                    case Object::kObjectTypeDoubleArray:
+                    case Object::kObjectTypeLongArray:
+                    case Object::kObjectTypeDataset:
                         return object;
                         break;
                         
@@ -1259,7 +2546,9 @@ namespace tinyclojure {
                         Object  *left = captureState(object->consValueLeft(), interpreterState),
                         *right = captureState(object->consValueRight(), interpreterState);
                         
-                        return _gc_short->registerObject(new Object(left, right));
+                        Object *captured = _gc_short->create(left, right);
+                        captured->setSourcePosition(object->sourcePosition());
+                        return captured;
                     } break;
                         
                     case Object::kObjectTypeVector: {
@@ -1269,7 +2558,7 @@ namespace tinyclojure {
                             newVector.push_back(captureState(object->vectorValue()[vectorIndex], interpreterState));
                         }
                         
-                        return _gc_short->registerObject(new Object(newVector));
+                        return _gc_short->create(newVector);
                     } break;
                         
                     case Object::kObjectTypeSymbol: {
@@ -1330,7 +2619,7 @@ namespace tinyclojure {
             
             Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
                 // symbol
-                Object  *symbol = _gc_long->registerObject(new Object(arguments[0], _gc_long)),
+                Object  *symbol = _gc_long->create(arguments[0], _gc_long),
                         *arglist = arguments[1];
                 
                 if (symbol->type()!=Object::kObjectTypeSymbol) {
@@ -1347,17 +2636,17 @@ namespace tinyclojure {
                 
                 // capture the arguments
                 ObjectList capturedArguments;
-                capturedArguments.push_back(_gc_short->registerObject(new Object("do", true)));
+                capturedArguments.push_back(_gc_short->create("do", true));
                 for (int argumentIndex = 0; argumentIndex < arguments.size(); ++argumentIndex) {
                     capturedArguments.push_back(captureState(arguments[argumentIndex], interpreterState));
                 }
                 
-                Object *lambda = _gc_short->registerObject(new Object(_evaluator->listObject(capturedArguments), argumentSymbols));
-                Object* lambda_long = _gc_long->registerObject(new Object(lambda, _gc_long));
+                Object *lambda = _gc_short->create(_evaluator->listObject(capturedArguments), argumentSymbols);
+                Object* lambda_long = _gc_long->create(lambda, _gc_long);
                 
                 interpreterState->setSymbolInScope(symbol->stringValue(), lambda_long);
                 
-                return _gc_short->registerObject(new Object());
+                return _gc_short->create();
             }
         };
 
@@ -1373,7 +2662,7 @@ namespace tinyclojure {
             Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
 
                 // Differentiate between symbols and arg list
-                Object *symbol = _gc_long->registerObject(new Object(arguments[0], _gc_long)), *argList = arguments[1];
+                Object *symbol = _gc_long->create(arguments[0], _gc_long), *argList = arguments[1];
 
                 if (symbol->type()!=Object::kObjectTypeSymbol) {
                     throw Error("first argument to defmacro must be a symbol");
@@ -1389,17 +2678,17 @@ namespace tinyclojure {
 
                 // capture the arguments
                 ObjectList capturedArguments;
-                capturedArguments.push_back(_gc_short->registerObject(new Object("do", true)));
+                capturedArguments.push_back(_gc_short->create("do", true));
                 for (int argumentIndex = 0; argumentIndex < arguments.size(); ++argumentIndex) {
                     capturedArguments.push_back(captureState(arguments[argumentIndex], interpreterState));
                 }
 
-                Object *lambda = _gc_short->registerObject(new Object(_evaluator->listObject(capturedArguments), argumentSymbols, true));
-                Object* lambda_long = _gc_long->registerObject(new Object(lambda, _gc_long));
+                Object *lambda = _gc_short->create(_evaluator->listObject(capturedArguments), argumentSymbols, true);
+                Object* lambda_long = _gc_long->create(lambda, _gc_long);
 
                 interpreterState->setSymbolInScope(symbol->stringValue(), lambda_long);
 
-                return _gc_short->registerObject(new Object());
+                return _gc_short->create();
             }
 
         };
@@ -1423,12 +2712,12 @@ namespace tinyclojure {
 
                 // capture the arguments
                 ObjectList capturedArguments;
-                capturedArguments.push_back(_gc_short->registerObject(new Object("do", true)));
+                capturedArguments.push_back(_gc_short->create("do", true));
                 for (int argumentIndex = 0; argumentIndex < arguments.size(); ++argumentIndex) {
                     capturedArguments.push_back(captureState(arguments[argumentIndex], interpreterState));
                 }
                 
-                return _gc_long->registerObject(new Object(_gc_short->registerObject(new Object(_evaluator->listObject(capturedArguments), argumentSymbols)), _gc_long));
+                return _gc_long->create(_gc_short->create(_evaluator->listObject(capturedArguments), argumentSymbols), _gc_long);
             }
         };
         
@@ -1512,7 +2801,7 @@ namespace tinyclojure {
             }
             
             Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {                
-                return _gc_short->registerObject(new Object(_ioProxy->readLine()));
+                return _gc_short->create(_ioProxy->readLine());
             }
         };
         
@@ -1521,6 +2810,10 @@ namespace tinyclojure {
                 return "cond";
             }
             
+            SpecialForm specialForm() {
+                return kSpecialFormCond;
+            }
+            
             bool preEvaluateArguments() {
                 return false;
             }
@@ -1539,7 +2832,7 @@ namespace tinyclojure {
                     }
                 }
                 
-                return _gc_short->registerObject(new Object());
+                return _gc_short->create();
             };
         };
         
@@ -1548,6 +2841,10 @@ namespace tinyclojure {
                 return "let";
             }
             
+            SpecialForm specialForm() {
+                return kSpecialFormLet;
+            }
+            
             bool preEvaluateArguments() {
                 return false;
             }
@@ -1592,13 +2889,11 @@ namespace tinyclojure {
                         throw Error("Let bindings should consist of symbol/value pairs");
                     }
 
-                    Object* newBindVal = _gc_long->registerObject(new Object(evaluatedBindingValue, _gc_long));
-
-                    letScope.setSymbolInScope(bindingSymbol->stringValue(), newBindVal);
+                    letScope.setSymbolInScope(bindingSymbol->stringValue(), evaluatedBindingValue);
                 }
                 
                 // now evaluate the arguments in turn
-                Object  *retValue = _gc_short->registerObject(new Object());
+                Object  *retValue = _gc_short->create();
                 
                 for (int argumentIndex = 1; argumentIndex < arguments.size(); ++argumentIndex) {
                     retValue = _evaluator->unscopedEval(&letScope, arguments[argumentIndex]);
@@ -1608,1359 +2903,6281 @@ namespace tinyclojure {
             }
         };
         
-        class Nth : public ExtensionFunction {
-            std::string functionName() {
-                return "nth";
+        /**
+         * base class for the primitive array functions
+         *
+         * double and long arrays hold unboxed values contiguously, so the bulk operations run as kernels over the
+         * whole array rather than through the evaluator
+         */
+        class ArrayFunction : public ExtensionFunction {
+        protected:
+            static bool isArray(Object *object) {
+                return object->type() == Object::kObjectTypeDoubleArray || object->type() == Object::kObjectTypeLongArray;
             }
             
-            int minimumNumberOfArguments() {
-                return 2;
+            void requireArray(Object *object) {
+                if (!isArray(object)) {
+                    std::stringstream stringBuilder;
+                    
+                    stringBuilder   << "arguments to "
+                                    << functionName()
+                                    << " must be a double-array or a long-array";
+                    
+                    throw Error(stringBuilder.str());
+                }
             }
             
-            int maximumNumberOfArguments() {
-                return 3;
+            size_t arrayLength(Object *array) {
+                if (array->type() == Object::kObjectTypeDoubleArray) {
+                    return array->doubleArrayValue().size();
+                }
+                
+                return array->longArrayValue().size();
             }
             
-            Object* execute(ObjectList arguments, InterpreterScope *interpreterState) {
-                Object  *collection = arguments[0],
-                        *indexValue = arguments[1],
-                        *defaultValue = NULL;
-                
-                if (arguments.size()==3) {
-                    defaultValue = arguments[2];
+            /// the contents of an array as doubles, copying only if it is a long array
+            const double* doubleElements(Object *array, std::vector<double>& conversionBuffer) {
+                if (array->type() == Object::kObjectTypeDoubleArray) {
+                    return array->doubleArrayValue().data();
                 }
                 
-                if (indexValue->type()!=Object::kObjectTypeNumber) {
-                    throw Error("second argument to nth must be an index");
+                conversionBuffer.assign(array->longArrayValue().begin(), array->longArrayValue().end());
+                return conversionBuffer.data();
+            }
+            
+            /// box a single element of an array
+            Object* boxedElement(Object *array, size_t index) {
+                if (array->type() == Object::kObjectTypeDoubleArray) {
+                    return _gc_short->create(array->doubleArrayValue()[index]);
                 }
                 
-                const int index = indexValue->numberValue().integerValue();
-                
-                ObjectList convertedList;
-                if (!collection->buildList(convertedList)) {
-                    throw Error("first argument to nth must be a collection");
+                return _gc_short->create(array->longArrayValue()[index]);
+            }
+            
+            /// unbox a number into an element of an array
+            void setElement(Object *array, size_t index, Object *value) {
+                if (value->type() != Object::kObjectTypeNumber) {
+                    std::stringstream stringBuilder;
+                    
+                    stringBuilder   << functionName()
+                                    << " can only store numbers in an array";
+                    
+                    throw Error(stringBuilder.str());
                 }
                 
-                if (index < convertedList.size()) {
-                    if (index >= 0) {
-                        return convertedList[index];
-                    } else {
-                        throw Error("index to nth is < 0");
-                    }
+                if (array->type() == Object::kObjectTypeDoubleArray) {
+                    array->doubleArrayValue()[index] = value->numberReference().floatingValue();
                 } else {
-                    // out of bounds.  this is an exception if no default value is supplied
-                    if (defaultValue) {
-                        return defaultValue;
-                    } else {
-                        throw Error("index to nth is out of bounds");
-                    }
+                    array->longArrayValue()[index] = value->numberReference().integerValue();
+                }
+            }
+            
+            size_t checkedIndex(Object *array, Object *indexObject) {
+                if (indexObject->type() != Object::kObjectTypeNumber) {
+                    throw Error("array index must be a number");
+                }
+                
+                int64_t index = indexObject->numberReference().integerValue();
+                if (index < 0 || (size_t)index >= arrayLength(array)) {
+                    throw Error("array index out of bounds");
                 }
+                
+                return (size_t)index;
             }
         };
-    }
-    
-#pragma mark -
-#pragma mark InterpreterScope
-    
-    Object* InterpreterScope::lookupSymbolInScope(std::string symbolName) {
-        std::map<std::string, Object*>::iterator it = _symbolTable.find(symbolName);
         
-        if (it == _symbolTable.end()) {
-            return NULL;
-        } else {
-            return it->second;
-        }
-    }
-    
-    void InterpreterScope::setSymbolInScope(std::string symbolName, Object *functionValue) {
-        _symbolTable[symbolName] = functionValue;
-    }
-
-    Object* InterpreterScope::lookupSymbol(std::string symbolName) {
-        Object *ret = lookupSymbolInScope(symbolName);
-        if (ret) {
-            return ret;
-        } else {
-            if (_parentScope) {
-                return _parentScope->lookupSymbol(symbolName);
-            } else {
-                return NULL;
-            }
-        }
-    }
-
-    Object* InterpreterScope::removeSymbolInScope(std::string symbolName) {
-        Object* ret = lookupSymbolInScope(symbolName);
-        _symbolTable.erase(symbolName);
-        return ret;
-    }
-
-    Object* InterpreterScope::removeSymbol(std::string symbolName) {
-        Object* ret = removeSymbolInScope(symbolName);
-
-        if (ret) {
-            return ret;
-        } else {
-            if (_parentScope) {
-                return _parentScope->removeSymbol(symbolName);
-            } else {
-                return NULL;
+        /**
+         * (double-array size-or-collection) and (long-array size-or-collection)
+         *
+         * a number makes a zero filled array of that length, a list, vector or array is copied element by element
+         */
+        class MakeArray : public ArrayFunction {
+            int requiredNumberOfArguments() {
+                return 1;
             }
-        }
-    }
-
-
-#pragma mark -
-#pragma mark Object
-    
-    Object::Object() {
-        _type = kObjectTypeNil;
-    }
-    
-    Object::Object(std::string stringVal, bool symbol) {
-        if (symbol) {
-            _type = kObjectTypeSymbol;
-            _contents.stringValue = new std::string(stringVal);            
-        } else {
-            _type = kObjectTypeString;
-            _contents.stringValue = new std::string(stringVal);
-        }
-    }
-    
-    Object::Object(Object *code, ObjectList arguments) {
-        _type = kObjectTypeClosure;
-        _contents.functionValue.objectPointer = code;
-        _contents.functionValue.argumentSymbols = new ObjectList(arguments);
-        _contents.functionValue.macro = false;
-    }
-
-    Object::Object(Object *code, ObjectList arguments, bool macro) {
-        _type = kObjectTypeClosure;
-        _contents.functionValue.objectPointer = code;
-        _contents.functionValue.argumentSymbols = new ObjectList(arguments);
-        _contents.functionValue.macro = macro;
-    }
-
-    Object::Object(ExtensionFunction *function) {
-        _type = kObjectTypeBuiltinFunction;
-        _contents.builtinFunctionValue.extensionFunctionPointer = function;
-    }
-
-    // Creates a deep copy of an object
-    // Does not have the ability to clone built in functions
-    Object::Object(Object* oldObj, GarbageCollector* gc) {
-
-        _type = oldObj->_type;
-
-        switch (_type) {
-
-            case kObjectTypeSymbol:
-                _contents.stringValue = new std::string(oldObj->stringValue());
-                break;
-
-            case kObjectTypeString:
-                _contents.stringValue = new std::string(oldObj->stringValue());
-                break;
-
-            case kObjectTypeVector:
-                _contents.vectorPointer = new ObjectList();
-
-                for(unsigned i = 0; i < oldObj->_contents.vectorPointer->size(); ++i)
-                    _contents.vectorPointer->push_back(gc->registerObject(new Object(oldObj->_contents.vectorPointer->at(i), gc)));
-                break;
-
-            case kObjectTypeClosure:
-                _contents.functionValue.objectPointer = gc->registerObject(new Object(oldObj->_contents.functionValue.objectPointer, gc));
-
-                _contents.functionValue.argumentSymbols = new ObjectList();
-
-                for(unsigned i = 0; i < oldObj->_contents.functionValue.argumentSymbols->size(); ++i)
-                    _contents.functionValue.argumentSymbols->push_back(gc->registerObject(new Object(oldObj->_contents.functionValue.argumentSymbols->at(i), gc)));
-
-                _contents.functionValue.macro = oldObj->_contents.functionValue.macro;
-                break;
-
-            case kObjectTypeNumber:
-                _contents.numberPointer = new Number(_contents.numberPointer);
-                break;
-
-            case kObjectTypeCons:
-                _contents.consValue.left = gc->registerObject(new Object(oldObj->consValueLeft(), gc));
-                _contents.consValue.right = gc->registerObject(new Object(oldObj->consValueRight(), gc));
-                break;
-
-            // Does not deep copy built in functions
-            case kObjectTypeBuiltinFunction:
-                _contents.builtinFunctionValue = oldObj->_contents.builtinFunctionValue;
-                break;
-
-            case kObjectTypeBoolean:
-                _contents.booleanValue = _contents.booleanValue;
-                break;
-
-            case kObjectTypeNil:
-                break;
-        }
-    }
-
-    Object::~Object() {
-        switch (_type) {
-            case kObjectTypeSymbol:
-            case kObjectTypeString:
-                delete _contents.stringValue;
-                break;
-                                
-            case kObjectTypeVector:
-                delete _contents.vectorPointer;
-                break;
             
-            case kObjectTypeClosure:
-                // leave the Objects to the gc
-                delete _contents.functionValue.argumentSymbols;
-                break;
-
-            case kObjectTypeNumber:
-                delete _contents.numberPointer;
-                break;
-                
-            case kObjectTypeCons:
-                // it isn't our business deleting "unused" objects, that is for the GC
-            case kObjectTypeBuiltinFunction:
-            case kObjectTypeBoolean:
-            case kObjectTypeNil:
-                // nothing need be done
-                break;
-        }
-    }
-    
-    bool Object::operator==(const Object& rhs) {
-        if (type() != rhs.type()) {
-            return false;
-        }
-        
-        switch (_type) {
-            case kObjectTypeBoolean:
-                return _contents.booleanValue == rhs._contents.booleanValue;
-                break;
+            virtual Object::ObjectType arrayType() = 0;
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                Object *source = arguments[0];
                 
-            case kObjectTypeNumber:
-                return *_contents.numberPointer == *rhs._contents.numberPointer;
-                break;
+                if (source->type() == Object::kObjectTypeNumber) {
+                    int64_t length = source->numberReference().integerValue();
+                    if (length < 0) {
+                        throw Error("array length must not be negative");
+                    }
+                    
+                    return _gc_short->create(arrayType(), (size_t)length);
+                }
                 
-            case kObjectTypeNil:
-                return true;
-                break;
+                Object *result = NULL;
                 
-            case kObjectTypeVector:
-                if (_contents.vectorPointer->size() == rhs._contents.vectorPointer->size()) {
-                    for (int elementIndex=0; elementIndex < _contents.vectorPointer->size(); ++elementIndex) {
-                        if (*(_contents.vectorPointer->at(elementIndex)) != *(rhs._contents.vectorPointer->at(elementIndex))) {
-                            return false;
+                if (isArray(source)) {
+                    size_t length = arrayLength(source);
+                    result = _gc_short->create(arrayType(), length);
+                    
+                    if (source->type() == Object::kObjectTypeDoubleArray && arrayType() == Object::kObjectTypeDoubleArray) {
+                        result->doubleArrayValue() = source->doubleArrayValue();
+                    } else if (source->type() == Object::kObjectTypeLongArray && arrayType() == Object::kObjectTypeLongArray) {
+                        result->longArrayValue() = source->longArrayValue();
+                    } else {
+                        for (size_t index = 0; index < length; ++index) {
+                            setElement(result, index, boxedElement(source, index));
                         }
-                        
                     }
-                    return true;
-                } else {
-                    return false;
+                    
+                    return result;
                 }
-                break;
                 
-            case kObjectTypeBuiltinFunction:
-                return _contents.builtinFunctionValue.extensionFunctionPointer->functionName() == rhs._contents.builtinFunctionValue.extensionFunctionPointer->functionName();
-                break;
+                ObjectList elements;
+                if (!source->buildList(elements)) {
+                    std::stringstream stringBuilder;
+                    
+                    stringBuilder   << functionName()
+                                    << " requires a size or a collection of numbers";
+                    
+                    throw Error(stringBuilder.str());
+                }
+                
+                result = _gc_short->create(arrayType(), elements.size());
+                for (size_t index = 0; index < elements.size(); ++index) {
+                    setElement(result, index, elements[index]);
+                }
+                
+                return result;
+            }
+        };
+        
+        class DoubleArray : public MakeArray {
+            std::string functionName() {
+                return "double-array";
+            }
+            
+            Object::ObjectType arrayType() {
+                return Object::kObjectTypeDoubleArray;
+            }
+        };
+        
+        class LongArray : public MakeArray {
+            std::string functionName() {
+                return "long-array";
+            }
+            
+            Object::ObjectType arrayType() {
+                return Object::kObjectTypeLongArray;
+            }
+        };
+        
+        class ArrayGet : public ArrayFunction {
+            std::string functionName() {
+                return "aget";
+            }
+            
+            int requiredNumberOfArguments() {
+                return 2;
+            }
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                requireArray(arguments[0]);
+                return boxedElement(arguments[0], checkedIndex(arguments[0], arguments[1]));
+            }
+        };
+        
+        class ArraySet : public ArrayFunction {
+            std::string functionName() {
+                return "aset";
+            }
+            
+            int requiredNumberOfArguments() {
+                return 3;
+            }
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                requireArray(arguments[0]);
+                setElement(arguments[0], checkedIndex(arguments[0], arguments[1]), arguments[2]);
+                return arguments[2];
+            }
+        };
+        
+        class ArrayLength : public ArrayFunction {
+            std::string functionName() {
+                return "alength";
+            }
+            
+            int requiredNumberOfArguments() {
+                return 1;
+            }
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                requireArray(arguments[0]);
+                return _gc_short->create((int64_t)arrayLength(arguments[0]));
+            }
+        };
+        
+        /**
+         * element wise arithmetic, (a+ array array-or-number)
+         *
+         * two long arrays give a long array (except for division), anything involving doubles gives a double array
+         */
+        class ArrayArithmetic : public ArrayFunction {
+            int requiredNumberOfArguments() {
+                return 2;
+            }
+            
+            virtual kernels::ArrayOperation operation() = 0;
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                Object  *lhs = arguments[0],
+                        *rhs = arguments[1];
+                
+                requireArray(lhs);
+                
+                const size_t length = arrayLength(lhs);
+                const bool scalar = rhs->type() == Object::kObjectTypeNumber;
+                
+                if (!scalar) {
+                    requireArray(rhs);
+                    
+                    if (arrayLength(rhs) != length) {
+                        std::stringstream stringBuilder;
+                        
+                        stringBuilder   << "arrays passed to "
+                                        << functionName()
+                                        << " must be the same length";
+                        
+                        throw Error(stringBuilder.str());
+                    }
+                }
+                
+                const kernels::KernelTable& table = kernels::kernelTable();
+                
+                bool longResult =   lhs->type() == Object::kObjectTypeLongArray
+                                    && operation() != kernels::kArrayOperationDivide
+                                    && (scalar
+                                        ? rhs->numberReference().getMode() == Number::kNumberModeInteger
+                                        : rhs->type() == Object::kObjectTypeLongArray);
+                
+                if (longResult) {
+                    Object *result = _gc_short->create(Object::kObjectTypeLongArray, length);
+                    int64_t scalarValue = scalar ? rhs->numberReference().rawInteger() : 0;
+                    
+                    table.elementwiseLongs[operation()](lhs->longArrayValue().data(),
+                                                        scalar ? &scalarValue : rhs->longArrayValue().data(),
+                                                        scalar ? 0 : 1,
+                                                        result->longArrayValue().data(),
+                                                        length);
+                    return result;
+                }
+                
+                Object *result = _gc_short->create(Object::kObjectTypeDoubleArray, length);
+                std::vector<double> lhsBuffer, rhsBuffer;
+                double scalarValue = scalar ? rhs->numberReference().floatingValue() : 0;
+                
+                table.elementwiseDoubles[operation()](doubleElements(lhs, lhsBuffer),
+                                                      scalar ? &scalarValue : doubleElements(rhs, rhsBuffer),
+                                                      scalar ? 0 : 1,
+                                                      result->doubleArrayValue().data(),
+                                                      length);
+                return result;
+            }
+        };
+        
+        class ArrayAdd : public ArrayArithmetic {
+            std::string functionName() {
+                return "a+";
+            }
+            
+            kernels::ArrayOperation operation() {
+                return kernels::kArrayOperationAdd;
+            }
+        };
+        
+        class ArraySubtract : public ArrayArithmetic {
+            std::string functionName() {
+                return "a-";
+            }
+            
+            kernels::ArrayOperation operation() {
+                return kernels::kArrayOperationSubtract;
+            }
+        };
+        
+        class ArrayMultiply : public ArrayArithmetic {
+            std::string functionName() {
+                return "a*";
+            }
+            
+            kernels::ArrayOperation operation() {
+                return kernels::kArrayOperationMultiply;
+            }
+        };
+        
+        class ArrayDivide : public ArrayArithmetic {
+            std::string functionName() {
+                return "a/";
+            }
+            
+            kernels::ArrayOperation operation() {
+                return kernels::kArrayOperationDivide;
+            }
+        };
+        
+        class ArraySum : public ArrayFunction {
+            std::string functionName() {
+                return "asum";
+            }
+            
+            int requiredNumberOfArguments() {
+                return 1;
+            }
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                Object *array = arguments[0];
+                requireArray(array);
+                
+                if (array->type() == Object::kObjectTypeLongArray) {
+                    return _gc_short->create(kernels::kernelTable().sumLongs(array->longArrayValue().data(), array->longArrayValue().size()));
+                }
+                
+                return _gc_short->create(kernels::kernelTable().sumDoubles(array->doubleArrayValue().data(), array->doubleArrayValue().size()));
+            }
+        };
+        
+        class ArrayMean : public ArrayFunction {
+            std::string functionName() {
+                return "amean";
+            }
+            
+            int requiredNumberOfArguments() {
+                return 1;
+            }
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                Object *array = arguments[0];
+                requireArray(array);
+                
+                const size_t length = arrayLength(array);
+                if (length == 0) {
+                    throw Error("amean of an empty array");
+                }
+                
+                double sum;
+                if (array->type() == Object::kObjectTypeLongArray) {
+                    sum = (double)kernels::kernelTable().sumLongs(array->longArrayValue().data(), length);
+                } else {
+                    sum = kernels::kernelTable().sumDoubles(array->doubleArrayValue().data(), length);
+                }
+                
+                return _gc_short->create(sum / length);
+            }
+        };
+        
+        class ArrayDot : public ArrayFunction {
+            std::string functionName() {
+                return "adot";
+            }
+            
+            int requiredNumberOfArguments() {
+                return 2;
+            }
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                requireArray(arguments[0]);
+                requireArray(arguments[1]);
+                
+                const size_t length = arrayLength(arguments[0]);
+                if (arrayLength(arguments[1]) != length) {
+                    throw Error("arrays passed to adot must be the same length");
+                }
+                
+                if (arguments[0]->type() == Object::kObjectTypeLongArray && arguments[1]->type() == Object::kObjectTypeLongArray) {
+                    const int64_t   *lhs = arguments[0]->longArrayValue().data(),
+                                    *rhs = arguments[1]->longArrayValue().data();
+                    
+                    uint64_t sum = 0;
+                    for (size_t index = 0; index < length; ++index) {
+                        sum += (uint64_t)lhs[index] * (uint64_t)rhs[index];
+                    }
+                    
+                    return _gc_short->create((int64_t)sum);
+                }
+                
+                std::vector<double> lhsBuffer, rhsBuffer;
+                return _gc_short->create(kernels::kernelTable().dotDoubles(doubleElements(arguments[0], lhsBuffer),
+                                                                                              doubleElements(arguments[1], rhsBuffer),
+                                                                                              length));
+            }
+        };
+        
+        /// (amin array) and (amax array)
+        class ArrayExtreme : public ArrayFunction {
+            int requiredNumberOfArguments() {
+                return 1;
+            }
+            
+            virtual bool maximum() = 0;
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                Object *array = arguments[0];
+                requireArray(array);
+                
+                if (arrayLength(array) == 0) {
+                    std::stringstream stringBuilder;
+                    
+                    stringBuilder   << functionName()
+                                    << " of an empty array";
+                    
+                    throw Error(stringBuilder.str());
+                }
+                
+                if (array->type() == Object::kObjectTypeLongArray) {
+                    std::vector<int64_t>& values = array->longArrayValue();
+                    int64_t extreme = maximum() ? *std::max_element(values.begin(), values.end()) : *std::min_element(values.begin(), values.end());
+                    
+                    return _gc_short->create(extreme);
+                }
+                
+                const kernels::KernelTable& table = kernels::kernelTable();
+                std::vector<double>& values = array->doubleArrayValue();
+                double extreme = maximum() ? table.maximumDouble(values.data(), values.size()) : table.minimumDouble(values.data(), values.size());
+                
+                return _gc_short->create(extreme);
+            }
+        };
+        
+        class ArrayMinimum : public ArrayExtreme {
+            std::string functionName() {
+                return "amin";
+            }
+            
+            bool maximum() {
+                return false;
+            }
+        };
+        
+        class ArrayMaximum : public ArrayExtreme {
+            std::string functionName() {
+                return "amax";
+            }
+            
+            bool maximum() {
+                return true;
+            }
+        };
+        
+        /// (amap f array), a new array of the same type holding f applied to each element
+        class ArrayMap : public ArrayFunction {
+            std::string functionName() {
+                return "amap";
+            }
+            
+            int requiredNumberOfArguments() {
+                return 2;
+            }
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                Object  *function = arguments[0],
+                        *array = arguments[1];
+                
+                requireArray(array);
+                
+                const size_t length = arrayLength(array);
+                Object *result = _gc_short->create(array->type(), length);
+                
+                ObjectList functionArguments(1);
+                for (size_t index = 0; index < length; ++index) {
+                    functionArguments[0] = boxedElement(array, index);
+                    setElement(result, index, _evaluator->apply(interpreterState, function, functionArguments));
+                }
+                
+                return result;
+            }
+        };
+        
+        /// (areduce f init array), folds f over the elements starting from init
+        class ArrayReduce : public ArrayFunction {
+            std::string functionName() {
+                return "areduce";
+            }
+            
+            int requiredNumberOfArguments() {
+                return 3;
+            }
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                Object  *function = arguments[0],
+                        *accumulator = arguments[1],
+                        *array = arguments[2];
+                
+                requireArray(array);
+                
+                const size_t length = arrayLength(array);
+                
+                ObjectList functionArguments(2);
+                for (size_t index = 0; index < length; ++index) {
+                    functionArguments[0] = accumulator;
+                    functionArguments[1] = boxedElement(array, index);
+                    accumulator = _evaluator->apply(interpreterState, function, functionArguments);
+                }
+                
+                return accumulator;
+            }
+        };
+        
+        /**
+         * base class for the dataset functions
+         *
+         * datasets are columnar, so these functions work a whole column at a time, only falling back to calling
+         * through the evaluator for each value when they are given an arbitrary predicate
+         */
+        class DatasetFunction : public ExtensionFunction {
+        protected:
+            Dataset& requireDataset(Object *object) {
+                if (object->type() != Object::kObjectTypeDataset) {
+                    std::stringstream stringBuilder;
+                    
+                    stringBuilder   << "the first argument to "
+                                    << functionName()
+                                    << " must be a dataset";
+                    
+                    throw Error(stringBuilder.str());
+                }
+                
+                return object->datasetValue();
+            }
+            
+            const Dataset::Column& requireColumn(Dataset& dataset, Object *nameObject) {
+                if (nameObject->type() != Object::kObjectTypeString) {
+                    throw Error("column names must be strings");
+                }
+                
+                int columnIndex = dataset.columnIndex(nameObject->stringValue());
+                if (columnIndex < 0) {
+                    std::stringstream stringBuilder;
+                    
+                    stringBuilder   << "the dataset has no column "
+                                    << nameObject->stringValue();
+                    
+                    throw Error(stringBuilder.str());
+                }
+                
+                return dataset.columns[columnIndex];
+            }
+        };
+        
+        /**
+         * (dataset "name" values "name" values ...)
+         *
+         * values can be a double-array or long-array, or a list or vector of all integers, all numbers or all strings
+         */
+        class MakeDataset : public DatasetFunction {
+            std::string functionName() {
+                return "dataset";
+            }
+            
+            void fillColumn(Dataset::Column& column, Object *values) {
+                if (values->type() == Object::kObjectTypeDoubleArray) {
+                    column.type = Dataset::kColumnTypeDouble;
+                    column.doubles = values->doubleArrayValue();
+                    return;
+                } else if (values->type() == Object::kObjectTypeLongArray) {
+                    column.type = Dataset::kColumnTypeLong;
+                    column.longs = values->longArrayValue();
+                    return;
+                }
+                
+                ObjectList elements;
+                if (!values->buildList(elements)) {
+                    throw Error("dataset columns must be arrays, lists or vectors");
+                }
+                
+                bool    allIntegers = true,
+                        allNumbers = true,
+                        allStrings = true;
+                
+                for (size_t index = 0; index < elements.size(); ++index) {
+                    bool number = elements[index]->type() == Object::kObjectTypeNumber;
+                    
+                    allNumbers &= number;
+                    allIntegers &= number && elements[index]->numberReference().getMode() == Number::kNumberModeInteger;
+                    allStrings &= elements[index]->type() == Object::kObjectTypeString;
+                }
+                
+                if (allIntegers) {
+                    column.type = Dataset::kColumnTypeLong;
+                    for (size_t index = 0; index < elements.size(); ++index) {
+                        column.longs.push_back(elements[index]->numberReference().rawInteger());
+                    }
+                } else if (allNumbers) {
+                    column.type = Dataset::kColumnTypeDouble;
+                    for (size_t index = 0; index < elements.size(); ++index) {
+                        column.doubles.push_back(elements[index]->numberReference().floatingValue());
+                    }
+                } else if (allStrings) {
+                    column.type = Dataset::kColumnTypeString;
+                    for (size_t index = 0; index < elements.size(); ++index) {
+                        column.strings.push_back(elements[index]->stringValue());
+                    }
+                } else {
+                    throw Error("dataset columns must be all numbers or all strings");
+                }
+            }
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                if (arguments.size() % 2 != 0) {
+                    throw Error("dataset requires pairs of column names and values");
+                }
+                
+                Dataset *dataset = new Dataset();
+                Object *result = _gc_short->create(dataset);
+                
+                for (size_t argumentIndex = 0; argumentIndex < arguments.size(); argumentIndex += 2) {
+                    if (arguments[argumentIndex]->type() != Object::kObjectTypeString) {
+                        throw Error("column names must be strings");
+                    }
+                    
+                    dataset->columns.push_back(Dataset::Column());
+                    dataset->columns.back().name = arguments[argumentIndex]->stringValue();
+                    fillColumn(dataset->columns.back(), arguments[argumentIndex + 1]);
+                    
+                    if (dataset->columns.back().size() != dataset->columns[0].size()) {
+                        throw Error("dataset columns must all be the same length");
+                    }
+                }
+                
+                return result;
+            }
+        };
+        
+        /// (column dataset "name"), the column as a primitive array or a vector of strings
+        class DatasetColumn : public DatasetFunction {
+            std::string functionName() {
+                return "column";
+            }
+            
+            int requiredNumberOfArguments() {
+                return 2;
+            }
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                Dataset& dataset = requireDataset(arguments[0]);
+                const Dataset::Column& column = requireColumn(dataset, arguments[1]);
+                
+                switch (column.type) {
+                    case Dataset::kColumnTypeDouble: {
+                        Object *result = _gc_short->create(Object::kObjectTypeDoubleArray, 0);
+                        result->doubleArrayValue() = column.doubles;
+                        return result;
+                    } break;
+                        
+                    case Dataset::kColumnTypeLong: {
+                        Object *result = _gc_short->create(Object::kObjectTypeLongArray, 0);
+                        result->longArrayValue() = column.longs;
+                        return result;
+                    } break;
+                        
+                    case Dataset::kColumnTypeString:
+                    default: {
+                        ObjectList strings;
+                        for (size_t row = 0; row < column.strings.size(); ++row) {
+                            strings.push_back(_gc_short->create(column.strings[row]));
+                        }
+                        return _gc_short->create(strings);
+                    } break;
+                }
+            }
+        };
+        
+        class DatasetRowCount : public DatasetFunction {
+            std::string functionName() {
+                return "row-count";
+            }
+            
+            int requiredNumberOfArguments() {
+                return 1;
+            }
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                return _gc_short->create((int64_t)requireDataset(arguments[0]).rowCount());
+            }
+        };
+        
+        class DatasetColumnNames : public DatasetFunction {
+            std::string functionName() {
+                return "column-names";
+            }
+            
+            int requiredNumberOfArguments() {
+                return 1;
+            }
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                Dataset& dataset = requireDataset(arguments[0]);
+                
+                ObjectList names;
+                for (size_t columnIndex = 0; columnIndex < dataset.columns.size(); ++columnIndex) {
+                    names.push_back(_gc_short->create(dataset.columns[columnIndex].name));
+                }
+                
+                return _gc_short->create(names);
+            }
+        };
+        
+        struct EqualComparison {
+            template <typename Lhs, typename Rhs>
+            static bool holds(const Lhs& lhs, const Rhs& rhs) {
+                return lhs == rhs;
+            }
+        };
+        
+        struct NotEqualComparison {
+            template <typename Lhs, typename Rhs>
+            static bool holds(const Lhs& lhs, const Rhs& rhs) {
+                return lhs != rhs;
+            }
+        };
+        
+        /**
+         * (where dataset "column" op value) or (where dataset "column" predicate)
+         *
+         * when op is one of the builtin comparisons the rows are selected by a kernel over the whole column,
+         * any other function is called once per row with that row's value
+         */
+        class Where : public DatasetFunction {
+            std::string functionName() {
+                return "where";
+            }
+            
+            int minimumNumberOfArguments() {
+                return 3;
+            }
+            
+            int maximumNumberOfArguments() {
+                return 4;
+            }
+            
+            /**
+             * append the index of every row where the comparison holds
+             *
+             * the index is always written and the count only advanced on a match, so the loop has no branch.  Each
+             * element is compared in place, a long column against a floating operand by the usual conversion
+             */
+            template <class Comparison, typename Element, typename Operand>
+            static void selectRows(const std::vector<Element>& values, const Operand& operand, std::vector<size_t>& rows) {
+                rows.resize(values.size());
+                
+                size_t selected = 0;
+                for (size_t row = 0; row < values.size(); ++row) {
+                    rows[selected] = row;
+                    selected += Comparison::holds(values[row], operand);
+                }
+                
+                rows.resize(selected);
+            }
+            
+            template <class Comparison>
+            static void selectColumn(const Dataset::Column& column, Object *operand, std::vector<size_t>& rows) {
+                if (column.type == Dataset::kColumnTypeString) {
+                    if (operand->type() != Object::kObjectTypeString) {
+                        throw Error("string columns can only be compared with strings");
+                    }
+                    
+                    selectRows<Comparison>(column.strings, operand->stringValue(), rows);
+                    return;
+                }
+                
+                if (operand->type() != Object::kObjectTypeNumber) {
+                    throw Error("numeric columns can only be compared with numbers");
+                }
+                
+                const Number& number = operand->numberReference();
+                
+                if (column.type == Dataset::kColumnTypeLong && number.getMode() == Number::kNumberModeInteger) {
+                    selectRows<Comparison>(column.longs, number.rawInteger(), rows);
+                } else if (column.type == Dataset::kColumnTypeLong) {
+                    selectRows<Comparison>(column.longs, number.floatingValue(), rows);
+                } else {
+                    selectRows<Comparison>(column.doubles, number.floatingValue(), rows);
+                }
+            }
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                Dataset& dataset = requireDataset(arguments[0]);
+                const Dataset::Column& column = requireColumn(dataset, arguments[1]);
+                Object *function = arguments[2];
+                
+                std::vector<size_t> rows;
+                
+                if (arguments.size() == 4) {
+                    std::string comparisonName;
+                    if (function->type() == Object::kObjectTypeBuiltinFunction) {
+                        comparisonName = function->functionValueExtensionFunction()->functionName();
+                    }
+                    
+                    if (comparisonName == "<") {
+                        selectColumn<LessThanComparison>(column, arguments[3], rows);
+                    } else if (comparisonName == ">") {
+                        selectColumn<GreaterThanComparison>(column, arguments[3], rows);
+                    } else if (comparisonName == "<=") {
+                        selectColumn<LessThanOrEqualComparison>(column, arguments[3], rows);
+                    } else if (comparisonName == ">=") {
+                        selectColumn<GreaterThanOrEqualComparison>(column, arguments[3], rows);
+                    } else if (comparisonName == "=") {
+                        selectColumn<EqualComparison>(column, arguments[3], rows);
+                    } else if (comparisonName == "not=") {
+                        selectColumn<NotEqualComparison>(column, arguments[3], rows);
+                    } else {
+                        throw Error("where with a value requires one of < > <= >= = not=");
+                    }
+                } else {
+                    // an arbitrary predicate, so evaluate it a row at a time
+                    ObjectList predicateArguments(1);
+                    
+                    for (size_t row = 0; row < column.size(); ++row) {
+                        switch (column.type) {
+                            case Dataset::kColumnTypeDouble:
+                                predicateArguments[0] = _gc_short->create(column.doubles[row]);
+                                break;
+                                
+                            case Dataset::kColumnTypeLong:
+                                predicateArguments[0] = _gc_short->create(column.longs[row]);
+                                break;
+                                
+                            case Dataset::kColumnTypeString:
+                                predicateArguments[0] = _gc_short->create(column.strings[row]);
+                                break;
+                        }
+                        
+                        if (_evaluator->apply(interpreterState, function, predicateArguments)->coerceBoolean()) {
+                            rows.push_back(row);
+                        }
+                    }
+                }
+                
+                return _gc_short->create(dataset.takeRows(rows));
+            }
+        };
+        
+        /// (select dataset "column" ...), a dataset with just the named columns
+        class Select : public DatasetFunction {
+            std::string functionName() {
+                return "select";
+            }
+            
+            int minimumNumberOfArguments() {
+                return 2;
+            }
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                Dataset& dataset = requireDataset(arguments[0]);
+                
+                Dataset *result = new Dataset();
+                Object *resultObject = _gc_short->create(result);
+                
+                for (size_t argumentIndex = 1; argumentIndex < arguments.size(); ++argumentIndex) {
+                    result->columns.push_back(requireColumn(dataset, arguments[argumentIndex]));
+                }
+                
+                return resultObject;
+            }
+        };
+        
+        /**
+         * (group-by-agg dataset "key" "value" "aggregate")
+         *
+         * aggregate is one of "sum", "count", "mean", "min" or "max".  The result has one row per distinct key, in the
+         * order each key is first seen, with the key column and a "value-aggregate" column.  Rows are assigned to
+         * groups in one pass over the key column, then the value column is folded into per group accumulators in a
+         * second pass.
+         */
+        class GroupByAggregate : public DatasetFunction {
+            std::string functionName() {
+                return "group-by-agg";
+            }
+            
+            int requiredNumberOfArguments() {
+                return 4;
+            }
+            
+            template <typename Key>
+            static void assignGroups(const std::vector<Key>& keys, std::vector<size_t>& groupOfRow, std::vector<size_t>& firstRowOfGroup) {
+                std::map<Key, size_t> groupOfKey;
+                
+                groupOfRow.resize(keys.size());
+                for (size_t row = 0; row < keys.size(); ++row) {
+                    typename std::map<Key, size_t>::iterator it = groupOfKey.find(keys[row]);
+                    
+                    if (it == groupOfKey.end()) {
+                        it = groupOfKey.insert(std::make_pair(keys[row], firstRowOfGroup.size())).first;
+                        firstRowOfGroup.push_back(row);
+                    }
+                    
+                    groupOfRow[row] = it->second;
+                }
+            }
+            
+            static void storeAccumulators(const std::vector<double>& accumulators, Dataset::Column& result) {
+                result.type = Dataset::kColumnTypeDouble;
+                result.doubles = accumulators;
+            }
+            
+            static void storeAccumulators(const std::vector<int64_t>& accumulators, Dataset::Column& result) {
+                result.type = Dataset::kColumnTypeLong;
+                result.longs = accumulators;
+            }
+            
+            /**
+             * the aggregates, each folds a row's value into its group's accumulator and stores the finished column
+             *
+             * a group's first value is copied into its accumulator, fold is only called for the rest.  LongAccumulator
+             * is the accumulator type used for a long column
+             */
+            struct StoredAggregate {
+                typedef int64_t LongAccumulator;
+                
+                template <typename Accumulator>
+                static void store(const std::vector<Accumulator>& accumulators, const std::vector<int64_t>& counts, Dataset::Column& result) {
+                    storeAccumulators(accumulators, result);
+                }
+            };
+            
+            struct SumAggregate : StoredAggregate {
+                template <typename Accumulator, typename Value>
+                static void fold(Accumulator& accumulator, const Value& value) {
+                    accumulator += value;
+                }
+                
+                /// a long column has nowhere to put a BigInteger, so an overflowing sum is an error
+                static void fold(int64_t& accumulator, const int64_t& value) {
+                    if (__builtin_add_overflow(accumulator, value, &accumulator)) {
+                        throw Error("group-by-agg sum overflows a long column");
+                    }
+                }
+            };
+            
+            /// sums into a double, so a mean of a long column can't overflow
+            struct MeanAggregate {
+                typedef double LongAccumulator;
+                
+                static void fold(double& accumulator, double value) {
+                    accumulator += value;
+                }
+                
+                static void store(const std::vector<double>& accumulators, const std::vector<int64_t>& counts, Dataset::Column& result) {
+                    result.type = Dataset::kColumnTypeDouble;
+                    for (size_t group = 0; group < accumulators.size(); ++group) {
+                        result.doubles.push_back(accumulators[group] / counts[group]);
+                    }
+                }
+            };
+            
+            struct MinAggregate : StoredAggregate {
+                template <typename Value>
+                static void fold(Value& accumulator, const Value& value) {
+                    accumulator = value < accumulator ? value : accumulator;
+                }
+            };
+            
+            struct MaxAggregate : StoredAggregate {
+                template <typename Value>
+                static void fold(Value& accumulator, const Value& value) {
+                    accumulator = value > accumulator ? value : accumulator;
+                }
+            };
+            
+            struct CountAggregate {
+                typedef int64_t LongAccumulator;
+                
+                template <typename Accumulator, typename Value>
+                static void fold(Accumulator& accumulator, const Value& value) {
+                }
+                
+                template <typename Accumulator>
+                static void store(const std::vector<Accumulator>& accumulators, const std::vector<int64_t>& counts, Dataset::Column& result) {
+                    result.type = Dataset::kColumnTypeLong;
+                    result.longs = counts;
+                }
+            };
+            
+            template <class Aggregate, typename Accumulator, typename Value>
+            static void aggregate(const std::vector<Value>& values, const std::vector<size_t>& groupOfRow, size_t groupCount, Dataset::Column& result) {
+                std::vector<Accumulator> accumulators(groupCount, 0);
+                std::vector<int64_t> counts(groupCount, 0);
+                
+                for (size_t row = 0; row < values.size(); ++row) {
+                    const size_t group = groupOfRow[row];
+                    
+                    if (counts[group] == 0) {
+                        accumulators[group] = values[row];
+                    } else {
+                        Aggregate::fold(accumulators[group], values[row]);
+                    }
+                    
+                    ++counts[group];
+                }
+                
+                Aggregate::store(accumulators, counts, result);
+            }
+            
+            /// the value column is switched on once, the per row loop is specialised for both the aggregate and the column type
+            template <class Aggregate>
+            static void aggregateColumn(const Dataset::Column& values, const std::vector<size_t>& groupOfRow, size_t groupCount, Dataset::Column& result) {
+                switch (values.type) {
+                    case Dataset::kColumnTypeDouble:
+                        aggregate<Aggregate, double>(values.doubles, groupOfRow, groupCount, result);
+                        break;
+                        
+                    case Dataset::kColumnTypeLong:
+                        aggregate<Aggregate, typename Aggregate::LongAccumulator>(values.longs, groupOfRow, groupCount, result);
+                        break;
+                        
+                    case Dataset::kColumnTypeString:
+                        // only count is allowed, which doesn't look at the values
+                        aggregate<CountAggregate, int64_t>(std::vector<int64_t>(values.strings.size(), 0), groupOfRow, groupCount, result);
+                        break;
+                }
+            }
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                Dataset& dataset = requireDataset(arguments[0]);
+                const Dataset::Column   &keyColumn = requireColumn(dataset, arguments[1]),
+                                        &valueColumn = requireColumn(dataset, arguments[2]);
+                
+                if (arguments[3]->type() != Object::kObjectTypeString) {
+                    throw Error("the aggregate passed to group-by-agg must be a string");
+                }
+                
+                const std::string aggregateName = arguments[3]->stringValue();
+                if (aggregateName != "sum" && aggregateName != "count" && aggregateName != "mean"
+                    && aggregateName != "min" && aggregateName != "max") {
+                    throw Error("group-by-agg aggregates are sum, count, mean, min and max");
+                }
+                
+                if (valueColumn.type == Dataset::kColumnTypeString && aggregateName != "count") {
+                    throw Error("string columns can only be counted");
+                }
+                
+                std::vector<size_t> groupOfRow, firstRowOfGroup;
+                switch (keyColumn.type) {
+                    case Dataset::kColumnTypeDouble:
+                        assignGroups(keyColumn.doubles, groupOfRow, firstRowOfGroup);
+                        break;
+                        
+                    case Dataset::kColumnTypeLong:
+                        assignGroups(keyColumn.longs, groupOfRow, firstRowOfGroup);
+                        break;
+                        
+                    case Dataset::kColumnTypeString:
+                        assignGroups(keyColumn.strings, groupOfRow, firstRowOfGroup);
+                        break;
+                }
+                
+                Dataset *result = new Dataset();
+                Object *resultObject = _gc_short->create(result);
+                
+                result->columns.resize(2);
+                
+                Dataset::Column& resultKeys = result->columns[0];
+                resultKeys.name = keyColumn.name;
+                resultKeys.type = keyColumn.type;
+                for (size_t group = 0; group < firstRowOfGroup.size(); ++group) {
+                    resultKeys.appendRow(keyColumn, firstRowOfGroup[group]);
+                }
+                
+                Dataset::Column& resultValues = result->columns[1];
+                resultValues.name = valueColumn.name + "-" + aggregateName;
+                
+                const size_t groupCount = firstRowOfGroup.size();
+                
+                if (aggregateName == "sum") {
+                    aggregateColumn<SumAggregate>(valueColumn, groupOfRow, groupCount, resultValues);
+                } else if (aggregateName == "mean") {
+                    aggregateColumn<MeanAggregate>(valueColumn, groupOfRow, groupCount, resultValues);
+                } else if (aggregateName == "min") {
+                    aggregateColumn<MinAggregate>(valueColumn, groupOfRow, groupCount, resultValues);
+                } else if (aggregateName == "max") {
+                    aggregateColumn<MaxAggregate>(valueColumn, groupOfRow, groupCount, resultValues);
+                } else {
+                    aggregateColumn<CountAggregate>(valueColumn, groupOfRow, groupCount, resultValues);
+                }
+                
+                return resultObject;
+            }
+        };
+        
+        /// (sort-by-column dataset "column") or (sort-by-column dataset "column" "desc"), a stable sort of the rows
+        class SortByColumn : public DatasetFunction {
+            std::string functionName() {
+                return "sort-by-column";
+            }
+            
+            int minimumNumberOfArguments() {
+                return 2;
+            }
+            
+            int maximumNumberOfArguments() {
+                return 3;
+            }
+            
+            /// sort the permutation of row indices rather than moving every column
+            template <typename Value>
+            static void sortRows(const std::vector<Value>& values, bool descending, std::vector<size_t>& rows) {
+                if (descending) {
+                    std::stable_sort(rows.begin(), rows.end(), [&values](size_t lhs, size_t rhs) {
+                        return values[rhs] < values[lhs];
+                    });
+                } else {
+                    std::stable_sort(rows.begin(), rows.end(), [&values](size_t lhs, size_t rhs) {
+                        return values[lhs] < values[rhs];
+                    });
+                }
+            }
+            
+            Object *execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                Dataset& dataset = requireDataset(arguments[0]);
+                const Dataset::Column& column = requireColumn(dataset, arguments[1]);
+                
+                bool descending = false;
+                if (arguments.size() == 3) {
+                    if (arguments[2]->type() != Object::kObjectTypeString
+                        || (arguments[2]->stringValue() != "asc" && arguments[2]->stringValue() != "desc")) {
+                        throw Error("the sort order must be \"asc\" or \"desc\"");
+                    }
+                    
+                    descending = arguments[2]->stringValue() == "desc";
+                }
+                
+                std::vector<size_t> rows(column.size());
+                for (size_t row = 0; row < rows.size(); ++row) {
+                    rows[row] = row;
+                }
+                
+                switch (column.type) {
+                    case Dataset::kColumnTypeDouble:
+                        sortRows(column.doubles, descending, rows);
+                        break;
+                        
+                    case Dataset::kColumnTypeLong:
+                        sortRows(column.longs, descending, rows);
+                        break;
+                        
+                    case Dataset::kColumnTypeString:
+                        sortRows(column.strings, descending, rows);
+                        break;
+                }
+                
+                return _gc_short->create(dataset.takeRows(rows));
+            }
+        };
+        
+        class Nth : public ExtensionFunction {
+            std::string functionName() {
+                return "nth";
+            }
+            
+            int minimumNumberOfArguments() {
+                return 2;
+            }
+            
+            int maximumNumberOfArguments() {
+                return 3;
+            }
+            
+            Object* execute(ObjectList arguments, InterpreterScope *interpreterState) {
+                Object  *collection = arguments[0],
+                        *indexValue = arguments[1],
+                        *defaultValue = NULL;
+                
+                if (arguments.size()==3) {
+                    defaultValue = arguments[2];
+                }
+                
+                if (indexValue->type()!=Object::kObjectTypeNumber) {
+                    throw Error("second argument to nth must be an index");
+                }
+                
+                const int index = indexValue->numberValue().integerValue();
+                
+                ObjectList convertedList;
+                if (!collection->buildList(convertedList)) {
+                    throw Error("first argument to nth must be a collection");
+                }
+                
+                if (index < convertedList.size()) {
+                    if (index >= 0) {
+                        return convertedList[index];
+                    } else {
+                        throw Error("index to nth is < 0");
+                    }
+                } else {
+                    // out of bounds.  this is an exception if no default value is supplied
+                    if (defaultValue) {
+                        return defaultValue;
+                    } else {
+                        throw Error("index to nth is out of bounds");
+                    }
+                }
+            }
+        };
+    }
+    
+#pragma mark -
+#pragma mark Dataset
+    
+    size_t Dataset::Column::size() const {
+        switch (type) {
+            case kColumnTypeDouble:
+                return doubles.size();
+                break;
+                
+            case kColumnTypeLong:
+                return longs.size();
+                break;
+                
+            case kColumnTypeString:
+            default:
+                return strings.size();
+                break;
+        }
+    }
+    
+    void Dataset::Column::appendRow(const Column& source, size_t sourceRow) {
+        switch (type) {
+            case kColumnTypeDouble:
+                doubles.push_back(source.doubles[sourceRow]);
+                break;
+                
+            case kColumnTypeLong:
+                longs.push_back(source.longs[sourceRow]);
+                break;
+                
+            case kColumnTypeString:
+                strings.push_back(source.strings[sourceRow]);
+                break;
+        }
+    }
+    
+    size_t Dataset::rowCount() const {
+        return columns.size() ? columns[0].size() : 0;
+    }
+    
+    size_t Dataset::storageSize() const {
+        size_t bytes = sizeof(Dataset) + columns.capacity() * sizeof(Column);
+        
+        for (size_t index = 0; index < columns.size(); ++index) {
+            const Column& column = columns[index];
+            bytes += column.name.capacity() + column.doubles.capacity() * sizeof(double) + column.longs.capacity() * sizeof(int64_t);
+            bytes += column.strings.capacity() * sizeof(std::string);
+            
+            for (size_t row = 0; row < column.strings.size(); ++row) {
+                bytes += column.strings[row].capacity();
+            }
+        }
+        
+        return bytes;
+    }
+    
+    int Dataset::columnIndex(const std::string& name) const {
+        for (size_t index = 0; index < columns.size(); ++index) {
+            if (columns[index].name == name) {
+                return (int)index;
+            }
+        }
+        
+        return -1;
+    }
+    
+    Dataset* Dataset::takeRows(const std::vector<size_t>& rows) const {
+        Dataset *result = new Dataset();
+        result->columns.resize(columns.size());
+        
+        for (size_t index = 0; index < columns.size(); ++index) {
+            const Column& source = columns[index];
+            Column& destination = result->columns[index];
+            
+            destination.name = source.name;
+            destination.type = source.type;
+            
+            // gather each column in its own pass so the loop stays on one contiguous vector
+            switch (source.type) {
+                case kColumnTypeDouble:
+                    destination.doubles.resize(rows.size());
+                    for (size_t row = 0; row < rows.size(); ++row) {
+                        destination.doubles[row] = source.doubles[rows[row]];
+                    }
+                    break;
+                    
+                case kColumnTypeLong:
+                    destination.longs.resize(rows.size());
+                    for (size_t row = 0; row < rows.size(); ++row) {
+                        destination.longs[row] = source.longs[rows[row]];
+                    }
+                    break;
+                    
+                case kColumnTypeString:
+                    destination.strings.reserve(rows.size());
+                    for (size_t row = 0; row < rows.size(); ++row) {
+                        destination.strings.push_back(source.strings[rows[row]]);
+                    }
+                    break;
+            }
+        }
+        
+        return result;
+    }
+    
+#pragma mark -
+#pragma mark InterpreterScope
+    
+    Object* InterpreterScope::lookupSymbolInScope(const std::string& symbolName) {
+        std::map<std::string, Object*>::iterator it = _symbolTable.find(symbolName);
+        
+        if (it == _symbolTable.end()) {
+            return NULL;
+        } else {
+            return it->second;
+        }
+    }
+    
+    void InterpreterScope::setSymbolInScope(std::string symbolName, Object *functionValue) {
+        if (_writeBarrier) {
+            _writeBarrier->writeBarrier(functionValue);
+        }
+        
+        _symbolTable[symbolName] = functionValue;
+        _symbolFilter |= symbolFilterBit(std::hash<std::string>()(symbolName));
+    }
+    
+    void InterpreterScope::markValues(GarbageCollector& collector) {
+        for (std::map<std::string, Object*>::iterator it = _symbolTable.begin(); it != _symbolTable.end(); ++it) {
+            collector.markObject(it->second);
+        }
+    }
+
+    Object* InterpreterScope::lookupSymbol(const std::string& symbolName) {
+        uint64_t symbolBit = symbolFilterBit(std::hash<std::string>()(symbolName));
+        
+        // a loop rather than recursion, as scope chains are as deep as the evaluation that made them
+        for (InterpreterScope *scope = this; scope; ) {
+            if (scope->_symbolFilter & symbolBit) {
+                Object *ret = scope->lookupSymbolInScope(symbolName);
+                if (ret) {
+                    return ret;
+                }
+            }
+            
+            if (scope != _rootScope && !(scope->_ancestorFilter & symbolBit)) {
+                scope = _rootScope;
+            } else {
+                scope = scope->_parentScope;
+            }
+        }
+        
+        return NULL;
+    }
+
+    Object* InterpreterScope::removeSymbolInScope(std::string symbolName) {
+        Object* ret = lookupSymbolInScope(symbolName);
+        _symbolTable.erase(symbolName);
+        return ret;
+    }
+
+    Object* InterpreterScope::removeSymbol(std::string symbolName) {
+        Object* ret = removeSymbolInScope(symbolName);
+
+        if (ret) {
+            return ret;
+        } else {
+            if (_parentScope) {
+                return _parentScope->removeSymbol(symbolName);
+            } else {
+                return NULL;
+            }
+        }
+    }
+
+
+#pragma mark -
+#pragma mark Object
+    
+    namespace {
+        /// the object pool is bypassed under AddressSanitizer so that use after free is still caught
+        const bool kObjectPool =
+#if defined(__SANITIZE_ADDRESS__)
+            false;
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+            false;
+#else
+            true;
+#endif
+#else
+            true;
+#endif
+        
+        const size_t kObjectCellSize = 32, kCacheLineSize = 64, kCellsPerSlab = 2048;
+        
+        /**
+         * a free list of fixed size cells for Objects, one per thread, so interpreters on different threads never share it
+         *
+         * cells are carved out of 64 byte aligned slabs, and are a power of two in size, so no object straddles a
+         * cache line.  A freed cell goes on the list of the thread that frees it, which needn't be the one that
+         * allocated it.  Slabs are never returned, the cells of a thread that exits are left on a shared list, which
+         * a thread takes before it carves a new slab.
+         */
+        class ObjectCellCache {
+        public:
+            ObjectCellCache() : _freeCells(NULL), _slabCursor(NULL), _slabEnd(NULL) {
+            }
+            
+            ~ObjectCellCache() {
+                // the rest of the slab is freed too, so all the cells are on the one list
+                for (; _slabCursor != _slabEnd; _slabCursor += kObjectCellSize) {
+                    release(_slabCursor);
+                }
+                
+                if (!_freeCells) {
+                    return;
+                }
+                
+                void *lastCell = _freeCells;
+                while (*(void**)lastCell) {
+                    lastCell = *(void**)lastCell;
+                }
+                
+                std::lock_guard<std::mutex> lock(sharedCellsMutex);
+                *(void**)lastCell = sharedCells;
+                sharedCells = _freeCells;
+                _freeCells = NULL;
+            }
+            
+            void *allocate() {
+                if (!_freeCells && _slabCursor == _slabEnd) {
+                    std::lock_guard<std::mutex> lock(sharedCellsMutex);
+                    _freeCells = sharedCells;
+                    sharedCells = NULL;
+                }
+                
+                if (_freeCells) {
+                    void *cell = _freeCells;
+                    _freeCells = *(void**)cell;
+                    return cell;
+                }
+                
+                if (_slabCursor == _slabEnd) {
+                    char *slab = (char*)::operator new(kObjectCellSize * kCellsPerSlab + kCacheLineSize);
+                    
+                    _slabCursor = slab + (kCacheLineSize - (uintptr_t)slab % kCacheLineSize) % kCacheLineSize;
+                    _slabEnd = _slabCursor + kObjectCellSize * kCellsPerSlab;
+                }
+                
+                void *cell = _slabCursor;
+                _slabCursor += kObjectCellSize;
+                return cell;
+            }
+            
+            void release(void *cell) {
+                *(void**)cell = _freeCells;
+                _freeCells = cell;
+            }
+            
+        private:
+            void *_freeCells;
+            char *_slabCursor, *_slabEnd;
+            
+            /// the cells left by threads that have exited
+            static std::mutex sharedCellsMutex;
+            static void *sharedCells;
+        };
+        
+        std::mutex ObjectCellCache::sharedCellsMutex;
+        void *ObjectCellCache::sharedCells = NULL;
+        
+        thread_local ObjectCellCache objectCells;
+    }
+    
+    void* Object::operator new(size_t size) {
+        static_assert(sizeof(Object) <= kObjectCellSize, "Object no longer fits in its cell");
+        
+        if (!kObjectPool || size > kObjectCellSize) {
+            return ::operator new(size);
+        }
+        
+        return objectCells.allocate();
+    }
+    
+    void Object::operator delete(void *pointer) {
+        if (!pointer) {
+            return;
+        }
+        
+        if (!kObjectPool) {
+            ::operator delete(pointer);
+            return;
+        }
+        
+        objectCells.release(pointer);
+    }
+    
+    namespace {
+        /// the splitmix64 finaliser, spreads every input bit across the result
+        uint64_t mixHash(uint64_t hash) {
+            hash ^= hash >> 30;
+            hash *= 0xbf58476d1ce4e5b9ULL;
+            hash ^= hash >> 27;
+            hash *= 0x94d049bb133111ebULL;
+            hash ^= hash >> 31;
+            return hash;
+        }
+        
+        /// order dependent combination, so (1 2) and (2 1) hash differently
+        uint64_t combineHashes(uint64_t seed, uint64_t hash) {
+            return mixHash(seed ^ (hash + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2)));
+        }
+        
+        /// 64 bit FNV-1a
+        uint64_t hashBytes(const char *bytes, size_t length) {
+            uint64_t hash = 0xcbf29ce484222325ULL;
+            
+            for (size_t index = 0; index < length; ++index) {
+                hash ^= (unsigned char)bytes[index];
+                hash *= 0x100000001b3ULL;
+            }
+            
+            return mixHash(hash);
+        }
+    }
+    
+    uint64_t Object::hashValue() {
+        bool cacheable;
+        return hashValue(cacheable);
+    }
+    
+    uint64_t Object::hashValue(bool& cacheable) {
+        cacheable = true;
+        
+        if (_flags & kObjectFlagHashCached) {
+            return _hash;
+        }
+        
+        uint64_t hash = mixHash(_type + 1);
+        bool elementCacheable;
+        
+        switch (_type) {
+            case kObjectTypeNil:
+                break;
+                
+            case kObjectTypeBoolean:
+                hash = combineHashes(hash, _contents.booleanValue);
+                break;
+                
+            case kObjectTypeNumber:
+                hash = combineHashes(hash, numberPointer()->hashValue());
+                break;
+                
+            case kObjectTypeString:
+            case kObjectTypeSymbol:
+                hash = combineHashes(hash, hashBytes(stringCharacters(), stringLength()));
+                break;
+                
+            case kObjectTypeBuiltinFunction: {
+                // builtins are equal when their names are
+                std::string name = _contents.builtinFunctionValue.extensionFunctionPointer->functionName();
+                hash = combineHashes(hash, hashBytes(name.data(), name.size()));
+            } break;
+                
+            case kObjectTypeClosure:
+                hash = combineHashes(hash, _contents.functionValue.objectPointer->hashValue(elementCacheable));
+                cacheable = elementCacheable;
+                break;
+                
+            case kObjectTypeVector:
+                for (size_t elementIndex = 0; elementIndex < _contents.vectorPointer->size(); ++elementIndex) {
+                    hash = combineHashes(hash, (*_contents.vectorPointer)[elementIndex]->hashValue(elementCacheable));
+                    cacheable &= elementCacheable;
+                }
+                break;
+                
+            case kObjectTypeCons: {
+                // walk the spine and hash it from the tail, so long lists don't recurse, caching each cell as we go
+                // until one holds something that can change
+                ObjectList spine;
+                Object *cell = this;
+                
+                while (cell->_type == kObjectTypeCons && !(cell->_flags & kObjectFlagHashCached)) {
+                    spine.push_back(cell);
+                    cell = cell->_contents.consValue.right;
+                }
+                
+                uint64_t tailHash = cell->hashValue(cacheable);
+                
+                for (size_t spineIndex = spine.size(); spineIndex-- > 0; ) {
+                    uint64_t elementHash = spine[spineIndex]->_contents.consValue.left->hashValue(elementCacheable);
+                    cacheable &= elementCacheable;
+                    
+                    tailHash = combineHashes(combineHashes(hash, elementHash), tailHash);
+                    if (cacheable) {
+                        spine[spineIndex]->cacheHash(tailHash);
+                    }
+                }
+                
+                return tailHash;
+            } break;
+                
+            case kObjectTypeDoubleArray:
+                cacheable = false;
+                for (size_t elementIndex = 0; elementIndex < _contents.doubleArrayPointer->size(); ++elementIndex) {
+                    hash = combineHashes(hash, Number((*_contents.doubleArrayPointer)[elementIndex]).hashValue());
+                }
+                break;
+                
+            case kObjectTypeLongArray:
+                cacheable = false;
+                for (size_t elementIndex = 0; elementIndex < _contents.longArrayPointer->size(); ++elementIndex) {
+                    hash = combineHashes(hash, Number((*_contents.longArrayPointer)[elementIndex]).hashValue());
+                }
+                break;
+                
+            case kObjectTypeDataset:
+                cacheable = false;
+                for (size_t columnIndex = 0; columnIndex < _contents.datasetPointer->columns.size(); ++columnIndex) {
+                    const Dataset::Column& column = _contents.datasetPointer->columns[columnIndex];
+                    hash = combineHashes(hash, hashBytes(column.name.data(), column.name.size()));
+                    hash = combineHashes(hash, column.size());
+                }
+                break;
+        }
+        
+        if (cacheable) {
+            cacheHash(hash);
+        }
+        
+        return hash;
+    }
+    
+    Object::Object() {
+        _type = kObjectTypeNil;
+        _flags = 0;
+        _regionDepth = 0;
+        _sourcePosition = 0;
+    }
+    
+    Object::Object(std::string stringVal, bool symbol) {
+        _type = symbol ? kObjectTypeSymbol : kObjectTypeString;
+        _regionDepth = 0;
+        _sourcePosition = 0;
+        setString(stringVal);
+    }
+    
+    void Object::setString(const std::string& value) {
+        if (value.size() <= kInlineStringCapacity) {
+            _flags = kObjectFlagInlineString;
+            _inlineStringLength = (uint8_t)value.size();
+            memcpy(_contents.inlineString, value.data(), value.size());
+        } else {
+            _flags = 0;
+            _contents.stringPointer = new std::string(value);
+        }
+    }
+    
+    Object::Object(Object *code, ObjectList arguments) {
+        _type = kObjectTypeClosure;
+        _flags = 0;
+        _regionDepth = 0;
+        _sourcePosition = 0;
+        _contents.functionValue.objectPointer = code;
+        _contents.functionValue.argumentSymbols = new ObjectList(arguments);
+    }
+
+    Object::Object(Object *code, ObjectList arguments, bool macro) {
+        _type = kObjectTypeClosure;
+        _flags = macro ? kObjectFlagMacro : 0;
+        _regionDepth = 0;
+        _sourcePosition = 0;
+        _contents.functionValue.objectPointer = code;
+        _contents.functionValue.argumentSymbols = new ObjectList(arguments);
+    }
+
+    Object::Object(ExtensionFunction *function) {
+        _type = kObjectTypeBuiltinFunction;
+        _flags = 0;
+        _regionDepth = 0;
+        _sourcePosition = 0;
+        _contents.builtinFunctionValue.extensionFunctionPointer = function;
+    }
+    
+    Object::Object(ObjectType arrayType, size_t length) {
+        _type = arrayType;
+        _flags = 0;
+        _regionDepth = 0;
+        _sourcePosition = 0;
+        
+        if (arrayType == kObjectTypeLongArray) {
+            _contents.longArrayPointer = new std::vector<int64_t>(length, 0);
+        } else {
+            _type = kObjectTypeDoubleArray;
+            _contents.doubleArrayPointer = new std::vector<double>(length, 0.0);
+        }
+    }
+    
+    Object::Object(Dataset *dataset) {
+        _type = kObjectTypeDataset;
+        _flags = 0;
+        _regionDepth = 0;
+        _sourcePosition = 0;
+        _contents.datasetPointer = dataset;
+    }
+
+    // Creates a deep copy of an object
+    // Does not have the ability to clone built in functions
+    Object::Object(Object* oldObj, GarbageCollector* gc) {
+        gc->countCopy();
+
+        _type = oldObj->_type;
+        _flags = oldObj->_flags & ~(kObjectFlagCanonical | kObjectFlagMarked);
+        _regionDepth = 0;
+        _sourcePosition = oldObj->_sourcePosition;
+        if (_flags & kObjectFlagHashCached) {
+            _hash = oldObj->_hash;
+        }
+
+        switch (_type) {
+
+            case kObjectTypeSymbol:
+            case kObjectTypeString:
+                setString(oldObj->stringValue());
+                break;
+
+            case kObjectTypeVector:
+                _contents.vectorPointer = new ObjectList();
+
+                for(unsigned i = 0; i < oldObj->_contents.vectorPointer->size(); ++i)
+                    _contents.vectorPointer->push_back(deepCopy(oldObj->_contents.vectorPointer->at(i), gc));
+                break;
+
+            case kObjectTypeClosure:
+                _contents.functionValue.objectPointer = deepCopy(oldObj->_contents.functionValue.objectPointer, gc);
+
+                _contents.functionValue.argumentSymbols = new ObjectList();
+
+                for(unsigned i = 0; i < oldObj->_contents.functionValue.argumentSymbols->size(); ++i)
+                    _contents.functionValue.argumentSymbols->push_back(deepCopy(oldObj->_contents.functionValue.argumentSymbols->at(i), gc));
+                break;
+
+            case kObjectTypeNumber:
+                new (_contents.numberStorage) Number(*oldObj->numberPointer());
+                break;
+
+            case kObjectTypeDoubleArray:
+                _contents.doubleArrayPointer = new std::vector<double>(*oldObj->_contents.doubleArrayPointer);
+                break;
+
+            case kObjectTypeLongArray:
+                _contents.longArrayPointer = new std::vector<int64_t>(*oldObj->_contents.longArrayPointer);
+                break;
+
+            case kObjectTypeDataset:
+                _contents.datasetPointer = new Dataset(*oldObj->_contents.datasetPointer);
+                break;
+
+            case kObjectTypeCons:
+                _contents.consValue.left = deepCopy(oldObj->consValueLeft(), gc);
+                _contents.consValue.right = deepCopy(oldObj->consValueRight(), gc);
+                break;
+
+            // Does not deep copy built in functions
+            case kObjectTypeBuiltinFunction:
+                _contents.builtinFunctionValue = oldObj->_contents.builtinFunctionValue;
+                break;
+
+            case kObjectTypeBoolean:
+                _contents.booleanValue = oldObj->_contents.booleanValue;
+                break;
+
+            case kObjectTypeNil:
+                break;
+        }
+    }
+
+    Object* Object::deepCopy(Object *object, GarbageCollector *gc) {
+        if (object->isCanonical()) {
+            return object;
+        }
+        
+        return gc->create(object, gc);
+    }
+
+    Object::~Object() {
+        switch (_type) {
+            case kObjectTypeSymbol:
+            case kObjectTypeString:
+                if (!(_flags & kObjectFlagInlineString)) {
+                    delete _contents.stringPointer;
+                }
+                break;
+                                
+            case kObjectTypeVector:
+                delete _contents.vectorPointer;
+                break;
+            
+            case kObjectTypeClosure:
+                // leave the Objects to the gc
+                delete _contents.functionValue.argumentSymbols;
+                break;
+
+            case kObjectTypeNumber:
+                numberPointer()->~Number();
+                break;
+                
+            case kObjectTypeDoubleArray:
+                delete _contents.doubleArrayPointer;
+                break;
+                
+            case kObjectTypeLongArray:
+                delete _contents.longArrayPointer;
+                break;
+                
+            case kObjectTypeDataset:
+                delete _contents.datasetPointer;
+                break;
+                
+            case kObjectTypeCons:
+                // it isn't our business deleting "unused" objects, that is for the GC
+            case kObjectTypeBuiltinFunction:
+            case kObjectTypeBoolean:
+            case kObjectTypeNil:
+                // nothing need be done
+                break;
+        }
+    }
+    
+    bool Object::ownsStorage() const {
+        switch (_type) {
+            case kObjectTypeSymbol:
+            case kObjectTypeString:
+                return !(_flags & kObjectFlagInlineString);
+                
+            case kObjectTypeNumber:
+                return numberPointer()->getMode() == Number::kNumberModeBigInteger;
+                
+            case kObjectTypeVector:
+            case kObjectTypeClosure:
+            case kObjectTypeDoubleArray:
+            case kObjectTypeLongArray:
+            case kObjectTypeDataset:
+                return true;
+                
+            default:
+                return false;
+        }
+    }
+    
+    const char* Object::typeName(ObjectType type) {
+        switch (type) {
+            case kObjectTypeString:             return "string";
+            case kObjectTypeSymbol:             return "symbol";
+            case kObjectTypeCons:               return "cons";
+            case kObjectTypeNil:                return "nil";
+            case kObjectTypeNumber:             return "number";
+            case kObjectTypeBoolean:            return "boolean";
+            case kObjectTypeVector:             return "vector";
+            case kObjectTypeBuiltinFunction:    return "builtin-function";
+            case kObjectTypeClosure:            return "closure";
+            case kObjectTypeDoubleArray:        return "double-array";
+            case kObjectTypeLongArray:          return "long-array";
+            case kObjectTypeDataset:            return "dataset";
+        }
+        
+        return "unknown";
+    }
+    
+    size_t Object::storageSize() const {
+        switch (_type) {
+            case kObjectTypeSymbol:
+            case kObjectTypeString:
+                return (_flags & kObjectFlagInlineString) ? 0 : sizeof(std::string) + _contents.stringPointer->capacity() + 1;
+                
+            case kObjectTypeNumber:
+                return numberPointer()->storageSize();
+                
+            case kObjectTypeVector:
+                return sizeof(ObjectList) + _contents.vectorPointer->capacity() * sizeof(Object*);
+                
+            case kObjectTypeClosure:
+                return sizeof(ObjectList) + _contents.functionValue.argumentSymbols->capacity() * sizeof(Object*);
+                
+            case kObjectTypeDoubleArray:
+                return sizeof(std::vector<double>) + _contents.doubleArrayPointer->capacity() * sizeof(double);
+                
+            case kObjectTypeLongArray:
+                return sizeof(std::vector<int64_t>) + _contents.longArrayPointer->capacity() * sizeof(int64_t);
+                
+            case kObjectTypeDataset:
+                return _contents.datasetPointer->storageSize();
+                
+            default:
+                return 0;
+        }
+    }
+    
+    bool Object::operator==(const Object& rhs) {
+        if (this == &rhs) {
+            return true;
+        }
+        
+        if (type() != rhs.type()) {
+            return false;
+        }
+        
+        if ((_flags & rhs._flags & kObjectFlagHashCached) && _hash != rhs._hash) {
+            return false;
+        }
+        
+        switch (_type) {
+            case kObjectTypeBoolean:
+                return _contents.booleanValue == rhs._contents.booleanValue;
+                break;
+                
+            case kObjectTypeNumber:
+                return *numberPointer() == *rhs.numberPointer();
+                break;
+                
+            case kObjectTypeNil:
+                return true;
+                break;
+                
+            case kObjectTypeVector:
+                // caching a hash doesn't change the value, so this is fine on a const rhs
+                if (hashValue() != const_cast<Object&>(rhs).hashValue()) {
+                    return false;
+                }
+                
+                if (_contents.vectorPointer->size() == rhs._contents.vectorPointer->size()) {
+                    for (int elementIndex=0; elementIndex < _contents.vectorPointer->size(); ++elementIndex) {
+                        if (*(_contents.vectorPointer->at(elementIndex)) != *(rhs._contents.vectorPointer->at(elementIndex))) {
+                            return false;
+                        }
+                        
+                    }
+                    return true;
+                } else {
+                    return false;
+                }
+                break;
+                
+            case kObjectTypeBuiltinFunction:
+                return _contents.builtinFunctionValue.extensionFunctionPointer->functionName() == rhs._contents.builtinFunctionValue.extensionFunctionPointer->functionName();
+                break;
+                
+            case kObjectTypeDoubleArray:
+                return *_contents.doubleArrayPointer == *rhs._contents.doubleArrayPointer;
+                break;
+                
+            case kObjectTypeLongArray:
+                return *_contents.longArrayPointer == *rhs._contents.longArrayPointer;
+                break;
+                
+            case kObjectTypeDataset: {
+                const std::vector<Dataset::Column>  &lhsColumns = _contents.datasetPointer->columns,
+                                                    &rhsColumns = rhs._contents.datasetPointer->columns;
+                
+                if (lhsColumns.size() != rhsColumns.size()) {
+                    return false;
+                }
+                
+                for (size_t columnIndex = 0; columnIndex < lhsColumns.size(); ++columnIndex) {
+                    if (lhsColumns[columnIndex].name != rhsColumns[columnIndex].name
+                        || lhsColumns[columnIndex].type != rhsColumns[columnIndex].type
+                        || lhsColumns[columnIndex].doubles != rhsColumns[columnIndex].doubles
+                        || lhsColumns[columnIndex].longs != rhsColumns[columnIndex].longs
+                        || lhsColumns[columnIndex].strings != rhsColumns[columnIndex].strings) {
+                        return false;
+                    }
+                }
+                
+                return true;
+            } break;
+                
+            case kObjectTypeClosure:
+                return *_contents.functionValue.objectPointer == *rhs._contents.functionValue.objectPointer;
+                break;
+ 
+            case kObjectTypeSymbol:
+            case kObjectTypeString:
+                return stringLength() == rhs.stringLength()
+                    && memcmp(stringCharacters(), rhs.stringCharacters(), stringLength()) == 0;
+                break;
+            
+            case kObjectTypeCons: {
+                // caching a hash doesn't change the value, so this is fine on a const rhs
+                if (hashValue() != const_cast<Object&>(rhs).hashValue()) {
+                    return false;
+                }
+                
+                // walk both spines together rather than recursing down them
+                const Object *lhsCell = this, *rhsCell = &rhs;
+                
+                while (lhsCell->_type == kObjectTypeCons && rhsCell->_type == kObjectTypeCons) {
+                    if (lhsCell == rhsCell) {
+                        return true;
+                    }
+                    
+                    if (*lhsCell->_contents.consValue.left != *rhsCell->_contents.consValue.left) {
+                        return false;
+                    }
+                    
+                    lhsCell = lhsCell->_contents.consValue.right;
+                    rhsCell = rhsCell->_contents.consValue.right;
+                }
+                
+                return *const_cast<Object*>(lhsCell) == *rhsCell;
+            } break;
+        }
+    }
+    
+    bool Object::operator!=(const Object& rhs) {
+        return !operator==(rhs);
+    }
+    
+    Object* Object::functionValueCode() {
+        return _contents.functionValue.objectPointer;
+    }
+
+    ExtensionFunction* Object::functionValueExtensionFunction() {
+        return _contents.builtinFunctionValue.extensionFunctionPointer;
+    }
+    
+    ObjectList Object::functionValueParameters() {
+        return *_contents.functionValue.argumentSymbols;
+    }
+
+    bool Object::isMacro() {
+        return (_flags & kObjectFlagMacro) != 0;
+    }
+    
+    Object* Object::consValueLeft() {
+        return _contents.consValue.left;
+    }
+    
+    Object* Object::consValueRight() {
+        return _contents.consValue.right;
+    }
+    
+    Object::Object(Number numberValue) {
+        _type = kObjectTypeNumber;
+        _flags = 0;
+        _regionDepth = 0;
+        _sourcePosition = 0;
+        new (_contents.numberStorage) Number(numberValue);
+    }
+    
+    Object::Object(bool boolValue) {
+        _type = kObjectTypeBoolean;
+        _flags = 0;
+        _regionDepth = 0;
+        _sourcePosition = 0;
+        _contents.booleanValue = boolValue;
+    }
+    
+    Object::Object(int val) {
+        _type = kObjectTypeNumber;
+        _flags = 0;
+        _regionDepth = 0;
+        _sourcePosition = 0;
+        new (_contents.numberStorage) Number(val);
+    }
+
+    Object::Object(int64_t val) {
+        _type = kObjectTypeNumber;
+        _flags = 0;
+        _regionDepth = 0;
+        _sourcePosition = 0;
+        new (_contents.numberStorage) Number(val);
+    }
+
+    Object::Object(double val) {
+        _type = kObjectTypeNumber;
+        _flags = 0;
+        _regionDepth = 0;
+        _sourcePosition = 0;
+        new (_contents.numberStorage) Number(val);
+    }
+    
+    Object::Object(Object *left, Object *right) {
+        _type = kObjectTypeCons;
+        _flags = 0;
+        _regionDepth = 0;
+        _sourcePosition = 0;
+        _contents.consValue.left = left;
+        _contents.consValue.right = right;
+    }
+    
+    Object::Object(ObjectList objects) {
+        _type = kObjectTypeVector;
+        _flags = 0;
+        _regionDepth = 0;
+        _sourcePosition = 0;
+        _contents.vectorPointer = new ObjectList(objects);
+    }
+    
+    std::string Object::stringValue(bool expandList) {
+        if (_type == kObjectTypeString || _type == kObjectTypeSymbol) {
+            return std::string(stringCharacters(), stringLength());
+        }
+        
+        std::stringstream stringBuilder;
+
+        switch (_type) {
+            case kObjectTypeBuiltinFunction:
+                stringBuilder << "<<<builtin "
+                << _contents.builtinFunctionValue.extensionFunctionPointer->functionName()
+                << ">>>";
+                break;
+
+            case kObjectTypeClosure:
+                stringBuilder << "<<<fn "
+                << _contents.functionValue.objectPointer->stringRepresentation()
+                << ">>>";
+                break;
+
+            case kObjectTypeString:
+                stringBuilder.write(stringCharacters(), stringLength());
+                break;
+
+            case kObjectTypeNumber:
+                stringBuilder << numberPointer()->stringRepresentation();
+                break;
+
+            case kObjectTypeVector:
+                stringBuilder << "[";
+                for (int elementIndex = 0; elementIndex < vectorValue().size(); ++elementIndex) {
+                    if (elementIndex) {
+                        stringBuilder << " ";
+                    }
+                    stringBuilder << _contents.vectorPointer->at(elementIndex)->stringRepresentation();
+                }
+                stringBuilder << "]";
+                break;
+
+            case kObjectTypeBoolean:
+                if (_contents.booleanValue) {
+                    stringBuilder << "true";
+                } else {
+                    stringBuilder << "false";
+                }
+                break;
+
+            case kObjectTypeCons: {
+                ObjectList elements;
+
+                if (buildList(elements) && expandList) {
+                    stringBuilder << "`(";
+                    for (int listIndex = 0; listIndex < elements.size(); ++listIndex) {
+                        stringBuilder << elements[listIndex]->stringRepresentation(false);
+
+                        if (listIndex < elements.size() - 1) {
+                            stringBuilder << " ";
+                        }
+                    }
+                    stringBuilder << ")";
+                } else {
+                    stringBuilder << "(cons "
+                    << _contents.consValue.left->stringRepresentation()
+                    << " "
+                    << _contents.consValue.right->stringRepresentation()
+                    << ")";
+                }
+            }
+                break;
+
+            case kObjectTypeNil:
+                stringBuilder << "nil";
+                break;
+
+            case kObjectTypeSymbol:
+                stringBuilder.write(stringCharacters(), stringLength());
+                break;
+
+            case kObjectTypeDoubleArray:
+            case kObjectTypeLongArray:
+            case kObjectTypeDataset:
+                return stringRepresentation(expandList);
+                break;
+        }
+
+        return stringBuilder.str();
+    }
+    
+    ObjectList Object::vectorValue() {
+        return *_contents.vectorPointer;
+    }
+    
+    Number Object::numberValue() {
+        return *numberPointer();
+    }
+    
+    const Number& Object::numberReference() {
+        return *numberPointer();
+    }
+    
+    bool Object::booleanValue() {
+        return _contents.booleanValue;
+    }
+    
+    std::vector<double>& Object::doubleArrayValue() {
+        return *_contents.doubleArrayPointer;
+    }
+    
+    std::vector<int64_t>& Object::longArrayValue() {
+        return *_contents.longArrayPointer;
+    }
+    
+    Dataset& Object::datasetValue() {
+        return *_contents.datasetPointer;
+    }
+    
+    bool Object::coerceBoolean() {
+        switch (_type) {                
+            case kObjectTypeNumber:
+                return numberValue()!=Number(0);
+                break;
+                
+            case kObjectTypeBoolean:
+                return booleanValue();
+                break;
+                
+            case kObjectTypeNil:
+                return false;
+                break;
+                
+            default:
+                // any object other than nil should be considered true
+                return true;
+                break;
+        }
+    }
+
+    std::string Object::stringRepresentation(bool expandList) {
+        std::stringstream stringBuilder;
+        
+        switch (_type) {
+            case kObjectTypeBuiltinFunction:
+                stringBuilder   << "<<<builtin "
+                                << _contents.builtinFunctionValue.extensionFunctionPointer->functionName()
+                                << ">>>";
+                break;
+                
+            case kObjectTypeClosure:
+                stringBuilder   << "<<<fn "
+                                << _contents.functionValue.objectPointer->stringRepresentation()
+                                << ">>>";
+                break;
                 
-            case kObjectTypeClosure:
-                return *_contents.functionValue.objectPointer == *rhs._contents.functionValue.objectPointer;
-                break;
- 
-            case kObjectTypeSymbol:
             case kObjectTypeString:
-                return *_contents.stringValue == *rhs._contents.stringValue;
+                stringBuilder << '"';
+                stringBuilder.write(stringCharacters(), stringLength());
+                stringBuilder << '"';
+                break;
+                
+            case kObjectTypeNumber:
+                stringBuilder << numberPointer()->stringRepresentation();
+                break;
+                
+            case kObjectTypeVector:
+                stringBuilder << "[";
+                for (int elementIndex=0; elementIndex<vectorValue().size(); ++elementIndex) {
+                    if (elementIndex) {
+                        stringBuilder << " ";
+                    }
+                    stringBuilder << _contents.vectorPointer->at(elementIndex)->stringRepresentation();
+                }
+                stringBuilder << "]";
+                break;
+                
+            case kObjectTypeBoolean:
+                if (_contents.booleanValue) {
+                    stringBuilder << "true";
+                } else {
+                    stringBuilder << "false";
+                }
+                break;
+                
+            case kObjectTypeCons: {
+                ObjectList elements;
+                
+                if (buildList(elements) && expandList) {
+                    stringBuilder << "`(";
+                    for (int listIndex = 0; listIndex < elements.size(); ++listIndex) {
+                        stringBuilder << elements[listIndex]->stringRepresentation(false);
+                        
+                        if (listIndex < elements.size()-1) {
+                            stringBuilder << " ";
+                        }
+                    }
+                    stringBuilder << ")";
+                } else {
+                    stringBuilder   << "(cons "
+                                    << _contents.consValue.left->stringRepresentation()
+                                    << " "
+                                    << _contents.consValue.right->stringRepresentation()
+                                    << ")";
+                }
+                } break;
+                
+            case kObjectTypeNil:
+                stringBuilder << "nil";
+                break;
+                
+            case kObjectTypeSymbol:
+                stringBuilder.write(stringCharacters(), stringLength());
+                break;
+                
+            case kObjectTypeDoubleArray:
+                stringBuilder << "#double-array[";
+                for (size_t elementIndex = 0; elementIndex < _contents.doubleArrayPointer->size(); ++elementIndex) {
+                    if (elementIndex) {
+                        stringBuilder << " ";
+                    }
+                    stringBuilder << (*_contents.doubleArrayPointer)[elementIndex];
+                }
+                stringBuilder << "]";
+                break;
+                
+            case kObjectTypeLongArray:
+                stringBuilder << "#long-array[";
+                for (size_t elementIndex = 0; elementIndex < _contents.longArrayPointer->size(); ++elementIndex) {
+                    if (elementIndex) {
+                        stringBuilder << " ";
+                    }
+                    stringBuilder << (*_contents.longArrayPointer)[elementIndex];
+                }
+                stringBuilder << "]";
+                break;
+                
+            case kObjectTypeDataset: {
+                const char *columnTypeNames[] = {"double", "long", "string"};
+                
+                stringBuilder << "#dataset[";
+                for (size_t columnIndex = 0; columnIndex < _contents.datasetPointer->columns.size(); ++columnIndex) {
+                    const Dataset::Column& column = _contents.datasetPointer->columns[columnIndex];
+                    stringBuilder << column.name << ":" << columnTypeNames[column.type] << " ";
+                }
+                stringBuilder << _contents.datasetPointer->rowCount() << " rows]";
+            } break;
+        }
+
+        return stringBuilder.str();
+    }
+
+    bool Object::isIterable() {
+        if (_type == kObjectTypeVector) {
+            return false;
+        }
+        
+        if (isList()) {
+            return true;
+        }
+                
+        return false;
+    }
+
+    bool Object::isList() {
+        Object *currentObject = this;
+        
+        while (currentObject->_type == kObjectTypeCons) {
+            if (currentObject->_contents.consValue.right->_type == kObjectTypeCons) {
+                // this is a cons with a cons as its right value, continue the list
+                currentObject = currentObject->_contents.consValue.right;
+            } else if (currentObject->_contents.consValue.right->_type == kObjectTypeNil) {
+                // a nil terminator for the list
+                return true;
+            } else {
+                // this isn't a list
+                return false;
+            }
+        }
+        
+        return false;
+    }
+    
+    bool Object::buildList(ObjectList& results) {
+        if (_type == kObjectTypeVector) {
+            results = *_contents.vectorPointer;
+            
+            return true;
+        } else {
+            Object *currentObject = this;
+
+            results.clear();
+            
+            while (currentObject->_type == kObjectTypeCons) {
+                if (currentObject->_contents.consValue.right->_type == kObjectTypeCons) {
+                    // this is a cons with a cons as its right value, continue the list
+                    results.push_back(currentObject->_contents.consValue.left);
+                    currentObject = currentObject->_contents.consValue.right;
+                } else if (currentObject->_contents.consValue.right->_type == kObjectTypeNil) {
+                    // a nil terminator for the list
+                    results.push_back(currentObject->_contents.consValue.left);
+                    return true;
+                } else {
+                    // this isn't a list
+                    return false;
+                }
+            }
+        }
+        
+        return false;
+    }
+    
+#pragma mark -
+#pragma mark TinyClojure
+    
+    Object* TinyClojure::listObject(const ObjectList& list) {
+        return listObject(list, _gc_short);
+    }
+    
+    Object* TinyClojure::listObject(const ObjectList& list, GarbageCollector *heap) {
+        if (list.size()) {
+            // end a list with a nil sentinel
+            Object *nilObject = heap->create();
+            return heap->registerList(list, nilObject);
+        } else {
+            // clojure's empty lists seem to be (cons nil nil)
+            Object *nilObject = heap->create();
+            return heap->create(nilObject, nilObject);
+        }
+    }
+
+    
+    TinyClojure::TinyClojure() {
+        _ioProxy = new IOProxy();
+        _gc_long = new GarbageCollector(&_heapAccount);
+        _gc_short = new GarbageCollector(&_heapAccount);
+        _newlineSet = std::string("\n\r");
+        
+        for (char excludeChar = 1; excludeChar<32; ++excludeChar) {
+            _excludeSet.append(&excludeChar, 1);
+        }
+        _excludeSet.append("\"()[]{}';` ");
+        
+        _numberSet = std::string("0123456789");
+        
+        _baseScope = NULL;
+        _hashConsing = false;
+        _allocationProfiler = NULL;
+        _samplingProfiler = NULL;
+        _traceRecorder = NULL;
+        
+        _stepLimit = 0;
+        _timeLimitMicros = 0;
+        _depthLimit = SIZE_MAX;
+        _evaluationDepth = 0;
+        _resuming = false;
+        startLimits();
+        
+        // the outermost region, which CollectGarbage empties
+        _gc_short->pushRegion();
+        
+        loadExtensionFunctions();
+
+        // this will initialise the root scope
+        resetInterpreter();
+    }
+    
+    TinyClojure::~TinyClojure() {
+        for (std::set<Evaluation*>::iterator it = _evaluations.begin(); it != _evaluations.end(); ++it) {
+            delete *it;
+        }
+        
+        for (std::vector<ExtensionFunction*>::iterator it = _extensionFunctions.begin(); it != _extensionFunctions.end(); ++it) {
+            delete *it;
+        }
+        
+        setAllocationProfiling(false);
+        delete _samplingProfiler;
+        
+        delete _baseScope;
+        delete _ioProxy;
+        delete _gc_long;
+        delete _gc_short;
+    }
+    
+    void TinyClojure::addExtensionFunction(ExtensionFunction *function) {
+        internalAddExtensionFunction(function);
+        resetInterpreter();
+    }
+    
+    void TinyClojure::internalAddExtensionFunction(ExtensionFunction *function) {
+        function->evaluator(this);
+        function->garbageCollector(_gc_long, _gc_short);
+        function->setIOProxy(_ioProxy);
+        function->setup();
+        
+        _extensionFunctions.push_back(function);        
+    }
+    
+    void TinyClojure::resetInterpreter() {
+        if (_baseScope) {
+            delete _baseScope;
+        }
+        
+        _baseScope = new InterpreterScope();
+        _baseScope->setWriteBarrier(_gc_long);
+        
+        for (int functionIndex = 0; functionIndex < _extensionFunctions.size(); ++functionIndex) {
+            ExtensionFunction *aFunction = _extensionFunctions[functionIndex];
+            _baseScope->setSymbolInScope(aFunction->functionName(),
+                                         _gc_long->create(aFunction));
+        }
+    }
+    
+    void TinyClojure::loadExtensionFunctions() {
+        internalAddExtensionFunction(new core::Plus());
+        internalAddExtensionFunction(new core::Minus());
+        internalAddExtensionFunction(new core::Multiply());
+        internalAddExtensionFunction(new core::Divide());
+        internalAddExtensionFunction(new core::If());
+        internalAddExtensionFunction(new core::Equality());
+        internalAddExtensionFunction(new core::NotEqual());
+        internalAddExtensionFunction(new core::Identical());
+        internalAddExtensionFunction(new core::Cons());
+        internalAddExtensionFunction(new core::List());
+        internalAddExtensionFunction(new core::LessThan);
+        internalAddExtensionFunction(new core::LessThanOrEqual);
+        internalAddExtensionFunction(new core::GreaterThan);
+        internalAddExtensionFunction(new core::GreaterThanOrEqual);
+        internalAddExtensionFunction(new core::Print());
+        internalAddExtensionFunction(new core::Println());
+        internalAddExtensionFunction(new core::PrintStr());
+        internalAddExtensionFunction(new core::PrintlnStr());
+        internalAddExtensionFunction(new core::Str());
+        internalAddExtensionFunction(new core::Count());
+        internalAddExtensionFunction(new core::Compare());
+        internalAddExtensionFunction(new core::Subs());
+        internalAddExtensionFunction(new core::Quot());
+        internalAddExtensionFunction(new core::Rem());
+        internalAddExtensionFunction(new core::Mod());
+        internalAddExtensionFunction(new core::Inc());
+        internalAddExtensionFunction(new core::Dec());
+        internalAddExtensionFunction(new core::Max());
+        internalAddExtensionFunction(new core::Min());
+        internalAddExtensionFunction(new core::LoadFile());
+        internalAddExtensionFunction(new core::LoadString());
+        internalAddExtensionFunction(new core::Spit());
+        internalAddExtensionFunction(new core::Slurp());
+        internalAddExtensionFunction(new core::Nsunmap());
+        internalAddExtensionFunction(new core::GcStats());
+        internalAddExtensionFunction(new core::BuiltinStats());
+        internalAddExtensionFunction(new core::NanoTime());
+        internalAddExtensionFunction(new core::CurrentTimeMillis());
+        internalAddExtensionFunction(new core::Time());
+        internalAddExtensionFunction(new core::Bench());
+        internalAddExtensionFunction(new core::Def);
+        internalAddExtensionFunction(new core::Do);
+        internalAddExtensionFunction(new core::Vector);
+        internalAddExtensionFunction(new core::Fn);
+        internalAddExtensionFunction(new core::Defn);
+        internalAddExtensionFunction(new core::First);
+        internalAddExtensionFunction(new core::Rest);
+        internalAddExtensionFunction(new core::ReadString);
+        internalAddExtensionFunction(new core::Eval);
+        internalAddExtensionFunction(new core::ReadLine);
+        internalAddExtensionFunction(new core::Cond);
+        internalAddExtensionFunction(new core::Let);
+        internalAddExtensionFunction(new core::Nth);
+        internalAddExtensionFunction(new core::Defmacro);
+        internalAddExtensionFunction(new core::DoubleArray);
+        internalAddExtensionFunction(new core::LongArray);
+        internalAddExtensionFunction(new core::ArrayGet);
+        internalAddExtensionFunction(new core::ArraySet);
+        internalAddExtensionFunction(new core::ArrayLength);
+        internalAddExtensionFunction(new core::ArrayAdd);
+        internalAddExtensionFunction(new core::ArraySubtract);
+        internalAddExtensionFunction(new core::ArrayMultiply);
+        internalAddExtensionFunction(new core::ArrayDivide);
+        internalAddExtensionFunction(new core::ArraySum);
+        internalAddExtensionFunction(new core::ArrayMean);
+        internalAddExtensionFunction(new core::ArrayDot);
+        internalAddExtensionFunction(new core::ArrayMinimum);
+        internalAddExtensionFunction(new core::ArrayMaximum);
+        internalAddExtensionFunction(new core::ArrayMap);
+        internalAddExtensionFunction(new core::ArrayReduce);
+        internalAddExtensionFunction(new core::MakeDataset);
+        internalAddExtensionFunction(new core::DatasetColumn);
+        internalAddExtensionFunction(new core::DatasetRowCount);
+        internalAddExtensionFunction(new core::DatasetColumnNames);
+        internalAddExtensionFunction(new core::Where);
+        internalAddExtensionFunction(new core::Select);
+        internalAddExtensionFunction(new core::GroupByAggregate);
+        internalAddExtensionFunction(new core::SortByColumn);
+    }
+    
+#pragma mark parser
+    
+    namespace {
+        /// the classes of characters the reader tells apart, as bits
+        enum {
+            kCharacterSeparator = 1,
+            kCharacterDelimiter = 2,
+            kCharacterDigit = 4,
+        };
+        
+        /**
+         * the class of every character
+         *
+         * separators are whitespace, commas and any other control characters.  Delimiters end a token, they are the
+         * separators and the characters that start or end a form.  Anything else, including bytes of UTF-8 sequences,
+         * is part of a token.
+         */
+        class CharacterClasses {
+        public:
+            CharacterClasses() {
+                for (int character = 0; character < 256; ++character) {
+                    _classes[character] = 0;
+                }
+                
+                for (int character = 0; character <= ' '; ++character) {
+                    _classes[character] = kCharacterSeparator | kCharacterDelimiter;
+                }
+                _classes[','] = _classes[127] = kCharacterSeparator | kCharacterDelimiter;
+                
+                for (const char *delimiter = "()[]{}\"';`"; *delimiter; ++delimiter) {
+                    _classes[(unsigned char)*delimiter] = kCharacterDelimiter;
+                }
+                
+                for (int character = '0'; character <= '9'; ++character) {
+                    _classes[character] = kCharacterDigit;
+                }
+            }
+            
+            bool is(char character, uint8_t characterClass) const {
+                return _classes[(unsigned char)character] & characterClass;
+            }
+            
+        protected:
+            uint8_t _classes[256];
+        };
+        
+        const CharacterClasses kCharacterClasses;
+        
+        /**
+         * scanners for the runs of characters the reader passes over: separators, comments and strings
+         *
+         * most of a large data file is these, so they look at 16 bytes at a time with SSE2, where the compiler
+         * targets it, or 32 with AVX2 when the CPU reports support at runtime, in the same way as the array kernels.
+         * They never read past length, finishing the last partial block a character at a time.
+         */
+        struct ScannerTable {
+            /// the first character at or after position that isn't a separator, or length
+            size_t (*skipSeparators)(const char *text, size_t position, size_t length);
+            
+            /// the first newline or carriage return at or after position, or length
+            size_t (*findLineEnd)(const char *text, size_t position, size_t length);
+            
+            /// the first double quote or backslash at or after position, or length
+            size_t (*findQuoteOrEscape)(const char *text, size_t position, size_t length);
+            
+            /// the name of the widest instruction set in use, for diagnostics
+            const char *instructionSet;
+        };
+        
+        size_t scalarSkipSeparators(const char *text, size_t position, size_t length) {
+            while (position < length && kCharacterClasses.is(text[position], kCharacterSeparator)) {
+                ++position;
+            }
+            return position;
+        }
+        
+        template <char first, char second>
+        size_t scalarFindEither(const char *text, size_t position, size_t length) {
+            while (position < length && text[position] != first && text[position] != second) {
+                ++position;
+            }
+            return position;
+        }
+        
+#if defined(__SSE2__)
+        size_t sse2SkipSeparators(const char *text, size_t position, size_t length) {
+            for (; position + 16 <= length; position += 16) {
+                __m128i block = _mm_loadu_si128((const __m128i *)(text + position));
+                
+                // control characters and space are the bytes from 0 to 32, bytes from 128 up compare as negative
+                __m128i separators = _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8(-1)), _mm_cmplt_epi8(block, _mm_set1_epi8(' ' + 1)));
+                separators = _mm_or_si128(separators, _mm_cmpeq_epi8(block, _mm_set1_epi8(',')));
+                separators = _mm_or_si128(separators, _mm_cmpeq_epi8(block, _mm_set1_epi8(127)));
+                
+                int others = ~_mm_movemask_epi8(separators) & 0xffff;
+                if (others) {
+                    return position + __builtin_ctz(others);
+                }
+            }
+            
+            return scalarSkipSeparators(text, position, length);
+        }
+        
+        template <char first, char second>
+        size_t sse2FindEither(const char *text, size_t position, size_t length) {
+            for (; position + 16 <= length; position += 16) {
+                __m128i block = _mm_loadu_si128((const __m128i *)(text + position));
+                int found = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(first)), _mm_cmpeq_epi8(block, _mm_set1_epi8(second))));
+                
+                if (found) {
+                    return position + __builtin_ctz(found);
+                }
+            }
+            
+            return scalarFindEither<first, second>(text, position, length);
+        }
+#endif
+        
+#if defined(__x86_64__) || defined(__i386__)
+        __attribute__((target("avx2"))) size_t avx2SkipSeparators(const char *text, size_t position, size_t length) {
+            for (; position + 32 <= length; position += 32) {
+                __m256i block = _mm256_loadu_si256((const __m256i *)(text + position));
+                
+                __m256i separators = _mm256_and_si256(_mm256_cmpgt_epi8(block, _mm256_set1_epi8(-1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(' ' + 1), block));
+                separators = _mm256_or_si256(separators, _mm256_cmpeq_epi8(block, _mm256_set1_epi8(',')));
+                separators = _mm256_or_si256(separators, _mm256_cmpeq_epi8(block, _mm256_set1_epi8(127)));
+                
+                uint32_t others = ~(uint32_t)_mm256_movemask_epi8(separators);
+                if (others) {
+                    return position + __builtin_ctz(others);
+                }
+            }
+            
+            return scalarSkipSeparators(text, position, length);
+        }
+        
+        template <char first, char second>
+        __attribute__((target("avx2"))) size_t avx2FindEither(const char *text, size_t position, size_t length) {
+            for (; position + 32 <= length; position += 32) {
+                __m256i block = _mm256_loadu_si256((const __m256i *)(text + position));
+                uint32_t found = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(first)),
+                                                                                _mm256_cmpeq_epi8(block, _mm256_set1_epi8(second))));
+                
+                if (found) {
+                    return position + __builtin_ctz(found);
+                }
+            }
+            
+            return scalarFindEither<first, second>(text, position, length);
+        }
+#endif
+        
+        ScannerTable selectScanners() {
+            ScannerTable table;
+            
+            table.instructionSet = "scalar";
+            table.skipSeparators = scalarSkipSeparators;
+            table.findLineEnd = scalarFindEither<'\n', '\r'>;
+            table.findQuoteOrEscape = scalarFindEither<'"', '\\'>;
+            
+#if defined(__SSE2__)
+            table.instructionSet = "sse2";
+            table.skipSeparators = sse2SkipSeparators;
+            table.findLineEnd = sse2FindEither<'\n', '\r'>;
+            table.findQuoteOrEscape = sse2FindEither<'"', '\\'>;
+#endif
+            
+#if defined(__x86_64__) || defined(__i386__)
+            if (__builtin_cpu_supports("avx2")) {
+                table.instructionSet = "avx2";
+                table.skipSeparators = avx2SkipSeparators;
+                table.findLineEnd = avx2FindEither<'\n', '\r'>;
+                table.findQuoteOrEscape = avx2FindEither<'"', '\\'>;
+            }
+#endif
+            
+            return table;
+        }
+        
+        /// the scanners for this CPU, selected on first use
+        const ScannerTable& scannerTable() {
+            static ScannerTable table = selectScanners();
+            return table;
+        }
+        
+        /// integers with no more digits than this fit in an int64_t, longer ones may need a BigInteger
+        const size_t kFixnumDigits = 18;
+        
+        /// a collection the reader has started and not yet finished, or a prefix waiting for the form it applies to
+        struct OpenForm {
+            typedef enum {
+                kOpenList,
+                kOpenQuotedList,
+                kOpenHashSet,
+                kOpenVector,
+                kOpenMap,
+                kOpenQuote,
+                kOpenDiscard,
+            } Kind;
+            
+            Kind kind;
+            
+            /// where the form starts, including any prefix, and where its elements start on the element stack
+            size_t start, firstElement;
+        };
+        
+        /// record where a parsed form started, see Object::sourcePosition
+        Object* positionedForm(Object *form, int startPosition) {
+            form->setSourcePosition((uint32_t)startPosition + 1);
+            return form;
+        }
+        
+        /// the character that closes a collection
+        char closingCharacter(OpenForm::Kind kind) {
+            switch (kind) {
+                case OpenForm::kOpenVector:
+                    return ']';
+                    
+                case OpenForm::kOpenMap:
+                case OpenForm::kOpenHashSet:
+                    return '}';
+                    
+                default:
+                    return ')';
+            }
+        }
+    }
+    
+    Object* TinyClojure::parse(const std::string& stringin) {
+        return parse(stringin.data(), stringin.length());
+    }
+    
+    Object* TinyClojure::parse(const char *text, size_t length) {
+        TraceRecorder::Scope parseTrace(_traceRecorder, "parse", "parse");
+        size_t position = 0;
+        Object *parsed = readForm(text, length, position, _gc_short);
+        
+        if (!parsed) {
+            parsed = _gc_short->create();
+        }
+        
+        if (_hashConsing) {
+            parsed = internObject(parsed);
+        }
+        
+        return parsed;
+    }
+    
+    void TinyClojure::parseAll(const std::string& codeText, ObjectList& expressions) {
+        parseAll(codeText.data(), codeText.length(), expressions);
+    }
+    
+    void TinyClojure::parseAll(const char *text, size_t length, ObjectList& expressions) {
+        TraceRecorder::Scope parseTrace(_traceRecorder, "parse", "parseAll");
+        size_t position = 0;
+        
+        while (Object *code = readForm(text, length, position, _gc_short)) {
+            expressions.push_back(_hashConsing ? internObject(code) : code);
+        }
+    }
+    
+    Object* TinyClojure::parseNext(const char *text, size_t length, size_t& position) {
+        TraceRecorder::Scope parseTrace(_traceRecorder, "parse", "parseNext");
+        Object *code = readForm(text, length, position, _gc_short);
+        
+        return code && _hashConsing ? internObject(code) : code;
+    }
+    
+    void TinyClojure::recursiveParseAll(const std::string& codeText, ObjectList& expressions) {
+        std::string parserString(codeText);
+        ParserState parseState(parserString);
+        
+        while (parseState.charactersLeft()) {
+            Object *code = recursiveParse(parseState);
+            if (code) {
+                expressions.push_back(_hashConsing ? internObject(code) : code);
+            }
+        }
+    }
+    
+    Object* TinyClojure::readForm(const char *text, size_t length, size_t& position, GarbageCollector *heap) {
+        const ScannerTable& scanners = scannerTable();
+        std::vector<OpenForm> openForms;
+        ObjectList elements;
+        std::string unescaped;
+        
+        while (true) {
+            // skip separators and comments, most runs of separators are a single space so look at that first
+            while (position < length) {
+                if (kCharacterClasses.is(text[position], kCharacterSeparator)) {
+                    position = scanners.skipSeparators(text, position + 1, length);
+                } else if (text[position] == ';') {
+                    position = scanners.findLineEnd(text, position, length);
+                } else {
+                    break;
+                }
+            }
+            
+            const size_t start = position;
+            Object *form = NULL;
+            
+            if (position >= length) {
+                if (openForms.empty()) {
+                    return NULL;
+                }
+                
+                // running out of characters ends any open lists, as the repl relies on, but nothing else
+                switch (openForms.back().kind) {
+                    case OpenForm::kOpenVector:
+                        throw Error(text, length, position, "Ran out of characters when building a vector");
+                        
+                    case OpenForm::kOpenMap:
+                        throw Error(text, length, position, "Ran out of characters when building a map");
+                        
+                    case OpenForm::kOpenQuote:
+                    case OpenForm::kOpenDiscard:
+                        throw Error(text, length, position, "Ran out of characters after a reader prefix");
+                        
+                    default:
+                        break;
+                }
+            }
+            
+            const char startChar = position < length ? text[position] : closingCharacter(openForms.back().kind),
+                       peekChar = position + 1 < length ? text[position + 1] : 0;
+            
+            if (startChar == '(' || startChar == '[' || startChar == '{' ||
+                (startChar == '#' && (peekChar == '(' || peekChar == '{')) ||
+                ((startChar == '\'' || startChar == '`') && (peekChar == '(' || peekChar == '[' || peekChar == '{'))) {
+                // start a collection, a quoted vector or map is just the vector or map
+                char openChar = startChar;
+                OpenForm open;
+                open.kind = OpenForm::kOpenList;
+                open.start = start;
+                open.firstElement = elements.size();
+                
+                if (startChar == '#' && peekChar == '(') {
+                    throw Error(text, length, position, "lambda shorthand unimplemented");
+                } else if (startChar == '#' && peekChar == '{') {
+                    open.kind = OpenForm::kOpenHashSet;
+                    openChar = peekChar;
+                    ++position;
+                } else if (startChar == '\'' || startChar == '`') {
+                    open.kind = peekChar == '(' ? OpenForm::kOpenQuotedList : OpenForm::kOpenList;
+                    openChar = peekChar;
+                    ++position;
+                }
+                
+                if (openChar == '[') {
+                    open.kind = OpenForm::kOpenVector;
+                } else if (openChar == '{' && open.kind != OpenForm::kOpenHashSet) {
+                    open.kind = OpenForm::kOpenMap;
+                }
+                
+                // the symbol that heads the list a collection becomes goes on first
+                switch (open.kind) {
+                    case OpenForm::kOpenQuotedList:
+                        elements.push_back(heap->create(std::string("list"), true));
+                        break;
+                        
+                    case OpenForm::kOpenHashSet:
+                        elements.push_back(heap->create(std::string("hash-set"), true));
+                        break;
+                        
+                    case OpenForm::kOpenVector:
+                        elements.push_back(heap->create(std::string("vector"), true));
+                        break;
+                        
+                    default:
+                        break;
+                }
+                
+                ++position;
+                openForms.push_back(open);
+                continue;
+            } else if (startChar == ')' || startChar == ']' || startChar == '}') {
+                // finish the innermost collection
+                if (openForms.empty() || openForms.back().kind == OpenForm::kOpenQuote || openForms.back().kind == OpenForm::kOpenDiscard ||
+                    closingCharacter(openForms.back().kind) != startChar) {
+                    throw Error(text, length, position, std::string("Unexpected ") + startChar);
+                }
+                
+                if (position < length) {
+                    ++position;
+                }
+                
+                OpenForm open = openForms.back();
+                openForms.pop_back();
+                
+                ObjectList collection(elements.begin() + open.firstElement, elements.end());
+                elements.resize(open.firstElement);
+                
+                form = positionedForm(listObject(collection, heap), (int)open.start);
+            } else if (startChar == '"' || (startChar == '#' && peekChar == '"')) {
+                // a string, sliced straight from the text unless it has escapes, or a regex, which is always sliced
+                const bool regex = startChar == '#';
+                if (regex) {
+                    ++position;
+                }
+                
+                const size_t contentStart = ++position;
+                bool escaped = false;
+                
+                while ((position = scanners.findQuoteOrEscape(text, position, length)) < length && text[position] == '\\') {
+                    escaped = true;
+                    position += 2;
+                }
+                
+                if (position >= length) {
+                    throw Error(text, length, length, "Ran out of characters when parsing a string");
+                }
+                
+                if (!escaped || regex) {
+                    form = heap->create(std::string(text + contentStart, position - contentStart));
+                } else {
+                    unescaped.clear();
+                    
+                    for (size_t characterIndex = contentStart; characterIndex < position; ++characterIndex) {
+                        char character = text[characterIndex];
+                        
+                        if (character == '\\') {
+                            switch (character = text[++characterIndex]) {
+                                case 'n':
+                                    character = 10;
+                                    break;
+                                    
+                                case 'r':
+                                    character = 13;
+                                    break;
+                                    
+                                case 't':
+                                    character = 9;
+                                    break;
+                            }
+                        }
+                        
+                        unescaped.push_back(character);
+                    }
+                    
+                    form = heap->create(unescaped);
+                }
+                
+                // past the closing quote
+                ++position;
+            } else if (startChar == '\'' || startChar == '`' || (startChar == '#' && peekChar == ';')) {
+                // a prefix that applies to the next form, 'x is (quote x) and #; drops x
+                OpenForm open;
+                open.kind = startChar == '#' ? OpenForm::kOpenDiscard : OpenForm::kOpenQuote;
+                open.start = start;
+                open.firstElement = elements.size();
+                
+                position += startChar == '#' ? 2 : 1;
+                openForms.push_back(open);
+                continue;
+            } else {
+                // a token runs to the next delimiter, or to a regex
+                while (position < length && !kCharacterClasses.is(text[position], kCharacterDelimiter) &&
+                       !(text[position] == '#' && position + 1 < length && text[position + 1] == '"' && position > start)) {
+                    ++position;
+                }
+                
+                form = readAtom(text + start, position - start, heap);
+            }
+            
+            // hand the form to the innermost open form, applying any prefixes
+            while (form && openForms.size()) {
+                OpenForm& open = openForms.back();
+                
+                if (open.kind == OpenForm::kOpenQuote) {
+                    ObjectList quoted;
+                    quoted.push_back(heap->create(std::string("quote"), true));
+                    quoted.push_back(form);
+                    form = positionedForm(listObject(quoted, heap), (int)open.start);
+                    openForms.pop_back();
+                } else if (open.kind == OpenForm::kOpenDiscard) {
+                    form = NULL;
+                    openForms.pop_back();
+                } else {
+                    elements.push_back(form);
+                    form = NULL;
+                }
+            }
+            
+            if (form) {
+                return form;
+            }
+        }
+    }
+    
+    Object* TinyClojure::readAtom(const char *token, size_t length, GarbageCollector *heap) {
+        switch (length) {
+            case 3:
+                if (!memcmp(token, "nil", 3)) {
+                    return heap->create();
+                }
+                break;
+                
+            case 4:
+                if (!memcmp(token, "true", 4)) {
+                    return heap->create(true);
+                }
+                break;
+                
+            case 5:
+                if (!memcmp(token, "false", 5)) {
+                    return heap->create(false);
+                }
+                break;
+        }
+        
+        // an optional minus sign, then at least one digit and at most one decimal point
+        size_t digitStart = token[0] == '-' ? 1 : 0, digits = 0, points = 0;
+        for (size_t characterIndex = digitStart; characterIndex < length; ++characterIndex) {
+            if (kCharacterClasses.is(token[characterIndex], kCharacterDigit)) {
+                ++digits;
+            } else if (token[characterIndex] == '.') {
+                ++points;
+            } else {
+                digits = 0;
+                break;
+            }
+        }
+        
+        if (!digits || points > 1) {
+            return heap->create(std::string(token, length), true);
+        }
+        
+        if (points) {
+            // strtod needs a terminator
+            std::string number(token, length);
+            return heap->create(strtod(number.c_str(), NULL));
+        }
+        
+        if (digits > kFixnumDigits) {
+            return heap->create(Number::integerFromString(std::string(token, length)));
+        }
+        
+        int64_t value = 0;
+        for (size_t characterIndex = digitStart; characterIndex < length; ++characterIndex) {
+            value = value * 10 + (token[characterIndex] - '0');
+        }
+        
+        return heap->create(Number(digitStart ? -value : value));
+    }
+    
+    Object* TinyClojure::lookupInterned(const std::string& key) {
+        std::unordered_map<std::string, Object*>::iterator it = _internedObjects.find(key);
+        return it == _internedObjects.end() ? NULL : it->second;
+    }
+    
+    Object* TinyClojure::addInterned(const std::string& key, Object *object) {
+        object->markCanonical();
+        _internedObjects[key] = object;
+        return object;
+    }
+    
+    Object* TinyClojure::internAtom(Object *object) {
+        if (object->isCanonical()) {
+            return object;
+        }
+        
+        std::string key;
+        
+        switch (object->type()) {
+            case Object::kObjectTypeNil:
+                key = "z";
+                break;
+                
+            case Object::kObjectTypeBoolean:
+                key = object->booleanValue() ? "t" : "f";
+                break;
+                
+            case Object::kObjectTypeString:
+                key = "s" + object->stringValue();
+                break;
+                
+            case Object::kObjectTypeSymbol:
+                key = "y" + object->stringValue();
+                break;
+                
+            case Object::kObjectTypeNumber: {
+                const Number& number = object->numberReference();
+                
+                // keep the mode in the key so that 1 and 1.0 stay distinct, and use the raw bits of doubles
+                key = "n";
+                switch (number.getMode()) {
+                    case Number::kNumberModeInteger: {
+                        int64_t value = number.rawInteger();
+                        key.append("i").append((const char*)&value, sizeof(value));
+                    } break;
+                        
+                    case Number::kNumberModeFloating: {
+                        double value = number.rawFloating();
+                        key.append("f").append((const char*)&value, sizeof(value));
+                    } break;
+                        
+                    case Number::kNumberModeBigInteger:
+                        key.append("b").append(number.stringRepresentation());
+                        break;
+                }
+            } break;
+                
+            default:
+                // functions, arrays and datasets are never produced by the reader, and collections are interned by
+                // internCollection
+                return object;
+        }
+        
+        Object *canonical = lookupInterned(key);
+        if (canonical) {
+            return canonical;
+        }
+        
+        return addInterned(key, _gc_long->create(object, _gc_long));
+    }
+    
+    Object* TinyClojure::internCollection(Object *object, const ObjectList& elements, bool list) {
+        const bool vector = object->type() == Object::kObjectTypeVector;
+        
+        std::string key = vector ? "v" : (list ? "l" : "c");
+        for (size_t elementIndex = 0; elementIndex < elements.size(); ++elementIndex) {
+            key.append((const char*)&elements[elementIndex], sizeof(Object*));
+        }
+        
+        Object *canonical = lookupInterned(key);
+        if (canonical) {
+            return canonical;
+        }
+        
+        if (vector) {
+            canonical = _gc_long->create(elements);
+        } else if (list) {
+            canonical = _gc_long->registerList(elements, internAtom(_gc_short->create()));
+            canonical->setSourcePosition(object->sourcePosition());
+            
+            // the tail cells are shared along with the head, so they are canonical too
+            for (Object *cell = canonical->consValueRight(); cell->type() == Object::kObjectTypeCons; cell = cell->consValueRight()) {
+                cell->markCanonical();
+            }
+        } else {
+            canonical = _gc_long->create(elements[0], elements[1]);
+        }
+        
+        return addInterned(key, canonical);
+    }
+    
+    Object* TinyClojure::internObject(Object *object) {
+        /// a collection whose elements are being interned
+        struct PendingCollection {
+            Object *collection;
+            ObjectList elements;
+            bool list;
+            size_t index;
+        };
+        
+        // an explicit stack rather than recursion, so that deeply nested data can't overflow the C++ stack
+        std::vector<PendingCollection> pending;
+        Object *next = object;
+        
+        while (true) {
+            if (next) {
+                const bool collection = !next->isCanonical()
+                    && (next->type() == Object::kObjectTypeVector || next->type() == Object::kObjectTypeCons);
+                
+                if (collection) {
+                    pending.push_back(PendingCollection());
+                    PendingCollection& open = pending.back();
+                    open.collection = next;
+                    open.index = 0;
+                    open.list = next->buildList(open.elements);
+                    
+                    if (!open.list) {
+                        // a dotted pair
+                        open.elements.push_back(next->consValueLeft());
+                        open.elements.push_back(next->consValueRight());
+                    }
+                } else {
+                    Object *interned = internAtom(next);
+                    if (pending.empty()) {
+                        return interned;
+                    }
+                    
+                    pending.back().elements[pending.back().index++] = interned;
+                }
+                
+                next = NULL;
+            }
+            
+            PendingCollection& open = pending.back();
+            if (open.index < open.elements.size()) {
+                next = open.elements[open.index];
+                continue;
+            }
+            
+            // every element is canonical, so the collection can be
+            Object *interned = internCollection(open.collection, open.elements, open.list);
+            pending.pop_back();
+            
+            if (pending.empty()) {
+                return interned;
+            }
+            
+            pending.back().elements[pending.back().index++] = interned;
+        }
+    }
+    
+    /**
+     * the original parser, replaced by readForm and kept for recursiveParseAll
+     *
+     * it is a poor translation of Lisping's objc parser,
+     * which is a highly tolerant parser, not appropriate for an interpreter
+     */
+    Object* TinyClojure::recursiveParse(ParserState& parseState) {
+        parseState.skipSeparators();
+        
+        if (parseState.position >= parseState.parserString.length()) {
+            // there is nothing here return NULL
+            return _gc_short->create();
+        }
+        
+        const int startPosition = parseState.position;
+        
+        char    startChar = parseState.currentChar(),
+                peekChar = parseState.peekChar();
+        
+        enum {
+            sexpTypeNormal,
+            sexpTypeLambdaShorthand,
+            sexpTypeListLiteral,
+            sexpTypeHashSet,
+        } sexpType = sexpTypeNormal;
+        
+        enum {
+            stringTypeNormal,
+            stringTypeRegex,
+        } stringType = stringTypeNormal;
+        
+        if (startChar == '#' && peekChar == '"') {
+            stringType = stringTypeRegex;
+            startChar = peekChar;
+            parseState.position++;
+        }
+        
+        if (startChar == '#' && peekChar == '(') {
+            sexpType = sexpTypeLambdaShorthand;
+            startChar = peekChar;
+            parseState.position++;
+        } else if (startChar == '#' && peekChar == '{') {
+            sexpType = sexpTypeHashSet;
+            startChar = peekChar;
+            parseState.position++;
+        } else if ((startChar == '\'' || startChar == '`') && (peekChar == '(' || peekChar == '[' || peekChar == '{')) {
+            sexpType = sexpTypeListLiteral;
+            startChar = peekChar;
+            parseState.position++;
+        }
+        
+        if (startChar == '"' || stringType == stringTypeRegex) {
+            // start collecting a string
+            std::string stringbuf;
+            
+            bool escapeNextChar = false;
+
+            // ignore the intial string char
+            ++parseState.position;
+            
+            while (parseState.charactersLeft()) {
+                const char currentChar = parseState.currentChar();
+                ++parseState.position;
+                
+                if (escapeNextChar) {
+                    char adjustedChar = currentChar;
+                    
+                    switch (currentChar) {
+                        case 'n':
+                            adjustedChar = 10;
+                            break;
+                            
+                        case 'r':
+                            adjustedChar = 13;
+                            break;
+                            
+                        case 't':
+                            adjustedChar = 9;
+                            break;
+                    }
+                    
+                    stringbuf.append(&adjustedChar, 1);
+
+                    escapeNextChar = false;
+                } else {
+                    if (currentChar == '\\') {
+                        escapeNextChar = true;
+                    } else {
+                        if (currentChar=='"' && stringbuf.length()) {
+                            // TODO do something in the case of regexes
+                            if (stringType == stringTypeRegex) {
+                                std::cerr << "Not dealing with regexes" << std::endl;
+                            }
+                            
+                            // end of the string
+                            return _gc_short->create(stringbuf);
+                        }
+                        stringbuf.append(&currentChar, 1);
+                    }
+                }
+            }
+            
+            Error error(parseState, std::string("Ran out of characters when parsing a string"));
+            throw error;
+        } else if (startChar == '(' || sexpType == sexpTypeHashSet) {
+            char closeChar = ')';
+            if (sexpType == sexpTypeHashSet) closeChar = '}';
+            
+            /*
+             * start an S-Expression
+             *
+             * We are looking for
+             * * Open parenthesis (found)
+             * * terms (recurse this function)
+             * * Close parenthesis
+             */
+            ObjectList elements;
+            
+            // advance from the parenthesis
+            ++parseState.position;
+            
+            while (true) {
+                // move on
+                parseState.skipSeparators();
+                
+                if (!parseState.charactersLeft()) {
+                    // nothing left, return the s expression so far
+                    break;
+                }
+                
+                if (parseState.currentChar()==closeChar) {
+                    // advance past the ) and end the S expression
+                    ++parseState.position;
+                    
+                    break;
+                }
+                
+                Object *element = recursiveParse(parseState);
+                if (element) {
+                    elements.push_back(element);
+                } else {
+                    // nothing left, return the s expression so far
+                    Error error(parseState, "Ran out of characters when building an S Expression");
+                    throw error;
+                    break;
+                }
+            }
+            
+            switch (sexpType) {
+                case sexpTypeNormal:
+                    return positionedForm(listObject(elements), startPosition);
+                    break;
+                    
+                case sexpTypeListLiteral:
+                    elements.insert(elements.begin(), _gc_short->create(std::string("list"), true));
+                    return positionedForm(listObject(elements), startPosition);
+                    break;
+                    
+                case sexpTypeLambdaShorthand:
+                    _ioProxy->writeErr("lambda shorthand unimplemented");
+                    return NULL;
+                    break;
+                    
+                case sexpTypeHashSet:
+                    elements.insert(elements.begin(), _gc_short->create(std::string("hash-set", true)));
+                    return positionedForm(listObject(elements), startPosition);
+                    break;
+            }
+            
+            return NULL;
+        } else if (startChar == '[') {
+            /*
+             * start a Clojure vector
+             *
+             * We are looking for
+             * * Open parenthesis (found)
+             * * terms (recurse this function)
+             * * Close parenthesis
+             */
+            ObjectList elements;
+            
+            // advance from the parenthesis
+            ++parseState.position;
+            
+            while (true) {
+                // move on
+                parseState.skipSeparators();
+                
+                if (!parseState.charactersLeft()) {
+                    Error error(parseState, "Ran out of characters when building a vector");
+                    throw error;
+                }
+                
+                if (parseState.currentChar()==']') {
+                    // advance past the ] and end the vector
+                    ++parseState.position;
+
+                    // insert the vector identifier at the beginning
+                    elements.insert(elements.begin(), _gc_short->create("vector", true));
+                    
+                    return positionedForm(listObject(elements), startPosition);
+                }
+                
+                Object *element = recursiveParse(parseState);
+                if (element) {
+                    elements.push_back(element);
+                } else {
+                    Error error(parseState, "Ran out of characters when building a vector");
+                    throw error;
+                }
+            }
+        } else if (startChar == '{') {
+            /*
+             * start a Clojure map
+             *
+             * We are looking for
+             * * Open parenthesis (found)
+             * * terms (recurse this function)
+             * * Close parenthesis
+             */
+            
+            ObjectList elements;
+            
+            // advance beyond the parenthesis
+            ++parseState.position;
+            
+            while (true) {
+                parseState.skipSeparators();
+                
+                if (!parseState.charactersLeft()) {
+                    Error error(parseState, "Ran out of characters when building a map");
+                    throw error;
+                }
+                
+                if (parseState.currentChar()=='}') {
+                    // advance past the ] and end the vector
+                    ++parseState.position;
+                    
+                    return listObject(elements);
+                }
+                
+                Object *element = recursiveParse(parseState);
+                if (element) {
+                    elements.push_back(element);
+                } else {
+                    Error error(parseState, "Ran out of characters when building a map");
+                    throw error;
+                }
+            }
+        } else if (startChar == ';') {
+            /// start a comment, run until the end of the line
+            std::string comment;
+            
+            while (parseState.charactersLeft()) {
+                const char currentChar = parseState.currentChar();
+                
+                bool commentChar = false;
+                
+                if (_newlineSet.find(currentChar) == _newlineSet.npos) {
+                    comment.append(&currentChar, 1);
+                    commentChar = true;
+                    ++parseState.position;
+                }
+                
+                if (!commentChar || !parseState.charactersLeft()) {
+                    // end of the comment, ignore it
+                    return recursiveParse(parseState);
+                }
+            }
+        } else if (startChar == '`' || startChar == '\'') {
+            // start collecting a symbol
+            // TODO no real difference between symbols, identifiers and numbers
+            std::string symbol;
+            
+            while (parseState.charactersLeft()) {
+                const char  currentChar = parseState.currentChar(),
+                            peekChar = parseState.peekChar(),
+                            peekPeekChar = parseState.peekPeekChar();
+                
+                bool identifierChar = false;
+                
+                if(_excludeSet.find(currentChar) == _excludeSet.npos
+                    || (symbol.length() == 0)) {
+                    symbol.append(&currentChar, 1);
+                    identifierChar = false;
+                    ++parseState.position;
+                }
+                
+                if (!identifierChar
+                    || !parseState.charactersLeft()
+                    || (peekChar=='#' && peekPeekChar=='"')) {
+                    // this is a literal symbol xxx, translate to (quote xxx) and push that
+                    std::vector<Object *> els;
+                    els.push_back(_gc_short->create("quote", true));
+                    els.push_back(_gc_short->create(symbol, true));
+                    return listObject(els);
+                }
+            }
+        } else if (_excludeSet.find(startChar) == _excludeSet.npos) {
+            // start an identifier
+            std::string identifier;
+            
+            while (parseState.charactersLeft()) {
+                const char  currentChar = parseState.currentChar(),
+                            peekChar = parseState.peekChar(),
+                            peekPeekChar = parseState.peekPeekChar();
+                
+                bool identifierChar = false;
+                
+                if (_excludeSet.find(currentChar) == _excludeSet.npos
+                    || ((startChar=='#') && (currentChar==';') && (parseState.position == startPosition+1))) {    // case to deal with inline comments
+                    identifier.append(&currentChar, 1);
+                    identifierChar = true;
+                    ++parseState.position;
+                }
+                
+                if (!identifierChar
+                    || !parseState.charactersLeft()
+                    || (peekChar=='#' && peekPeekChar=='"')) {
+                    if (identifier.find("#;")==0) {
+                        // inline comment element
+                        return recursiveParse(parseState);
+                    } else {
+                        // check for known symbol names
+                        if (identifier == "true") {
+                            return _gc_short->create(true);
+                        } else if (identifier == "false") {
+                            return _gc_short->create(false);
+                        } else if (identifier == "nil") {
+                            return _gc_short->create();
+                        }
+                        
+                        int numberBaseIndex = 0;
+                        if (identifier[numberBaseIndex] == '-') {
+                            numberBaseIndex = 1;
+                        }
+                        
+                        bool isInteger = true;
+                        for (int identifierIndex = numberBaseIndex; identifierIndex < identifier.size(); ++identifierIndex) {
+                            if (_numberSet.find(identifier[identifierIndex]) == _numberSet.npos) {
+                                isInteger = false;
+                                break;
+                            }
+                        }
+                        if (identifier.length() == numberBaseIndex) {
+                            // this can happen with a pure - sign
+                            isInteger = false;
+                        }
+                        
+                        bool    isFloat = true,
+                                pointFound = false;
+                        for (int identifierIndex = numberBaseIndex; identifierIndex < identifier.size(); ++identifierIndex) {
+                            if (identifier[identifierIndex]=='.') {
+                                if (pointFound) {
+                                    isFloat = false;
+                                    break;
+                                } else {
+                                    pointFound = true;
+                                }
+                            } else if (_numberSet.find(identifier[identifierIndex]) == _numberSet.npos) {
+                                isInteger = false;
+                                break;
+                            }
+                        }
+                        if (!pointFound) {
+                            isFloat = false;
+                        }
+                        
+                        if (isInteger) {
+                            return _gc_short->create(Number::integerFromString(identifier));
+                        } else if (isFloat) {
+                            return _gc_short->create(atof(identifier.c_str()));
+                        } else {
+                            return _gc_short->create(identifier, true);
+                        }
+                    }
+                }            
+            }
+        }
+                
+        return NULL;
+    }
+    
+#pragma mark pipelined reader
+    
+    namespace {
+        /// how long a thread of a PipelinedReader sleeps when it has spun for a while waiting on the other
+        const std::chrono::microseconds kPipelineIdle(50);
+        
+        /// the times a thread yields before it starts sleeping
+        const size_t kPipelineSpins = 64;
+    }
+    
+    PipelinedReader::PipelinedReader(TinyClojure& interpreter, const char *text, size_t length, size_t capacity) :
+        _interpreter(&interpreter), _text(text), _length(length), _capacity(std::max(capacity, (size_t)1)),
+        _produced(0), _consumed(0), _holding(false), _finished(false), _stopping(false) {
+        _slots = new Slot[_capacity];
+        
+        for (size_t slotIndex = 0; slotIndex < _capacity; ++slotIndex) {
+            _slots[slotIndex].account.setLimits(0, interpreter._heapAccount.hardLimit());
+            _slots[slotIndex].heap = new GarbageCollector(&_slots[slotIndex].account);
+            _slots[slotIndex].heap->pushRegion();
+        }
+        
+        _reader = std::thread(&PipelinedReader::readForms, this);
+    }
+    
+    PipelinedReader::~PipelinedReader() {
+        _stopping = true;
+        _reader.join();
+        
+        if (_holding) {
+            releaseCharge(_slots[_consumed.load(std::memory_order_relaxed) % _capacity]);
+        }
+        
+        for (size_t slotIndex = 0; slotIndex < _capacity; ++slotIndex) {
+            delete _slots[slotIndex].heap;
+        }
+        delete [] _slots;
+    }
+    
+    Object* PipelinedReader::next() {
+        size_t consumed = _consumed.load(std::memory_order_relaxed);
+        
+        // hand the last form's slot back to the reader
+        if (_holding) {
+            releaseCharge(_slots[consumed % _capacity]);
+            _consumed.store(++consumed, std::memory_order_release);
+            _holding = false;
+        }
+        
+        if (_finished) {
+            return NULL;
+        }
+        
+        size_t attempts = 0;
+        while (_produced.load(std::memory_order_acquire) == consumed) {
+            pause(attempts);
+        }
+        
+        Slot& slot = _slots[consumed % _capacity];
+        
+        // the reader stops after the end or an error, so the last slot needn't be handed back
+        if (!slot.form) {
+            _finished = true;
+            
+            if (slot.failed) {
+                throw slot.error;
+            }
+            return NULL;
+        }
+        
+        try {
+            chargeInterpreter(slot);
+        } catch (...) {
+            _finished = true;
+            throw;
+        }
+        
+        _holding = true;
+        return _interpreter->_hashConsing ? _interpreter->internObject(slot.form) : slot.form;
+    }
+    
+    void PipelinedReader::readForms() {
+        size_t position = 0;
+        
+        for (size_t produced = 0; !_stopping; ++produced) {
+            size_t attempts = 0;
+            while (produced - _consumed.load(std::memory_order_acquire) == _capacity) {
+                if (_stopping) {
+                    return;
+                }
+                pause(attempts);
+            }
+            
+            // the evaluator has finished with the form last read into this slot
+            Slot& slot = _slots[produced % _capacity];
+            slot.heap->collectGarbage();
+            
+            try {
+                TraceRecorder::Scope parseTrace(_interpreter->_traceRecorder, "parse", "pipelined parse");
+                slot.form = TinyClojure::readForm(_text, _length, position, slot.heap);
+            } catch (Error error) {
+                slot.form = NULL;
+                slot.failed = true;
+                slot.error = error;
+            }
+            
+            _produced.store(produced + 1, std::memory_order_release);
+            
+            if (!slot.form) {
+                return;
+            }
+        }
+    }
+    
+    void PipelinedReader::chargeInterpreter(Slot& slot) {
+        HeapAccount& account = _interpreter->_heapAccount;
+        
+        // the reader is done with the slot until it is handed back, and its writes were published with _produced
+        if (!account.charge(slot.account.bytesInUse())) {
+            throw Error("heap limit exceeded");
+        }
+        
+        slot.chargedBytes = slot.account.bytesInUse();
+        slot.chargedStatistics = slot.account.statistics();
+        
+        for (size_t type = 0; type < HeapStatistics::kObjectTypeCount; ++type) {
+            if (slot.chargedStatistics.liveObjects[type]) {
+                account.countObjects((Object::ObjectType)type, slot.chargedStatistics.liveObjects[type], slot.chargedStatistics.liveBytes[type]);
+            }
+        }
+    }
+    
+    void PipelinedReader::releaseCharge(Slot& slot) {
+        HeapAccount& account = _interpreter->_heapAccount;
+        
+        account.release(slot.chargedBytes);
+        for (size_t type = 0; type < HeapStatistics::kObjectTypeCount; ++type) {
+            account.uncountObjects((Object::ObjectType)type, slot.chargedStatistics.liveObjects[type], slot.chargedStatistics.liveBytes[type]);
+        }
+        
+        slot.chargedBytes = 0;
+    }
+    
+    void PipelinedReader::pause(size_t& attempts) {
+        if (++attempts < kPipelineSpins) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(kPipelineIdle);
+        }
+    }
+    
+#pragma mark evaluator
+    
+    Object* TinyClojure::scopedEval(InterpreterScope *interpreterState, Object *code) {
+        InterpreterScope newScope(interpreterState);
+        
+        return unscopedEval(interpreterState, code);
+    }
+    
+    namespace {
+        /// attribute allocations to a call form while it is evaluated, if allocation profiling is on
+        class AllocationSiteScope {
+        public:
+            AllocationSiteScope(AllocationProfiler *profiler, Object *form) : _profiler(profiler) {
+                if (_profiler) {
+                    _previous = _profiler->enterSite(form);
+                }
+            }
+            
+            ~AllocationSiteScope() {
+                if (_profiler) {
+                    _profiler->leaveSite(_previous);
+                }
+            }
+            
+        protected:
+            AllocationProfiler *_profiler;
+            AllocationProfiler::Site *_previous;
+        };
+        
+        /// the stack a thread keeps free below the deepest evaluation, for the builtins and printing it calls
+        const size_t kStackReserveBytes = 256 * 1024;
+        
+        /**
+         * the lowest address the current thread's stack may reach before the evaluator stops nesting calls, or NULL
+         * if the stack can't be found
+         *
+         * this is a quarter of the stack, or kStackReserveBytes if that is less, above the bottom of the stack.  Stacks
+         * grow down on every platform this is built for.
+         */
+        const char* stackFloor() {
+            static thread_local bool found = false;
+            static thread_local const char *floor = NULL;
+            
+            if (!found) {
+                char *bottom = NULL;
+                size_t size = 0;
+                
+#if defined(__APPLE__)
+                size = pthread_get_stacksize_np(pthread_self());
+                bottom = (char*)pthread_get_stackaddr_np(pthread_self()) - size;
+#else
+                pthread_attr_t attributes;
+                if (pthread_getattr_np(pthread_self(), &attributes) == 0) {
+                    void *address = NULL;
+                    if (pthread_attr_getstack(&attributes, &address, &size) == 0) {
+                        bottom = (char*)address;
+                    }
+                    pthread_attr_destroy(&attributes);
+                }
+#endif
+                
+                floor = bottom ? bottom + std::min(kStackReserveBytes, size / 4) : NULL;
+                found = true;
+            }
+            
+            return floor;
+        }
+        
+        /// count a call form as nested while it is evaluated, throwing if that passes the limit or the stack is nearly full
+        class EvaluationDepthScope {
+        public:
+            EvaluationDepthScope(size_t& depth, size_t limit) : _depth(depth) {
+                if (++_depth > limit || (const char*)__builtin_frame_address(0) < stackFloor()) {
+                    --_depth;
+                    throw Error("evaluation depth limit exceeded", Error::kErrorKindDepthLimit);
+                }
+            }
+            
+            ~EvaluationDepthScope() {
+                --_depth;
+            }
+            
+        protected:
+            size_t& _depth;
+        };
+        
+        /// trace a closure call if it takes at least the threshold, naming it after the head of the form that called it
+        class ClosureTraceScope {
+        public:
+            ClosureTraceScope(TraceRecorder *recorder, std::chrono::nanoseconds threshold, Object *form)
+                : _recorder(recorder), _threshold(threshold), _form(form) {
+                if (_recorder) {
+                    _start = std::chrono::steady_clock::now();
+                }
+            }
+            
+            ~ClosureTraceScope() {
+                if (_recorder) {
+                    TraceRecorder::TimePoint end = std::chrono::steady_clock::now();
+                    if (end - _start >= _threshold) {
+                        _recorder->record("call", SamplingProfiler::frameName(_form), _start, end);
+                    }
+                }
+            }
+            
+        protected:
+            TraceRecorder *_recorder;
+            std::chrono::nanoseconds _threshold;
+            Object *_form;
+            TraceRecorder::TimePoint _start;
+        };
+        
+        /// time a builtin call from construction to destruction, so calls that throw are counted too, unless statistics is NULL
+        class BuiltinCallTimer {
+        public:
+            BuiltinCallTimer(BuiltinStatistics *statistics) : _statistics(statistics) {
+                if (_statistics) {
+                    _start = std::chrono::steady_clock::now();
+                }
+            }
+            
+            ~BuiltinCallTimer() {
+                if (_statistics) {
+                    _statistics->record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start).count());
+                }
+            }
+            
+        protected:
+            BuiltinStatistics *_statistics;
+            std::chrono::steady_clock::time_point _start;
+        };
+        
+        /// keep a call form on the sampled call stack while it is evaluated, if profiling is on
+        class ProfiledFrameScope {
+        public:
+            ProfiledFrameScope(SamplingProfiler *profiler, Object *form) : _profiler(profiler) {
+                if (_profiler) {
+                    _profiler->enterFrame(form);
+                }
+            }
+            
+            ~ProfiledFrameScope() {
+                if (_profiler) {
+                    _profiler->leaveFrame();
+                }
+            }
+            
+        protected:
+            SamplingProfiler *_profiler;
+        };
+    }
+    
+    Object* TinyClojure::unscopedEval(InterpreterScope *interpreterState, Object *code) {
+        if (--_fuel == 0) {
+            refuel();
+        }
+        
+        switch (code->type()) {
+            case Object::kObjectTypeNil:
+            case Object::kObjectTypeNumber:
+            case Object::kObjectTypeString:
+            case Object::kObjectTypeBoolean:
+            case Object::kObjectTypeBuiltinFunction:
+            case Object::kObjectTypeClosure:
+            case Object::kObjectTypeDoubleArray:
+            case Object::kObjectTypeLongArray:
+            case Object::kObjectTypeDataset:
+                return code;
                 break;
-            
-            case kObjectTypeCons:
-                // recursively evaluate ==, NB lhs equality should return more quickly than rhs equality
-                if (*_contents.consValue.left != *rhs._contents.consValue.left) {
-                    return false;
+                
+            case Object::kObjectTypeVector: {
+                ObjectList elements;
+                
+                for (int elementIndex=0; elementIndex<code->vectorValue().size(); ++elementIndex) {
+                    elements.push_back(scopedEval(interpreterState, code->vectorValue()[elementIndex]));
                 }
-                return *_contents.consValue.right == *rhs._contents.consValue.right;
-                break;
+                
+                return _gc_short->create(elements);
+                } break;
+        
+            case Object::kObjectTypeSymbol: {
+
+                Object *symbolValue = interpreterState->lookupSymbol(code->stringValue());
+
+                if (symbolValue) {
+
+                    // Checks if the symbol still needs to be evaluated (i.e. Macros need to be evaluated at a different stage)
+                    if (symbolValue->type() == Object::kObjectTypeCons) {
+                        if (symbolValue->consValueLeft()->stringValue() == "macroEval") {
+
+                            if (symbolValue->consValueRight()->type() == Object::kObjectTypeCons) {
+                                Object *temp = scopedEval(interpreterState, symbolValue->consValueRight());
+                                return scopedEval(interpreterState, temp);
+                            } else {
+                                return symbolValue->consValueRight();
+                            }
+                        }
+                    }
+
+                    return symbolValue;
+                } else {
+                    std::stringstream stringBuilder;
+                    stringBuilder << "I do not understand the symbol " << code->stringValue();
+                    throw Error(stringBuilder.str());
+                }
+            } break;
+        
+            case Object::kObjectTypeCons: {
+                EvaluationDepthScope evaluationDepth(_evaluationDepth, _depthLimit);
+                AllocationSiteScope allocationSite(_allocationProfiler, code);
+                ProfiledFrameScope profiledFrame(_samplingProfiler, code);
+                ObjectList arguments;
+                
+                // walk the list once, the identifier is the first element and the rest are the arguments
+                if (code->consValueRight()->type() == Object::kObjectTypeNil || code->consValueRight()->buildList(arguments)) {
+                    Object *identifierObject = scopedEval(interpreterState, code->consValueLeft());
+                    
+                    if (identifierObject->type()==Object::kObjectTypeBuiltinFunction) {
+                        ExtensionFunction *function = identifierObject->functionValueExtensionFunction();
+                        
+                        validateBuiltinCall(function, arguments);
+                        
+                        ObjectList preparedArguments;
+                        if (function->preEvaluateArguments()) {
+                            for (int argumentIndex=0; argumentIndex<arguments.size(); ++argumentIndex) {
+                                preparedArguments.push_back(scopedEval(interpreterState, arguments[argumentIndex]));
+                            }
+                        } else {
+                            preparedArguments = arguments;
+                        }
+                        
+                        return executeBuiltin(function, preparedArguments, interpreterState);
+                    } else if (identifierObject->type() == Object::kObjectTypeClosure) {
+
+                        if (identifierObject->isMacro()) {
+                            return callMacro(interpreterState, identifierObject, arguments);
+                        }
+
+                        // not a macro, normal function
+                        ObjectList evaluatedArguments;
+                        for (int argumentIndex = 0; argumentIndex < arguments.size(); ++argumentIndex) {
+                            evaluatedArguments.push_back(scopedEval(interpreterState, arguments[argumentIndex]));
+                        }
+
+                        ClosureTraceScope closureTrace(_traceRecorder, _traceClosureThreshold, code);
+                        return callClosure(interpreterState, identifierObject, evaluatedArguments);
+
+                    } else {
+                        throw Error("An executable S Expression must begin with a function object");
+                    }
+                } else {
+                    // I could be wrong, but I don't think this case makes any sense, most likely we got here cos of a flaw in buildList
+                    throw Error("An executable S Expression was not understood");
+                }
+            } break;
         }
+        
+        return NULL;
     }
     
-    bool Object::operator!=(const Object& rhs) {
-        return !operator==(rhs);
+    void TinyClojure::validateBuiltinCall(ExtensionFunction *function, ObjectList& arguments) {
+        int minArgs = function->minimumNumberOfArguments(),
+            maxArgs = function->maximumNumberOfArguments();
+        
+        if (minArgs>=0) {
+            if (arguments.size() < minArgs) {
+                std::stringstream stringBuilder;
+                stringBuilder   << "Function "
+                                << function->functionName()
+                                << " requires at least "
+                                << minArgs
+                                << " arguments"
+                                << std::endl;
+                
+                throw Error(stringBuilder.str());
+            }
+        }
+        
+        if (maxArgs>=0) {
+            if (arguments.size() > maxArgs) {
+                std::stringstream stringBuilder;
+                stringBuilder   << "Function "
+                                << function->functionName()
+                                << " requires no more than "
+                                << maxArgs
+                                << " arguments"
+                                << std::endl;
+                
+                throw Error(stringBuilder.str());
+            }
+        }
+        
+        std::vector<Object::ObjectType> types;
+        for (int parameterIndex=0; parameterIndex<arguments.size(); ++parameterIndex) {
+            types.push_back(arguments[parameterIndex]->type());
+        }
+        
+        if (!function->validateArgumentTypes(types)) {
+            std::stringstream stringBuilder;
+            stringBuilder   << "Function "
+                            << function->functionName()
+                            << "'s type signature does not match that which is passed"
+                            << std::endl;
+
+            throw Error(stringBuilder.str());
+        }
     }
     
-    Object* Object::functionValueCode() {
-        return _contents.functionValue.objectPointer;
+    Object* TinyClojure::executeBuiltin(ExtensionFunction *function, ObjectList& arguments, InterpreterScope *interpreterState) {
+        BuiltinCallTimer callTimer(kBuiltinStatistics ? &function->statistics() : NULL);
+        
+        Object *result = function->execute(arguments, interpreterState);
+        if (result==NULL) {
+            result = _gc_short->create();
+        }
+        
+        return result;
     }
+    
+    Object* TinyClojure::callMacro(InterpreterScope *interpreterState, Object *macro, ObjectList& arguments) {
+        if (macro->functionValueParameters().size() != arguments.size()) {
+            std::stringstream stringBuilder;
+            stringBuilder << "Function requires "
+            << macro->functionValueParameters().size()
+            << " argument(s)"
+            << std::endl;
+
+            throw Error(stringBuilder.str());
+        }
 
-    ExtensionFunction* Object::functionValueExtensionFunction() {
-        return _contents.builtinFunctionValue.extensionFunctionPointer;
+        // build a new scope containing the passed arguments
+        InterpreterScope functionScope(interpreterState);
+
+        for (int parameterIndex = 0; parameterIndex < macro->functionValueParameters().size(); ++parameterIndex) {
+            std::string macroEval = "macroEval";
+
+            Object* testObj = _gc_short->create(_gc_short->create(macroEval), parse(arguments[parameterIndex]->stringValue()));
+            functionScope.setSymbolInScope(macro->functionValueParameters()[parameterIndex]->stringValue(), testObj);
+        }
+
+        return scopedEval(&functionScope, macro->functionValueCode());
     }
     
-    ObjectList Object::functionValueParameters() {
-        return *_contents.functionValue.argumentSymbols;
-    }
+    void TinyClojure::bindClosureArguments(Object *closure, ObjectList& evaluatedArguments, InterpreterScope *functionScope) {
+        if (closure->functionValueParameters().size() != evaluatedArguments.size()) {
+            std::stringstream stringBuilder;
+            stringBuilder << "Function requires "
+            << closure->functionValueParameters().size()
+            << " argument(s)"
+            << std::endl;
+
+            throw Error(stringBuilder.str());
+        }
 
-    bool Object::isMacro() {
-        return _contents.functionValue.macro;
+        for (int parameterIndex = 0; parameterIndex < closure->functionValueParameters().size(); ++parameterIndex) {
+            functionScope->setSymbolInScope(closure->functionValueParameters()[parameterIndex]->stringValue(), evaluatedArguments[parameterIndex]);
+        }
     }
     
-    Object* Object::consValueLeft() {
-        return _contents.consValue.left;
+    Object* TinyClojure::callClosure(InterpreterScope *interpreterState, Object *closure, ObjectList& evaluatedArguments) {
+        // build a new scope containing the passed arguments
+        InterpreterScope functionScope(interpreterState);
+        bindClosureArguments(closure, evaluatedArguments, &functionScope);
+
+        return scopedEval(&functionScope, closure->functionValueCode());
     }
     
-    Object* Object::consValueRight() {
-        return _contents.consValue.right;
+    Object* TinyClojure::apply(InterpreterScope *interpreterState, Object *function, ObjectList arguments) {
+        if (function->type() == Object::kObjectTypeBuiltinFunction) {
+            ExtensionFunction *extensionFunction = function->functionValueExtensionFunction();
+            
+            validateBuiltinCall(extensionFunction, arguments);
+            
+            return executeBuiltin(extensionFunction, arguments, interpreterState);
+        } else if (function->type() == Object::kObjectTypeClosure && !function->isMacro()) {
+            return callClosure(interpreterState, function, arguments);
+        }
+        
+        throw Error("Only functions can be applied");
     }
     
-    Object::Object(Number numberValue) {
-        _type = kObjectTypeNumber;
-        _contents.numberPointer = new Number(numberValue);
+    Object* TinyClojure::eval(Object* code) {
+        // an eval from inside a builtin, or from a builtin that resume called, shares the limits of the one it is
+        // part of, and can't collect as the caller's values are on the C++ stack
+        bool outermost = _gc_short->regionDepth() == 1 && !_resuming;
+        
+        if (outermost && _heapAccount.takeSoftLimitReached()) {
+            softHeapLimitReached(_heapAccount.bytesInUse());
+        }
+        
+        TraceRecorder::Scope evalTrace(_traceRecorder, "eval",
+                                       _traceRecorder && code->type() == Object::kObjectTypeCons ? SamplingProfiler::frameName(code) : std::string("eval"));
+        
+        if (outermost) {
+            startLimits();
+        }
+        
+        // everything the evaluation allocates goes in its own region, which is freed as soon as it finishes
+        _gc_short->pushRegion();
+        
+        Object *ret;
+        try {
+            ret = unscopedEval(_baseScope, code);
+        } catch (...) {
+            _gc_short->popRegion(NULL);
+            throw;
+        }
+        
+        if (ret==NULL) {
+            ret = _gc_short->create();
+        }
+        
+        // the result is the only thing that escapes to the caller, anything def'd has already been copied to _gc_long
+        return _gc_short->popRegion(ret);
     }
     
-    Object::Object(bool boolValue) {
-        _type = kObjectTypeBoolean;
-        _contents.booleanValue = boolValue;
+    Object* TinyClojure::exportObject(Object *object) {
+        return _gc_long->retainRootObject(Object::deepCopy(object, _gc_long));
     }
     
-    Object::Object(int val) {
-        _type = kObjectTypeNumber;
-        _contents.numberPointer = new Number(val);
+    void TinyClojure::releaseObject(Object *object) {
+        _gc_long->releaseRootObject(object);
     }
 
-    Object::Object(double val) {
-        _type = kObjectTypeNumber;
-        _contents.numberPointer = new Number(val);
+    void TinyClojure::CollectGarbage() {
+        // evaluations keep their values in the short term heap between calls to resume
+        if (_evaluations.size()) {
+            return;
+        }
+        
+        TraceRecorder::Scope collectionTrace(_traceRecorder, "gc", "CollectGarbage");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        
+        _gc_short->collectGarbage();
+        
+        _heapAccount.recordPause(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count(), true);
     }
     
-    Object::Object(Object *left, Object *right) {
-        _type = kObjectTypeCons;
-        _contents.consValue.left = left;
-        _contents.consValue.right = right;
+    void TinyClojure::setAllocationProfiling(bool enabled) {
+        _heapAccount.setProfiler(NULL);
+        delete _allocationProfiler;
+        _allocationProfiler = NULL;
+        
+        if (enabled) {
+            _allocationProfiler = new AllocationProfiler();
+            _heapAccount.setProfiler(_allocationProfiler);
+        }
     }
     
-    Object::Object(ObjectList objects) {
-        _type = kObjectTypeVector;
-        _contents.vectorPointer = new ObjectList(objects);
+    void TinyClojure::startProfiling(int64_t intervalMicros) {
+        delete _samplingProfiler;
+        _samplingProfiler = new SamplingProfiler(intervalMicros);
+        _foldedStacks.clear();
     }
     
-    std::string Object::stringValue(bool expandList) {
-        std::stringstream stringBuilder;
-
-        switch (_type) {
-            case kObjectTypeBuiltinFunction:
-                stringBuilder << "<<<builtin "
-                << _contents.builtinFunctionValue.extensionFunctionPointer->functionName()
-                << ">>>";
-                break;
-
-            case kObjectTypeClosure:
-                stringBuilder << "<<<fn "
-                << _contents.functionValue.objectPointer->stringRepresentation()
-                << ">>>";
-                break;
-
-            case kObjectTypeString:
-                stringBuilder << *_contents.stringValue;
-                break;
-
-            case kObjectTypeNumber:
-                stringBuilder << _contents.numberPointer->stringRepresentation();
-                break;
-
-            case kObjectTypeVector:
-                stringBuilder << "[";
-                for (int elementIndex = 0; elementIndex < vectorValue().size(); ++elementIndex) {
-                    if (elementIndex) {
-                        stringBuilder << " ";
-                    }
-                    stringBuilder << _contents.vectorPointer->at(elementIndex)->stringRepresentation();
-                }
-                stringBuilder << "]";
-                break;
-
-            case kObjectTypeBoolean:
-                if (_contents.booleanValue) {
-                    stringBuilder << "true";
-                } else {
-                    stringBuilder << "false";
-                }
-                break;
-
-            case kObjectTypeCons: {
-                ObjectList elements;
-
-                if (buildList(elements) && expandList) {
-                    stringBuilder << "`(";
-                    for (int listIndex = 0; listIndex < elements.size(); ++listIndex) {
-                        stringBuilder << elements[listIndex]->stringRepresentation(false);
-
-                        if (listIndex < elements.size() - 1) {
-                            stringBuilder << " ";
-                        }
-                    }
-                    stringBuilder << ")";
-                } else {
-                    stringBuilder << "(cons "
-                    << _contents.consValue.left->stringRepresentation()
-                    << " "
-                    << _contents.consValue.right->stringRepresentation()
-                    << ")";
-                }
+    void TinyClojure::stopProfiling() {
+        if (_samplingProfiler) {
+            _foldedStacks = _samplingProfiler->foldedStacks();
+            delete _samplingProfiler;
+            _samplingProfiler = NULL;
+        }
+    }
+    
+    void TinyClojure::setTraceRecorder(TraceRecorder *recorder, int64_t closureThresholdMicros) {
+        _traceRecorder = recorder;
+        _traceClosureThreshold = std::chrono::microseconds(closureThresholdMicros);
+    }
+    
+    std::string TinyClojure::foldedStacks() const {
+        return _samplingProfiler ? _samplingProfiler->foldedStacks() : _foldedStacks;
+    }
+    
+    void TinyClojure::startLimits() {
+        _reserveSteps = _stepLimit;
+        _deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(_timeLimitMicros);
+        
+        // the first step looks at the limits and gives out the fuel
+        _fuel = 1;
+    }
+    
+    void TinyClojure::refuel() {
+        if (_stepLimit && _reserveSteps == 0) {
+            throw Error("evaluation step limit exceeded", Error::kErrorKindStepLimit);
+        }
+        
+        if (_timeLimitMicros && std::chrono::steady_clock::now() >= _deadline) {
+            throw Error("evaluation time limit exceeded", Error::kErrorKindTimeLimit);
+        }
+        
+        _fuel = _timeLimitMicros ? kStepsBetweenClockChecks : UINT64_MAX;
+        if (_stepLimit) {
+            _fuel = std::min(_fuel, _reserveSteps);
+            _reserveSteps -= _fuel;
+        }
+    }
+    
+    void TinyClojure::softHeapLimitReached(size_t bytesInUse) {
+        // any step size will do, nothing else is waiting
+        while (!gcStep(1000)) {
+        }
+    }
+    
+    void TinyClojure::markLongTermRoots() {
+        _baseScope->markValues(*_gc_long);
+        _gc_long->markRootObjects();
+        
+        for (std::unordered_map<std::string, Object*>::iterator it = _internedObjects.begin(); it != _internedObjects.end(); ++it) {
+            _gc_long->markObject(it->second);
+        }
+        
+        _gc_short->markRegionReferences(*_gc_long);
+        markEvaluationReferences();
+    }
+    
+    void TinyClojure::markEvaluationReferences() {
+        for (std::set<Evaluation*>::iterator it = _evaluations.begin(); it != _evaluations.end(); ++it) {
+            (*it)->markReferences(*_gc_long);
+        }
+    }
+    
+    bool TinyClojure::gcStep(int64_t budgetMicros) {
+        // a running eval holds references on the C++ stack, and in scopes, that the collector can't see
+        if (_gc_short->regionDepth() > 1 || _resuming) {
+            return false;
+        }
+        
+        TraceRecorder::Scope collectionTrace(_traceRecorder, "gc", "gcStep");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        
+        bool finished = collectLongTermHeap(start + std::chrono::microseconds(budgetMicros));
+        
+        _heapAccount.recordPause(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count(), finished);
+        
+        return finished;
+    }
+    
+    bool TinyClojure::collectLongTermHeap(GarbageCollector::Deadline deadline) {
+        if (_gc_long->collectionPhase() == GarbageCollector::kCollectionIdle) {
+            _gc_long->startCollection();
+            markLongTermRoots();
+        }
+        
+        while (_gc_long->collectionPhase() == GarbageCollector::kCollectionMarking) {
+            if (!_gc_long->markStep(deadline)) {
+                return false;
+            }
+            
+            // the write barrier covers def and bindings, but evals since the roots were marked may have returned long
+            // term objects into the short term heap, or resumed evaluations into their frames, so look there again
+            // before deciding that marking is over
+            _gc_short->markRegionReferences(*_gc_long);
+            markEvaluationReferences();
+            
+            if (_gc_long->markStep(deadline)) {
+                _gc_long->startSweep();
             }
-                break;
-
-            case kObjectTypeNil:
-                stringBuilder << "nil";
-                break;
-
-            case kObjectTypeSymbol:
-                stringBuilder << *_contents.stringValue;
-                break;
         }
+        
+        return _gc_long->sweepStep(deadline);
+    }
 
-        return stringBuilder.str();
+#pragma mark -
+#pragma mark Stackless Evaluation
+    
+    namespace {
+        /// note that resume is running for as long as it is in scope
+        class ResumingScope {
+        public:
+            ResumingScope(bool& resuming) : _resuming(resuming) {
+                _resuming = true;
+            }
+            
+            ~ResumingScope() {
+                _resuming = false;
+            }
+            
+        protected:
+            bool& _resuming;
+        };
     }
     
-    ObjectList Object::vectorValue() {
-        return *_contents.vectorPointer;
+    Evaluation::Evaluation(TinyClojure *interpreter, Object *code) : _interpreter(interpreter), _value(NULL), _state(kEvaluationSuspended), _result(NULL), _steps(0), _reserveSteps(0), _timeLeft(0) {
+        evaluate(code, interpreter->_baseScope);
     }
     
-    Number Object::numberValue() {
-        return *_contents.numberPointer;
+    Evaluation::~Evaluation() {
+        clear();
     }
     
-    bool Object::booleanValue() {
-        return _contents.booleanValue;
+    Evaluation::Frame& Evaluation::pushFrame(Frame::Kind kind, Object *form, InterpreterScope *scope) {
+        if (!_interpreter->_heapAccount.charge(sizeof(Frame))) {
+            throw Error("heap limit exceeded");
+        }
+        
+        _frames.push_back(Frame());
+        
+        Frame& frame = _frames.back();
+        frame.kind = kind;
+        frame.form = form;
+        frame.function = NULL;
+        frame.scope = scope;
+        frame.ownsScope = false;
+        frame.index = 0;
+        
+        return frame;
     }
     
-    bool Object::coerceBoolean() {
-        switch (_type) {                
-            case kObjectTypeNumber:
-                return numberValue()!=Number(0);
-                break;
+    void Evaluation::popFrame() {
+        Frame& frame = _frames.back();
+        
+        if (frame.ownsScope) {
+            _interpreter->_heapAccount.release(sizeof(InterpreterScope));
+            delete frame.scope;
+        }
+        
+        _interpreter->_heapAccount.release(sizeof(Frame));
+        _frames.pop_back();
+    }
+    
+    void Evaluation::ownScope() {
+        if (!_interpreter->_heapAccount.charge(sizeof(InterpreterScope))) {
+            throw Error("heap limit exceeded");
+        }
+        
+        Frame& frame = _frames.back();
+        frame.scope = new InterpreterScope(frame.scope);
+        frame.ownsScope = true;
+    }
+    
+    void Evaluation::clear() {
+        while (_frames.size()) {
+            popFrame();
+        }
+    }
+    
+    void Evaluation::markReferences(GarbageCollector& collector) {
+        if (_evaluating) {
+            collector.markObject(_form);
+        } else if (_value) {
+            collector.markObject(_value);
+        }
+        
+        if (_result) {
+            collector.markObject(_result);
+        }
+        
+        for (size_t frameIndex = 0; frameIndex < _frames.size(); ++frameIndex) {
+            Frame& frame = _frames[frameIndex];
+            
+            collector.markObject(frame.form);
+            if (frame.function) {
+                collector.markObject(frame.function);
+            }
+            
+            for (size_t objectIndex = 0; objectIndex < frame.arguments.size(); ++objectIndex) {
+                collector.markObject(frame.arguments[objectIndex]);
+            }
+            
+            for (size_t objectIndex = 0; objectIndex < frame.values.size(); ++objectIndex) {
+                collector.markObject(frame.values[objectIndex]);
+            }
+            
+            for (size_t objectIndex = 0; objectIndex < frame.bindings.size(); ++objectIndex) {
+                collector.markObject(frame.bindings[objectIndex]);
+            }
+            
+            if (frame.ownsScope) {
+                frame.scope->markValues(collector);
+            }
+        }
+    }
+    
+    void Evaluation::step() {
+        ++_steps;
+        
+        if (_evaluating) {
+            evaluateForm();
+        } else if (_frames.empty()) {
+            _state = kEvaluationFinished;
+            _result = _value;
+        } else {
+            continueFrame();
+        }
+    }
+    
+    void Evaluation::evaluateForm() {
+        Object *form = _form;
+        InterpreterScope *scope = _scope;
+        
+        switch (form->type()) {
+            case Object::kObjectTypeCons: {
+                Frame& frame = pushFrame(Frame::kFrameHead, form, scope);
                 
-            case kObjectTypeBoolean:
-                return booleanValue();
+                if (form->consValueRight()->type() != Object::kObjectTypeNil && !form->consValueRight()->buildList(frame.arguments)) {
+                    throw Error("An executable S Expression was not understood");
+                }
+                
+                evaluate(form->consValueLeft(), scope);
+                } break;
+                
+            case Object::kObjectTypeVector:
+                if (form->vectorValue().empty()) {
+                    produce(_interpreter->_gc_short->create(ObjectList()));
+                } else {
+                    Frame& frame = pushFrame(Frame::kFrameVector, form, scope);
+                    frame.arguments = form->vectorValue();
+                    evaluate(frame.arguments[0], scope);
+                }
                 break;
                 
-            case kObjectTypeNil:
-                return false;
+            case Object::kObjectTypeSymbol:
+                // symbols never recurse far, and macro arguments need the recursive evaluator anyway
+                produce(_interpreter->unscopedEval(scope, form));
                 break;
                 
             default:
-                // any object other than nil should be considered true
-                return true;
+                produce(form);
                 break;
         }
     }
-
-    std::string Object::stringRepresentation(bool expandList) {
-        std::stringstream stringBuilder;
+    
+    void Evaluation::continueFrame() {
+        Frame& frame = _frames.back();
         
-        switch (_type) {
-            case kObjectTypeBuiltinFunction:
-                stringBuilder   << "<<<builtin "
-                                << _contents.builtinFunctionValue.extensionFunctionPointer->functionName()
-                                << ">>>";
+        switch (frame.kind) {
+            case Frame::kFrameHead:
+                startCall(_value);
                 break;
                 
-            case kObjectTypeClosure:
-                stringBuilder   << "<<<fn "
-                                << _contents.functionValue.objectPointer->stringRepresentation()
-                                << ">>>";
-                break;
+            case Frame::kFrameArguments:
+                frame.values.push_back(_value);
                 
-            case kObjectTypeString:
-                stringBuilder << '"' << *_contents.stringValue << '"';
+                if (frame.values.size() < frame.arguments.size()) {
+                    evaluate(frame.arguments[frame.values.size()], frame.scope);
+                } else {
+                    finishCall();
+                }
                 break;
                 
-            case kObjectTypeNumber:
-                stringBuilder << _contents.numberPointer->stringRepresentation();
-                break;
+            case Frame::kFrameVector:
+                frame.values.push_back(_value);
                 
-            case kObjectTypeVector:
-                stringBuilder << "[";
-                for (int elementIndex=0; elementIndex<vectorValue().size(); ++elementIndex) {
-                    if (elementIndex) {
-                        stringBuilder << " ";
-                    }
-                    stringBuilder << _contents.vectorPointer->at(elementIndex)->stringRepresentation();
+                if (frame.values.size() < frame.arguments.size()) {
+                    evaluate(frame.arguments[frame.values.size()], frame.scope);
+                } else {
+                    Object *vector = _interpreter->_gc_short->create(frame.values);
+                    popFrame();
+                    produce(vector);
                 }
-                stringBuilder << "]";
                 break;
                 
-            case kObjectTypeBoolean:
-                if (_contents.booleanValue) {
-                    stringBuilder << "true";
+            case Frame::kFrameBody:
+                if (++frame.index < frame.arguments.size()) {
+                    evaluate(frame.arguments[frame.index], frame.scope);
                 } else {
-                    stringBuilder << "false";
+                    popFrame();
                 }
                 break;
                 
-            case kObjectTypeCons: {
-                ObjectList elements;
+            case Frame::kFrameIf: {
+                // the chosen branch is a tail call, it replaces the if's frame
+                InterpreterScope *scope = frame.scope;
+                Object *branch = NULL;
                 
-                if (buildList(elements) && expandList) {
-                    stringBuilder << "`(";
-                    for (int listIndex = 0; listIndex < elements.size(); ++listIndex) {
-                        stringBuilder << elements[listIndex]->stringRepresentation(false);
-                        
-                        if (listIndex < elements.size()-1) {
-                            stringBuilder << " ";
-                        }
-                    }
-                    stringBuilder << ")";
+                if (_value->coerceBoolean()) {
+                    branch = frame.arguments[1];
+                } else if (frame.arguments.size() == 3) {
+                    branch = frame.arguments[2];
+                }
+                
+                popFrame();
+                
+                if (branch) {
+                    evaluate(branch, scope);
                 } else {
-                    stringBuilder   << "(cons "
-                                    << _contents.consValue.left->stringRepresentation()
-                                    << " "
-                                    << _contents.consValue.right->stringRepresentation()
-                                    << ")";
+                    produce(_interpreter->_gc_short->create());
                 }
                 } break;
                 
-            case kObjectTypeNil:
-                stringBuilder << "nil";
+            case Frame::kFrameCond:
+                if (_value->coerceBoolean()) {
+                    InterpreterScope *scope = frame.scope;
+                    Object *branch = frame.arguments[frame.index + 1];
+                    
+                    popFrame();
+                    evaluate(branch, scope);
+                } else if ((frame.index += 2) < frame.arguments.size()) {
+                    evaluate(frame.arguments[frame.index], frame.scope);
+                } else {
+                    popFrame();
+                    produce(_interpreter->_gc_short->create());
+                }
                 break;
                 
-            case kObjectTypeSymbol:
-                stringBuilder << *_contents.stringValue;
+            case Frame::kFrameLet:
+                frame.scope->setSymbolInScope(frame.bindings[frame.index]->stringValue(), _value);
+                
+                if ((frame.index += 2) < frame.bindings.size()) {
+                    evaluate(frame.bindings[frame.index + 1], frame.scope);
+                } else {
+                    frame.index = 1;
+                    startBody();
+                }
                 break;
-        }
-
-        return stringBuilder.str();
-    }
-
-    bool Object::isIterable() {
-        if (_type == kObjectTypeVector) {
-            return false;
-        }
-        
-        if (isList()) {
-            return true;
-        }
                 
-        return false;
-    }
-
-    bool Object::isList() {
-        Object *currentObject = this;
-        
-        while (currentObject->_type == kObjectTypeCons) {
-            if (currentObject->_contents.consValue.right->_type == kObjectTypeCons) {
-                // this is a cons with a cons as its right value, continue the list
-                currentObject = currentObject->_contents.consValue.right;
-            } else if (currentObject->_contents.consValue.right->_type == kObjectTypeNil) {
-                // a nil terminator for the list
-                return true;
-            } else {
-                // this isn't a list
-                return false;
-            }
+            case Frame::kFrameDef: {
+                GarbageCollector *longTerm = _interpreter->_gc_long;
+                
+                frame.scope->setSymbolInScope(frame.arguments[0]->stringValue(), longTerm->create(_value, longTerm));
+                popFrame();
+                produce(_interpreter->_gc_short->create());
+                } break;
+                
+            case Frame::kFrameEquality: {
+                bool equality = frame.function->functionValueExtensionFunction()->specialForm() == ExtensionFunction::kSpecialFormEqual;
+                
+                if (frame.values.empty()) {
+                    frame.values.push_back(_value);
+                } else if ((*frame.values[0] == *_value) != equality) {
+                    popFrame();
+                    produce(_interpreter->_gc_short->create(false));
+                    break;
+                }
+                
+                if (++frame.index < frame.arguments.size()) {
+                    evaluate(frame.arguments[frame.index], frame.scope);
+                } else {
+                    popFrame();
+                    produce(_interpreter->_gc_short->create(true));
+                }
+                } break;
         }
-        
-        return false;
     }
     
-    bool Object::buildList(ObjectList& results) {
-        if (_type == kObjectTypeVector) {
-            results = *_contents.vectorPointer;
+    void Evaluation::startCall(Object *function) {
+        Frame& frame = _frames.back();
+        frame.function = function;
+        
+        if (function->type() == Object::kObjectTypeBuiltinFunction) {
+            ExtensionFunction *extensionFunction = function->functionValueExtensionFunction();
             
-            return true;
-        } else {
-            Object *currentObject = this;
-
-            results.clear();
+            _interpreter->validateBuiltinCall(extensionFunction, frame.arguments);
             
-            while (currentObject->_type == kObjectTypeCons) {
-                if (currentObject->_contents.consValue.right->_type == kObjectTypeCons) {
-                    // this is a cons with a cons as its right value, continue the list
-                    results.push_back(currentObject->_contents.consValue.left);
-                    currentObject = currentObject->_contents.consValue.right;
-                } else if (currentObject->_contents.consValue.right->_type == kObjectTypeNil) {
-                    // a nil terminator for the list
-                    results.push_back(currentObject->_contents.consValue.left);
-                    return true;
-                } else {
-                    // this isn't a list
-                    return false;
-                }
+            // the control forms, with the same checks and errors as their execute methods
+            switch (extensionFunction->specialForm()) {
+                case ExtensionFunction::kSpecialFormIf:
+                    frame.kind = Frame::kFrameIf;
+                    evaluate(frame.arguments[0], frame.scope);
+                    return;
+                    
+                case ExtensionFunction::kSpecialFormCond:
+                    if (frame.arguments.size() % 2 != 0) {
+                        throw Error("The cond form requires an even number of arguemnts");
+                    }
+                    
+                    if (frame.arguments.empty()) {
+                        popFrame();
+                        produce(_interpreter->_gc_short->create());
+                    } else {
+                        frame.kind = Frame::kFrameCond;
+                        evaluate(frame.arguments[0], frame.scope);
+                    }
+                    return;
+                    
+                case ExtensionFunction::kSpecialFormDo:
+                    ownScope();
+                    startBody();
+                    return;
+                    
+                case ExtensionFunction::kSpecialFormLet:
+                    if (!frame.arguments[0]->buildList(frame.bindings) || !frame.bindings.size() ||
+                        frame.bindings[0]->type() != Object::kObjectTypeSymbol || frame.bindings[0]->stringValue() != std::string("vector")) {
+                        throw Error("First argument to let statement must be a vector of bindings");
+                    }
+                    
+                    if (frame.bindings.size() % 2 != 1) {
+                        throw Error("First argument of let statement must consist of variables and values");
+                    }
+                    
+                    for (size_t bindingIndex = 1; bindingIndex < frame.bindings.size(); bindingIndex += 2) {
+                        if (frame.bindings[bindingIndex]->type() != Object::kObjectTypeSymbol) {
+                            throw Error("Let bindings should consist of symbol/value pairs");
+                        }
+                    }
+                    
+                    ownScope();
+                    frame.kind = Frame::kFrameLet;
+                    frame.index = 1;
+                    
+                    if (frame.bindings.size() > 1) {
+                        evaluate(frame.bindings[2], frame.scope);
+                    } else {
+                        startBody();
+                    }
+                    return;
+                    
+                case ExtensionFunction::kSpecialFormDef:
+                    if (frame.arguments[0]->type() != Object::kObjectTypeSymbol) {
+                        throw Error("first argument to def must be a symbol");
+                    }
+                    
+                    frame.kind = Frame::kFrameDef;
+                    evaluate(frame.arguments[1], frame.scope);
+                    return;
+                    
+                case ExtensionFunction::kSpecialFormEqual:
+                case ExtensionFunction::kSpecialFormNotEqual:
+                    frame.kind = Frame::kFrameEquality;
+                    evaluate(frame.arguments[0], frame.scope);
+                    return;
+                    
+                case ExtensionFunction::kSpecialFormNone:
+                    break;
             }
-        }
-        
-        return false;
-    }
-    
-#pragma mark -
-#pragma mark TinyClojure
-    
-    Object* TinyClojure::listObject(ObjectList list) {
-        if (list.size()) {
-            if (list.size()==1) {
-                // end a list with a nil sentinel
-                Object *nilObject = _gc_short->registerObject(new Object());
-                return _gc_short->registerObject(new Object(list[0], nilObject));
+            
+            if (extensionFunction->preEvaluateArguments() && frame.arguments.size()) {
+                frame.kind = Frame::kFrameArguments;
+                evaluate(frame.arguments[0], frame.scope);
             } else {
-                Object *left = list[0];
-                list.erase(list.begin());
-                return _gc_short->registerObject(new Object(left, listObject(list)));
+                finishCall();
+            }
+        } else if (function->type() == Object::kObjectTypeClosure) {
+            if (function->isMacro()) {
+                Object *value = _interpreter->callMacro(frame.scope, function, frame.arguments);
+                popFrame();
+                produce(value);
+            } else if (frame.arguments.size()) {
+                frame.kind = Frame::kFrameArguments;
+                evaluate(frame.arguments[0], frame.scope);
+            } else {
+                finishCall();
             }
         } else {
-            // clojure's empty lists seem to be (cons nil nil)
-            Object *nilObject = _gc_short->registerObject(new Object());
-            return _gc_short->registerObject(new Object(nilObject, nilObject));
-        }
-    }
-
-    
-    TinyClojure::TinyClojure() {
-        _ioProxy = new IOProxy();
-        _gc_long = new GarbageCollector();
-        _gc_short = new GarbageCollector();
-        _newlineSet = std::string("\n\r");
-        
-        for (char excludeChar = 1; excludeChar<32; ++excludeChar) {
-            _excludeSet.append(&excludeChar, 1);
+            throw Error("An executable S Expression must begin with a function object");
         }
-        _excludeSet.append("\"()[]{}';` ");
-        
-        _numberSet = std::string("0123456789");
-        
-        _baseScope = NULL;
-        
-        loadExtensionFunctions();
-
-        // this will initialise the root scope
-        resetInterpreter();
     }
     
-    TinyClojure::~TinyClojure() {
-        for (std::vector<ExtensionFunction*>::iterator it = _extensionFunctions.begin(); it != _extensionFunctions.end(); ++it) {
-            delete *it;
-        }
+    void Evaluation::finishCall() {
+        Frame& frame = _frames.back();
         
-        delete _baseScope;
-        delete _ioProxy;
-        delete _gc_long;
-        delete _gc_short;
+        if (frame.function->type() == Object::kObjectTypeBuiltinFunction) {
+            ExtensionFunction *extensionFunction = frame.function->functionValueExtensionFunction();
+            
+            Object *value = _interpreter->executeBuiltin(extensionFunction,
+                                                         extensionFunction->preEvaluateArguments() ? frame.values : frame.arguments,
+                                                         frame.scope);
+            popFrame();
+            produce(value);
+        } else {
+            // the closure's scope has the caller's as its parent, as callClosure's does
+            ownScope();
+            _interpreter->bindClosureArguments(frame.function, frame.values, frame.scope);
+            
+            frame.arguments.assign(1, frame.function->functionValueCode());
+            frame.index = 0;
+            startBody();
+        }
     }
     
-    void TinyClojure::addExtensionFunction(ExtensionFunction *function) {
-        internalAddExtensionFunction(function);
-        resetInterpreter();
+    void Evaluation::startBody() {
+        Frame& frame = _frames.back();
+        
+        if (frame.index < frame.arguments.size()) {
+            frame.kind = Frame::kFrameBody;
+            evaluate(frame.arguments[frame.index], frame.scope);
+        } else {
+            popFrame();
+            produce(_interpreter->_gc_short->create());
+        }
     }
     
-    void TinyClojure::internalAddExtensionFunction(ExtensionFunction *function) {
-        function->evaluator(this);
-        function->garbageCollector(_gc_long, _gc_short);
-        function->setIOProxy(_ioProxy);
-        function->setup();
+    Evaluation* TinyClojure::startEvaluation(Object *code) {
+        Evaluation *evaluation = new Evaluation(this, code);
+        evaluation->_reserveSteps = _stepLimit;
+        evaluation->_timeLeft = std::chrono::microseconds(_timeLimitMicros);
         
-        _extensionFunctions.push_back(function);        
+        _evaluations.insert(evaluation);
+        return evaluation;
     }
     
-    void TinyClojure::resetInterpreter() {
-        if (_baseScope) {
-            delete _baseScope;
+    bool TinyClojure::resume(Evaluation *evaluation, uint64_t steps) {
+        if (_resuming || _gc_short->regionDepth() > 1) {
+            throw Error("resume can't be called during an evaluation");
         }
         
-        _baseScope = new InterpreterScope();
-        
-        for (int functionIndex = 0; functionIndex < _extensionFunctions.size(); ++functionIndex) {
-            ExtensionFunction *aFunction = _extensionFunctions[functionIndex];
-            _baseScope->setSymbolInScope(aFunction->functionName(),
-                                         _gc_long->registerObject(new Object(aFunction)));
+        if (evaluation->_state == Evaluation::kEvaluationFailed) {
+            throw Error("resume of an evaluation that failed");
         }
-    }
-    
-    void TinyClojure::loadExtensionFunctions() {
-        internalAddExtensionFunction(new core::Plus());
-        internalAddExtensionFunction(new core::Minus());
-        internalAddExtensionFunction(new core::Multiply());
-        internalAddExtensionFunction(new core::Divide());
-        internalAddExtensionFunction(new core::If());
-        internalAddExtensionFunction(new core::Equality());
-        internalAddExtensionFunction(new core::NotEqual());
-        internalAddExtensionFunction(new core::Cons());
-        internalAddExtensionFunction(new core::List());
-        internalAddExtensionFunction(new core::LessThan);
-        internalAddExtensionFunction(new core::LessThanOrEqual);
-        internalAddExtensionFunction(new core::GreaterThan);
-        internalAddExtensionFunction(new core::GreaterThanOrEqual);
-        internalAddExtensionFunction(new core::Print());
-        internalAddExtensionFunction(new core::Println());
-        internalAddExtensionFunction(new core::PrintStr());
-        internalAddExtensionFunction(new core::PrintlnStr());
-        internalAddExtensionFunction(new core::Str());
-        internalAddExtensionFunction(new core::Count());
-        internalAddExtensionFunction(new core::Compare());
-        internalAddExtensionFunction(new core::Subs());
-        internalAddExtensionFunction(new core::Quot());
-        internalAddExtensionFunction(new core::Rem());
-        internalAddExtensionFunction(new core::Mod());
-        internalAddExtensionFunction(new core::Inc());
-        internalAddExtensionFunction(new core::Dec());
-        internalAddExtensionFunction(new core::Max());
-        internalAddExtensionFunction(new core::Min());
-        internalAddExtensionFunction(new core::LoadFile());
-        internalAddExtensionFunction(new core::LoadString());
-        internalAddExtensionFunction(new core::Spit());
-        internalAddExtensionFunction(new core::Slurp());
-        internalAddExtensionFunction(new core::Nsunmap());
-        internalAddExtensionFunction(new core::Def);
-        internalAddExtensionFunction(new core::Do);
-        internalAddExtensionFunction(new core::Vector);
-        internalAddExtensionFunction(new core::Fn);
-        internalAddExtensionFunction(new core::Defn);
-        internalAddExtensionFunction(new core::First);
-        internalAddExtensionFunction(new core::Rest);
-        internalAddExtensionFunction(new core::ReadString);
-        internalAddExtensionFunction(new core::Eval);
-        internalAddExtensionFunction(new core::ReadLine);
-        internalAddExtensionFunction(new core::Cond);
-        internalAddExtensionFunction(new core::Let);
-        internalAddExtensionFunction(new core::Nth);
-        internalAddExtensionFunction(new core::Defmacro);
-    }
-    
-#pragma mark parser
-    
-    Object* TinyClojure::parse(std::string startText) {
-        ParserState parseState(startText);
-        return recursiveParse(parseState);
-    }
-    
-    void TinyClojure::parseAll(std::string codeText, ObjectList& expressions) {
-        ParserState parseState(codeText);
         
-        while (parseState.charactersLeft()) {
-            Object *code = recursiveParse(parseState);
-            if (code) {
-                expressions.push_back(code);
-            }
+        if (_heapAccount.takeSoftLimitReached()) {
+            softHeapLimitReached(_heapAccount.bytesInUse());
         }
-    }
-    
-    /**
-     * TODO rewrite the entire parser
-     *
-     * it is a poor translation of Lisping's objc parser,
-     * which is a highly tolerant parser, not appropriate for an interpreter
-     */
-    Object* TinyClojure::recursiveParse(ParserState& parseState) {
-        parseState.skipSeparators();
         
-        if (parseState.position >= parseState.parserString.length()) {
-            // there is nothing here return NULL
-            return _gc_short->registerObject(new Object());
-        }
+        ResumingScope resuming(_resuming);
         
-        const int startPosition = parseState.position;
+        // carry on with what the evaluation has left of the limits, the first step looks at them and gives out the fuel
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        _reserveSteps = evaluation->_reserveSteps;
+        _deadline = start + evaluation->_timeLeft;
+        _fuel = 1;
         
-        char    startChar = parseState.currentChar(),
-                peekChar = parseState.peekChar();
+        try {
+            for (uint64_t stepIndex = 0; stepIndex < steps && evaluation->_state == Evaluation::kEvaluationSuspended; ++stepIndex) {
+                if (--_fuel == 0) {
+                    refuel();
+                }
+                
+                evaluation->step();
+            }
+        } catch (...) {
+            evaluation->_state = Evaluation::kEvaluationFailed;
+            evaluation->clear();
+            throw;
+        }
         
-        enum {
-            sexpTypeNormal,
-            sexpTypeLambdaShorthand,
-            sexpTypeListLiteral,
-            sexpTypeHashSet,
-        } sexpType = sexpTypeNormal;
+        // the fuel not yet burnt goes back, but for the step that would have taken more
+        if (_stepLimit) {
+            evaluation->_reserveSteps = _reserveSteps + _fuel - 1;
+        }
+        evaluation->_timeLeft -= std::chrono::steady_clock::now() - start;
         
-        enum {
-            stringTypeNormal,
-            stringTypeRegex,
-        } stringType = stringTypeNormal;
+        return evaluation->_state == Evaluation::kEvaluationFinished;
+    }
+    
+    void TinyClojure::releaseEvaluation(Evaluation *evaluation) {
+        _evaluations.erase(evaluation);
+        delete evaluation;
+    }
+
+#pragma mark -
+#pragma mark Allocation Profiler
+    
+    namespace {
+        /// forms longer than this are abbreviated in allocation profiles
+        const size_t kProfiledFormLength = 48;
         
-        if (startChar == '#' && peekChar == '"') {
-            stringType = stringTypeRegex;
-            startChar = peekChar;
-            parseState.position++;
+        bool moreObjects(const AllocationProfiler::Site& lhs, const AllocationProfiler::Site& rhs) {
+            return lhs.objects > rhs.objects;
         }
         
-        if (startChar == '#' && peekChar == '(') {
-            sexpType = sexpTypeLambdaShorthand;
-            startChar = peekChar;
-            parseState.position++;
-        } else if (startChar == '#' && peekChar == '{') {
-            sexpType = sexpTypeHashSet;
-            startChar = peekChar;
-            parseState.position++;
-        } else if ((startChar == '\'' || startChar == '`') && (peekChar == '(' || peekChar == '[' || peekChar == '{')) {
-            sexpType = sexpTypeListLiteral;
-            startChar = peekChar;
-            parseState.position++;
+        bool moreBytes(const AllocationProfiler::Site& lhs, const AllocationProfiler::Site& rhs) {
+            return lhs.bytes > rhs.bytes;
         }
         
-        if (startChar == '"' || stringType == stringTypeRegex) {
-            // start collecting a string
-            std::string stringbuf;
-            
-            bool escapeNextChar = false;
-
-            // ignore the intial string char
-            ++parseState.position;
+        /// append a readable version of form to description, stopping once it is longer than kProfiledFormLength
+        void describeForm(Object *form, std::string& description) {
+            if (description.size() > kProfiledFormLength) {
+                return;
+            }
             
-            while (parseState.charactersLeft()) {
-                const char currentChar = parseState.currentChar();
-                ++parseState.position;
-                
-                if (escapeNextChar) {
-                    char adjustedChar = currentChar;
-                    
-                    switch (currentChar) {
-                        case 'n':
-                            adjustedChar = 10;
-                            break;
-                            
-                        case 'r':
-                            adjustedChar = 13;
-                            break;
-                            
-                        case 't':
-                            adjustedChar = 9;
-                            break;
-                    }
-                    
-                    stringbuf.append(&adjustedChar, 1);
-
-                    escapeNextChar = false;
-                } else {
-                    if (currentChar == '\\') {
-                        escapeNextChar = true;
-                    } else {
-                        if (currentChar=='"' && stringbuf.length()) {
-                            // TODO do something in the case of regexes
-                            if (stringType == stringTypeRegex) {
-                                std::cerr << "Not dealing with regexes" << std::endl;
-                            }
-                            
-                            // end of the string
-                            Object *element = new Object(stringbuf);
-                            _gc_short->registerObject(element);
-                            return element;
+            switch (form->type()) {
+                case Object::kObjectTypeCons:
+                    description += "(";
+                    for (Object *cell = form; cell->type() == Object::kObjectTypeCons; cell = cell->consValueRight()) {
+                        if (cell != form) {
+                            description += " ";
                         }
-                        stringbuf.append(&currentChar, 1);
+                        describeForm(cell->consValueLeft(), description);
                     }
-                }
-            }
-            
-            Error error(parseState, std::string("Ran out of characters when parsing a string"));
-            throw error;
-        } else if (startChar == '(' || sexpType == sexpTypeHashSet) {
-            char closeChar = ')';
-            if (sexpType == sexpTypeHashSet) closeChar = '}';
-            
-            /*
-             * start an S-Expression
-             *
-             * We are looking for
-             * * Open parenthesis (found)
-             * * terms (recurse this function)
-             * * Close parenthesis
-             */
-            ObjectList elements;
-            
-            // advance from the parenthesis
-            ++parseState.position;
-            
-            while (true) {
-                // move on
-                parseState.skipSeparators();
-                
-                if (!parseState.charactersLeft()) {
-                    // nothing left, return the s expression so far
-                    break;
-                }
-                
-                if (parseState.currentChar()==closeChar) {
-                    // advance past the ) and end the S expression
-                    ++parseState.position;
-                    
-                    break;
-                }
-                
-                Object *element = recursiveParse(parseState);
-                if (element) {
-                    elements.push_back(element);
-                } else {
-                    // nothing left, return the s expression so far
-                    Error error(parseState, "Ran out of characters when building an S Expression");
-                    throw error;
-                    break;
-                }
-            }
-            
-            switch (sexpType) {
-                case sexpTypeNormal:
-                    return listObject(elements);
+                    description += ")";
                     break;
                     
-                case sexpTypeListLiteral:
-                    elements.insert(elements.begin(), _gc_short->registerObject(new Object(std::string("list"), true)));
-                    return listObject(elements);
+                case Object::kObjectTypeBuiltinFunction:
+                    description += form->functionValueExtensionFunction()->functionName();
                     break;
                     
-                case sexpTypeLambdaShorthand:
-                    _ioProxy->writeErr("lambda shorthand unimplemented");
-                    return NULL;
+                case Object::kObjectTypeString:
+                    description += "\"" + form->stringValue() + "\"";
                     break;
                     
-                case sexpTypeHashSet:
-                    elements.insert(elements.begin(), _gc_short->registerObject(new Object(std::string("hash-set", true))));
-                    return listObject(elements);
+                default:
+                    description += form->stringRepresentation();
                     break;
             }
+        }
+    }
+    
+    AllocationProfiler::AllocationProfiler() {
+        _topLevel.function = "(top level)";
+        _topLevel.position = 0;
+        _topLevel.objects = _topLevel.bytes = 0;
+        _currentSite = &_topLevel;
+    }
+    
+    AllocationProfiler::Site* AllocationProfiler::enterSite(Object *form) {
+        std::string function = SamplingProfiler::frameName(form);
+        std::pair<uint32_t, std::string> key(form->sourcePosition(), function);
+        std::map<std::pair<uint32_t, std::string>, Site>::iterator it = _sites.find(key);
+        
+        if (it == _sites.end()) {
+            Site site;
+            site.function = function;
+            describeForm(form, site.form);
+            if (site.form.size() > kProfiledFormLength) {
+                site.form = site.form.substr(0, kProfiledFormLength) + "...";
+            }
+            site.position = form->sourcePosition();
+            site.objects = site.bytes = 0;
             
-            return NULL;
-        } else if (startChar == '[') {
-            /*
-             * start a Clojure vector
-             *
-             * We are looking for
-             * * Open parenthesis (found)
-             * * terms (recurse this function)
-             * * Close parenthesis
-             */
-            ObjectList elements;
+            it = _sites.insert(std::make_pair(key, site)).first;
+        }
+        
+        Site *previous = _currentSite;
+        _currentSite = &it->second;
+        return previous;
+    }
+    
+    std::vector<AllocationProfiler::Site> AllocationProfiler::sites() const {
+        std::vector<Site> sites;
+        
+        if (_topLevel.objects) {
+            sites.push_back(_topLevel);
+        }
+        
+        for (std::map<std::pair<uint32_t, std::string>, Site>::const_iterator it = _sites.begin(); it != _sites.end(); ++it) {
+            if (it->second.objects) {
+                sites.push_back(it->second);
+            }
+        }
+        
+        std::stable_sort(sites.begin(), sites.end(), moreBytes);
+        return sites;
+    }
+    
+    std::string AllocationProfiler::report(size_t topCount) const {
+        std::vector<Site> sites = this->sites();
+        std::stringstream stringBuilder;
+        
+        for (int ranking = 0; ranking < 2; ++ranking) {
+            std::stable_sort(sites.begin(), sites.end(), ranking == 0 ? moreObjects : moreBytes);
             
-            // advance from the parenthesis
-            ++parseState.position;
+            stringBuilder   << (ranking == 0 ? "allocation sites by objects" : "allocation sites by bytes") << std::endl
+                            << std::setw(12) << "objects" << std::setw(14) << "bytes" << std::setw(10) << "position"
+                            << "  function: form" << std::endl;
             
-            while (true) {
-                // move on
-                parseState.skipSeparators();
-                
-                if (!parseState.charactersLeft()) {
-                    Error error(parseState, "Ran out of characters when building a vector");
-                    throw error;
-                }
-                
-                if (parseState.currentChar()==']') {
-                    // advance past the ] and end the vector
-                    ++parseState.position;
-
-                    // insert the vector identifier at the beginning
-                    elements.insert(elements.begin(), _gc_short->registerObject(new Object("vector", true)));
-                    
-                    return listObject(elements);
-                }
+            for (size_t siteIndex = 0; siteIndex < std::min(topCount, sites.size()); ++siteIndex) {
+                const Site& site = sites[siteIndex];
                 
-                Object *element = recursiveParse(parseState);
-                if (element) {
-                    elements.push_back(element);
+                stringBuilder   << std::setw(12) << site.objects << std::setw(14) << site.bytes << std::setw(10);
+                if (site.position) {
+                    stringBuilder << site.position;
                 } else {
-                    Error error(parseState, "Ran out of characters when building a vector");
-                    throw error;
+                    stringBuilder << "-";
                 }
+                stringBuilder   << "  " << site.function << ": " << site.form << std::endl;
             }
-        } else if (startChar == '{') {
-            /*
-             * start a Clojure map
-             *
-             * We are looking for
-             * * Open parenthesis (found)
-             * * terms (recurse this function)
-             * * Close parenthesis
-             */
-            
-            ObjectList elements;
             
-            // advance beyond the parenthesis
-            ++parseState.position;
+            stringBuilder << std::endl;
+        }
+        
+        return stringBuilder.str();
+    }
+
+#pragma mark -
+#pragma mark Sampling Profiler
+    
+    namespace {
+        /// ticks of the profiling timer, counted by the signal handler, lock free so the handler may touch it
+        std::atomic<unsigned long> profilingTicks(0);
+        static_assert(ATOMIC_LONG_LOCK_FREE == 2, "the profiling tick counter must be lock free to be used in a signal handler");
+        
+        /**
+         * the number of SamplingProfilers, the timer runs while there are any
+         *
+         * the first to start installs the handler and the timer, and the last to stop puts back what was there before,
+         * so the count and the saved handler and timer are only touched with profilersMutex held
+         */
+        std::mutex profilersMutex;
+        int activeProfilers = 0;
+        struct sigaction previousProfilingAction;
+        struct itimerval previousProfilingTimer;
+        
+        void countProfilingTick(int signalNumber) {
+            profilingTicks.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    
+    SamplingProfiler::SamplingProfiler(int64_t intervalMicros) {
+        _ticksTaken = profilingTicks.load(std::memory_order_relaxed);
+        
+        std::lock_guard<std::mutex> lock(profilersMutex);
+        
+        if (activeProfilers++ == 0) {
+            struct sigaction action;
+            memset(&action, 0, sizeof(action));
+            action.sa_handler = countProfilingTick;
+            action.sa_flags = SA_RESTART;
+            sigemptyset(&action.sa_mask);
+            sigaction(SIGPROF, &action, &previousProfilingAction);
             
-            while (true) {
-                parseState.skipSeparators();
-                
-                if (!parseState.charactersLeft()) {
-                    Error error(parseState, "Ran out of characters when building a map");
-                    throw error;
-                }
+            struct itimerval timer;
+            timer.it_interval.tv_sec = timer.it_value.tv_sec = intervalMicros / 1000000;
+            timer.it_interval.tv_usec = timer.it_value.tv_usec = intervalMicros % 1000000;
+            setitimer(ITIMER_PROF, &timer, &previousProfilingTimer);
+        }
+    }
+    
+    SamplingProfiler::~SamplingProfiler() {
+        std::lock_guard<std::mutex> lock(profilersMutex);
+        
+        if (--activeProfilers == 0) {
+            // the timer goes first, so no tick arrives after the handler it was meant for has gone
+            setitimer(ITIMER_PROF, &previousProfilingTimer, NULL);
+            sigaction(SIGPROF, &previousProfilingAction, NULL);
+        }
+    }
+    
+    std::string SamplingProfiler::frameName(Object *form) {
+        Object *head = form->consValueLeft();
+        
+        switch (head->type()) {
+            case Object::kObjectTypeSymbol:
+                return head->stringValue();
                 
-                if (parseState.currentChar()=='}') {
-                    // advance past the ] and end the vector
-                    ++parseState.position;
-                    
-                    return listObject(elements);
-                }
+            case Object::kObjectTypeBuiltinFunction:
+                return head->functionValueExtensionFunction()->functionName();
                 
-                Object *element = recursiveParse(parseState);
-                if (element) {
-                    elements.push_back(element);
+            default:
+                return Object::typeName(head->type());
+        }
+    }
+    
+    void SamplingProfiler::takeSamples() {
+        unsigned long ticks = profilingTicks.load(std::memory_order_relaxed);
+        if (ticks == _ticksTaken) {
+            return;
+        }
+        
+        std::string stack;
+        for (size_t frameIndex = 0; frameIndex < _stack.size(); ++frameIndex) {
+            if (frameIndex) {
+                stack += ";";
+            }
+            stack += _stack[frameIndex];
+        }
+        
+        _samples[stack.empty() ? std::string("(top level)") : stack] += ticks - _ticksTaken;
+        _ticksTaken = ticks;
+    }
+    
+    std::string SamplingProfiler::foldedStacks() const {
+        std::stringstream stringBuilder;
+        
+        for (std::map<std::string, uint64_t>::const_iterator it = _samples.begin(); it != _samples.end(); ++it) {
+            stringBuilder << it->first << " " << it->second << std::endl;
+        }
+        
+        return stringBuilder.str();
+    }
+
+#pragma mark -
+#pragma mark Trace Recorder
+    
+    namespace {
+        /// how long the writer thread waits when the ring is empty
+        const std::chrono::milliseconds kTraceWriterIdle(10);
+        
+        /// a small number identifying the calling thread in trace events
+        uint32_t traceThreadId() {
+            static std::atomic<uint32_t> threadCount(0);
+            static thread_local uint32_t threadId = ++threadCount;
+            return threadId;
+        }
+        
+        void writeJSONString(FILE *file, const char *text) {
+            fputc('"', file);
+            for (const char *character = text; *character; ++character) {
+                if (*character == '"' || *character == '\\') {
+                    fputc('\\', file);
+                    fputc(*character, file);
+                } else if ((unsigned char)*character < 0x20) {
+                    fprintf(file, "\\u%04x", *character);
                 } else {
-                    Error error(parseState, "Ran out of characters when building a map");
-                    throw error;
+                    fputc(*character, file);
                 }
             }
-        } else if (startChar == ';') {
-            /// start a comment, run until the end of the line
-            std::string comment;
+            fputc('"', file);
+        }
+    }
+    
+    TraceRecorder::TraceRecorder(const std::string& path, size_t capacity) : _enqueuePosition(0), _dequeuePosition(0), _droppedEvents(0), _stopping(false) {
+        _file = fopen(path.c_str(), "w");
+        if (!_file) {
+            throw Error("could not create the trace file " + path);
+        }
+        fputs("{\"traceEvents\":[", _file);
+        _firstEvent = true;
+        _processId = getpid();
+        _origin = std::chrono::steady_clock::now();
+        
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        _mask = size - 1;
+        
+        // each slot's sequence says whose turn it is, a producer at that position or the consumer one after it
+        _ring = new Event[size];
+        for (size_t position = 0; position < size; ++position) {
+            _ring[position].sequence.store(position, std::memory_order_relaxed);
+        }
+        
+        _writer = std::thread(&TraceRecorder::writeEvents, this);
+    }
+    
+    TraceRecorder::~TraceRecorder() {
+        _stopping = true;
+        _writer.join();
+        
+        fputs("\n]}\n", _file);
+        fclose(_file);
+        delete[] _ring;
+    }
+    
+    void TraceRecorder::record(const char *category, const std::string& name, TimePoint start, TimePoint end) {
+        size_t position = _enqueuePosition.load(std::memory_order_relaxed);
+        Event *event;
+        
+        // claim a slot, several threads may be recording
+        for (;;) {
+            event = &_ring[position & _mask];
+            size_t sequence = event->sequence.load(std::memory_order_acquire);
             
-            while (parseState.charactersLeft()) {
-                const char currentChar = parseState.currentChar();
-                
-                bool commentChar = false;
-                
-                if (_newlineSet.find(currentChar) == _newlineSet.npos) {
-                    comment.append(&currentChar, 1);
-                    commentChar = true;
-                    ++parseState.position;
-                }
-                
-                if (!commentChar || !parseState.charactersLeft()) {
-                    // end of the comment, ignore it
-                    return recursiveParse(parseState);
+            if (sequence == position) {
+                if (_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
                 }
+            } else if (sequence < position) {
+                // the writer hasn't got this far round
+                ++_droppedEvents;
+                return;
+            } else {
+                position = _enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+        
+        event->category = category;
+        size_t nameLength = std::min(name.size(), kNameLength - 1);
+        memcpy(event->name, name.data(), nameLength);
+        event->name[nameLength] = 0;
+        event->startNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(start - _origin).count();
+        event->durationNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        event->threadId = traceThreadId();
+        
+        event->sequence.store(position + 1, std::memory_order_release);
+    }
+    
+    void TraceRecorder::writeEvents() {
+        while (!_stopping) {
+            if (!drainEvents()) {
+                std::this_thread::sleep_for(kTraceWriterIdle);
+            }
+        }
+        
+        // whatever was recorded before the recorder was destroyed
+        while (drainEvents()) {
+        }
+    }
+    
+    bool TraceRecorder::drainEvents() {
+        bool drained = false;
+        
+        for (;;) {
+            Event *event = &_ring[_dequeuePosition & _mask];
+            if (event->sequence.load(std::memory_order_acquire) != _dequeuePosition + 1) {
+                return drained;
             }
-        } else if (startChar == '`' || startChar == '\'') {
-            // start collecting a symbol
-            // TODO no real difference between symbols, identifiers and numbers
-            std::string symbol;
             
-            while (parseState.charactersLeft()) {
-                const char  currentChar = parseState.currentChar(),
-                            peekChar = parseState.peekChar(),
-                            peekPeekChar = parseState.peekPeekChar();
-                
-                bool identifierChar = false;
-                
-                if(_excludeSet.find(currentChar) == _excludeSet.npos
-                    || (symbol.length() == 0)) {
-                    symbol.append(&currentChar, 1);
-                    identifierChar = false;
-                    ++parseState.position;
-                }
+            fputs(_firstEvent ? "\n{\"name\":" : ",\n{\"name\":", _file);
+            writeJSONString(_file, event->name);
+            fprintf(_file, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u}",
+                    event->category, event->startNanos / 1000.0, event->durationNanos / 1000.0, _processId, event->threadId);
+            _firstEvent = false;
+            drained = true;
+            
+            // hand the slot back to the producers for their next time round
+            event->sequence.store(_dequeuePosition + _mask + 1, std::memory_order_release);
+            ++_dequeuePosition;
+        }
+    }
+
+#pragma mark -
+#pragma mark Source File
+    
+    SourceFile::SourceFile(const std::string& path) : _text(""), _length(0), _mapping(NULL) {
+        int descriptor = open(path.c_str(), O_RDONLY);
+        if (descriptor < 0) {
+            throw Error("could not open " + path);
+        }
+        
+        struct stat status;
+        if (fstat(descriptor, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0) {
+            void *mapping = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            
+            if (mapping != MAP_FAILED) {
+                // the reader goes through the text once, from start to end
+                madvise(mapping, status.st_size, MADV_SEQUENTIAL);
+                _mapping = mapping;
+                _text = (const char*)mapping;
+                _length = status.st_size;
+            }
+        }
+        
+        if (!_mapping) {
+            char block[65536];
+            ssize_t count;
+            
+            while ((count = read(descriptor, block, sizeof(block))) > 0) {
+                _buffer.append(block, count);
+            }
+            
+            _text = _buffer.data();
+            _length = _buffer.length();
+        }
+        
+        close(descriptor);
+    }
+    
+    SourceFile::~SourceFile() {
+        if (_mapping) {
+            munmap(_mapping, _length);
+        }
+    }
+
+#pragma mark -
+#pragma mark Script Image
+    
+    namespace {
+        /// the start of every image, then its format version and a word to check the byte order
+        const char kImageMagic[8] = "TCLJC\n\x1a";
+        const uint32_t kImageVersion = 1, kImageByteOrder = 0x01020304;
+        const size_t kImageHeaderSize = sizeof(kImageMagic) + 2 * sizeof(uint32_t);
+        
+        /// append count to out as unsigned LEB128, seven bits a byte with the top bit set on all but the last
+        void appendCount(std::string& out, uint64_t count) {
+            while (count >= 0x80) {
+                out.push_back((char)(0x80 | (count & 0x7f)));
+                count >>= 7;
+            }
+            out.push_back((char)count);
+        }
+        
+        /// append the bytes of a fixed size value, in this machine's byte order
+        template <typename Value>
+        void appendRaw(std::string& out, Value value) {
+            out.append((const char*)&value, sizeof(value));
+        }
+        
+        /// builds an image a form at a time, sharing table entries between equal symbols and constants
+        class ImageWriter {
+        public:
+            ImageWriter() : _symbolCount(0), _constantCount(0) {}
+            
+            /// append a form, a tree of the atoms and lists the reader makes, to the form stream
+            void writeForm(Object *form) {
+                std::vector<Object*> pending(1, form);
+                ObjectList elements;
                 
-                if (!identifierChar
-                    || !parseState.charactersLeft()
-                    || (peekChar=='#' && peekPeekChar=='"')) {
-                    // this is a literal symbol xxx, translate to (quote xxx) and push that
-                    std::vector<Object *> els;
-                    els.push_back(_gc_short->registerObject(new Object("quote", true)));
-                    els.push_back(_gc_short->registerObject(new Object(symbol, true)));
-                    return listObject(els);
+                while (pending.size()) {
+                    Object *object = pending.back();
+                    pending.pop_back();
+                    
+                    switch (object->type()) {
+                        case Object::kObjectTypeNil:
+                            _forms.push_back(ScriptImage::kTagNil);
+                            break;
+                            
+                        case Object::kObjectTypeBoolean:
+                            _forms.push_back(object->booleanValue() ? ScriptImage::kTagTrue : ScriptImage::kTagFalse);
+                            break;
+                            
+                        case Object::kObjectTypeSymbol:
+                            _forms.push_back(ScriptImage::kTagSymbol);
+                            appendCount(_forms, symbolIndex(object->stringValue()));
+                            break;
+                            
+                        case Object::kObjectTypeString:
+                            _forms.push_back(ScriptImage::kTagConstant);
+                            appendCount(_forms, constantIndex(ScriptImage::kConstantString, object->stringValue()));
+                            break;
+                            
+                        case Object::kObjectTypeNumber: {
+                            const Number& number = object->numberReference();
+                            
+                            switch (number.getMode()) {
+                                case Number::kNumberModeInteger: {
+                                    int64_t value = number.rawInteger();
+                                    _forms.push_back(ScriptImage::kTagInteger);
+                                    appendCount(_forms, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+                                } break;
+                                    
+                                case Number::kNumberModeFloating:
+                                    _forms.push_back(ScriptImage::kTagFloating);
+                                    appendRaw(_forms, number.rawFloating());
+                                    break;
+                                    
+                                case Number::kNumberModeBigInteger:
+                                    _forms.push_back(ScriptImage::kTagConstant);
+                                    appendCount(_forms, constantIndex(ScriptImage::kConstantBigInteger, number.stringRepresentation()));
+                                    break;
+                            }
+                        } break;
+                            
+                        case Object::kObjectTypeCons: {
+                            elements.clear();
+                            
+                            Object *cell = object;
+                            for (; cell->type() == Object::kObjectTypeCons; cell = cell->consValueRight()) {
+                                elements.push_back(cell->consValueLeft());
+                            }
+                            
+                            if (cell->type() != Object::kObjectTypeNil) {
+                                throw Error("dotted pairs can't be compiled");
+                            }
+                            
+                            _forms.push_back(ScriptImage::kTagList);
+                            appendCount(_forms, elements.size());
+                            appendCount(_forms, object->sourcePosition());
+                            
+                            // the elements are written first to last, so they go on the stack last to first
+                            pending.insert(pending.end(), elements.rbegin(), elements.rend());
+                        } break;
+                            
+                        default:
+                            throw Error("only the forms the reader makes can be compiled, not " + object->stringRepresentation());
+                    }
                 }
             }
-        } else if (_excludeSet.find(startChar) == _excludeSet.npos) {
-            // start an identifier
-            std::string identifier;
             
-            while (parseState.charactersLeft()) {
-                const char  currentChar = parseState.currentChar(),
-                            peekChar = parseState.peekChar(),
-                            peekPeekChar = parseState.peekPeekChar();
-                
-                bool identifierChar = false;
+            /// the whole image, the header, the tables and the forms
+            std::string image() const {
+                std::string out(kImageMagic, sizeof(kImageMagic));
+                appendRaw(out, kImageVersion);
+                appendRaw(out, kImageByteOrder);
+                appendCount(out, _symbolCount);
+                out += _symbols;
+                appendCount(out, _constantCount);
+                out += _constants;
+                out += _forms;
+                return out;
+            }
+            
+        protected:
+            uint64_t symbolIndex(const std::string& name) {
+                std::unordered_map<std::string, uint64_t>::iterator it = _symbolIndexes.find(name);
+                if (it != _symbolIndexes.end()) {
+                    return it->second;
+                }
                 
-                if (_excludeSet.find(currentChar) == _excludeSet.npos
-                    || ((startChar=='#') && (currentChar==';') && (parseState.position == startPosition+1))) {    // case to deal with inline comments
-                    identifier.append(&currentChar, 1);
-                    identifierChar = true;
-                    ++parseState.position;
+                appendCount(_symbols, name.size());
+                _symbols += name;
+                return _symbolIndexes[name] = _symbolCount++;
+            }
+            
+            /// the index of the constant, the characters of a string or the digits of a big integer
+            uint64_t constantIndex(ScriptImage::ConstantKind kind, const std::string& text) {
+                std::string key = (char)kind + text;
+                std::unordered_map<std::string, uint64_t>::iterator it = _constantIndexes.find(key);
+                if (it != _constantIndexes.end()) {
+                    return it->second;
                 }
                 
-                if (!identifierChar
-                    || !parseState.charactersLeft()
-                    || (peekChar=='#' && peekPeekChar=='"')) {
-                    if (identifier.find("#;")==0) {
-                        // inline comment element
-                        return recursiveParse(parseState);
-                    } else {
-                        // check for known symbol names
-                        if (identifier == "true") {
-                            return _gc_short->registerObject(new Object(true));
-                        } else if (identifier == "false") {
-                            return _gc_short->registerObject(new Object(false));
-                        } else if (identifier == "nil") {
-                            return _gc_short->registerObject(new Object());
-                        }
-                        
-                        int numberBaseIndex = 0;
-                        if (identifier[numberBaseIndex] == '-') {
-                            numberBaseIndex = 1;
-                        }
-                        
-                        bool isInteger = true;
-                        for (int identifierIndex = numberBaseIndex; identifierIndex < identifier.size(); ++identifierIndex) {
-                            if (_numberSet.find(identifier[identifierIndex]) == _numberSet.npos) {
-                                isInteger = false;
-                                break;
-                            }
-                        }
-                        if (identifier.length() == numberBaseIndex) {
-                            // this can happen with a pure - sign
-                            isInteger = false;
-                        }
-                        
-                        bool    isFloat = true,
-                                pointFound = false;
-                        for (int identifierIndex = numberBaseIndex; identifierIndex < identifier.size(); ++identifierIndex) {
-                            if (identifier[identifierIndex]=='.') {
-                                if (pointFound) {
-                                    isFloat = false;
-                                    break;
-                                } else {
-                                    pointFound = true;
-                                }
-                            } else if (_numberSet.find(identifier[identifierIndex]) == _numberSet.npos) {
-                                isInteger = false;
-                                break;
-                            }
-                        }
-                        if (!pointFound) {
-                            isFloat = false;
-                        }
-                        
-                        if (isInteger) {
-                            return _gc_short->registerObject(new Object(atoi(identifier.c_str())));
-                        } else if (isFloat) {
-                            return _gc_short->registerObject(new Object(atof(identifier.c_str())));
-                        } else {
-                            return _gc_short->registerObject(new Object(identifier, true));
-                        }
-                    }
-                }            
+                _constants.push_back((char)kind);
+                appendCount(_constants, text.size());
+                _constants += text;
+                return _constantIndexes[key] = _constantCount++;
+            }
+            
+            std::string _symbols, _constants, _forms;
+            uint64_t _symbolCount, _constantCount;
+            std::unordered_map<std::string, uint64_t> _symbolIndexes, _constantIndexes;
+        };
+        
+        /// the time a file was last changed, in nanoseconds, or -1 if it can't be found
+        int64_t modificationTime(const std::string& path) {
+            struct stat status;
+            if (stat(path.c_str(), &status) != 0) {
+                return -1;
             }
+            
+#if defined(__APPLE__)
+            return (int64_t)status.st_mtimespec.tv_sec * 1000000000 + status.st_mtimespec.tv_nsec;
+#else
+            return (int64_t)status.st_mtim.tv_sec * 1000000000 + status.st_mtim.tv_nsec;
+#endif
         }
-                
-        return NULL;
     }
     
-#pragma mark evaluator
+    ScriptImage::ScriptImage(const std::string& path) : _file(path), _path(path) {
+        uint32_t version, byteOrder;
+        
+        if (_file.length() < kImageHeaderSize || memcmp(_file.text(), kImageMagic, sizeof(kImageMagic))) {
+            throw Error(path + " is not a script image");
+        }
+        
+        memcpy(&version, _file.text() + sizeof(kImageMagic), sizeof(version));
+        memcpy(&byteOrder, _file.text() + sizeof(kImageMagic) + sizeof(version), sizeof(byteOrder));
+        if (version != kImageVersion || byteOrder != kImageByteOrder) {
+            throw Error(path + " was compiled by another version of TinyClojure or for another machine");
+        }
+        
+        size_t position = kImageHeaderSize;
+        
+        uint64_t symbolCount = readCount(position);
+        for (uint64_t symbolIndex = 0; symbolIndex < symbolCount; ++symbolIndex) {
+            uint64_t length = readCount(position);
+            _symbols.push_back(std::make_pair(readBytes(position, length), (size_t)length));
+        }
+        
+        uint64_t constantCount = readCount(position);
+        for (uint64_t constantIndex = 0; constantIndex < constantCount; ++constantIndex) {
+            uint8_t kind = readByte(position);
+            if (kind > kConstantBigInteger) {
+                throw Error("the script image " + _path + " is damaged");
+            }
+            
+            Constant constant;
+            constant.kind = (ConstantKind)kind;
+            constant.length = readCount(position);
+            constant.text = readBytes(position, constant.length);
+            _constants.push_back(constant);
+        }
+        
+        _formsStart = position;
+    }
     
-    Object* TinyClojure::scopedEval(InterpreterScope *interpreterState, Object *code) {
-        InterpreterScope newScope(interpreterState);
+    std::string ScriptImage::imagePath(const std::string& sourcePath) {
+        const std::string extension(".clj");
         
-        return unscopedEval(interpreterState, code);
+        if (sourcePath.size() >= extension.size() && sourcePath.compare(sourcePath.size() - extension.size(), extension.size(), extension) == 0) {
+            return sourcePath.substr(0, sourcePath.size() - extension.size()) + ".tcljc";
+        }
+        return sourcePath + ".tcljc";
     }
     
-    Object* TinyClojure::unscopedEval(InterpreterScope *interpreterState, Object *code) {
-        switch (code->type()) {
-            case Object::kObjectTypeNil:
-            case Object::kObjectTypeNumber:
-            case Object::kObjectTypeString:
-            case Object::kObjectTypeBoolean:
-            case Object::kObjectTypeBuiltinFunction:
-            case Object::kObjectTypeClosure:
-                return code;
-                break;
-                
-            case Object::kObjectTypeVector: {
-                ObjectList elements;
-                
-                for (int elementIndex=0; elementIndex<code->vectorValue().size(); ++elementIndex) {
-                    elements[elementIndex] = scopedEval(interpreterState, code->vectorValue()[elementIndex]);
+    bool ScriptImage::isCurrent(const std::string& imagePath, const std::string& sourcePath) {
+        int64_t sourceTime = modificationTime(sourcePath);
+        return sourceTime >= 0 && modificationTime(imagePath) > sourceTime;
+    }
+    
+    ScriptImage* ScriptImage::openCurrent(const std::string& sourcePath) {
+        std::string path = imagePath(sourcePath);
+        if (!isCurrent(path, sourcePath)) {
+            return NULL;
+        }
+        
+        try {
+            return new ScriptImage(path);
+        } catch (Error error) {
+            return NULL;
+        }
+    }
+    
+    uint8_t ScriptImage::readByte(size_t& position) const {
+        if (position >= _file.length()) {
+            throw Error("the script image " + _path + " is damaged");
+        }
+        return (uint8_t)_file.text()[position++];
+    }
+    
+    uint64_t ScriptImage::readCount(size_t& position) const {
+        uint64_t count = 0;
+        
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t byte = readByte(position);
+            count |= (uint64_t)(byte & 0x7f) << shift;
+            
+            if (!(byte & 0x80)) {
+                return count;
+            }
+        }
+        
+        throw Error("the script image " + _path + " is damaged");
+    }
+    
+    const char* ScriptImage::readBytes(size_t& position, uint64_t count) const {
+        if (count > _file.length() - position) {
+            throw Error("the script image " + _path + " is damaged");
+        }
+        
+        const char *bytes = _file.text() + position;
+        position += count;
+        return bytes;
+    }
+    
+    void TinyClojure::compileImage(const char *text, size_t length, const std::string& imagePath) {
+        TraceRecorder::Scope compileTrace(_traceRecorder, "parse", "compileImage");
+        ImageWriter writer;
+        size_t position = 0;
+        
+        // each form is freed once it is written, so the parsed forms of the whole text are never all in memory
+        while (true) {
+            _gc_short->pushRegion();
+            
+            try {
+                Object *form = readForm(text, length, position, _gc_short);
+                if (!form) {
+                    _gc_short->popRegion(NULL);
+                    break;
                 }
                 
-                return _gc_short->registerObject(new Object(elements));
-                } break;
+                writer.writeForm(form);
+            } catch (...) {
+                _gc_short->popRegion(NULL);
+                throw;
+            }
+            
+            _gc_short->popRegion(NULL);
+        }
         
-            case Object::kObjectTypeSymbol: {
-
-                Object *symbolValue = interpreterState->lookupSymbol(code->stringValue());
-
-                if (symbolValue) {
-
-                    // Checks if the symbol still needs to be evaluated (i.e. Macros need to be evaluated at a different stage)
-                    if (symbolValue->type() == Object::kObjectTypeCons) {
-                        if (symbolValue->consValueLeft()->stringValue() == "macroEval") {
-
-                            if (symbolValue->consValueRight()->type() == Object::kObjectTypeCons) {
-                                Object *temp = scopedEval(interpreterState, symbolValue->consValueRight());
-                                return scopedEval(interpreterState, temp);
-                            } else {
-                                return symbolValue->consValueRight();
-                            }
-                        }
-                    }
-
-                    return symbolValue;
-                } else {
-                    std::stringstream stringBuilder;
-                    stringBuilder << "I do not understand the symbol " << code->stringValue();
-                    throw Error(stringBuilder.str());
-                }
-            } break;
+        std::string image = writer.image(), temporaryPath = imagePath + ".tmp";
         
-            case Object::kObjectTypeCons:
-                if (code->isList()) {
-                    ObjectList arguments;
-                    code->buildList(arguments);
+        FILE *file = fopen(temporaryPath.c_str(), "wb");
+        if (!file) {
+            throw Error("could not create " + temporaryPath);
+        }
+        
+        bool written = fwrite(image.data(), 1, image.size(), file) == image.size();
+        written = fclose(file) == 0 && written;
+        
+        if (!written || rename(temporaryPath.c_str(), imagePath.c_str()) != 0) {
+            remove(temporaryPath.c_str());
+            throw Error("could not write " + imagePath);
+        }
+    }
+    
+    Object* TinyClojure::loadNext(const ScriptImage& image, size_t& position) {
+        if (position >= image.length()) {
+            return NULL;
+        }
+        
+        TraceRecorder::Scope loadTrace(_traceRecorder, "parse", "loadNext");
+        
+        // the lists being made, which are kept on a stack rather than by recursion as in readForm
+        struct OpenList {
+            uint64_t remaining;
+            size_t firstElement;
+            uint32_t sourcePosition;
+        };
+        std::vector<OpenList> openLists;
+        ObjectList elements;
+        
+        while (true) {
+            Object *form;
+            
+            switch (image.readByte(position)) {
+                case ScriptImage::kTagNil:
+                    form = _gc_short->create();
+                    break;
                     
-                    Object *identifierObject = scopedEval(interpreterState, arguments[0]);
+                case ScriptImage::kTagTrue:
+                    form = _gc_short->create(true);
+                    break;
                     
-                    // remove the identifier so that arguments contains just the arguments to the function
-                    arguments.erase(arguments.begin());
+                case ScriptImage::kTagFalse:
+                    form = _gc_short->create(false);
+                    break;
                     
-                    if (identifierObject->type()==Object::kObjectTypeBuiltinFunction) {
-                        ExtensionFunction *function = identifierObject->functionValueExtensionFunction();
-                        
-                        int minArgs = function->minimumNumberOfArguments(),
-                            maxArgs = function->maximumNumberOfArguments();
-                        
-                        if (minArgs>=0) {
-                            if (arguments.size() < minArgs) {
-                                std::stringstream stringBuilder;
-                                stringBuilder   << "Function "
-                                                << function->functionName()
-                                                << " requires at least "
-                                                << minArgs
-                                                << " arguments"
-                                                << std::endl;
-                                
-                                throw Error(stringBuilder.str());
-                            }
-                        }
-                        
-                        if (maxArgs>=0) {
-                            if (arguments.size() > maxArgs) {
-                                std::stringstream stringBuilder;
-                                stringBuilder   << "Function "
-                                                << function->functionName()
-                                                << " requires no more than "
-                                                << maxArgs
-                                                << " arguments"
-                                                << std::endl;
-                                
-                                throw Error(stringBuilder.str());
-                            }
-                        }
-                        
-                        std::vector<Object::ObjectType> types;
-                        for (int parameterIndex=0; parameterIndex<arguments.size(); ++parameterIndex) {
-                            types.push_back(arguments[parameterIndex]->type());
-                        }
-                        
-                        if (!function->validateArgumentTypes(types)) {
-                            std::stringstream stringBuilder;
-                            stringBuilder   << "Function "
-                                            << function->functionName()
-                                            << "'s type signature does not match that which is passed"
-                                            << std::endl;
-
-                            throw Error(stringBuilder.str());
-                        }
-                        
-                        ObjectList preparedArguments;
-                        if (function->preEvaluateArguments()) {
-                            for (int argumentIndex=0; argumentIndex<arguments.size(); ++argumentIndex) {
-                                preparedArguments.push_back(scopedEval(interpreterState, arguments[argumentIndex]));
-                            }
-                        } else {
-                            preparedArguments = arguments;
-                        }
-                        
-                        Object *result = function->execute(preparedArguments, interpreterState);
-                        if (result==NULL) {
-                            result = _gc_short->registerObject(new Object());
-                        }
-                        
-                        return result;
-                    } else if (identifierObject->type() == Object::kObjectTypeClosure) {
-
-                        if (identifierObject->functionValueParameters().size() != arguments.size()) {
-                            std::stringstream stringBuilder;
-                            stringBuilder << "Function requires "
-                            << identifierObject->functionValueParameters().size()
-                            << " argument(s)"
-                            << std::endl;
-
-                            throw Error(stringBuilder.str());
-                        }
-
-                        // build a new scope containing the passed arguments
-                        InterpreterScope functionScope(interpreterState);
-
-                        if (identifierObject->isMacro()) {
-
-                            // is a macro
-                            for (int parameterIndex = 0; parameterIndex < identifierObject->functionValueParameters().size(); ++parameterIndex) {
-                                std::string macroEval = "macroEval";
-
-                                Object* testObj = _gc_short->registerObject(new Object(_gc_short->registerObject(new Object(macroEval)), parse(arguments[parameterIndex]->stringValue())));
-                                Object* newTestObj = _gc_long->registerObject(new Object(testObj, _gc_long));
-                                functionScope.setSymbolInScope(identifierObject->functionValueParameters()[parameterIndex]->stringValue(), newTestObj);
-                            }
-
-                        } else {
-
-                            // not a macro, normal function
-                            for (int parameterIndex = 0; parameterIndex < identifierObject->functionValueParameters().size(); ++parameterIndex) {
-                                functionScope.setSymbolInScope(identifierObject->functionValueParameters()[parameterIndex]->stringValue(), _gc_long->registerObject(new Object(scopedEval(interpreterState, arguments[parameterIndex]), _gc_long)));
-                            }
-                        }
-
-                        return scopedEval(&functionScope, identifierObject->functionValueCode());
-
+                case ScriptImage::kTagSymbol: {
+                    uint64_t index = image.readCount(position);
+                    if (index >= image._symbols.size()) {
+                        throw Error("the script image " + image._path + " is damaged");
+                    }
+                    
+                    form = _gc_short->create(std::string(image._symbols[index].first, image._symbols[index].second), true);
+                } break;
+                    
+                case ScriptImage::kTagConstant: {
+                    uint64_t index = image.readCount(position);
+                    if (index >= image._constants.size()) {
+                        throw Error("the script image " + image._path + " is damaged");
+                    }
+                    
+                    const ScriptImage::Constant& constant = image._constants[index];
+                    if (constant.kind == ScriptImage::kConstantString) {
+                        form = _gc_short->create(std::string(constant.text, constant.length));
                     } else {
-                        throw Error("An executable S Expression must begin with a function object");
+                        form = _gc_short->create(Number::integerFromString(std::string(constant.text, constant.length)));
                     }
-                } else {
-                    // I could be wrong, but I don't think this case makes any sense, most likely we got here cos of a flaw in buildList
-                    throw Error("An executable S Expression was not understood");
+                } break;
+                    
+                case ScriptImage::kTagInteger: {
+                    uint64_t zigzag = image.readCount(position);
+                    form = _gc_short->create(Number((int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1)));
+                } break;
+                    
+                case ScriptImage::kTagFloating: {
+                    double value;
+                    memcpy(&value, image.readBytes(position, sizeof(value)), sizeof(value));
+                    form = _gc_short->create(value);
+                } break;
+                    
+                case ScriptImage::kTagList: {
+                    OpenList open;
+                    open.remaining = image.readCount(position);
+                    open.firstElement = elements.size();
+                    open.sourcePosition = (uint32_t)image.readCount(position);
+                    
+                    if (open.remaining) {
+                        openLists.push_back(open);
+                        continue;
+                    }
+                    
+                    form = listObject(ObjectList(), _gc_short);
+                    form->setSourcePosition(open.sourcePosition);
+                } break;
+                    
+                default:
+                    throw Error("the script image " + image._path + " is damaged");
+            }
+            
+            // a finished form is the next element of the innermost list, which may finish that list in turn
+            while (true) {
+                if (openLists.empty()) {
+                    return _hashConsing ? internObject(form) : form;
                 }
-                break;
+                
+                elements.push_back(form);
+                if (--openLists.back().remaining) {
+                    break;
+                }
+                
+                OpenList open = openLists.back();
+                openLists.pop_back();
+                
+                ObjectList list(elements.begin() + open.firstElement, elements.end());
+                elements.resize(open.firstElement);
+                
+                form = listObject(list, _gc_short);
+                form->setSourcePosition(open.sourcePosition);
+            }
         }
+    }
+
+#pragma mark -
+#pragma mark Builtin Statistics
+    
+    void BuiltinStatistics::record(uint64_t nanos) {
+        ++calls;
+        totalNanos += nanos;
+        maxNanos = std::max(maxNanos, nanos);
         
-        return NULL;
+        int bucket = 0;
+        while (nanos && bucket < kLatencyBucketCount - 1) {
+            nanos >>= 1;
+            ++bucket;
+        }
+        ++latencyBuckets[bucket];
     }
     
-    Object* TinyClojure::eval(Object* code) {
-        Object *ret = unscopedEval(_baseScope, code);
+    void BuiltinStatistics::reset() {
+        calls = totalNanos = maxNanos = 0;
+        std::fill(latencyBuckets, latencyBuckets + kLatencyBucketCount, 0);
+    }
+    
+    namespace {
+        bool moreBuiltinTime(const std::pair<std::string, BuiltinStatistics>& a,
+                             const std::pair<std::string, BuiltinStatistics>& b) {
+            return a.second.totalNanos > b.second.totalNanos;
+        }
+    }
+    
+    std::vector<std::pair<std::string, BuiltinStatistics> > TinyClojure::builtinStatistics() const {
+        std::vector<std::pair<std::string, BuiltinStatistics> > statistics;
         
-        if (ret==NULL) {
-            ret = _gc_short->registerObject(new Object());
+        for (size_t functionIndex = 0; functionIndex < _extensionFunctions.size(); ++functionIndex) {
+            ExtensionFunction *function = _extensionFunctions[functionIndex];
+            if (function->statistics().calls) {
+                statistics.push_back(std::make_pair(function->functionName(), function->statistics()));
+            }
         }
+        std::stable_sort(statistics.begin(), statistics.end(), moreBuiltinTime);
         
-        return ret;
+        return statistics;
+    }
+    
+    void TinyClojure::resetBuiltinStatistics() {
+        for (size_t functionIndex = 0; functionIndex < _extensionFunctions.size(); ++functionIndex) {
+            _extensionFunctions[functionIndex]->statistics().reset();
+        }
+    }
+    
+    std::string TinyClojure::builtinStatisticsReport(size_t topCount) const {
+        std::vector<std::pair<std::string, BuiltinStatistics> > statistics = builtinStatistics();
+        std::stringstream stringBuilder;
+        
+        stringBuilder   << "builtins by time" << std::endl
+                        << std::setw(12) << "calls" << std::setw(14) << "total ns" << std::setw(10) << "mean ns"
+                        << std::setw(12) << "max ns" << "  builtin" << std::endl;
+        
+        for (size_t builtinIndex = 0; builtinIndex < std::min(topCount, statistics.size()); ++builtinIndex) {
+            const BuiltinStatistics& builtin = statistics[builtinIndex].second;
+            
+            stringBuilder   << std::setw(12) << builtin.calls << std::setw(14) << builtin.totalNanos
+                            << std::setw(10) << builtin.totalNanos / builtin.calls << std::setw(12) << builtin.maxNanos
+                            << "  " << statistics[builtinIndex].first << std::endl;
+        }
+        
+        stringBuilder << std::endl;
+        return stringBuilder.str();
     }
 
-    void TinyClojure::CollectGarbage() {
-        _gc_short->collectGarbage();
+#pragma mark -
+#pragma mark Heap Account
+    
+    void HeapAccount::recordPause(double micros, bool finishedCollection) {
+        _statistics.totalPauseMicros += micros;
+        _statistics.maxPauseMicros = std::max(_statistics.maxPauseMicros, micros);
+        
+        if (finishedCollection) {
+            ++_statistics.collections;
+        }
+    }
+    
+    HeapStatistics HeapAccount::statistics() const {
+        HeapStatistics statistics = _statistics;
+        statistics.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - _statisticsReset).count();
+        return statistics;
+    }
+    
+    void HeapAccount::resetStatistics() {
+        _statistics.collections = _statistics.promotedObjects = 0;
+        _statistics.allocatedObjects = _statistics.allocatedBytes = 0;
+        _statistics.totalPauseMicros = _statistics.maxPauseMicros = _statistics.elapsedSeconds = 0;
+        _statisticsReset = std::chrono::steady_clock::now();
     }
 
 #pragma mark -
 #pragma mark Garbage Collector
     
+    namespace {
+        /// regions are carved from blocks of this size, larger requests get a block of their own
+        const size_t kRegionBlockSize = 64 * 1024, kRegionAlignment = 64, kMaximumSpareBlocks = kObjectPool ? 16 : 0;
+        
+        /// incremental collection checks the clock after this many objects
+        const size_t kCollectionStepGranularity = 64;
+        
+        void throwHeapLimitError() {
+            throw Error("heap limit exceeded");
+        }
+    }
+    
     Object* GarbageCollector::registerObject(Object* object) {
-        _objects.insert(object);
+        size_t bytes = sizeof(Object) + object->storageSize();
+        
+        if (!_account->charge(bytes)) {
+            delete object;
+            throwHeapLimitError();
+        }
+        
+        _account->countObjects(object->type(), 1, bytes);
+        
+        if (_regions.empty()) {
+            object->_regionDepth = 0;
+            object->_flags = (object->_flags & ~Object::kObjectFlagMarked) | allocationColor();
+            _objects.push_back(object);
+        } else {
+            object->_regionDepth = (uint8_t)std::min(_regions.size(), (size_t)UINT8_MAX);
+            _regions.back().registered.push_back(object);
+        }
+        
         return object;
     }
 
     void GarbageCollector::deleteObject(Object* object) {
+        // a collection in progress holds indices into _objects, it will free the object if nothing refers to it
+        if (_collectionPhase != kCollectionIdle) {
+            return;
+        }
+        
         // Get object from _objects data structure
-        std::set<Object*>::iterator objToDelete = _objects.find(object);
+        ObjectList::iterator objToDelete = std::find(_objects.begin(), _objects.end(), object);
+        
+        // cells of a list block aren't registered individually, they go when the block does
+        if (objToDelete == _objects.end()) {
+            return;
+        }
+        
         // Erase from data structure
-        _objects.erase(object);
+        _objects.erase(objToDelete);
         // Deallocate the memory dedicated to this object
-        delete *objToDelete;
+        freeObject(object);
+    }
+    
+    void GarbageCollector::freeObject(Object *object) {
+        size_t bytes = sizeof(Object) + object->storageSize();
+        
+        _account->release(bytes);
+        _account->uncountObjects(object->type(), 1, bytes);
+        delete object;
+    }
+    
+    Object* GarbageCollector::registerList(const ObjectList& elements, Object *terminator) {
+        if (elements.empty()) {
+            return terminator;
+        }
+        
+        Object *cells;
+        if (_regions.empty()) {
+            if (!_account->charge(sizeof(Object) * elements.size())) {
+                throwHeapLimitError();
+            }
+            
+            cells = (Object*)::operator new(sizeof(Object) * elements.size());
+            _listBlocks.push_back(std::make_pair(cells, elements.size()));
+        } else {
+            cells = (Object*)allocateInRegion(sizeof(Object) * elements.size());
+        }
+        
+        _account->countObjects(Object::kObjectTypeCons, elements.size(), elements.size() * sizeof(Object));
+        
+        if (_regions.size()) {
+            _regions.back().objectCounts[Object::kObjectTypeCons] += elements.size();
+            _regions.back().byteCounts[Object::kObjectTypeCons] += elements.size() * sizeof(Object);
+        }
+        
+        for (size_t elementIndex = 0; elementIndex < elements.size(); ++elementIndex) {
+            Object *next = elementIndex + 1 < elements.size() ? cells + elementIndex + 1 : terminator;
+            new (cells + elementIndex) Object(elements[elementIndex], next);
+            cells[elementIndex]._regionDepth = (uint8_t)std::min(_regions.size(), (size_t)UINT8_MAX);
+            
+            if (_regions.empty()) {
+                cells[elementIndex]._flags |= allocationColor();
+            }
+        }
+        
+        return cells;
+    }
+    
+    void GarbageCollector::freeListBlocks() {
+        for (size_t blockIndex = 0; blockIndex < _listBlocks.size(); ++blockIndex) {
+            freeListBlock(_listBlocks[blockIndex].first, _listBlocks[blockIndex].second);
+        }
+        
+        _listBlocks.clear();
+    }
+    
+    void GarbageCollector::freeListBlock(Object *cells, size_t cellCount) {
+        for (size_t cellIndex = 0; cellIndex < cellCount; ++cellIndex) {
+            cells[cellIndex].~Object();
+        }
+        
+        _account->release(sizeof(Object) * cellCount);
+        _account->uncountObjects(Object::kObjectTypeCons, cellCount, sizeof(Object) * cellCount);
+        ::operator delete(cells);
+    }
+    
+    void GarbageCollector::pushRegion() {
+        Region region;
+        region.cursor = region.end = NULL;
+        
+        for (size_t type = 0; type < HeapStatistics::kObjectTypeCount; ++type) {
+            region.objectCounts[type] = region.byteCounts[type] = 0;
+        }
+        
+        _regions.push_back(region);
+    }
+    
+    void* GarbageCollector::allocateInRegion(size_t size) {
+        Region& region = _regions.back();
+        
+        if ((size_t)(region.end - region.cursor) < size) {
+            char *block;
+            size_t blockSize = std::max(size, kRegionBlockSize);
+            
+            if (blockSize == kRegionBlockSize && _spareBlocks.size()) {
+                block = _spareBlocks.back();
+                _spareBlocks.pop_back();
+            } else {
+                if (!_account->charge(blockSize + kRegionAlignment)) {
+                    throwHeapLimitError();
+                }
+                
+                block = (char*)::operator new(blockSize + kRegionAlignment);
+            }
+            
+            if (region.blocks.size()) {
+                region.blocks.back().used = region.cursor;
+            }
+            
+            // keep the raw pointer for freeing, and start the objects on a cache line
+            RegionBlock regionBlock;
+            regionBlock.memory = block;
+            regionBlock.size = blockSize;
+            regionBlock.objects = regionBlock.used = block + (kRegionAlignment - (uintptr_t)block % kRegionAlignment) % kRegionAlignment;
+            region.blocks.push_back(regionBlock);
+            
+            region.cursor = regionBlock.objects;
+            region.end = region.cursor + blockSize;
+        }
+        
+        void *allocation = region.cursor;
+        region.cursor += size;
+        return allocation;
+    }
+    
+    Object* GarbageCollector::adoptRegionObject(Object *object) {
+        object->_regionDepth = (uint8_t)std::min(_regions.size(), (size_t)UINT8_MAX);
+        size_t bytes = sizeof(Object);
+        
+        if (object->ownsStorage()) {
+            size_t storage = object->storageSize();
+            
+            if (!_account->charge(storage)) {
+                object->~Object();
+                throwHeapLimitError();
+            }
+            
+            bytes += storage;
+            _regions.back().finalizers.push_back(object);
+        }
+        
+        _account->countObjects(object->type(), 1, bytes);
+        _regions.back().objectCounts[object->type()]++;
+        _regions.back().byteCounts[object->type()] += bytes;
+        
+        return object;
+    }
+    
+    void GarbageCollector::freeRegion(Region& region) {
+        for (size_t type = 0; type < HeapStatistics::kObjectTypeCount; ++type) {
+            _account->uncountObjects((Object::ObjectType)type, region.objectCounts[type], region.byteCounts[type]);
+        }
+        
+        for (size_t objectIndex = 0; objectIndex < region.finalizers.size(); ++objectIndex) {
+            _account->release(region.finalizers[objectIndex]->storageSize());
+            region.finalizers[objectIndex]->~Object();
+        }
+        
+        for (size_t objectIndex = 0; objectIndex < region.registered.size(); ++objectIndex) {
+            freeObject(region.registered[objectIndex]);
+        }
+        
+        // spare blocks stay on the account until they are given back to the heap
+        for (size_t blockIndex = 0; blockIndex < region.blocks.size(); ++blockIndex) {
+            if (region.blocks[blockIndex].size == kRegionBlockSize && _spareBlocks.size() < kMaximumSpareBlocks) {
+                _spareBlocks.push_back(region.blocks[blockIndex].memory);
+            } else {
+                _account->release(region.blocks[blockIndex].size + kRegionAlignment);
+                ::operator delete(region.blocks[blockIndex].memory);
+            }
+        }
+    }
+    
+    Object* GarbageCollector::popRegion(Object *escaping) {
+        // take the region off the stack first, so that the promoted copies are created in the enclosing one
+        Region dying = _regions.back();
+        size_t dyingDepth = _regions.size();
+        _regions.pop_back();
+        
+        if (escaping) {
+            std::map<Object*, Object*> promoted;
+            
+            // promotion allocates, so it can hit the heap limit
+            try {
+                escaping = promote(escaping, dyingDepth, promoted);
+            } catch (...) {
+                freeRegion(dying);
+                throw;
+            }
+        }
+        
+        freeRegion(dying);
+        
+        return escaping;
+    }
+    
+    Object* GarbageCollector::promote(Object *object, size_t dyingDepth, std::map<Object*, Object*>& promoted) {
+        // depths saturate, so deep regions may copy a little more than they need to, which is harmless
+        if (object->_regionDepth == 0 || object->_regionDepth < std::min(dyingDepth, (size_t)UINT8_MAX)) {
+            return object;
+        }
+        
+        std::map<Object*, Object*>::iterator it = promoted.find(object);
+        if (it != promoted.end()) {
+            return it->second;
+        }
+        
+        Object *copy;
+        ObjectList elements;
+        
+        switch (object->type()) {
+            case Object::kObjectTypeCons:
+                if (object->buildList(elements)) {
+                    Object *terminator = object;
+                    while (terminator->type() == Object::kObjectTypeCons) {
+                        terminator = terminator->consValueRight();
+                    }
+                    
+                    for (size_t elementIndex = 0; elementIndex < elements.size(); ++elementIndex) {
+                        elements[elementIndex] = promote(elements[elementIndex], dyingDepth, promoted);
+                    }
+                    
+                    copy = registerList(elements, promote(terminator, dyingDepth, promoted));
+                    copy->_sourcePosition = object->_sourcePosition;
+                } else {
+                    copy = create(promote(object->consValueLeft(), dyingDepth, promoted),
+                                  promote(object->consValueRight(), dyingDepth, promoted));
+                }
+                break;
+                
+            case Object::kObjectTypeVector:
+                elements = object->vectorValue();
+                for (size_t elementIndex = 0; elementIndex < elements.size(); ++elementIndex) {
+                    elements[elementIndex] = promote(elements[elementIndex], dyingDepth, promoted);
+                }
+                copy = create(elements);
+                break;
+                
+            case Object::kObjectTypeClosure:
+                elements = object->functionValueParameters();
+                for (size_t elementIndex = 0; elementIndex < elements.size(); ++elementIndex) {
+                    elements[elementIndex] = promote(elements[elementIndex], dyingDepth, promoted);
+                }
+                copy = create(promote(object->functionValueCode(), dyingDepth, promoted), elements, object->isMacro());
+                break;
+                
+            default:
+                // everything else has no references to other objects, so the deep copy constructor is a plain copy
+                copy = create(object, this);
+                break;
+        }
+        
+        promoted[object] = copy;
+        return copy;
     }
 
-    GarbageCollector::GarbageCollector() {
+    GarbageCollector::GarbageCollector(HeapAccount *account) : _account(account ? account : &_ownAccount), _collectionPhase(kCollectionIdle) {
     }
     
     GarbageCollector::~GarbageCollector() {
-        for (std::set<Object*>::iterator it = _objects.begin(); it != _objects.end(); ++it)
-            delete *it;
+        while (_regions.size()) {
+            popRegion(NULL);
+        }
+        
+        abandonCollection();
+        
+        for (size_t objectIndex = 0; objectIndex < _objects.size(); ++objectIndex)
+            freeObject(_objects[objectIndex]);
+        
+        freeListBlocks();
+        
+        for (size_t blockIndex = 0; blockIndex < _spareBlocks.size(); ++blockIndex) {
+            _account->release(kRegionBlockSize + kRegionAlignment);
+            ::operator delete(_spareBlocks[blockIndex]);
+        }
     }
     
     Object* GarbageCollector::retainRootObject(Object *object) {
+        writeBarrier(object);
+        ++_rootObjects[object];
         return object;
     }
     
     Object* GarbageCollector::releaseRootObject(Object *object) {
+        std::map<Object*, int>::iterator it = _rootObjects.find(object);
+        
+        if (it != _rootObjects.end() && --it->second <= 0) {
+            _rootObjects.erase(it);
+        }
+        
         return object;
     }
     
     void GarbageCollector::collectGarbage() {
-        for (std::set<Object*>::iterator it = _objects.begin(); it != _objects.end(); ++it) {
-            delete *it;
+        abandonCollection();
+        
+        for (size_t objectIndex = 0; objectIndex < _objects.size(); ++objectIndex) {
+            freeObject(_objects[objectIndex]);
         }
         _objects.clear();
+        
+        freeListBlocks();
+        
+        // everything in every region goes too, leaving a fresh outermost region if there were any
+        if (_regions.size()) {
+            while (_regions.size()) {
+                popRegion(NULL);
+            }
+            
+            pushRegion();
+        }
+    }
+    
+    void GarbageCollector::abandonCollection() {
+        // the swept part of the object and block lists holds survivors followed by pointers to freed memory
+        if (_collectionPhase == kCollectionSweeping) {
+            _objects.erase(_objects.begin() + _sweepObjectKept, _objects.begin() + _sweepObjectIndex);
+            _listBlocks.erase(_listBlocks.begin() + _sweepBlockKept, _listBlocks.begin() + _sweepBlockIndex);
+        }
+        
+        _collectionPhase = kCollectionIdle;
+        _greyObjects.clear();
+    }
+    
+    void GarbageCollector::startCollection() {
+        _collectionPhase = kCollectionMarking;
+    }
+    
+    void GarbageCollector::markRootObjects() {
+        for (std::map<Object*, int>::iterator it = _rootObjects.begin(); it != _rootObjects.end(); ++it) {
+            markObject(it->first);
+        }
+    }
+    
+    void GarbageCollector::markReferences(Object *object, GarbageCollector& target) {
+        switch (object->type()) {
+            case Object::kObjectTypeCons:
+                target.markObject(object->_contents.consValue.left);
+                target.markObject(object->_contents.consValue.right);
+                break;
+                
+            case Object::kObjectTypeVector:
+                for (size_t elementIndex = 0; elementIndex < object->_contents.vectorPointer->size(); ++elementIndex) {
+                    target.markObject((*object->_contents.vectorPointer)[elementIndex]);
+                }
+                break;
+                
+            case Object::kObjectTypeClosure:
+                target.markObject(object->_contents.functionValue.objectPointer);
+                for (size_t elementIndex = 0; elementIndex < object->_contents.functionValue.argumentSymbols->size(); ++elementIndex) {
+                    target.markObject((*object->_contents.functionValue.argumentSymbols)[elementIndex]);
+                }
+                break;
+                
+            default:
+                // nothing else refers to other objects
+                break;
+        }
+    }
+    
+    void GarbageCollector::markRegionReferences(GarbageCollector& target) {
+        // every region allocation is one or more whole objects, so a block is an array of objects up to its used mark
+        for (size_t regionIndex = 0; regionIndex < _regions.size(); ++regionIndex) {
+            Region& region = _regions[regionIndex];
+            
+            for (size_t blockIndex = 0; blockIndex < region.blocks.size(); ++blockIndex) {
+                Object *object = (Object*)region.blocks[blockIndex].objects;
+                Object *used = (Object*)(blockIndex + 1 == region.blocks.size() ? region.cursor : region.blocks[blockIndex].used);
+                
+                for (; object < used; ++object) {
+                    markReferences(object, target);
+                }
+            }
+            
+            for (size_t objectIndex = 0; objectIndex < region.registered.size(); ++objectIndex) {
+                markReferences(region.registered[objectIndex], target);
+            }
+        }
+    }
+    
+    bool GarbageCollector::markStep(Deadline deadline) {
+        while (_greyObjects.size()) {
+            for (size_t traced = 0; traced < kCollectionStepGranularity && _greyObjects.size(); ++traced) {
+                Object *object = _greyObjects.back();
+                _greyObjects.pop_back();
+                markReferences(object, *this);
+            }
+            
+            if (std::chrono::steady_clock::now() >= deadline) {
+                return _greyObjects.empty();
+            }
+        }
+        
+        return true;
+    }
+    
+    void GarbageCollector::startSweep() {
+        _collectionPhase = kCollectionSweeping;
+        _sweepObjectIndex = _sweepObjectKept = 0;
+        _sweepObjectLimit = _objects.size();
+        _sweepBlockIndex = _sweepBlockKept = 0;
+        _sweepBlockLimit = _listBlocks.size();
+    }
+    
+    bool GarbageCollector::sweepStep(Deadline deadline) {
+        // survivors are packed down as the sweep goes, objects registered since it started sit beyond the limit
+        while (_sweepObjectIndex < _sweepObjectLimit) {
+            size_t stepLimit = std::min(_sweepObjectLimit, _sweepObjectIndex + kCollectionStepGranularity);
+            
+            for (; _sweepObjectIndex < stepLimit; ++_sweepObjectIndex) {
+                Object *object = _objects[_sweepObjectIndex];
+                
+                if (object->_flags & Object::kObjectFlagMarked) {
+                    object->_flags &= ~Object::kObjectFlagMarked;
+                    _objects[_sweepObjectKept++] = object;
+                } else {
+                    freeObject(object);
+                }
+            }
+            
+            if (std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+        }
+        
+        // a list block lives while any of its cells are reachable, the cells before a reachable one are just unused
+        while (_sweepBlockIndex < _sweepBlockLimit) {
+            size_t stepLimit = std::min(_sweepBlockLimit, _sweepBlockIndex + kCollectionStepGranularity);
+            
+            for (; _sweepBlockIndex < stepLimit; ++_sweepBlockIndex) {
+                Object *cells = _listBlocks[_sweepBlockIndex].first;
+                size_t cellCount = _listBlocks[_sweepBlockIndex].second;
+                bool reachable = false;
+                
+                for (size_t cellIndex = 0; cellIndex < cellCount; ++cellIndex) {
+                    reachable |= (cells[cellIndex]._flags & Object::kObjectFlagMarked) != 0;
+                    cells[cellIndex]._flags &= ~Object::kObjectFlagMarked;
+                }
+                
+                if (reachable) {
+                    _listBlocks[_sweepBlockKept++] = _listBlocks[_sweepBlockIndex];
+                } else {
+                    freeListBlock(cells, cellCount);
+                }
+            }
+            
+            if (std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+        }
+        
+        _objects.erase(_objects.begin() + _sweepObjectKept, _objects.begin() + _sweepObjectLimit);
+        _listBlocks.erase(_listBlocks.begin() + _sweepBlockKept, _listBlocks.begin() + _sweepBlockLimit);
+        _collectionPhase = kCollectionIdle;
+        
+        return true;
     }
 
 #pragma mark -
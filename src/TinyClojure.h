@@ -34,35 +34,126 @@
 #include <sstream>
 #include <set>
 #include <map>
+#include <unordered_map>
 #include <cmath>
 #include <vector>
 #include <cstdarg>
 #include <cstdio>
+#include <stdint.h>
+#include <utility>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <algorithm>
 
 namespace tinyclojure {
+    /// set this to false to compile out the timing of each builtin call, see BuiltinStatistics
+    const bool kBuiltinStatistics = true;
+    
+    /**
+     * An arbitrary precision integer, the top of the integer part of the numeric tower
+     *
+     * stored as a sign and a magnitude of 32 bit limbs, least significant limb first
+     */
+    class BigInteger {
+    public:
+        BigInteger();
+        BigInteger(int64_t val);
+        
+        /// parse a string of decimal digits with an optional leading minus sign
+        static BigInteger fromString(const std::string& digits);
+        
+        BigInteger operator+(const BigInteger& rhs) const;
+        BigInteger operator-(const BigInteger& rhs) const;
+        BigInteger operator*(const BigInteger& rhs) const;
+        BigInteger operator-() const;
+        
+        /// return a negative number, zero or a positive number if this is less than, equal to or greater than rhs
+        int compare(const BigInteger& rhs) const;
+        
+        /// true if this value can be represented by an int64_t
+        bool fitsInteger() const;
+        
+        /// the value as an int64_t, only meaningful if fitsInteger() is true
+        int64_t integerValue() const;
+        
+        /// the closest double to this value
+        double floatingValue() const;
+        
+        bool isNegative() const { return _negative; }
+        
+        /// the bytes this number holds on the heap, including itself
+        size_t storageSize() const { return sizeof(BigInteger) + _magnitude.capacity() * sizeof(uint32_t); }
+        
+        /// return a decimal string representation of this number
+        std::string stringRepresentation() const;
+        
+    protected:
+        typedef std::vector<uint32_t> Magnitude;
+        
+        static int compareMagnitudes(const Magnitude& lhs, const Magnitude& rhs);
+        static Magnitude addMagnitudes(const Magnitude& lhs, const Magnitude& rhs);
+        
+        /// subtract rhs from lhs, lhs must have the larger magnitude
+        static Magnitude subtractMagnitudes(const Magnitude& lhs, const Magnitude& rhs);
+        
+        /// remove leading zero limbs, and the sign of zero
+        void normalise();
+        
+        Magnitude _magnitude;
+        bool _negative;
+    };
+    
     /**
      * A fancy number class to implement Clojure's numeric tower
+     *
+     * integers are 64 bit fixnums, arithmetic on them is overflow checked and promotes to a BigInteger when the result
+     * does not fit.  BigInteger results that fit in 64 bits are demoted again, so the BigInteger mode only ever holds
+     * values outside the fixnum range.
      */
     class Number {
     public:
+        /// number modes, ordered so that the result of mixed mode arithmetic is in the greater mode
         typedef enum {
             kNumberModeInteger,
+            kNumberModeBigInteger,
             kNumberModeFloating,
         } NumberMode;
         
         Number(double val);
         Number(int val);
+        Number(int64_t val);
+        Number(const BigInteger& val);
         Number();
         Number(Number* oldNum);
+        Number(const Number& rhs);
+        ~Number();
+        Number& operator=(const Number& rhs);
+        
+        /// parse a string of decimal digits, promoting to a BigInteger if it will not fit in a fixnum
+        static Number integerFromString(const std::string& digits);
+        
         double floatingValue() const;
         Number floatingVersion() const;
-        int integerValue() const;
+        
+        /// the value as an int64_t, BigIntegers saturate to the int64_t range
+        int64_t integerValue() const;
         Number integerVersion() const;
+        
+        /// the value as a BigInteger, floating values are truncated
+        BigInteger bigIntegerValue() const;
+        
         Number operator+(const Number& rhs) const;
         Number operator*(const Number& rhs) const;
         Number operator/(const Number& rhs) const;
         Number operator-(const Number& rhs) const;
         Number::NumberMode getMode() const;
+        
+        /// the unboxed fixnum, only meaningful in kNumberModeInteger
+        int64_t rawInteger() const { return _value.integer; }
+        
+        /// the unboxed double, only meaningful in kNumberModeFloating
+        double rawFloating() const { return _value.floating; }
         void roundUp();
         void roundDown();
         
@@ -73,21 +164,80 @@ namespace tinyclojure {
         bool operator<=(const Number& rhs) const;
         bool operator>=(const Number& rhs) const;
         
+        /// a 64 bit hash, equal for any two numbers that are ==, whatever their modes
+        uint64_t hashValue() const;
+        
+        /// the bytes this number holds on the heap, only BigIntegers hold any
+        size_t storageSize() const { return _mode == kNumberModeBigInteger ? _value.bigInteger->storageSize() : 0; }
 
         /// return a string representation of this number
         std::string stringRepresentation() const;
     protected:
-        static void equivalentModes(const Number& originalLHS, const Number& originalRHS, Number& newLHS, Number& newRHS);
+        /// the mode both operands must be converted to for a mixed mode operation
+        static NumberMode promotedMode(const Number& lhs, const Number& rhs) {
+            return lhs._mode > rhs._mode ? lhs._mode : rhs._mode;
+        }
+        
+        /// three way comparison in the promoted mode, used by all the comparison operators
+        static int compare(const Number& lhs, const Number& rhs);
+        
         void setFloating(double val);
-        void setInteger(int val);
+        void setInteger(int64_t val);
+        void setBigInteger(const BigInteger& val);
+        
+        /// free any BigInteger storage
+        void clear();
                 
         union {
-            int integer;
+            int64_t integer;
             double floating;
+            BigInteger* bigInteger;
         } _value;
         NumberMode _mode;
     };
 
+    /**
+     * A table of named, typed columns
+     *
+     * each column stores its values contiguously so that filters and aggregates run as loops over whole columns
+     */
+    class Dataset {
+    public:
+        typedef enum {
+            kColumnTypeDouble,
+            kColumnTypeLong,
+            kColumnTypeString,
+        } ColumnType;
+        
+        /// a single column, only the vector matching type is used
+        struct Column {
+            std::string name;
+            ColumnType type;
+            std::vector<double> doubles;
+            std::vector<int64_t> longs;
+            std::vector<std::string> strings;
+            
+            size_t size() const;
+            
+            /// append row sourceRow of source, which must have the same type
+            void appendRow(const Column& source, size_t sourceRow);
+        };
+        
+        /// the number of rows, all columns have the same length
+        size_t rowCount() const;
+        
+        /// the index of the named column, or -1 if there is no such column
+        int columnIndex(const std::string& name) const;
+        
+        /// a new dataset holding the passed rows of this one, in the order given
+        Dataset* takeRows(const std::vector<size_t>& rows) const;
+        
+        /// the approximate bytes this dataset holds on the heap, including itself
+        size_t storageSize() const;
+        
+        std::vector<Column> columns;
+    };
+    
     /// a forward declaration to allow for an ExtensionFunction pointer in Object
     class ExtensionFunction;
     class TinyClojure;
@@ -112,6 +262,9 @@ namespace tinyclojure {
             kObjectTypeVector,
             kObjectTypeBuiltinFunction,
             kObjectTypeClosure,
+            kObjectTypeDoubleArray,
+            kObjectTypeLongArray,
+            kObjectTypeDataset,
         } ObjectType;
         
         /// construct either a symbol (if symbol=true) or a string object otherwise
@@ -125,6 +278,9 @@ namespace tinyclojure {
         
         /// construct an integer number object
         Object(int intValue);
+        
+        /// construct a 64 bit integer number object
+        Object(int64_t intValue);
 
         /// construct an floating point number object
         Object(double doubleValue);
@@ -146,6 +302,12 @@ namespace tinyclojure {
         
         /// construct an extension function
         Object(ExtensionFunction *function);
+        
+        /// construct a zero filled primitive array, arrayType is kObjectTypeDoubleArray or kObjectTypeLongArray
+        Object(ObjectType arrayType, size_t length);
+        
+        /// construct a dataset, taking ownership of it
+        Object(Dataset *dataset);
 
         // copy constructor (deep copy)
         Object(Object* oldObj, GarbageCollector* gc);
@@ -153,7 +315,10 @@ namespace tinyclojure {
         ~Object();
         
         /// this object's type
-        ObjectType type() const { return _type; }
+        ObjectType type() const { return (ObjectType)_type; }
+        
+        /// a lower case name for an object type, such as "cons"
+        static const char* typeName(ObjectType type);
         
         /// negated equality operator
         bool operator!=(const Object& rhs);
@@ -188,9 +353,27 @@ namespace tinyclojure {
         /// return a reference to this object as an integer value
         Number numberValue();
         
+        /// return a reference to this object's number without copying it
+        const Number& numberReference();
+        
         /// return a reference to this object as a boolean value
         bool booleanValue();
         
+        /// return a reference to the contents of a double array
+        std::vector<double>& doubleArrayValue();
+        
+        /// return a reference to the contents of a long array
+        std::vector<int64_t>& longArrayValue();
+        
+        /// return a reference to this object as a dataset
+        Dataset& datasetValue();
+        
+        /// true if destroying this object frees storage outside it, such as a long string or a vector
+        bool ownsStorage() const;
+        
+        /// the approximate bytes of the storage outside this object, see ownsStorage
+        size_t storageSize() const;
+        
         /// this coerces whatever we have into a boolean
         bool coerceBoolean();
         
@@ -206,10 +389,98 @@ namespace tinyclojure {
         /// is this object iterable
         bool isIterable();
         
+        /**
+         * a 64 bit structural hash, equal for any two objects that are ==
+         *
+         * it is computed on first use and cached, except for arrays and datasets which can be modified in place, and
+         * anything holding one
+         */
+        uint64_t hashValue();
+        
+        /// true if this is the shared, canonical copy of a hash consed value, which must never be modified
+        bool isCanonical() const { return (_flags & kObjectFlagCanonical) != 0; }
+        
+        /// for a parsed form, where it started in the parsed text counting from 1, otherwise 0.  Copies keep it.
+        uint32_t sourcePosition() const { return _sourcePosition; }
+        void setSourcePosition(uint32_t position) { _sourcePosition = position; }
+        
+        /// mark this object as canonical, see TinyClojure::setHashConsing
+        void markCanonical() { _flags |= kObjectFlagCanonical; }
+        
+        /// a deep copy registered with gc, or object itself if it is canonical and so can be shared
+        static Object* deepCopy(Object *object, GarbageCollector *gc);
+        
+        /// objects are allocated from fixed size, cache line aligned cells rather than directly from the heap
+        static void* operator new(size_t size);
+        static void operator delete(void *pointer);
+        
+        /// placement new, for objects constructed in storage that is owned elsewhere
+        static void* operator new(size_t size, void *where) { return where; }
+        static void operator delete(void *pointer, void *where) {}
+        
     protected:
-        ObjectType _type;
+        /// bits in _flags
+        enum {
+            kObjectFlagInlineString = 1 << 0,
+            kObjectFlagMacro        = 1 << 1,
+            kObjectFlagCanonical    = 1 << 2,
+            kObjectFlagHashCached   = 1 << 3,
+            kObjectFlagMarked       = 1 << 4,
+        };
+        
+        /// strings and symbols up to this many bytes are stored in the object rather than in a separate allocation
+        static const size_t kInlineStringCapacity = 15;
+        
+        /// store a string or symbol's characters, inline if they fit
+        void setString(const std::string& value);
+        
+        /// the characters of a string or symbol, not NUL terminated
+        const char* stringCharacters() const {
+            return (_flags & kObjectFlagInlineString) ? _contents.inlineString : _contents.stringPointer->data();
+        }
+        
+        /// the length of a string or symbol
+        size_t stringLength() const {
+            return (_flags & kObjectFlagInlineString) ? _inlineStringLength : _contents.stringPointer->size();
+        }
+        
+        /// the number, constructed in place in _contents
+        Number* numberPointer() {
+            return reinterpret_cast<Number*>(_contents.numberStorage);
+        }
+        
+        const Number* numberPointer() const {
+            return reinterpret_cast<const Number*>(_contents.numberStorage);
+        }
+        
+        friend class GarbageCollector;
+        
+        /// hashValue, setting cacheable to false if the hash reached an array or dataset, so mustn't be cached
+        uint64_t hashValue(bool& cacheable);
+        
+        /// remember a hash computed by hashValue
+        void cacheHash(uint64_t hash) {
+            _hash = hash;
+            _flags |= kObjectFlagHashCached;
+        }
+        
+        // an 8 byte header, the cached hash, then 16 bytes of contents, filling a 32 byte cell
+        uint8_t _type;
+        uint8_t _flags;
+        uint8_t _inlineStringLength;
+        
+        /// the region this object was allocated in, counting from 1, or 0 if it is not in a region
+        uint8_t _regionDepth;
+        
+        /// see sourcePosition
+        uint32_t _sourcePosition;
+        
+        uint64_t _hash;
+        
         union {
-            std::string* stringValue;
+            std::string* stringPointer;
+            
+            char inlineString[kInlineStringCapacity];
             
             struct {
                 Object *left, *right;
@@ -219,7 +490,6 @@ namespace tinyclojure {
             struct {
                 Object *objectPointer;
                 ObjectList* argumentSymbols;
-                bool macro;
             } functionValue;
             
             struct {
@@ -228,7 +498,14 @@ namespace tinyclojure {
             
             ObjectList* vectorPointer;
             
-            Number *numberPointer;
+            std::vector<double>* doubleArrayPointer;
+            
+            std::vector<int64_t>* longArrayPointer;
+            
+            Dataset* datasetPointer;
+            
+            // storage for a Number, which is constructed and destroyed in place
+            uint64_t numberStorage[2];
             
             bool booleanValue;
         } _contents;
@@ -254,46 +531,616 @@ namespace tinyclojure {
 
     };
 
+    /**
+     * heap and collection statistics, see HeapAccount::statistics
+     */
+    struct HeapStatistics {
+        static const size_t kObjectTypeCount = Object::kObjectTypeDataset + 1;
+        
+        /// live objects, and their bytes counting the cell and any storage it owns, indexed by Object::ObjectType
+        uint64_t liveObjects[kObjectTypeCount], liveBytes[kObjectTypeCount];
+        
+        /// finished collections of either heap, and the time spent collecting, since the statistics were reset
+        uint64_t collections;
+        double totalPauseMicros, maxPauseMicros;
+        
+        /// objects copied from the short term heap into the long term heap since the statistics were reset
+        uint64_t promotedObjects;
+        
+        /// objects and bytes allocated since the statistics were reset, and how long ago that was
+        uint64_t allocatedObjects, allocatedBytes;
+        double elapsedSeconds;
+        
+        /// bytes allocated per second since the statistics were reset
+        double allocationRate() const { return elapsedSeconds > 0 ? allocatedBytes / elapsedSeconds : 0; }
+    };
+    
+    /**
+     * attributes allocations to the form being evaluated, see TinyClojure::setAllocationProfiling
+     *
+     * a site is a call form, identified by its source position and the name at its head, which is a builtin or
+     * the name a closure was called by.  Allocations are charged to the innermost call being evaluated, or to a
+     * top level site when there is none, such as while parsing.
+     */
+    class AllocationProfiler {
+    public:
+        struct Site {
+            /// the name at the head of the form, the form itself, abbreviated, and its position, 0 if unknown
+            std::string function, form;
+            uint32_t position;
+            
+            uint64_t objects, bytes;
+        };
+        
+        AllocationProfiler();
+        
+        /// attribute allocations to form until leaveSite, returning the site to pass to it
+        Site* enterSite(Object *form);
+        
+        /// go back to attributing allocations to previous, as returned by enterSite
+        void leaveSite(Site *previous) { _currentSite = previous; }
+        
+        /// charge allocations to the current site
+        void recordAllocation(uint64_t objects, uint64_t bytes) {
+            _currentSite->objects += objects;
+            _currentSite->bytes += bytes;
+        }
+        
+        /// every site with an allocation, those with the most bytes first
+        std::vector<Site> sites() const;
+        
+        /// a table of the topCount sites with the most objects, then the topCount with the most bytes
+        std::string report(size_t topCount) const;
+        
+    protected:
+        std::map<std::pair<uint32_t, std::string>, Site> _sites;
+        Site _topLevel, *_currentSite;
+    };
+    
+    /**
+     * samples the Clojure call stack, see TinyClojure::startProfiling
+     *
+     * a profiling timer counts ticks of CPU time in a signal handler, and the evaluator takes any ticks that have
+     * passed as it enters or leaves a call, charging them to the stack of call names at that point.  The handler
+     * does nothing else, so evaluation is only ever sampled at these safe points.
+     */
+    class SamplingProfiler {
+    public:
+        /// start sampling every intervalMicros of CPU time, the timer is shared by every profiler in the process, from any thread
+        SamplingProfiler(int64_t intervalMicros);
+        ~SamplingProfiler();
+        
+        /// push a frame, the name of the function a call form calls
+        void enterFrame(Object *form) {
+            takeSamples();
+            _stack.push_back(frameName(form));
+        }
+        
+        /// pop the innermost frame
+        void leaveFrame() {
+            takeSamples();
+            _stack.pop_back();
+        }
+        
+        /// the samples as folded stacks, one "outer;inner count" line per distinct stack, for flame graph tools
+        std::string foldedStacks() const;
+        
+        /// the name of the builtin or closure a call form calls, for reports
+        static std::string frameName(Object *form);
+        
+    protected:
+        /// charge any ticks since the last call to the current stack
+        void takeSamples();
+        
+        std::vector<std::string> _stack;
+        std::map<std::string, uint64_t> _samples;
+        unsigned long _ticksTaken;
+    };
+    
+    /**
+     * writes Chrome trace events to a JSON file for chrome://tracing or Perfetto, see TinyClojure::setTraceRecorder
+     *
+     * each event is a complete ("X") event with a category, a name, a start and a duration.  Recording threads put
+     * events in a fixed size ring without locking or allocating, and a writer thread drains the ring into the file.
+     * Events recorded while the ring is full are dropped and counted.
+     */
+    class TraceRecorder {
+    public:
+        typedef std::chrono::steady_clock::time_point TimePoint;
+        
+        /// start a trace in a new file at path, throwing an Error if it can't be created, capacity is rounded up to a power of two
+        TraceRecorder(const std::string& path, size_t capacity=65536);
+        
+        /// write the events still in the ring and finish the file
+        ~TraceRecorder();
+        
+        /// record an event, the category should be a string literal, names are truncated to fit an event
+        void record(const char *category, const std::string& name, TimePoint start, TimePoint end);
+        
+        /// the events that didn't fit in the ring
+        uint64_t droppedEvents() const { return _droppedEvents; }
+        
+        /// records an event lasting as long as the scope, if there is a recorder
+        class Scope {
+        public:
+            Scope(TraceRecorder *recorder, const char *category, const std::string& name) : _recorder(recorder) {
+                if (_recorder) {
+                    _category = category;
+                    _name = name;
+                    _start = std::chrono::steady_clock::now();
+                }
+            }
+            
+            ~Scope() {
+                if (_recorder) {
+                    _recorder->record(_category, _name, _start, std::chrono::steady_clock::now());
+                }
+            }
+            
+        protected:
+            TraceRecorder *_recorder;
+            const char *_category;
+            std::string _name;
+            TimePoint _start;
+        };
+        
+    protected:
+        static const size_t kNameLength = 48;
+        
+        struct Event {
+            std::atomic<size_t> sequence;
+            const char *category;
+            char name[kNameLength];
+            int64_t startNanos, durationNanos;
+            uint32_t threadId;
+        };
+        
+        /// the writer thread's loop
+        void writeEvents();
+        
+        /// write the events in the ring to the file, returning false if there were none
+        bool drainEvents();
+        
+        Event *_ring;
+        size_t _mask;
+        std::atomic<size_t> _enqueuePosition;
+        size_t _dequeuePosition;
+        std::atomic<uint64_t> _droppedEvents;
+        std::atomic<bool> _stopping;
+        
+        FILE *_file;
+        bool _firstEvent;
+        int _processId;
+        TimePoint _origin;
+        std::thread _writer;
+    };
+    
+    /**
+     * the text of a source file, mapped into memory read only
+     *
+     * the pages are read in as the reader reaches them, so a file can be read a form at a time without ever holding
+     * a copy of all of it.  Anything that can't be mapped, such as a pipe, is read into a buffer instead.  The text is
+     * not null terminated.
+     */
+    class SourceFile {
+    public:
+        /// map the file at path, throwing an Error if it can't be opened
+        SourceFile(const std::string& path);
+        
+        /// unmap the file
+        ~SourceFile();
+        
+        const char* text() const { return _text; }
+        size_t length() const { return _length; }
+        
+    protected:
+        const char *_text;
+        size_t _length;
+        
+        /// the mapping, or NULL if the text is in _buffer
+        void *_mapping;
+        std::string _buffer;
+    };
+    
+    /**
+     * a script's parsed forms, written to a .tcljc file by TinyClojure::compileImage so they needn't be parsed again
+     *
+     * an image is a header, a table of the symbols its forms use, a pool of their strings and big integers, and the
+     * forms in order.  Each form is a prefix walk of tags, with symbols and constants as indexes into the tables,
+     * other numbers inline, and lists as their length and source position followed by their elements.  Counts and
+     * indexes are LEB128, and integers zigzag encoded LEB128 so that small negative numbers are short too.  The
+     * image is mapped like a SourceFile and TinyClojure::loadNext makes its forms one at a time.  Images are in the
+     * byte order of the machine that wrote them, and any image of another byte order or format version is rejected.
+     */
+    class ScriptImage {
+    public:
+        typedef enum {
+            kTagNil,
+            kTagTrue,
+            kTagFalse,
+            kTagSymbol,
+            kTagConstant,
+            kTagInteger,
+            kTagFloating,
+            kTagList,
+        } Tag;
+        
+        typedef enum {
+            kConstantString,
+            kConstantBigInteger,
+        } ConstantKind;
+        
+        /// map the image at path and read its tables, throwing an Error if it can't be opened or read
+        ScriptImage(const std::string& path);
+        
+        /// the path of the image for a source file, with .tcljc in place of .clj
+        static std::string imagePath(const std::string& sourcePath);
+        
+        /// true if the image at imagePath was written after the source at sourcePath was last changed
+        static bool isCurrent(const std::string& imagePath, const std::string& sourcePath);
+        
+        /**
+         * the image for the source at sourcePath, if it is current and this build can read it, otherwise NULL
+         *
+         * the caller deletes the image.  An image that can't be read is ignored, as the source is there to parse.
+         */
+        static ScriptImage* openCurrent(const std::string& sourcePath);
+        
+        /// where the forms start, the position to pass to the first loadNext
+        size_t formsStart() const { return _formsStart; }
+        
+        /// the length of the image, the position after the last form
+        size_t length() const { return _file.length(); }
+        
+    protected:
+        friend class TinyClojure;
+        
+        struct Constant {
+            ConstantKind kind;
+            
+            /// the characters of the string, or the digits of the big integer
+            const char *text;
+            size_t length;
+        };
+        
+        /// read a byte at position, moving past it, throwing an Error at the end of the image
+        uint8_t readByte(size_t& position) const;
+        
+        /// read an unsigned LEB128 number at position, moving past it
+        uint64_t readCount(size_t& position) const;
+        
+        /// the count bytes at position, moving past them
+        const char* readBytes(size_t& position, uint64_t count) const;
+        
+        SourceFile _file;
+        std::string _path;
+        std::vector<std::pair<const char*, size_t> > _symbols;
+        std::vector<Constant> _constants;
+        size_t _formsStart;
+    };
+    
+    /**
+     * a count of the bytes allocated through one or more garbage collectors, with optional limits and statistics
+     *
+     * the count covers object cells, the storage objects own outside their cells, list blocks and region blocks,
+     * including the spare region blocks a collector keeps for reuse.  Keeping the statistics costs a few increments
+     * per allocation.
+     */
+    class HeapAccount {
+    public:
+        HeapAccount() : _bytesInUse(0), _softLimit(0), _hardLimit(0), _softLimitReached(false), _profiler(NULL) {
+            for (size_t type = 0; type < HeapStatistics::kObjectTypeCount; ++type) {
+                _statistics.liveObjects[type] = _statistics.liveBytes[type] = 0;
+            }
+            
+            resetStatistics();
+        }
+        
+        /**
+         * add bytes to the count, returning false and leaving the count alone if that would pass the hard limit
+         *
+         * going over the soft limit is noted, see takeSoftLimitReached
+         */
+        bool charge(size_t bytes) {
+            if (_hardLimit && _bytesInUse + bytes > _hardLimit) {
+                return false;
+            }
+            
+            if (_softLimit && _bytesInUse <= _softLimit && _bytesInUse + bytes > _softLimit) {
+                _softLimitReached = true;
+            }
+            
+            _bytesInUse += bytes;
+            return true;
+        }
+        
+        /// take bytes off the count
+        void release(size_t bytes) { _bytesInUse -= bytes; }
+        
+        /// the number of bytes currently allocated
+        size_t bytesInUse() const { return _bytesInUse; }
+        
+        /// set the limits in bytes, 0 means no limit
+        void setLimits(size_t softLimit, size_t hardLimit) {
+            _softLimit = softLimit;
+            _hardLimit = hardLimit;
+            _softLimitReached = false;
+        }
+        
+        size_t softLimit() const { return _softLimit; }
+        size_t hardLimit() const { return _hardLimit; }
+        
+        /// true, once, after the count goes over the soft limit
+        bool takeSoftLimitReached() {
+            bool reached = _softLimitReached;
+            _softLimitReached = false;
+            return reached;
+        }
+        
+        /// note new objects of a type and their size, which charge doesn't do as region objects share their blocks
+        void countObjects(Object::ObjectType type, uint64_t objects, uint64_t bytes) {
+            _statistics.liveObjects[type] += objects;
+            _statistics.liveBytes[type] += bytes;
+            _statistics.allocatedObjects += objects;
+            _statistics.allocatedBytes += bytes;
+            
+            if (_profiler) {
+                _profiler->recordAllocation(objects, bytes);
+            }
+        }
+        
+        /// pass every counted allocation on to profiler as well, or stop if it is NULL
+        void setProfiler(AllocationProfiler *profiler) { _profiler = profiler; }
+        
+        /// note that objects counted by countObjects have been freed
+        void uncountObjects(Object::ObjectType type, uint64_t objects, uint64_t bytes) {
+            _statistics.liveObjects[type] -= objects;
+            _statistics.liveBytes[type] -= bytes;
+        }
+        
+        /// note objects copied into the long term heap
+        void countPromotions(uint64_t objects) { _statistics.promotedObjects += objects; }
+        
+        /// note time spent collecting, and whether a collection finished
+        void recordPause(double micros, bool finishedCollection);
+        
+        /// a snapshot of the statistics
+        HeapStatistics statistics() const;
+        
+        /// zero the statistics, other than the live counts
+        void resetStatistics();
+        
+    protected:
+        size_t _bytesInUse, _softLimit, _hardLimit;
+        bool _softLimitReached;
+        
+        HeapStatistics _statistics;
+        std::chrono::steady_clock::time_point _statisticsReset;
+        
+        AllocationProfiler *_profiler;
+    };
+    
     /**
      * a very simple garbage collector for TinyClojure objects
      *
-     * TODO nothing is really implemented yet
+     * objects either live in a stack of regions, arenas which are freed wholesale, or outside any region until the
+     * collector itself is emptied.  The interpreter's short term collector runs each eval in a region of its own.
      *
      * the ExportedObject is essentially a C++ reference counting mechanism to keep track of "root objects" ie objects being used in the real world
      * when a garbage collection happens connectivity to these objects is the criteria for garbage collecting an object or not
      */
     class GarbageCollector {
     public:
-        GarbageCollector();
+        /// construct a collector that counts its allocations in account, or in an account of its own if that is NULL
+        GarbageCollector(HeapAccount *account=NULL);
         ~GarbageCollector();
         
-        /**
-         * register an object with the garbage collector
-         */
-        Object* registerObject(Object* object);
-
-        // Deletes an object from the garbage collector
-        // Returns true/false based on success of operation
-        void deleteObject(Object* object);
+        /**
+         * register an object with the garbage collector
+         *
+         * this, and everything else that allocates, throws an Error if the allocation would pass the account's hard
+         * limit, in which case the object is deleted
+         */
+        Object* registerObject(Object* object);
+
+        // Deletes an object from the garbage collector
+        // Returns true/false based on success of operation
+        void deleteObject(Object* object);
+        
+        /**
+         * increment the "root object" reference count for this Object
+         */
+        Object* retainRootObject(Object *object);
+        
+        /**
+         * decrement the "root object" reference count for this Object
+         */
+        Object* releaseRootObject(Object *object);
+        
+        /**
+         * call this to start a garbage collection run
+         */
+        void collectGarbage();
+        
+        /**
+         * build a list of elements, ending in terminator, as one contiguous block of cons cells
+         *
+         * each cell's cdr is the next cell in the block, so walking the list is sequential memory access and
+         * building it is a single pass.  The block belongs to the collector as a whole, its cells are not
+         * registered individually.
+         */
+        Object* registerList(const ObjectList& elements, Object *terminator);
+        
+        /**
+         * construct and register an Object, taking the same arguments as the Object constructors
+         *
+         * inside a region the object is bump allocated from the region, otherwise it comes from the object pool
+         */
+        template <typename... Arguments>
+        Object* create(Arguments&&... arguments) {
+            if (_regions.empty()) {
+                return registerObject(new Object(std::forward<Arguments>(arguments)...));
+            }
+            
+            return adoptRegionObject(new (allocateInRegion(sizeof(Object))) Object(std::forward<Arguments>(arguments)...));
+        }
+        
+        /**
+         * start a region, an arena that everything created or registered until the matching popRegion lives in
+         */
+        void pushRegion();
+        
+        /**
+         * end the innermost region, freeing everything in it
+         *
+         * escaping, which may be NULL, is promoted first: it and anything it references from the ending region are
+         * copied, once, into the enclosing region (or the object pool if there is none) and the copy is returned.
+         * Freeing costs one step per block of memory, plus a destructor call for each object that owns storage
+         * outside itself, such as a long string or a vector.
+         */
+        Object* popRegion(Object *escaping);
+        
+        /// the number of open regions
+        size_t regionDepth() const { return _regions.size(); }
+        
+        /// the account allocations are counted in
+        HeapAccount& heapAccount() { return *_account; }
+        
+        /// note an object copied into this collector, which is a promotion if it is going into the long term heap
+        void countCopy() {
+            if (_regions.empty()) {
+                _account->countPromotions(1);
+            }
+        }
+        
+        /// the phases of an incremental collection of the objects outside any region
+        typedef enum {
+            kCollectionIdle,
+            kCollectionMarking,
+            kCollectionSweeping,
+        } CollectionPhase;
+        
+        typedef std::chrono::steady_clock::time_point Deadline;
+        
+        /**
+         * start an incremental, tri-color mark and sweep collection of the objects outside any region
+         *
+         * an object is white until it is marked, grey while it is marked but its references have not been traced,
+         * and black once they have.  The owner marks the roots with markObject, then calls markStep until it
+         * returns true, then startSweep and sweepStep until that returns true.  Objects created while marking is
+         * under way are black and objects created while sweeping are not swept, so the collection can be spread
+         * across any number of steps with the heap in use in between.
+         */
+        void startCollection();
+        
+        /// the current phase, see startCollection
+        CollectionPhase collectionPhase() const { return _collectionPhase; }
+        
+        /// mark an object of this collector grey, ignoring region objects and objects that are already marked
+        void markObject(Object *object) {
+            if (object->_regionDepth == 0 && !(object->_flags & Object::kObjectFlagMarked)) {
+                object->_flags |= Object::kObjectFlagMarked;
+                _greyObjects.push_back(object);
+            }
+        }
+        
+        /// the write barrier, call this with any object stored somewhere the collector has already traced
+        void writeBarrier(Object *object) {
+            if (_collectionPhase == kCollectionMarking) {
+                markObject(object);
+            }
+        }
+        
+        /// mark every root object, see retainRootObject
+        void markRootObjects();
+        
+        /// mark every object of target that an object in one of this collector's regions refers to
+        void markRegionReferences(GarbageCollector& target);
+        
+        /// trace grey objects until there are none left, returning true, or the deadline passes
+        bool markStep(Deadline deadline);
+        
+        /// finish marking, anything still white is garbage
+        void startSweep();
+        
+        /// free unmarked objects until the sweep is finished, returning true, or the deadline passes
+        bool sweepStep(Deadline deadline);
+        
+    protected:
+        /// a block of region memory
+        struct RegionBlock {
+            /// the allocation, which is freed, and its usable size
+            char *memory;
+            size_t size;
+            
+            /// the first object, on a cache line, and the end of the objects allocated from the block
+            char *objects, *used;
+        };
+        
+        /// a bump allocated arena, see pushRegion
+        struct Region {
+            /// the blocks the region has allocated from, the last of which is used up to cursor
+            std::vector<RegionBlock> blocks;
+            char *cursor, *end;
+            
+            /// the objects allocated from the blocks and their bytes, by type, for HeapAccount::uncountObjects
+            uint64_t objectCounts[HeapStatistics::kObjectTypeCount], byteCounts[HeapStatistics::kObjectTypeCount];
+            
+            /// objects that must have their destructor run when the region is freed
+            ObjectList finalizers;
+            
+            /// objects allocated elsewhere and then registered while this region was open
+            ObjectList registered;
+        };
+        
+        /// frees every list block
+        void freeListBlocks();
+        
+        /// bump allocate from the innermost region
+        void* allocateInRegion(size_t size);
+        
+        /// record a newly constructed region object, noting it if it needs finalising
+        Object* adoptRegionObject(Object *object);
+        
+        /// run destructors and give a region's memory back
+        void freeRegion(Region& region);
         
-        /**
-         * increment the "root object" reference count for this Object
-         */
-        Object* retainRootObject(Object *object);
+        /// copy object out of the region at depth dyingDepth, sharing anything that lives outside it
+        Object* promote(Object *object, size_t dyingDepth, std::map<Object*, Object*>& promoted);
         
-        /**
-         * decrement the "root object" reference count for this Object
-         */
-        Object* releaseRootObject(Object *object);
+        /// stop any collection in progress, leaving the marks where they are
+        void abandonCollection();
         
-        /**
-         * call this to start a garbage collection run
-         */
-        void collectGarbage();
+        /// delete an object outside any region, taking it off the account
+        void freeObject(Object *object);
         
-    protected:
-        std::set<Object*> _objects;
+        /// destroy and free a list block allocated outside any region
+        void freeListBlock(Object *cells, size_t cellCount);
+        
+        /// mark everything that object refers to in target
+        static void markReferences(Object *object, GarbageCollector& target);
+        
+        /// the mark bit new objects get, they are allocated black while marking is under way
+        uint8_t allocationColor() const {
+            return _collectionPhase == kCollectionMarking ? (uint8_t)Object::kObjectFlagMarked : 0;
+        }
+        
+        ObjectList _objects;
+        std::vector<std::pair<Object*, size_t> > _listBlocks;
         std::map<Object*, int> _rootObjects;
+        std::vector<Region> _regions;
+        
+        /// region memory kept for reuse rather than going back to the heap
+        std::vector<char*> _spareBlocks;
+        
+        /// where allocations are counted, _ownAccount unless the collector was given one
+        HeapAccount _ownAccount, *_account;
+        
+        /// incremental collection state, the sweep covers the objects and list blocks that existed when it started
+        CollectionPhase _collectionPhase;
+        ObjectList _greyObjects;
+        size_t _sweepObjectIndex, _sweepObjectLimit, _sweepObjectKept;
+        size_t _sweepBlockIndex, _sweepBlockLimit, _sweepBlockKept;
     };
         
     /**
@@ -353,23 +1200,31 @@ namespace tinyclojure {
     class InterpreterScope {
     public:
         /// construct a root scope
-        InterpreterScope() : _parentScope(NULL) {
+        InterpreterScope() : _parentScope(NULL), _rootScope(this), _writeBarrier(NULL), _symbolFilter(0), _ancestorFilter(0) {
             
         }
         
         /// construct a scope from a parent scope
-        InterpreterScope(InterpreterScope *parentScope) : _parentScope(parentScope) {
+        InterpreterScope(InterpreterScope *parentScope)
+            : _parentScope(parentScope), _rootScope(parentScope->_rootScope), _writeBarrier(parentScope->_writeBarrier), _symbolFilter(0),
+              _ancestorFilter(parentScope == parentScope->_rootScope ? 0 : parentScope->_ancestorFilter | parentScope->_symbolFilter) {
             
         }
         
+        /// the collector told about every value bound in this scope and the scopes made from it, see GarbageCollector::writeBarrier
+        void setWriteBarrier(GarbageCollector *collector) { _writeBarrier = collector; }
+        
+        /// mark every value bound in this scope, but not its parents
+        void markValues(GarbageCollector& collector);
+        
         /// set the symbol in this scope
         void setSymbolInScope(std::string symbolName, Object *functionValue);
         
         /// return the symbol or NULL
-        Object *lookupSymbolInScope(std::string symbolName);
+        Object *lookupSymbolInScope(const std::string& symbolName);
                 
         /// look for a symbol (in this and all parent scopes), return NULL if not found
-        Object *lookupSymbol(std::string symbolName);
+        Object *lookupSymbol(const std::string& symbolName);
 
         // Removes the symbol from scope, used for undefining symbols and garbage collection
         // Returns return object of symbol removed
@@ -380,8 +1235,27 @@ namespace tinyclojure {
         Object* removeSymbol(std::string);
 
     protected:
-        InterpreterScope *_parentScope;
+        InterpreterScope *_parentScope, *_rootScope;
+        GarbageCollector *_writeBarrier;
         std::map<std::string, Object*> _symbolTable;
+        
+        /**
+         * one bit, chosen by hash, for each symbol ever set in this scope
+         *
+         * scoping is dynamic, so the chain of scopes is as deep as the evaluation, and lookupSymbol uses this to pass
+         * over scopes that can't hold the symbol without searching their tables
+         */
+        uint64_t _symbolFilter;
+        
+        /**
+         * the symbol filters of the scopes between this one and the root when it was made, so that lookupSymbol can
+         * go straight to the root for a symbol none of them can hold, such as a function's own name as it recurses
+         *
+         * this can't go stale, as symbols are only ever set in the innermost scope, once the scopes made from it are gone
+         */
+        uint64_t _ancestorFilter;
+        
+        static uint64_t symbolFilterBit(size_t symbolHash) { return (uint64_t)1 << (symbolHash % 64); }
     };
     
     /**
@@ -389,23 +1263,36 @@ namespace tinyclojure {
      */
     class Error {
     public:
+        /// what went wrong, most errors are general, the others are the evaluation limits, see TinyClojure::setStepLimit
+        typedef enum {
+            kErrorKindGeneral,
+            kErrorKindStepLimit,
+            kErrorKindTimeLimit,
+            kErrorKindDepthLimit,
+        } ErrorKind;
+        
         /// constructor for parser errors
-        Error(ParserState &state, std::string errorMessage) : message(errorMessage), position(state.position) {
+        Error(ParserState &state, std::string errorMessage)
+            : Error(state.parserString.data(), state.parserString.length(), state.position, errorMessage) {
+        }
+        
+        /// constructor for errors at errorPosition in length characters of text, the message shows the text around it
+        Error(const char *text, size_t length, size_t errorPosition, std::string errorMessage) : message(errorMessage), position((int)errorPosition), kind(kErrorKindGeneral) {
             int fragLength = 10,
-                startFragment = state.position - fragLength,
-                endFragment = state.position + fragLength;
+                startFragment = position - fragLength,
+                endFragment = position + fragLength;
             
             if (startFragment < 0) {
                 startFragment = 0;
             }
             
-            if (endFragment >= state.parserString.length()) {
-                endFragment = (int)state.parserString.length()-1;
+            if (endFragment >= (int)length) {
+                endFragment = (int)length-1;
             }
             
-            if (startFragment != endFragment) {
-                std::string trailing = state.parserString.substr(position, endFragment - position),
-                            leading = state.parserString.substr(startFragment, position - startFragment);
+            if (startFragment != endFragment && position <= (int)length) {
+                std::string trailing(text + position, std::max(endFragment - position, 0)),
+                            leading(text + startFragment, position - startFragment);
                 
                 std::stringstream stringBuilder;
                 
@@ -421,11 +1308,15 @@ namespace tinyclojure {
         }
         
         /// constructor for generic errors
-        Error(std::string errorMessage) : message(errorMessage) {
+        Error(std::string errorMessage, ErrorKind errorKind=kErrorKindGeneral) : message(errorMessage), position(0), kind(errorKind) {
         }
         
+        /// true if an evaluation limit ran out, builtins that report errors and carry on must pass these on instead
+        bool isEvaluationLimit() const { return kind != kErrorKindGeneral; }
+        
         std::string message;
         int position;
+        ErrorKind kind;
     };
     
     /**
@@ -460,6 +1351,27 @@ namespace tinyclojure {
         GarbageCollector *_gc_long;
         Object *_object;
     };
+    
+    /**
+     * how often a builtin has been called and how long the calls took, see TinyClojure::builtinStatistics
+     *
+     * times include everything the builtin evaluates, so a builtin like if or do counts the forms it runs.  Bucket n
+     * of the histogram counts the calls that took from 2^(n-1) up to 2^n nanoseconds, the last bucket taking the
+     * rest.
+     */
+    struct BuiltinStatistics {
+        static const int kLatencyBucketCount = 32;
+        
+        BuiltinStatistics() { reset(); }
+        
+        uint64_t calls, totalNanos, maxNanos;
+        uint64_t latencyBuckets[kLatencyBucketCount];
+        
+        /// count a call which took nanos
+        void record(uint64_t nanos);
+        
+        void reset();
+    };
         
     /**
      * An abstract base class for all interpreter functions
@@ -527,6 +1439,30 @@ namespace tinyclojure {
             return true;
         }
         
+        /// the control forms that the stackless evaluator runs itself instead of calling execute, see Evaluation
+        typedef enum {
+            kSpecialFormNone,
+            kSpecialFormIf,
+            kSpecialFormDo,
+            kSpecialFormLet,
+            kSpecialFormCond,
+            kSpecialFormDef,
+            kSpecialFormEqual,
+            kSpecialFormNotEqual,
+        } SpecialForm;
+        
+        /**
+         * which control form this is, if it is one
+         *
+         * only the builtins that evaluate their own arguments need this, so that their evaluation can be suspended
+         */
+        virtual SpecialForm specialForm() {
+            return kSpecialFormNone;
+        }
+        
+        /// the calls to this function, counted by TinyClojure's evaluator
+        BuiltinStatistics& statistics() { return _statistics; }
+        
     protected:
         /**
          * an array of types that must be matched by the arguments to this function
@@ -539,28 +1475,267 @@ namespace tinyclojure {
         GarbageCollector *_gc_short;
         TinyClojure *_evaluator;
         IOProxy *_ioProxy;
+        
+        BuiltinStatistics _statistics;
+    };
+    
+    /**
+     * an evaluation run by the stackless evaluator, see TinyClojure::startEvaluation
+     *
+     * rather than recursing on the C++ stack, the evaluator keeps what is left to do in frames on the heap, so an
+     * evaluation can stop after any number of steps and carry on later, and recursion is limited by the heap limits
+     * rather than the stack.  The control forms (if, do, let, cond, def, = and not=), builtin calls and closure
+     * calls are all run this way.  Builtins that evaluate code themselves, such as macros, amap or time, still
+     * recurse for the code they evaluate.  The profilers, tracing and depth limit only see the recursive evaluator.
+     */
+    class Evaluation {
+    public:
+        typedef enum {
+            kEvaluationSuspended,
+            kEvaluationFinished,
+            kEvaluationFailed,
+        } State;
+        
+        State state() const { return _state; }
+        
+        /// the value once the evaluation has finished, which lives in the short term heap like eval's values
+        Object* result() const { return _result; }
+        
+        /// the steps taken so far
+        uint64_t steps() const { return _steps; }
+        
+        /// the frames waiting for a value, the depth of the evaluation's recursion
+        size_t depth() const { return _frames.size(); }
+        
+    protected:
+        friend class TinyClojure;
+        
+        struct Frame {
+            typedef enum {
+                kFrameHead,
+                kFrameArguments,
+                kFrameBody,
+                kFrameIf,
+                kFrameCond,
+                kFrameLet,
+                kFrameDef,
+                kFrameEquality,
+                kFrameVector,
+            } Kind;
+            
+            Kind kind;
+            
+            /// the form this frame is evaluating, and the function it calls once it is known
+            Object *form, *function;
+            
+            /// where the frame's forms are evaluated, deleted with the frame if it owns it
+            InterpreterScope *scope;
+            bool ownsScope;
+            
+            /// the unevaluated arguments or body forms, the values so far, and a let's bindings
+            ObjectList arguments, values, bindings;
+            
+            /// the form being evaluated within arguments or bindings
+            size_t index;
+        };
+        
+        Evaluation(TinyClojure *interpreter, Object *code);
+        ~Evaluation();
+        
+        /// take one step, either evaluating the next form or handing the last value to the innermost frame
+        void step();
+        
+        void evaluateForm();
+        void continueFrame();
+        
+        /// the head of the innermost call form has been evaluated
+        void startCall(Object *function);
+        
+        /// the arguments of the innermost call form have been evaluated
+        void finishCall();
+        
+        /// go on to evaluate the innermost let's body, or finish if it has none
+        void startBody();
+        
+        /// evaluate form in scope next
+        void evaluate(Object *form, InterpreterScope *scope) {
+            _form = form;
+            _scope = scope;
+            _evaluating = true;
+        }
+        
+        /// hand value to the innermost frame next
+        void produce(Object *value) {
+            _value = value;
+            _evaluating = false;
+        }
+        
+        Frame& pushFrame(Frame::Kind kind, Object *form, InterpreterScope *scope);
+        void popFrame();
+        
+        /// give the innermost frame a new scope of its own, made from its scope
+        void ownScope();
+        
+        /// free the frames after a failure
+        void clear();
+        
+        /// mark the long term objects the frames refer to
+        void markReferences(GarbageCollector& collector);
+        
+        TinyClojure *_interpreter;
+        std::vector<Frame> _frames;
+        
+        /// the form to evaluate next, and where, if evaluating, otherwise the value for the innermost frame
+        bool _evaluating;
+        Object *_form, *_value;
+        InterpreterScope *_scope;
+        
+        State _state;
+        Object *_result;
+        uint64_t _steps;
+        
+        /// what is left of the step and time limits, carried from one resume to the next
+        uint64_t _reserveSteps;
+        std::chrono::steady_clock::duration _timeLeft;
+    };
+    
+    /**
+     * reads the forms of a text on a thread of its own, so that parsing overlaps the evaluation of earlier forms
+     *
+     * the reader thread fills a bounded ring of slots, with one producer and one consumer, which next empties in
+     * order.  Each slot has a collector of its own that only the thread holding the slot uses, and that collector
+     * always has a region open, so forms are bump allocated without touching the object pool or any other collector.
+     * A slot's form is freed when the reader comes round to the slot again, after the evaluator has moved past it.
+     * So, like the forms of parseNext, a form must not be referred to once the evaluation of it has finished:
+     * anything def'd is copied to the long term heap.
+     *
+     * each slot's collector counts into an account of the slot's own, which only one thread uses at a time.  next
+     * charges the interpreter's account for the form it hands out, on the evaluator's thread, and takes the charge
+     * off again when the slot goes back, so the form shows in the heap limits, statistics and allocation profile as
+     * if parse had made it.  A slot's account has the interpreter's hard limit too, so a form too big for the limit
+     * on its own is stopped while it is being read.
+     */
+    class PipelinedReader {
+    public:
+        /// start reading the length characters of text, which must outlive the reader, up to capacity forms ahead
+        PipelinedReader(TinyClojure& interpreter, const char *text, size_t length, size_t capacity=16);
+        
+        /// stop the reader thread, and free the forms
+        ~PipelinedReader();
+        
+        /**
+         * the next form, which is valid until the next call, or NULL if there are none left
+         *
+         * an Error from reading the form is thrown here, once the forms before it have been taken, as is one if the
+         * form would take the interpreter's heap past its hard limit.
+         */
+        Object* next();
+        
+    protected:
+        struct Slot {
+            Slot() : heap(NULL), chargedBytes(0), form(NULL), failed(false), error("") {}
+            
+            /// the slot's collector and the account it counts into
+            GarbageCollector *heap;
+            HeapAccount account;
+            
+            /// what next charged the interpreter's account for the slot's form
+            size_t chargedBytes;
+            HeapStatistics chargedStatistics;
+            
+            /// the form, or NULL at the end of the text or if reading it failed
+            Object *form;
+            bool failed;
+            Error error;
+        };
+        
+        /// the reader thread's loop
+        void readForms();
+        
+        /// charge the interpreter's account for a slot's form, throwing if that passes the hard limit
+        void chargeInterpreter(Slot& slot);
+        
+        /// take a slot's charge off the interpreter's account
+        void releaseCharge(Slot& slot);
+        
+        /// wait a little for the other thread, spinning at first as the wait is often short
+        static void pause(size_t& attempts);
+        
+        TinyClojure *_interpreter;
+        const char *_text;
+        size_t _length;
+        
+        Slot *_slots;
+        size_t _capacity;
+        
+        /// the number of slots the reader has filled and the evaluator has finished with, in the order they are used
+        std::atomic<size_t> _produced, _consumed;
+        
+        /// whether the evaluator holds the slot after the ones it has finished with, or has reached the end
+        bool _holding, _finished;
+        
+        std::atomic<bool> _stopping;
+        std::thread _reader;
     };
     
     class TinyClojure {
+        friend class Evaluation;
+        friend class PipelinedReader;
+        
     public:        
         /**
          * create a list from a std::vector
          *
-         * this is here, not in the Object constructor because it needs access to the garbage collector
+         * this is here, not in the Object constructor because it needs access to the garbage collector.  The cells are
+         * allocated as one contiguous block, see GarbageCollector::registerList
          */
-        Object* listObject(ObjectList list);
+        Object* listObject(const ObjectList& list);
         
         /**
-         * parse the passed string, returning the parsed object, or NULL on error
+         * parse the first form in the passed string
          *
          * this will parse the data into a tree of S Expressions.  This throws an exception if there is a parser error.
          *
-         * @return either an object created by parsing the input, or NULL if nothing was found
+         * @return the object created by parsing the input, or nil if nothing was found
          */
-        Object* parse(std::string stringin);
+        Object* parse(const std::string& stringin);
+        
+        /// parse the first form in length characters of text, which need not be null terminated, see parse
+        Object* parse(const char *text, size_t length);
         
         /// parse all code in a string
-        void parseAll(std::string codeText, ObjectList& expressions);
+        void parseAll(const std::string& codeText, ObjectList& expressions);
+        
+        /// parse all code in length characters of text, which need not be null terminated
+        void parseAll(const char *text, size_t length, ObjectList& expressions);
+        
+        /**
+         * parse length characters of text and write an image of the forms to imagePath, see ScriptImage
+         *
+         * this throws an Error if the text doesn't parse or the image can't be written.  The image is written to a
+         * temporary file that replaces imagePath once it is complete, so a partly written image is never loaded.
+         */
+        void compileImage(const char *text, size_t length, const std::string& imagePath);
+        
+        /// the next form of image at or after position, moving position past it, or NULL if there are none left, see parseNext
+        Object* loadNext(const ScriptImage& image, size_t& position);
+        
+        /**
+         * parse the next form in length characters of text, at or after position, and move position past it
+         *
+         * this reads a text a form at a time, so each can be evaluated before the next is read, as load-file does.
+         *
+         * @return the form, or NULL if there are no forms left
+         */
+        Object* parseNext(const char *text, size_t length, size_t& position);
+        
+        /**
+         * parse all code in a string with the original recursive descent parser, which parse and parseAll replaced
+         *
+         * this is kept as the baseline for the parse benchmarks.  It is slower, recursion limits the nesting depth,
+         * and it has bugs the reader fixes, such as not ending empty strings.
+         */
+        void recursiveParseAll(const std::string& codeText, ObjectList& expressions);
         
         /**
          * evaluate the code passed above
@@ -573,9 +1748,9 @@ namespace tinyclojure {
         TinyClojure();
         
         /**
-         * destructor
+         * destructor, virtual as a host may subclass the interpreter to override softHeapLimitReached
          */
-        ~TinyClojure();
+        virtual ~TinyClojure();
         
         /// call this to load all extension functions, override it to change which functions are loaded
         virtual void loadExtensionFunctions();
@@ -586,14 +1761,191 @@ namespace tinyclojure {
         /// the internal recursive evaluator, this puts statements in a scope and evaluates them
         Object* scopedEval(InterpreterScope *interpreterState, Object *code);
         
+        /**
+         * call a function object (a builtin or a closure) with arguments that have already been evaluated
+         *
+         * this is how extension functions call back into user code, e.g. amap
+         */
+        Object* apply(InterpreterScope *interpreterState, Object *function, ObjectList arguments);
+        
+        /**
+         * start evaluating code with the stackless evaluator, see Evaluation, returning the evaluation to pass to resume
+         *
+         * this is for hosts that need to stop an evaluation and carry on with it later, such as from an event loop,
+         * or that run deep recursion.  Nothing is evaluated until resume is called.  Pass the evaluation to
+         * releaseEvaluation once finished with it.  Until then CollectGarbage does nothing, as it would free the
+         * evaluation's objects, but gcStep works as usual.
+         */
+        Evaluation* startEvaluation(Object *code);
+        
+        /**
+         * carry on with an evaluation for up to steps steps, returning true if it finished
+         *
+         * call this between evals, not during one.  An Error fails the evaluation and is passed on, leaving the
+         * interpreter usable.  The step and time limits set when the evaluation started apply to the evaluation as a
+         * whole, as they would to one eval, with whatever each call leaves carried on to the next.  Time spent
+         * between calls doesn't count.
+         */
+        bool resume(Evaluation *evaluation, uint64_t steps);
+        
+        /// free an evaluation, finished or not
+        void releaseEvaluation(Evaluation *evaluation);
+        
         /// this erases the persistent scope, removing all symbols and objects
         void resetInterpreter();
         
         /// add an extension function and reset the interpreter so that it is loaded
         void addExtensionFunction(ExtensionFunction *function);
+        
+        /**
+         * limit each eval to about steps evaluation steps, 0 meaning no limit, which is the default
+         *
+         * a step is the evaluation of one form, so a computation that runs too long runs out.  There is no loop or
+         * recur, so a runaway is a recursion, which in eval usually reaches the depth limit first, see setDepthLimit.
+         * The steps are counted down by a decrement and compare that is always on.  Running out throws an Error of
+         * kind kErrorKindStepLimit, which eval passes on after freeing its region, leaving the interpreter usable.
+         */
+        void setStepLimit(uint64_t steps) { _stepLimit = steps; }
+        
+        /**
+         * limit each eval to timeLimitMicros of wall clock time, 0 meaning no limit, which is the default
+         *
+         * the clock is read every kStepsBetweenClockChecks steps, so the deadline is noticed a little late.  Running
+         * out throws an Error of kind kErrorKindTimeLimit.
+         */
+        void setTimeLimit(int64_t timeLimitMicros) { _timeLimitMicros = timeLimitMicros; }
+        
+        /**
+         * limit how deeply call forms may nest, 0 meaning as deeply as the thread's stack allows, which is the default
+         *
+         * each call nests the C++ stack too, so whatever the limit a call that would leave less than a quarter of the
+         * thread's stack, or 256 KB if that is less, is stopped as well.  Either throws an Error of kind
+         * kErrorKindDepthLimit rather than crashing, which eval passes on after freeing its region.
+         */
+        void setDepthLimit(size_t depth) { _depthLimit = depth ? depth : SIZE_MAX; }
+        
+        /// steps evaluated between reads of the clock while there is a time limit
+        static const uint64_t kStepsBetweenClockChecks = 4096;
+        
+        /**
+         * turn hash consing of parsed data on or off, it is off by default
+         *
+         * when it is on, everything produced by parse, parseAll and read-string is replaced by a canonical copy, so
+         * structurally equal strings, numbers and lists share one object and compare equal by pointer.  Canonical
+         * objects live in the long term heap for the life of the interpreter and deep copies share rather than copy
+         * them.
+         */
+        void setHashConsing(bool enabled) { _hashConsing = enabled; }
+        bool hashConsing() const { return _hashConsing; }
 
+        /**
+         * free the short term heap, everything parsed or returned by eval since the last call
+         *
+         * values bound with def, and exported objects, survive.  It does nothing while there are evaluations that
+         * have not been released, see startEvaluation.
+         */
         void CollectGarbage();
         
+        /**
+         * copy an object into the long term heap so that the host can hold it across CollectGarbage
+         *
+         * eval returns objects that only live until the next CollectGarbage, export one to keep it
+         */
+        Object* exportObject(Object *object);
+        
+        /// release an object returned by exportObject
+        void releaseObject(Object *object);
+        
+        /// the bytes allocated by this interpreter's heaps, see HeapAccount
+        size_t heapBytesInUse() const { return _heapAccount.bytesInUse(); }
+        
+        /**
+         * limit this interpreter's heaps, in bytes, 0 meaning no limit
+         *
+         * an allocation that would pass the hard limit throws an Error instead, which eval passes on after freeing its
+         * region, leaving the interpreter usable.  Going over the soft limit calls softHeapLimitReached before the
+         * next eval.  Forms read ahead by a PipelinedReader count from when they are handed out, see PipelinedReader.
+         */
+        void setHeapLimits(size_t softLimit, size_t hardLimit) { _heapAccount.setLimits(softLimit, hardLimit); }
+        
+        /**
+         * called between evaluations after the heaps go over the soft limit, override it to change what happens
+         *
+         * no eval is running, so this may use gcStep or CollectGarbage.  By default it finishes a collection of the
+         * long term heap.
+         */
+        virtual void softHeapLimitReached(size_t bytesInUse);
+        
+        /**
+         * statistics for this interpreter's heaps and their collection, see HeapStatistics
+         *
+         * collections are those finished by gcStep and CollectGarbage, and pauses are the time spent in each call
+         * to them.  The (gc-stats) builtin reports the same figures.
+         */
+        HeapStatistics heapStatistics() const { return _heapAccount.statistics(); }
+        
+        /// start the statistics' allocation, collection and promotion counts again from zero
+        void resetHeapStatistics() { _heapAccount.resetStatistics(); }
+        
+        /**
+         * turn allocation profiling on or off, it is off by default
+         *
+         * when it is on, every allocation is attributed to the call form being evaluated, see AllocationProfiler.
+         * Turning it on starts a new profile.
+         */
+        void setAllocationProfiling(bool enabled);
+        
+        /// the current allocation profile, or NULL if allocation profiling is off
+        const AllocationProfiler* allocationProfile() const { return _allocationProfiler; }
+        
+        /**
+         * start sampling which functions evaluation spends its CPU time in, discarding any earlier samples
+         *
+         * see SamplingProfiler, this uses the process's SIGPROF timer while any interpreter is profiling, and the
+         * handler and timer that were there before are put back when the last one stops
+         */
+        void startProfiling(int64_t intervalMicros=1000);
+        
+        /// stop sampling, keeping the samples for foldedStacks
+        void stopProfiling();
+        
+        /// the samples taken since startProfiling as folded stacks, for flame graph tools
+        std::string foldedStacks() const;
+        
+        /**
+         * record trace events to recorder, or stop if it is NULL, the recorder stays owned by the caller
+         *
+         * the events are each top level eval, parse and parseAll, load-file, CollectGarbage and gcStep, and the
+         * closure calls that take at least closureThresholdMicros.  A recorder may be shared by interpreters.
+         */
+        void setTraceRecorder(TraceRecorder *recorder, int64_t closureThresholdMicros=100);
+        
+        /// the recorder set by setTraceRecorder, or NULL
+        TraceRecorder* traceRecorder() const { return _traceRecorder; }
+        
+        /**
+         * the call statistics of each builtin that has been called, by name, busiest first
+         *
+         * every call to a builtin is counted unless the interpreter is compiled with kBuiltinStatistics set to false,
+         * when this is always empty.  The (builtin-stats) builtin reports the same figures.
+         */
+        std::vector<std::pair<std::string, BuiltinStatistics> > builtinStatistics() const;
+        
+        /// start every builtin's statistics again from zero
+        void resetBuiltinStatistics();
+        
+        /// a table of the topCount builtins with the most time in them, with their call counts and latencies
+        std::string builtinStatisticsReport(size_t topCount) const;
+        
+        /**
+         * do up to budgetMicros of incremental collection of the long term heap, returning true if a collection finished
+         *
+         * values that are no longer bound, exported or referenced from the short term heap are freed, a little at a
+         * time, so a host can spend its idle time collecting without a long pause.  Each call does at least a small
+         * fixed amount of work.  It does nothing while an eval or resume is running.
+         */
+        bool gcStep(int64_t budgetMicros);
+        
     protected:
         /// add an extension function to the function table
         void internalAddExtensionFunction(ExtensionFunction *function);
@@ -604,6 +1956,20 @@ namespace tinyclojure {
         /// the base scope owned by this object and persistent between evaluations
         InterpreterScope *_baseScope;
         
+        /// the allocations of both collectors, with this interpreter's heap limits and statistics
+        HeapAccount _heapAccount;
+        
+        /// see setAllocationProfiling
+        AllocationProfiler *_allocationProfiler;
+        
+        /// the profiler while sampling, see startProfiling, and the folded stacks of the last profile once it stops
+        SamplingProfiler *_samplingProfiler;
+        std::string _foldedStacks;
+        
+        /// see setTraceRecorder
+        TraceRecorder *_traceRecorder;
+        std::chrono::nanoseconds _traceClosureThreshold;
+        
         /// the shared garbage collector
         // Long term and short term garbage collectors
         // One for symbols, defined functions that need to be saved for the life of the program
@@ -611,13 +1977,108 @@ namespace tinyclojure {
         GarbageCollector *_gc_long;
         GarbageCollector *_gc_short;
         
-        /// the internal recursive parser function, see parse for documentation
+        /// the internal recursive parser function, see recursiveParseAll
         Object* recursiveParse(ParserState& parseState);
         
+        /**
+         * the reader behind parse and parseAll, reading the form at or after position and moving position past it
+         *
+         * it returns NULL if only separators and comments are left.  Nesting is kept on a stack rather than by
+         * recursion, characters are classified with a table, and atoms are made straight from the text.  Everything
+         * is created in heap and nothing else is touched, so a PipelinedReader can read on a thread of its own.  There
+         * are no regexes yet, so #"..." is read as a string of the characters between the quotes, with backslashes
+         * left as they are for the pattern.
+         */
+        static Object* readForm(const char *text, size_t length, size_t& position, GarbageCollector *heap);
+        
+        /// the atom, a number, boolean, nil or symbol, that length characters of token spell, created in heap
+        static Object* readAtom(const char *token, size_t length, GarbageCollector *heap);
+        
+        /// a list of the objects in list, created in heap, see listObject
+        static Object* listObject(const ObjectList& list, GarbageCollector *heap);
+        
+        /**
+         * the canonical copy of a parsed object, creating it in the long term heap if it is the first of its value
+         *
+         * nested collections are interned from the inside out, with a stack of the collections still open rather than
+         * recursion, so any depth the reader can read can be interned
+         */
+        Object* internObject(Object *object);
+        
+        /// internObject for anything but a vector or cons, which is left as it is if it can't be interned
+        Object* internAtom(Object *object);
+        
+        /// internObject for a vector, list or dotted pair, given its elements, which must already be canonical
+        Object* internCollection(Object *object, const ObjectList& elements, bool list);
+        
+        /// the canonical object for key, or NULL
+        Object* lookupInterned(const std::string& key);
+        
+        /// record and mark a new canonical object
+        Object* addInterned(const std::string& key, Object *object);
+        
+        /// mark the roots of the long term heap
+        void markLongTermRoots();
+        
+        /// the work of gcStep, see there
+        bool collectLongTermHeap(GarbageCollector::Deadline deadline);
+        
+        /// true if parsed data is hash consed
+        bool _hashConsing;
+        
+        /// see setStepLimit, setTimeLimit and setDepthLimit
+        uint64_t _stepLimit;
+        int64_t _timeLimitMicros;
+        size_t _depthLimit;
+        
+        /// steps left until refuel must look at the limits, counted down by unscopedEval
+        uint64_t _fuel;
+        
+        /// steps of the step limit not yet given out as fuel, and when the running eval's time limit runs out
+        uint64_t _reserveSteps;
+        std::chrono::steady_clock::time_point _deadline;
+        
+        /// the number of call forms being evaluated
+        size_t _evaluationDepth;
+        
+        /// true while resume is running, when the evaluation's values are only reachable from its frames
+        bool _resuming;
+        
+        /// mark the long term objects that unreleased evaluations refer to
+        void markEvaluationReferences();
+        
+        /// start the limits again for a new top level eval
+        void startLimits();
+        
+        /// throw if a limit has run out, otherwise give out more fuel
+        void refuel();
+        
+        /// canonical objects, keyed on their type and contents, with children keyed by pointer as they are canonical too
+        std::unordered_map<std::string, Object*> _internedObjects;
+        
+        /// throw an Error if the arguments do not satisfy the builtin's arity and type signature
+        void validateBuiltinCall(ExtensionFunction *function, ObjectList& arguments);
+        
+        /// validated arguments are passed to the builtin, whose result, or nil, is returned, counting the call
+        Object* executeBuiltin(ExtensionFunction *function, ObjectList& arguments, InterpreterScope *interpreterState);
+        
+        /// evaluate a macro's body with its unevaluated arguments bound to its parameters
+        Object* callMacro(InterpreterScope *interpreterState, Object *macro, ObjectList& arguments);
+        
+        /// throw an Error if the closure takes a different number of arguments, otherwise bind them in functionScope
+        void bindClosureArguments(Object *closure, ObjectList& evaluatedArguments, InterpreterScope *functionScope);
+        
+        /// bind the evaluated arguments to the closure's parameters and evaluate its body
+        Object* callClosure(InterpreterScope *interpreterState, Object *closure, ObjectList& evaluatedArguments);
+
+        
         std::string _newlineSet, _excludeSet, _numberSet;
         
         /// a list of loaded extension functions
         std::vector<ExtensionFunction*> _extensionFunctions;
+        
+        /// the evaluations started and not yet released, see startEvaluation
+        std::set<Evaluation*> _evaluations;
     };
 }
 
@@ -32,8 +32,58 @@
 #include <iostream>
 #include <string>
 #include <fstream>
-#include <streambuf>
+#include <cstdlib>
 
+/// how long to spend collecting the long term heap between top level forms
+const int64_t kIdleCollectionMicros = 500;
+
+/// how many allocation sites --alloc-profile reports
+const size_t kReportedAllocationSites = 10;
+
+/// the number of builtins listed by --builtin-stats
+const size_t kReportedBuiltins = 15;
+
+/// the steps --stackless evaluates between incremental collections
+const uint64_t kStacklessSliceSteps = 100000;
+
+/// evaluate code with the stackless evaluator, a slice at a time, collecting in between as an event loop might
+void evalStackless(tinyclojure::TinyClojure& interpreter, tinyclojure::Object *code) {
+    tinyclojure::Evaluation *evaluation = interpreter.startEvaluation(code);
+    
+    try {
+        while (!interpreter.resume(evaluation, kStacklessSliceSteps)) {
+            interpreter.gcStep(kIdleCollectionMicros);
+        }
+    } catch (...) {
+        interpreter.releaseEvaluation(evaluation);
+        throw;
+    }
+    
+    interpreter.releaseEvaluation(evaluation);
+}
+
+/**
+ * evaluate a top level form of a file, then collect the short term heap it leaves, so memory doesn't grow with the file
+ *
+ * a form stopped by an evaluation limit is reported and the file carries on, any other error ends the file
+ */
+void evalTopLevel(tinyclojure::TinyClojure& interpreter, tinyclojure::Object *expression, bool stackless) {
+    try {
+        if (stackless) {
+            evalStackless(interpreter, expression);
+        } else {
+            interpreter.eval(expression)->stringRepresentation();
+        }
+    } catch (tinyclojure::Error error) {
+        if (!error.isEvaluationLimit()) {
+            throw;
+        }
+        std::cout << error.position << ": " << error.message << std::endl << std::endl;
+    }
+    
+    interpreter.CollectGarbage();
+    interpreter.gcStep(kIdleCollectionMicros);
+}
 
 void repl() {
     std::string input;
@@ -50,6 +100,7 @@ void repl() {
                     tinyclojure::Object *result = interpreter.eval(code);
                     std::cout << result->stringRepresentation() << std::endl;
                     interpreter.CollectGarbage();
+                    interpreter.gcStep(kIdleCollectionMicros);
                 }
             }
         } catch (tinyclojure::Error error) {
@@ -59,7 +110,15 @@ void repl() {
 }
 
 int main(int argc, const char * argv[]) {
-    bool startRepl = false;
+    bool startRepl = false, hashConsing = false, allocationProfiling = false, builtinStatistics = false, stackless = false, compiling = false;
+    std::string profilePath;
+    
+    // reading ahead only helps if the reader thread has a core of its own
+    bool pipelined = std::thread::hardware_concurrency() > 1;
+    tinyclojure::TraceRecorder *traceRecorder = NULL;
+    uint64_t stepLimit = 0;
+    int64_t timeLimitMillis = 0;
+    size_t depthLimit = 0, heapLimit = 0;
     
     if (argc == 1) {
         startRepl = true;
@@ -71,31 +130,163 @@ int main(int argc, const char * argv[]) {
         std::string filename(argv[argpos]);
         
         if (filename=="-h") {
-            std::cout << "help: -h prints this message, -r starts the repl, pass any files to execute" << std::endl;
+            std::cout << "help: -h prints this message, -r starts the repl, --hash-cons shares equal parsed data, --alloc-profile reports where files allocate, --profile out.folded samples where files spend their time, --builtin-stats reports the calls to each builtin, --trace out.json records trace events, --step-limit n and --time-limit ms stop each top level form that runs too long, --depth-limit n stops runaway recursion sooner than the stack does, --heap-limit bytes stops any allocation that would take the heap past bytes, --stackless evaluates without recursing on the C++ stack, --pipeline parses ahead on a thread of its own, the default with more than one core, --no-pipeline parses each form after evaluating the one before, --compile writes the parsed forms of each file to a .tcljc image that is loaded instead of the file until it changes, pass any files to execute" << std::endl;
             startRepl = false;
+            ++argpos;
+            continue;
         } else if (filename=="-r") {
             // guarantee that the repl starts
             startRepl = true;
+            ++argpos;
+            continue;
+        } else if (filename=="--hash-cons") {
+            // applies to the files that follow
+            hashConsing = true;
+            ++argpos;
+            continue;
+        } else if (filename=="--alloc-profile") {
+            // applies to the files that follow
+            allocationProfiling = true;
+            ++argpos;
+            continue;
+        } else if (filename=="--stackless") {
+            // applies to the files that follow
+            stackless = true;
+            ++argpos;
+            continue;
+        } else if (filename=="--compile") {
+            // the files that follow are compiled rather than executed
+            compiling = true;
+            ++argpos;
+            continue;
+        } else if (filename=="--pipeline") {
+            // applies to the files that follow
+            pipelined = true;
+            ++argpos;
+            continue;
+        } else if (filename=="--no-pipeline") {
+            // applies to the files that follow
+            pipelined = false;
+            ++argpos;
+            continue;
+        } else if (filename=="--builtin-stats") {
+            // applies to the files that follow
+            builtinStatistics = true;
+            ++argpos;
+            continue;
+        } else if (filename=="--trace" && argpos + 1 < argc) {
+            // the events of the files that follow all go in one trace
+            try {
+                delete traceRecorder;
+                traceRecorder = NULL;
+                traceRecorder = new tinyclojure::TraceRecorder(argv[argpos + 1]);
+            } catch (tinyclojure::Error error) {
+                std::cout << error.message << std::endl;
+            }
+            argpos += 2;
+            continue;
+        } else if (filename=="--step-limit" && argpos + 1 < argc) {
+            // applies to the files that follow
+            stepLimit = strtoull(argv[argpos + 1], NULL, 10);
+            argpos += 2;
+            continue;
+        } else if (filename=="--time-limit" && argpos + 1 < argc) {
+            // applies to the files that follow
+            timeLimitMillis = strtoll(argv[argpos + 1], NULL, 10);
+            argpos += 2;
+            continue;
+        } else if (filename=="--depth-limit" && argpos + 1 < argc) {
+            // applies to the files that follow
+            depthLimit = strtoull(argv[argpos + 1], NULL, 10);
+            argpos += 2;
+            continue;
+        } else if (filename=="--heap-limit" && argpos + 1 < argc) {
+            // applies to the files that follow
+            heapLimit = strtoull(argv[argpos + 1], NULL, 10);
+            argpos += 2;
+            continue;
+        } else if (filename=="--profile" && argpos + 1 < argc) {
+            // the samples of the files that follow are all written to one file
+            profilePath = argv[argpos + 1];
+            std::ofstream(profilePath.c_str(), std::ios::trunc);
+            argpos += 2;
+            continue;
         }
         
-        std::ifstream t(filename);
-        std::string fileInput((std::istreambuf_iterator<char>(t)),std::istreambuf_iterator<char>());
+        tinyclojure::TinyClojure interpreter;
+        interpreter.setHashConsing(hashConsing);
+        interpreter.setAllocationProfiling(allocationProfiling);
+        if (profilePath.size()) {
+            interpreter.startProfiling();
+        }
+        interpreter.setTraceRecorder(traceRecorder);
+        interpreter.setStepLimit(stepLimit);
+        interpreter.setTimeLimit(timeLimitMillis * 1000);
+        interpreter.setDepthLimit(depthLimit);
+        interpreter.setHeapLimits(0, heapLimit);
         
         try {
-            tinyclojure::TinyClojure interpreter;
-            std::vector<tinyclojure::Object*> expressions;
-            interpreter.parseAll(fileInput, expressions);
+            tinyclojure::ScriptImage *image = compiling ? NULL : tinyclojure::ScriptImage::openCurrent(filename);
             
-            for (int expressionIndex = 0; expressionIndex < expressions.size(); ++expressionIndex) {
-                interpreter.eval(expressions[expressionIndex])->stringRepresentation();
-            }            
+            if (compiling) {
+                tinyclojure::SourceFile source(filename);
+                interpreter.compileImage(source.text(), source.length(), tinyclojure::ScriptImage::imagePath(filename));
+            } else if (image) {
+                // the file hasn't changed since it was compiled, so its forms needn't be parsed again
+                size_t position = image->formsStart();
+                
+                try {
+                    while (tinyclojure::Object *expression = interpreter.loadNext(*image, position)) {
+                        evalTopLevel(interpreter, expression, stackless);
+                    }
+                } catch (...) {
+                    delete image;
+                    throw;
+                }
+                
+                delete image;
+            } else if (pipelined) {
+                tinyclojure::SourceFile source(filename);
+                
+                // a reader thread parses the forms ahead of their evaluation
+                tinyclojure::PipelinedReader reader(interpreter, source.text(), source.length());
+                
+                while (tinyclojure::Object *expression = reader.next()) {
+                    evalTopLevel(interpreter, expression, stackless);
+                }
+            } else {
+                // each form is read after the one before it has been evaluated
+                tinyclojure::SourceFile source(filename);
+                size_t position = 0;
+                
+                while (tinyclojure::Object *expression = interpreter.parseNext(source.text(), source.length(), position)) {
+                    evalTopLevel(interpreter, expression, stackless);
+                }
+            }
         } catch (tinyclojure::Error error) {
             std::cout << error.position << ": " << error.message << std::endl << std::endl;
         }
         
+        // after any error too, as that may be what is being tracked down
+        if (allocationProfiling) {
+            std::cout << interpreter.allocationProfile()->report(kReportedAllocationSites);
+        }
+        
+        if (builtinStatistics) {
+            std::cout << interpreter.builtinStatisticsReport(kReportedBuiltins);
+        }
+        
+        if (profilePath.size()) {
+            interpreter.stopProfiling();
+            std::ofstream(profilePath.c_str(), std::ios::app) << interpreter.foldedStacks();
+        }
+        
         ++argpos;
     }
     
+    // finish the trace
+    delete traceRecorder;
+    
     if (startRepl) {
         repl();
     }
@@ -0,0 +1,20 @@
+; tests for the limits make limittest passes on the command line
+; each runaway form is stopped with an error, and the forms after it must still evaluate
+
+; a long computation, stopped by the step, time or depth limit, which --stackless carries across its slices
+(defn fib [n] (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+(fib 40)
+(println "computation stopped")
+
+; runaway recursion, stopped by the depth limit, or when there is none, before the stack runs out.  --stackless keeps
+; its frames on the heap, so it runs until the step or time limit
+(defn spin [n] (spin (+ n 1)))
+(spin 0)
+(println "recursion stopped")
+
+; a heap limit of 4000000 bytes, load-string reports the error and carries on
+(load-string "(long-array 1000000)")
+(def after-heap-limit (long-array 1000))
+(println "heap limit passed" (alength after-heap-limit))
+
+(println "limits.clj finished")
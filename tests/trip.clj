@@ -65,4 +65,149 @@
   (nth [1 2 3 4] 10 0)
   "nth vector failure")
 
+; 64 bit integers, promoting to BigIntegers on overflow
+(def big (* 4294967296 4294967296))
+(assertzero (- big 18446744073709551616) "bigint multiply overflow")
+(assertzero (- (+ 9223372036854775807 1) 9223372036854775808) "bigint add overflow")
+(assertzero (- (- -9223372036854775807 2) -9223372036854775809) "bigint subtract overflow")
+(assertzero (- (- big big) 0) "bigint demotes to fixnum")
+(assertzero (if (> big 9223372036854775807) 0 1) "bigint comparison")
+(assertzero (if (= (* 3000000000 3) 9000000000) 0 1) "64 bit fixnum")
+(assertzero (if (= (str (* big big)) "340282366920938463463374607431768211456") 0 1) "bigint string")
+
+; specialised arithmetic and comparison kernels
+(assertzero (- (+ 1 2 3 4) 10) "all fixnum +")
+(assertzero (- (* 0.5 4.0 2.0) 4) "all floating *")
+(assertzero (- (/ 10 4) 2.5) "fixnum /")
+(assertzero (- (+ 1 2.5 9223372036854775807) 9223372036854775810.5) "mixed mode +")
+(assertzero (if (< 1 2 3 4) 0 1) "variadic <")
+(assertzero (if (< 1 3 2) 1 0) "variadic < fails")
+(assertzero (if (>= 3.0 3.0 1.5) 0 1) "floating >=")
+(assertzero (if (< 1 1.5 2) 0 1) "mixed mode <")
+
+; primitive arrays
+(def samples (double-array [1 2 3 4 5 6 7 8 9]))
+(assertzero (- (asum samples) 45) "asum")
+(assertzero (- (adot samples samples) 285) "adot")
+(assertzero (- (amin samples) 1) "amin")
+(assertzero (- (amax samples) 9) "amax")
+(assertzero (- (amean samples) 5) "amean")
+(assertzero (- (asum (a+ samples samples)) 90) "a+ arrays")
+(assertzero (- (asum (a* samples 2)) 90) "a* scalar")
+(assertzero (- (asum (a- (long-array [5 6 7]) (long-array [1 1 1]))) 15) "a- long arrays")
+(assertzero (- (aget (a/ (long-array [5 6 7]) 2) 0) 2.5) "a/ long arrays")
+(assertzero (- (asum (amap (fn [x] (* x 10)) samples)) 450) "amap")
+(assertzero (- (areduce + 0 (long-array [1 2 3 4])) 10) "areduce")
+(assertzero (- (alength (double-array 1000)) 1000) "alength")
+(assertzero (- (aget samples 2) 3) "aget")
+
+; columnar datasets
+(def sales (dataset "region" ["north" "south" "north" "east" "south"] "units" [3 5 2 7 1] "price" [1.5 2.0 3.0 0.5 4.0]))
+(assertzero (- (row-count sales) 5) "row-count")
+(assertzero (- (row-count (where sales "units" > 2)) 3) "where kernel")
+(assertzero (- (asum (column (where sales "region" = "north") "units")) 5) "where string kernel")
+(assertzero (- (asum (column (where sales "price" (fn [p] (< p 2))) "units")) 10) "where predicate")
+(assertzero (if (= (column-names (select sales "price" "region")) ["price" "region"]) 0 1) "select")
+(assertzero (- (aget (column (group-by-agg sales "region" "units" "sum") "units-sum") 1) 6) "group-by-agg sum")
+(assertzero (- (aget (column (group-by-agg sales "region" "price" "mean") "price-mean") 0) 2.25) "group-by-agg mean")
+(assertzero (- (aget (column (group-by-agg sales "region" "units" "mean") "units-mean") 1) 3) "group-by-agg long mean")
+(assertzero (- (aget (column (group-by-agg sales "region" "units" "min") "units-min") 0) 2) "group-by-agg min")
+(assertzero (- (aget (column (group-by-agg sales "region" "price" "max") "price-max") 1) 4) "group-by-agg max")
+(assertzero (- (aget (column (group-by-agg sales "region" "region" "count") "region-count") 2) 1) "group-by-agg count")
+(assertzero (- (row-count (where sales "units" < 2.5)) 2) "where long column against a double")
+(assertzero (- (aget (column (sort-by-column sales "price" "desc") "price") 0) 4) "sort-by-column")
+
+; compact objects, strings either side of the inline limit
+(def fifteen "abcdefghijklmno")
+(def sixteen "abcdefghijklmnop")
+(assertzero (if (= (str fifteen "p") sixteen) 0 1) "inline string grows past the limit")
+(assertzero (if (= fifteen sixteen) 1 0) "inline and heap strings differ")
+(def a-rather-long-symbol-name 3)
+(assertzero (- a-rather-long-symbol-name 3) "heap symbol lookup")
+
+; contiguous lists
+(def packed '(1 2 3 4))
+(assertzero (- (first (rest (rest packed))) 3) "rest walks a packed list")
+(assertzero (if (= (rest (rest (rest (rest packed)))) nil) 0 1) "packed list is nil terminated")
+(assertzero (if (= packed (list 1 2 3 4)) 0 1) "packed lists from reader and list agree")
+(assertzero (if (= (cons 0 packed) '(0 1 2 3 4)) 0 1) "cons onto a packed list")
+
+; hash consing, trip.clj is also run with --hash-cons
+(def table-a (read-string "(\"k\" (1 2) (1 2) 3.5)"))
+(def table-b (read-string "(\"k\" (1 2) (1 2) 3.5)"))
+(assertzero (if (= table-a table-b) 0 1) "read-string tables are equal")
+(assertzero (if (= #"a\d+" "a\\d+") 0 1) "regex literals read as their pattern")
+(assertzero (if (identical? table-a table-a) 0 1) "identical? to itself")
+(assertzero (if (identical? table-a table-b) 1 0) "def copies the top of a table")
+(assertzero (if (= (nth table-a 1) (nth table-b 2)) 0 1) "equal sub-lists")
+
+; cached hashes and identity in equality
+(def long-a (read-string "(1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16)"))
+(def long-b (read-string "(1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 17)"))
+(assertzero (if (= long-a long-a) 0 1) "a list equals itself")
+(assertzero (if (= long-a long-b) 1 0) "lists differing in the last element")
+(assertzero (if (= long-a long-b) 1 0) "again, with both hashes cached")
+(assertzero (if (= (rest long-a) (rest (read-string "(0 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16)"))) 0 1) "equal tails")
+(assertzero (if (= (list 1 2.0) (list 1.0 2)) 0 1) "numbers of different modes hash alike")
+(assertzero (if (= [1 (list 2 3)] [1 (list 2 3)]) 0 1) "nested vectors")
+(def holds-array [(double-array [1 0])])
+(def lists-array (list 1 (long-array [1 0])))
+(assertzero (if (= holds-array [(double-array [1 0])]) 0 1) "a vector holding an array, hashed before an aset")
+(assertzero (if (= lists-array (list 1 (long-array [1 0]))) 0 1) "a list holding an array, hashed before an aset")
+(aset (nth holds-array 0) 0 0)
+(aset (nth lists-array 1) 0 0)
+(assertzero (if (= holds-array [(double-array 2)]) 0 1) "a vector isn't equal by a hash cached before an aset")
+(assertzero (if (= lists-array (list 1 (long-array 2))) 0 1) "nor is a list")
+
+; regions, each top level form is evaluated in its own region
+(defn make-adder [n] (fn [x] (+ x n)))
+(def add5 (make-adder 5))
+(assertzero (- (add5 1) 6) "closure escapes its region through def")
+(def kept (let [words (list "a string too long to be inline" 2)] words))
+(assertzero (if (= (first kept) "a string too long to be inline") 0 1) "let value escapes through def")
+
+; incremental collection of the long term heap, tclj runs a step between top level forms
+(def churn (list "a string too long to be inline" 1 2))
+(def churn (list "another string too long to be inline" 3 4))
+(def doubler (fn [x] (* x 2)))
+(def churn (list doubler (vector "a third string too long to be inline")))
+(assertzero (- ((first churn) 21) 42) "values survive collection steps")
+(def unmapped (list 1 2 3))
+(ns-unmap unmapped)
+(assertzero (- (doubler 2) 4) "closures survive collection steps")
+(assertzero (- (add5 1) 6) "closures over collected scopes survive")
+
+; heap statistics
+(assertzero (if (> (gc-stats "allocated-objects") 0) 0 1) "gc-stats counts allocations")
+(assertzero (if (> (gc-stats "collections") 0) 0 1) "gc-stats counts the collections between forms")
+(assertzero (if (> (nth (nth (gc-stats "live-objects") 7) 1) 50) 0 1) "builtin functions are live")
+
+; builtin call statistics
+(str "builtin" "-" "stats")
+(assertzero (if (> (nth (nth (builtin-stats "str") 0) 1) 0) 0 1) "builtin-stats counts calls")
+(assertzero (if (>= (nth (nth (builtin-stats "str") 1) 1) 0) 0 1) "builtin-stats times calls")
+
+; clocks
+(def started (nano-time))
+(assertzero (if (>= (nano-time) started) 0 1) "nano-time is monotonic")
+(assertzero (if (> (current-time-millis) 1500000000000) 0 1) "current-time-millis counts from the epoch")
+(assertzero (- (time (+ 1 2)) 3) "time returns the value of its expression")
+(assertzero (- (nth (nth (bench (str "a" "b") 20) 0) 1) 20) "bench runs its expression n times")
+(def bench-summary (bench (+ 1 2) 10))
+(assertzero (if (<= (nth (nth bench-summary 2) 1) (nth (nth bench-summary 6) 1)) 0 1) "bench's median is no more than its maximum")
+
+; reader
+(assertzero (if (= (str "" "a" "") "a") 0 1) "empty strings end")
+(assertzero (if (= (read-string "(a ; a comment before the close\n)") (read-string "(a)")) 0 1) "comments can end a list")
+(assertzero (if (= (read-string "[1,2,3]") (read-string "[1 2 3]")) 0 1) "commas separate")
+(assertzero (if (= (read-string "(1 #;(2 3) 4)") (read-string "(1 4)")) 0 1) "#; drops the next form")
+(assertzero (if (= (nth (read-string "'sym") 1) (first (read-string "(sym)"))) 0 1) "quote reads the next form")
+(assertzero (- (nth (read-string "(-12 3.5 123456789012345678901)") 0) -12) "negative integers")
+(assertzero (if (= (first (read-string "(1.x)")) 1) 1 0) "malformed numbers are symbols")
+
+; load-file
+(spit "/tmp/tinyclojure-trip-load.clj" "(def loaded-sum\n  (+ 1\n     2))\n; a comment\n(def loaded-twice (* loaded-sum 2))")
+(load-file "/tmp/tinyclojure-trip-load.clj")
+(assertzero (- loaded-twice 6) "load-file reads forms that span lines")
+
 (print "trip.clj finished")
\ No newline at end of file